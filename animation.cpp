@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cstring>
+
+#include "animation.h"
+#include "memory.h"
+#include "parallel.h"
+#include "transform.h"
+
+using namespace qm;
+
+namespace {
+
+// Tracks interpolated together, the size of the gather buffers
+const size_t TRACK_CHUNK = 64;
+
+// Keys scanned one by one before a forward search goes binary
+const int LINEAR_STEPS = 4;
+
+// Append keys (a single key at time 0 holding identity if there are none)
+// after the used keys of times and values. Returns false if the allocation
+// failed.
+template<typename T> bool appendKeys(const Keyframes<T>& keys, const T& identity, size_t used, float*& times,
+  T*& values, size_t& capacity) {
+  size_t count = (keys.count > 0) ? keys.count : 1;
+  if (used + count > capacity) {
+    size_t size = std::max(2 * capacity, used + count);
+    if (!alignedReallocate(times, used, size) || !alignedReallocate(values, used, size))
+      return false;
+    capacity = size;
+  }
+  if (keys.count == 0) {
+    times[used] = 0.0f;
+    values[used] = identity;
+    return true;
+  }
+  memcpy(times + used, keys.times, count * sizeof(float));
+  memcpy((void*) (values + used), keys.values, count * sizeof(T));
+  return true;
+}
+
+// Last of the n keys of times at or before time (0 if none), searched from key
+inline uint32_t seek(const float* times, uint32_t n, uint32_t key, float time) {
+  if (key >= n)
+    key = n - 1;
+  if (time >= times[key]) {
+    for (int step = 0 ; step < LINEAR_STEPS ; step++, key++)
+      if (key + 1 >= n || times[key + 1] > time)
+        return key;
+    return (uint32_t) (std::upper_bound(times + key, times + n, time) - times) - 1;
+  }
+  uint32_t after = (uint32_t) (std::upper_bound(times, times + key, time) - times);
+  return (after > 0) ? after - 1 : 0;
+}
+
+// Keys to blend at time: from times[key] to times[next] by u in [0, 1)
+inline float blendFactor(const float* times, uint32_t n, uint32_t key, float time, uint32_t& next) {
+  if (key + 1 < n && time > times[key]) {
+    next = key + 1;
+    return (time - times[key]) / (times[next] - times[key]);
+  }
+  next = key;
+  return 0.0f;
+}
+
+// Enough instances per parallel chunk to amortize the dispatch
+inline size_t instanceGrain(size_t trackCount) {
+  return 1 + 1024 / trackCount;
+}
+
+}
+
+namespace qm {
+
+AnimationClip::AnimationClip() :
+  translationKeys(0), rotationKeys(0), scaleKeys(0), trackCount(0), trackCapacity(0), duration(0.0f) {
+  for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+    times[c] = 0;
+    first[c] = 0;
+    keyCapacity[c] = 0;
+  }
+  growTracks(16);
+}
+
+AnimationClip::AnimationClip(const AnimationClip& C) :
+  translationKeys(0), rotationKeys(0), scaleKeys(0), trackCount(0), trackCapacity(0), duration(0.0f) {
+  for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+    times[c] = 0;
+    first[c] = 0;
+    keyCapacity[c] = 0;
+  }
+  growTracks(C.trackCapacity);
+  *this = C;
+}
+
+AnimationClip::~AnimationClip() {
+  for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+    alignedFree(times[c]);
+    alignedFree(first[c]);
+  }
+  alignedFree(translationKeys);
+  alignedFree(rotationKeys);
+  alignedFree(scaleKeys);
+}
+
+AnimationClip& AnimationClip::operator=(const AnimationClip& C) {
+  if (this == &C)
+    return *this;
+  trackCount = 0;
+  duration = 0.0f;
+  // first[SCALE] is allocated last: without it, some track arrays are missing
+  if ((C.trackCount > trackCapacity || !first[SCALE]) && !growTracks(C.trackCount))
+    return *this;
+  for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+    size_t keys = C.first[c][C.trackCount];
+    if (keys > keyCapacity[c]) {
+      bool grown = alignedReallocate(times[c], 0, keys);
+      if (c == TRANSLATION)
+        grown = grown && alignedReallocate(translationKeys, 0, keys);
+      else if (c == ROTATION)
+        grown = grown && alignedReallocate(rotationKeys, 0, keys);
+      else
+        grown = grown && alignedReallocate(scaleKeys, 0, keys);
+      if (!grown) {
+        keyCapacity[c] = 0;
+        return *this;
+      }
+      keyCapacity[c] = keys;
+    }
+  }
+  trackCount = C.trackCount;
+  duration = C.duration;
+  for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+    memcpy(first[c], C.first[c], (trackCount + 1) * sizeof(uint32_t));
+    size_t keys = C.first[c][trackCount];
+    if (keys == 0)
+      continue;
+    memcpy(times[c], C.times[c], keys * sizeof(float));
+    if (c == TRANSLATION)
+      memcpy((void*) translationKeys, C.translationKeys, keys * sizeof(Vec3f));
+    else if (c == ROTATION)
+      memcpy((void*) rotationKeys, C.rotationKeys, keys * sizeof(Quat));
+    else
+      memcpy((void*) scaleKeys, C.scaleKeys, keys * sizeof(Vec3f));
+  }
+  return *this;
+}
+
+bool AnimationClip::growTracks(size_t size) {
+  for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+    bool empty = (first[c] == 0);
+    if (!alignedReallocate(first[c], empty ? 0 : trackCount + 1, size + 1))
+      return false;
+    if (empty)
+      first[c][0] = 0;
+  }
+  trackCapacity = size;
+  return true;
+}
+
+size_t AnimationClip::addTrack(const Keyframes<Vec3f>& translation, const Keyframes<Quat>& rotation,
+  const Keyframes<Vec3f>& scale) {
+  if (trackCount == trackCapacity && !growTracks((trackCapacity > 0) ? 2 * trackCapacity : 16))
+    return NONE;
+  if (!appendKeys(translation, Vec3f(), first[TRANSLATION][trackCount], times[TRANSLATION], translationKeys,
+        keyCapacity[TRANSLATION])
+      || !appendKeys(rotation, Quat::identity(), first[ROTATION][trackCount], times[ROTATION], rotationKeys,
+        keyCapacity[ROTATION])
+      || !appendKeys(scale, Vec3f(1.0f, 1.0f, 1.0f), first[SCALE][trackCount], times[SCALE], scaleKeys,
+        keyCapacity[SCALE]))
+    return NONE;
+  size_t counts[CHANNEL_COUNT] = {translation.count, rotation.count, scale.count};
+  for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+    size_t count = (counts[c] > 0) ? counts[c] : 1;
+    first[c][trackCount + 1] = first[c][trackCount] + (uint32_t) count;
+    duration = std::max(duration, times[c][first[c][trackCount + 1] - 1]);
+  }
+  return trackCount++;
+}
+
+/**
+ * Tracks [begin, end) by chunks: the cursor finds the keys of each track and
+ * their values are gathered in pairs, then every pair of the chunk is blended
+ * at once (slerpMany for rotations). Outputs start at track begin.
+ */
+void AnimationClip::sampleTracks(AnimationCursor& cursor, float time, size_t begin, size_t end,
+  Vec3f* translations, Quat* rotations, Vec3f* scales, Precision precision) const {
+  Vec3f vectors[2][TRACK_CHUNK];
+  Quat quats[2][TRACK_CHUNK];
+  float u[TRACK_CHUNK];
+  for (size_t chunk = begin ; chunk < end ; chunk += TRACK_CHUNK) {
+    size_t count = std::min(end - chunk, TRACK_CHUNK);
+    for (int c = 0 ; c < CHANNEL_COUNT ; c++) {
+      uint32_t* keys = cursor.keys + c * trackCount + chunk;
+      for (size_t i = 0 ; i < count ; i++) {
+        uint32_t start = first[c][chunk + i];
+        uint32_t n = first[c][chunk + i + 1] - start;
+        const float* t = times[c] + start;
+        uint32_t key = seek(t, n, keys[i], time), next;
+        keys[i] = key;
+        u[i] = blendFactor(t, n, key, time, next);
+        if (c == ROTATION) {
+          quats[0][i] = rotationKeys[start + key];
+          quats[1][i] = rotationKeys[start + next];
+        } else {
+          const Vec3f* values = (c == TRANSLATION) ? translationKeys : scaleKeys;
+          vectors[0][i] = values[start + key];
+          vectors[1][i] = values[start + next];
+        }
+      }
+      if (c == ROTATION) {
+        slerpMany(quats[0], quats[1], u, rotations + chunk - begin, count, precision);
+        continue;
+      }
+      Vec3f* out = ((c == TRANSLATION) ? translations : scales) + chunk - begin;
+      for (size_t i = 0 ; i < count ; i++)
+        out[i] = vectors[0][i] + (vectors[1][i] - vectors[0][i]) * u[i];
+    }
+  }
+}
+
+void AnimationClip::sample(AnimationCursor& cursor, float time, Vec3f* translations, Quat* rotations,
+  Vec3f* scales, Precision precision) const {
+  if (cursor.size() != trackCount && !cursor.reset(*this))
+    return;
+  sampleTracks(cursor, time, 0, trackCount, translations, rotations, scales, precision);
+}
+
+void AnimationClip::sample(AnimationCursor& cursor, float time, Mat4f* locals, Precision precision) const {
+  if (cursor.size() != trackCount && !cursor.reset(*this))
+    return;
+  Vec3f translations[TRACK_CHUNK], scales[TRACK_CHUNK];
+  Quat rotations[TRACK_CHUNK];
+  for (size_t chunk = 0 ; chunk < trackCount ; chunk += TRACK_CHUNK) {
+    size_t count = std::min(trackCount - chunk, TRACK_CHUNK);
+    sampleTracks(cursor, time, chunk, chunk + count, translations, rotations, scales, precision);
+    for (size_t i = 0 ; i < count ; i++)
+      locals[chunk + i] = trsMatrix(translations[i], rotations[i], scales[i]);
+  }
+}
+
+void AnimationClip::sampleMany(AnimationCursor* cursors, const float* times, size_t count, Vec3f* translations,
+  Quat* rotations, Vec3f* scales, Precision precision) const {
+  if (trackCount == 0)
+    return;
+  parallel_for(0, count, instanceGrain(trackCount), [&](size_t firstInstance, size_t lastInstance) {
+    for (size_t i = firstInstance ; i < lastInstance ; i++) {
+      size_t offset = i * trackCount;
+      sample(cursors[i], times[i], translations + offset, rotations + offset, scales + offset, precision);
+    }
+  });
+}
+
+void AnimationClip::sampleMany(AnimationCursor* cursors, const float* times, size_t count, Mat4f* locals,
+  Precision precision) const {
+  if (trackCount == 0)
+    return;
+  parallel_for(0, count, instanceGrain(trackCount), [&](size_t firstInstance, size_t lastInstance) {
+    for (size_t i = firstInstance ; i < lastInstance ; i++)
+      sample(cursors[i], times[i], locals + i * trackCount, precision);
+  });
+}
+
+AnimationCursor::AnimationCursor() : keys(0), trackCount(0) {
+}
+
+AnimationCursor::AnimationCursor(const AnimationClip& clip) : keys(0), trackCount(0) {
+  reset(clip);
+}
+
+AnimationCursor::AnimationCursor(const AnimationCursor& C) : keys(0), trackCount(0) {
+  *this = C;
+}
+
+AnimationCursor::~AnimationCursor() {
+  alignedFree(keys);
+}
+
+AnimationCursor& AnimationCursor::operator=(const AnimationCursor& C) {
+  if (this == &C)
+    return *this;
+  if (C.trackCount != trackCount) {
+    alignedFree(keys);
+    keys = (uint32_t*) alignedMalloc(AnimationClip::CHANNEL_COUNT * C.trackCount * sizeof(uint32_t));
+    trackCount = keys ? C.trackCount : 0;
+  }
+  if (trackCount > 0)
+    memcpy(keys, C.keys, AnimationClip::CHANNEL_COUNT * trackCount * sizeof(uint32_t));
+  return *this;
+}
+
+bool AnimationCursor::reset(const AnimationClip& clip) {
+  if (clip.size() != trackCount) {
+    alignedFree(keys);
+    keys = (uint32_t*) alignedMalloc(AnimationClip::CHANNEL_COUNT * clip.size() * sizeof(uint32_t));
+    trackCount = keys ? clip.size() : 0;
+  }
+  if (trackCount > 0)
+    memset(keys, 0, AnimationClip::CHANNEL_COUNT * trackCount * sizeof(uint32_t));
+  return trackCount == clip.size();
+}
+
+}
@@ -0,0 +1,144 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+#include "vec3.h"
+#include "mat4.h"
+#include "quat.h"
+
+namespace qm {
+
+/**
+ * Keyframes of one channel of a track: count values at increasing times.
+ */
+template<typename T> struct Keyframes {
+  const float* times;
+  const T* values;
+  size_t count;
+};
+
+class AnimationCursor;
+
+/**
+ * Animation clip: one track per joint, each with translation, rotation and
+ * scale channels of keyframes. Channels are interpolated linearly (slerp for
+ * rotations, see slerpMany) and hold their first and last key outside of
+ * them. A channel without keys holds the identity.
+ *
+ * Keys are stored as structure-of-arrays: per channel, one array of times and
+ * one array of values, the keys of every track back to back. Finding the key
+ * of a track only reads its times, and sampling gathers two values per track.
+ *
+ * A clip is read-only once built: any number of instances sample it at once,
+ * from any thread, each with its own AnimationCursor.
+ *
+ * If an allocation fails, assignments leave the clip empty and addTrack()
+ * returns NONE.
+ */
+class AnimationClip {
+
+  public:
+    // No track, returned by addTrack() when the allocation failed
+    static const size_t NONE = ~(size_t) 0;
+
+    enum Channel {
+      TRANSLATION = 0,
+      ROTATION,
+      SCALE,
+      CHANNEL_COUNT
+    };
+
+    // Constructors
+    AnimationClip();
+    AnimationClip(const AnimationClip& C);
+    ~AnimationClip();
+    // Operators
+    AnimationClip& operator=(const AnimationClip& C);
+    // Tracks
+    inline size_t size() const {
+      return trackCount;
+    }
+    // Time of the last key of all channels
+    inline float getDuration() const {
+      return duration;
+    }
+    inline size_t getKeyCount(Channel channel, size_t track) const {
+      return first[channel][track + 1] - first[channel][track];
+    }
+    // Append a track and return its index (NONE if the allocation failed).
+    // Times must be increasing.
+    size_t addTrack(const Keyframes<Vec3f>& translation, const Keyframes<Quat>& rotation,
+      const Keyframes<Vec3f>& scale);
+    // Sample every track at time, with cursor (reset if it was used with a
+    // clip of another size), into size() translations, rotations and scales
+    // or local matrices T * R * S
+    void sample(AnimationCursor& cursor, float time, Vec3f* translations, Quat* rotations, Vec3f* scales,
+      Precision precision = QM_DEFAULT_PRECISION) const;
+    void sample(AnimationCursor& cursor, float time, Mat4f* locals,
+      Precision precision = QM_DEFAULT_PRECISION) const;
+    // Sample count instances in parallel, instance i with cursors[i] at
+    // times[i] into the size() outputs starting at i * size()
+    void sampleMany(AnimationCursor* cursors, const float* times, size_t count, Vec3f* translations,
+      Quat* rotations, Vec3f* scales, Precision precision = QM_DEFAULT_PRECISION) const;
+    void sampleMany(AnimationCursor* cursors, const float* times, size_t count, Mat4f* locals,
+      Precision precision = QM_DEFAULT_PRECISION) const;
+
+  private:
+    bool growTracks(size_t size);
+    void sampleTracks(AnimationCursor& cursor, float time, size_t begin, size_t end, Vec3f* translations,
+      Quat* rotations, Vec3f* scales, Precision precision) const;
+
+    // Keys of track i in channel c: first[c][i] to first[c][i + 1] - 1
+    float* times[CHANNEL_COUNT];
+    Vec3f* translationKeys;
+    Quat* rotationKeys;
+    Vec3f* scaleKeys;
+    uint32_t* first[CHANNEL_COUNT];
+    size_t keyCapacity[CHANNEL_COUNT];
+    size_t trackCount;
+    size_t trackCapacity;
+    float duration;
+
+};
+
+/**
+ * Playback state of one instance of a clip: the current key of every channel
+ * of every track, 12 bytes per track. Sampling at increasing times moves keys
+ * forward from where the last sample left them, O(1) per track as long as
+ * frames are shorter than keys. Going back in time (looping) or far forward
+ * falls back to a binary search.
+ */
+class AnimationCursor {
+
+  public:
+    // Constructors
+    AnimationCursor();
+    explicit AnimationCursor(const AnimationClip& clip);
+    AnimationCursor(const AnimationCursor& C);
+    ~AnimationCursor();
+    // Operators
+    AnimationCursor& operator=(const AnimationCursor& C);
+    // Tracks
+    inline size_t size() const {
+      return trackCount;
+    }
+    // Size for clip and go back to the first keys. Returns false (and leaves
+    // the cursor empty) if the allocation failed.
+    bool reset(const AnimationClip& clip);
+
+  private:
+    friend class AnimationClip;
+
+    // Key of track i in channel c, relative to the first key of the track:
+    // keys[c * size() + i]
+    uint32_t* keys;
+    size_t trackCount;
+
+};
+
+}
+
+#endif // ANIMATION_H
@@ -0,0 +1,2090 @@
+// Benchmarks of the library operations, one line of results per case.
+//
+//   g++ -std=c++11 -O2 -pthread bench.cpp quat.cpp mat4.cpp mat3x4.cpp vecsoa.cpp transform.cpp parallel.cpp frustum.cpp bvh.cpp ray.cpp animation.cpp skinning.cpp fastmath.cpp packed.cpp binary.cpp format.cpp -o bench
+//   ./bench [--format=csv|json] [--mode=latency|throughput|scaling|all] [--filter=text]
+//           [--isa=scalar|sse2|avx|avx2+fma] [--sizes=16K,256K,8M,128M] [--min-time=ms]
+//           [--threads=N]
+//
+// - latency: one element, each operation depends on the previous result
+//   (x = op(x)), so ns/op is the latency of op.
+// - throughput: out[i] = op(in[i]) over arrays of --sizes bytes (inputs and
+//   outputs), from L1-resident to DRAM-bound working sets.
+// - batch: the batched kernels (transformPoints, inverseMany, SoA...), in
+//   throughput mode only.
+// - scaling: batches split with parallel_for on 1, 2, 4... up to --threads
+//   threads (one per core by default).
+//
+// The maximum relative error of the fast normalizations (PRECISION_FAST) is
+// checked against its documented bound and printed to stderr; the exit status
+// is 1 if it is exceeded. So are the errors of the fast trigonometry
+// (sincosMany, acosMany, atan2Many) and of the packed quaternion round trips
+// (PackedQuat32, PackedQuat48). The position error of the camera-relative matrices
+// (cameraRelativeMany against the naive float conversion) is printed too.
+//
+// cycles/op counts time stamp counter cycles (x86 only, empty otherwise): the
+// TSC ticks at a fixed reference frequency, which differs from the core clock
+// under frequency scaling.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "simd.h"
+#if QM_SIMD_X86
+#include <x86intrin.h>
+#endif
+
+#include "memory.h"
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "mat3.h"
+#include "mat4.h"
+#include "mat3x4.h"
+#include "expr.h"
+#include "fastmath.h"
+#include "quat.h"
+#include "vecsoa.h"
+#include "transform.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "ray.h"
+#include "animation.h"
+#include "skinning.h"
+#include "packed.h"
+#include "binary.h"
+#include "format.h"
+#include "parallel.h"
+
+using namespace qm;
+
+namespace {
+
+//
+// Measurement
+//
+
+enum Mode { LATENCY = 1, THROUGHPUT = 2, SCALING = 4 };
+
+struct Options {
+  bool json;
+  int modes;
+  const char* filter;
+  double minTime;
+  std::vector<size_t> sizes;
+  unsigned maxThreads;
+};
+
+struct Result {
+  std::string name;
+  const char* type;
+  const char* mode;
+  unsigned threads;
+  size_t workingSet;
+  double elements;
+  double nsPerOp;
+  double cyclesPerOp;
+};
+
+// Keep the compiler from discarding a result or caching memory across passes
+template<typename T> inline void keep(T& value) {
+  asm volatile("" : "+m"(value) : : "memory");
+}
+
+inline void clobberMemory() {
+  asm volatile("" : : : "memory");
+}
+
+inline unsigned long long readCycles() {
+#if QM_SIMD_X86
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+struct Timing {
+  double seconds;
+  double cycles;
+};
+
+template<typename Run> Timing timeRun(Run& run, size_t reps) {
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  unsigned long long c0 = readCycles();
+  run(reps);
+  unsigned long long c1 = readCycles();
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+  Timing timing;
+  timing.seconds = std::chrono::duration<double>(t1 - t0).count();
+  timing.cycles = (double) (c1 - c0);
+  return timing;
+}
+
+class Suite {
+
+  public:
+    explicit Suite(const Options& options) : options(options) { }
+
+    inline const std::vector<Result>& getResults() const {
+      return results;
+    }
+
+    inline bool selected(const std::string& name) const {
+      return !options.filter || name.find(options.filter) != std::string::npos;
+    }
+
+    // Single element chain: x = op(x)
+    template<typename T, typename Op> void latency(const std::string& name, const char* type, const T& seed, Op op) {
+      if (!(options.modes & LATENCY) || !selected(name))
+        return;
+      T x = seed;
+      struct Run {
+        T& x;
+        Op& op;
+        void operator()(size_t reps) {
+          for (size_t r = 0 ; r < reps ; r++)
+            x = op(x);
+          keep(x);
+        }
+      } run = {x, op};
+      record(name, type, "latency", sizeof(T), 1, run);
+    }
+
+    // out[i] = op(in[i]) over every working set size
+    template<typename T, typename Op> void throughput(const std::string& name, const char* type, const T& seed, Op op) {
+      if (!(options.modes & THROUGHPUT) || !selected(name))
+        return;
+      for (size_t s = 0 ; s < options.sizes.size() ; s++) {
+        size_t count = elementCount(options.sizes[s], 2 * sizeof(T));
+        T* in = allocate(count, seed);
+        T* out = allocate(count, seed);
+        struct Run {
+          const T* in;
+          T* out;
+          size_t count;
+          Op& op;
+          void operator()(size_t reps) {
+            for (size_t r = 0 ; r < reps ; r++) {
+              for (size_t i = 0 ; i < count ; i++)
+                out[i] = op(in[i]);
+              clobberMemory();
+            }
+          }
+        } run = {in, out, count, op};
+        record(name, type, "throughput", count * 2 * sizeof(T), count, run);
+        alignedFree(in);
+        alignedFree(out);
+      }
+    }
+
+    template<typename T, typename Op> void both(const std::string& name, const char* type, const T& seed, Op op) {
+      latency(name, type, seed, op);
+      throughput(name, type, seed, op);
+    }
+
+    // Batched kernel: kernel(count) processes count elements of bytesPerElement
+    // bytes. setup(count) (re)allocates the kernel data for each size.
+    template<typename Kernel> void batch(const std::string& name, const char* type, size_t bytesPerElement, Kernel& kernel) {
+      if (!(options.modes & THROUGHPUT) || !selected(name))
+        return;
+      for (size_t s = 0 ; s < options.sizes.size() ; s++) {
+        size_t count = elementCount(options.sizes[s], bytesPerElement);
+        kernel.setup(count);
+        struct Run {
+          Kernel& kernel;
+          size_t count;
+          void operator()(size_t reps) {
+            for (size_t r = 0 ; r < reps ; r++) {
+              kernel(count);
+              clobberMemory();
+            }
+          }
+        } run = {kernel, count};
+        record(name, type, "throughput", count * bytesPerElement, count, run);
+      }
+    }
+
+    // Batched kernel run by kernel(count) on kernel.pool, for every working set
+    // size and number of threads
+    template<typename Kernel> void scaling(const std::string& name, const char* type, size_t bytesPerElement, Kernel& kernel) {
+      if (!(options.modes & SCALING) || !selected(name))
+        return;
+      std::vector<unsigned> threads;
+      for (unsigned t = 1 ; t < options.maxThreads ; t *= 2)
+        threads.push_back(t);
+      threads.push_back(options.maxThreads);
+      for (size_t s = 0 ; s < options.sizes.size() ; s++) {
+        size_t count = elementCount(options.sizes[s], bytesPerElement);
+        kernel.setup(count);
+        for (size_t t = 0 ; t < threads.size() ; t++) {
+          ThreadPool pool(threads[t]);
+          kernel.pool = &pool;
+          struct Run {
+            Kernel& kernel;
+            size_t count;
+            void operator()(size_t reps) {
+              for (size_t r = 0 ; r < reps ; r++) {
+                kernel(count);
+                clobberMemory();
+              }
+            }
+          } run = {kernel, count};
+          record(name, type, "scaling", count * bytesPerElement, count, run, threads[t]);
+        }
+      }
+    }
+
+  private:
+    static inline size_t elementCount(size_t bytes, size_t bytesPerElement) {
+      size_t count = bytes / bytesPerElement;
+      return count > 0 ? count : 1;
+    }
+
+    template<typename T> static T* allocate(size_t count, const T& seed) {
+      T* array = (T*) alignedMalloc(count * sizeof(T));
+      if (!array) {
+        fprintf(stderr, "bench: cannot allocate %lu bytes\n", (unsigned long) (count * sizeof(T)));
+        exit(1);
+      }
+      for (size_t i = 0 ; i < count ; i++)
+        new (array + i) T(seed);
+      return array;
+    }
+
+    // Grow the repetitions until a run lasts a quarter of the minimum time,
+    // then keep the fastest of 3 runs of a third of it each
+    template<typename Run> void record(const std::string& name, const char* type, const char* mode,
+      size_t workingSet, size_t elementsPerRep, Run& run, unsigned threads = 1) {
+      size_t reps = 1;
+      Timing timing = timeRun(run, reps);
+      while (timing.seconds < options.minTime / 4) {
+        double scale = timing.seconds > 0 ? options.minTime / 4 / timing.seconds : 16;
+        reps = (size_t) (reps * (scale < 2 ? 2 : (scale > 16 ? 16 : scale * 1.2)));
+        timing = timeRun(run, reps);
+      }
+      reps = (size_t) (reps * options.minTime / 3 / timing.seconds) + 1;
+      Timing best = timeRun(run, reps);
+      for (int trial = 1 ; trial < 3 ; trial++) {
+        timing = timeRun(run, reps);
+        if (timing.seconds < best.seconds)
+          best = timing;
+      }
+      Result result;
+      result.name = name;
+      result.type = type;
+      result.mode = mode;
+      result.threads = threads;
+      result.workingSet = workingSet;
+      result.elements = (double) reps * elementsPerRep;
+      result.nsPerOp = best.seconds * 1e9 / result.elements;
+      result.cyclesPerOp = QM_SIMD_X86 ? best.cycles / result.elements : -1;
+      results.push_back(result);
+    }
+
+    const Options& options;
+    std::vector<Result> results;
+
+};
+
+//
+// Cases
+//
+
+template<typename T> struct TypeName;
+template<> struct TypeName<float> { static const char* get() { return "float"; } };
+template<> struct TypeName<double> { static const char* get() { return "double"; } };
+
+// Rotation by deg degrees around y, as Mat4f::rotateY
+template<typename T> Mat4Base<T> rotationY(T deg) {
+  T rad = deg * ONE_DEG_IN_RAD;
+  T c = cos(rad), s = sin(rad);
+  return Mat4Base<T>(c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1);
+}
+
+// Operations whose result type differs from their input write it back into
+// the input (e.g. x[0] = dot(x, c)), which keeps the latency chains dependent.
+// Chains stay bounded: rotations, unit vectors, small increments.
+template<typename T> void vectorCases(Suite& suite) {
+  const char* type = TypeName<T>::get();
+  volatile T one = 1;
+  const T s = -one;
+
+  const Vec2<T> c2(0.001f, -0.002f);
+  suite.both("vec2.add", type, Vec2<T>(1, 2), [c2](const Vec2<T>& x) { return x + c2; });
+  suite.both("vec2.dot", type, Vec2<T>(0.6f, 0.8f), [c2](const Vec2<T>& x) {
+    Vec2<T> r(x);
+    r[0] = Vec2<T>::dotProduct(x, c2) + 0.5f;
+    return r;
+  });
+  suite.both("vec2.normalize", type, Vec2<T>(3, 4), [](const Vec2<T>& x) {
+    Vec2<T> r(x);
+    r.normalize();
+    return r;
+  });
+
+  const Vec3<T> c3(0.001f, -0.002f, 0.003f);
+  const Vec3<T> axis(0, 0.6f, 0.8f);
+  suite.both("vec3.add", type, Vec3<T>(1, 2, 3), [c3](const Vec3<T>& x) { return x + c3; });
+  suite.both("vec3.sub", type, Vec3<T>(1, 2, 3), [c3](const Vec3<T>& x) { return x - c3; });
+  suite.both("vec3.scale", type, Vec3<T>(1, 2, 3), [s](const Vec3<T>& x) { return x * s; });
+  suite.both("vec3.dot", type, Vec3<T>(0.3f, 0.4f, 0.5f), [axis](const Vec3<T>& x) {
+    Vec3<T> r(x);
+    r[0] = Vec3<T>::dotProduct(x, axis);
+    return r;
+  });
+  suite.both("vec3.cross", type, Vec3<T>(1, 2, 3), [axis](const Vec3<T>& x) {
+    return Vec3<T>::crossProduct(x, axis);
+  });
+  suite.both("vec3.length", type, Vec3<T>(0.3f, 0.4f, 0.5f), [](const Vec3<T>& x) {
+    Vec3<T> r(x);
+    r[0] = x.getLength() * (T) 0.5;
+    return r;
+  });
+  suite.both("vec3.normalize", type, Vec3<T>(1, 2, 3), [](const Vec3<T>& x) {
+    Vec3<T> r(x);
+    r.normalize();
+    return r;
+  });
+
+  const Vec4<T> c4(0.001f, -0.002f, 0.003f, -0.004f);
+  suite.both("vec4.add", type, Vec4<T>(1, 2, 3, 4), [c4](const Vec4<T>& x) { return x + c4; });
+  suite.both("vec4.sub", type, Vec4<T>(1, 2, 3, 4), [c4](const Vec4<T>& x) { return x - c4; });
+  suite.both("vec4.scale", type, Vec4<T>(1, 2, 3, 4), [s](const Vec4<T>& x) { return x * s; });
+}
+
+template<typename T> void matrixCases(Suite& suite) {
+  const char* type = TypeName<T>::get();
+  const Mat4Base<T> R4 = rotationY<T>(10);
+  const Mat4Base<T> M4 = rotationY<T>(30);
+  const Mat3Base<T> R3 = R4.toMat3();
+  const Mat3Base<T> M3 = M4.toMat3();
+
+  suite.both("mat3.mul", type, M3, [R3](const Mat3Base<T>& x) { return x * R3; });
+  suite.both("mat3.mulVec3", type, Vec3<T>(1, 2, 3), [R3](const Vec3<T>& x) { return R3 * x; });
+  suite.both("mat4.mul", type, M4, [R4](const Mat4Base<T>& x) { return x * R4; });
+  suite.both("mat4.mulVec4", type, Vec4<T>(1, 2, 3, 1), [R4](const Vec4<T>& x) { return R4 * x; });
+
+  const Mat4<T> A4(M4);
+  const Vec3<T> t(0.001f, -0.002f, 0.003f);
+  suite.both("mat4.rotateY", type, A4, [](const Mat4<T>& x) { return Mat4<T>(x).rotateY(10); });
+  suite.both("mat4.translate", type, A4, [t](const Mat4<T>& x) { return Mat4<T>(x).translate(t); });
+  suite.both("mat4.inverse", type, A4, [](const Mat4<T>& x) { return x.inverse(); });
+  suite.both("mat4.inverseAffine", type, A4, [](const Mat4<T>& x) { return x.inverseAffine(); });
+  suite.both("mat4.inverseRigid", type, A4, [](const Mat4<T>& x) { return x.inverseRigid(); });
+  suite.both("mat4.transpose", type, A4, [](const Mat4<T>& x) { return x.transpose(); });
+  suite.both("mat4.determinant", type, A4, [](const Mat4<T>& x) {
+    Mat4<T> r(x);
+    r[15] = x.determinant();
+    return r;
+  });
+
+  const Quaternion<T> Q(30, 0, 1, 0);
+  const Quaternion<T> R(10, 0.6f, 0, 0.8f);
+  suite.both("quat.multiply", type, Q, [R](const Quaternion<T>& x) { return Quaternion<T>::multiply(x, R); });
+  suite.both("quat.rotate", type, Vec3<T>(1, 2, 3), [R](const Vec3<T>& x) { return R.rotate(x); });
+  suite.both("quat.toMatrix", type, Q, [](const Quaternion<T>& x) {
+    Mat4<T> M = x.toMatrix();
+    Quaternion<T> r(x);
+    r[1] = T(0.5) * M[6];
+    return r;
+  });
+}
+
+void floatCases(Suite& suite) {
+  const char* type = "float";
+  const Mat4f R4(rotationY<float>(10));
+  const Mat4f M4(rotationY<float>(30));
+  const Vec3f t(0.001f, -0.002f, 0.003f);
+
+  suite.both("mat4.rotateY.fast", type, M4, [](const Mat4f& x) { return Mat4f(x).rotateY(10, PRECISION_FAST); });
+
+  const Mat3x4f R34(R4);
+  const Mat3x4f M34(M4);
+  suite.both("mat3x4.mul", type, M34, [R34](const Mat3x4f& x) { return Mat3x4f(x * R34); });
+  suite.both("mat3x4.transformPoint", type, Vec3f(1, 2, 3), [R34](const Vec3f& x) { return R34.transformPoint(x); });
+  suite.both("mat3x4.rotateY", type, M34, [](const Mat3x4f& x) { return x.rotateY(10); });
+  suite.both("mat3x4.rotateY.fast", type, M34, [](const Mat3x4f& x) { return x.rotateY(10, PRECISION_FAST); });
+  suite.both("mat3x4.translate", type, M34, [t](const Mat3x4f& x) { return x.translate(t); });
+  suite.both("mat3x4.inverse", type, M34, [](const Mat3x4f& x) { return Mat3x4f(x.inverse()); });
+  suite.both("mat3x4.inverseRigid", type, M34, [](const Mat3x4f& x) { return Mat3x4f(x.inverseRigid()); });
+
+  const Quat Q(30, 0, 1, 0);
+  const Quat R(10, 0.6f, 0, 0.8f);
+  suite.both("quat.init", type, Q, [](const Quat& x) { return Quat(90 * x[0], 0.6f, 0, 0.8f, PRECISION_EXACT); });
+  suite.both("quat.init.fast", type, Q, [](const Quat& x) { return Quat(90 * x[0], 0.6f, 0, 0.8f, PRECISION_FAST); });
+  suite.both("quat.mul", type, Q, [R](const Quat& x) { return Quat(x) * R; });
+  suite.both("quat.normalize", type, Quat::fromComponents(1, 2, 3, 4), [](const Quat& x) {
+    Quat r(x);
+    r[0] *= 2;
+    return r.normalize();
+  });
+  // Alternate between two targets 90 degrees apart so that slerp never
+  // reaches its A == B shortcut
+  struct Slerp {
+    Quat targets[2];
+    int next;
+    Quat operator()(const Quat& x) {
+      Quat a(x);
+      next ^= 1;
+      return slerp(a, targets[next], 0.5f);
+    }
+  } slerpOp = {{Quat(0, 0, 1, 0), Quat(90, 0, 1, 0)}, 0};
+  suite.both("quat.slerp", type, Q, slerpOp);
+}
+
+//
+// Batched kernels
+//
+
+template<typename In, typename Out> struct ArrayKernel {
+  In* in;
+  Out* out;
+  In seed;
+  ArrayKernel(const In& seed) : in(0), out(0), seed(seed) { }
+  ~ArrayKernel() {
+    alignedFree(in);
+    alignedFree(out);
+  }
+  void setup(size_t count) {
+    alignedFree(in);
+    alignedFree(out);
+    in = (In*) alignedMalloc(count * sizeof(In));
+    out = (Out*) alignedMalloc(count * sizeof(Out));
+    if (!in || !out) {
+      fprintf(stderr, "bench: cannot allocate %lu elements\n", (unsigned long) count);
+      exit(1);
+    }
+    for (size_t i = 0 ; i < count ; i++) {
+      new (in + i) In(seed);
+      new (out + i) Out();
+    }
+  }
+};
+
+template<typename T> struct TransformPoints : ArrayKernel<Vec3<T>, Vec3<T> > {
+  Mat4<T> M;
+  TransformPoints() : ArrayKernel<Vec3<T>, Vec3<T> >(Vec3<T>(1, 2, 3)), M(rotationY<T>(30)) { }
+  void operator()(size_t count) { transformPoints(M, this->in, this->out, count); }
+};
+
+struct TransformDirections : TransformPoints<float> {
+  void operator()(size_t count) { transformDirections(M, in, out, count); }
+};
+
+// Padded vectors: one load and one store per vector
+struct TransformPointsA : ArrayKernel<Vec3fA, Vec3fA> {
+  Mat4f M;
+  TransformPointsA() : ArrayKernel<Vec3fA, Vec3fA>(Vec3fA(1, 2, 3)), M(rotationY<float>(30)) { }
+  void operator()(size_t count) { transformPoints(M, in, out, count); }
+};
+
+struct TransformPoints3x4 : TransformPoints<float> {
+  void operator()(size_t count) { transformPoints(Mat3x4f(M), in, out, count); }
+};
+
+template<typename T> struct TransformVec4 : ArrayKernel<Vec4<T>, Vec4<T> > {
+  Mat4<T> M;
+  TransformVec4() : ArrayKernel<Vec4<T>, Vec4<T> >(Vec4<T>(1, 2, 3, 1)), M(rotationY<T>(30)) { }
+  void operator()(size_t count) { transformVec4(M, this->in, this->out, count); }
+};
+
+// In place, with the lengths as output: vectors stay unit length from one
+// pass to the next
+struct NormalizeVec3 : ArrayKernel<Vec3f, float> {
+  Precision precision;
+  explicit NormalizeVec3(Precision precision) : ArrayKernel<Vec3f, float>(Vec3f(1, 2, 3)), precision(precision) { }
+  void operator()(size_t count) { normalizeMany(in, count, out, precision); }
+};
+
+struct NormalizeQuat : ArrayKernel<Quat, float> {
+  Precision precision;
+  explicit NormalizeQuat(Precision precision) :
+    ArrayKernel<Quat, float>(Quat::fromComponents(1, 2, 3, 4)), precision(precision) { }
+  void operator()(size_t count) { normalizeMany(in, count, out, precision); }
+};
+
+struct MultiplyQuats : ArrayKernel<Quat, Quat> {
+  MultiplyQuats() : ArrayKernel<Quat, Quat>(Quat(30, 0, 1, 0)) { }
+  void operator()(size_t count) { multiplyMany(in, in, out, count); }
+};
+
+struct RotateVectors : ArrayKernel<Vec3f, Vec3f> {
+  Quat Q;
+  RotateVectors() : ArrayKernel<Vec3f, Vec3f>(Vec3f(1, 2, 3)), Q(30, 0.6f, 0, 0.8f) { }
+  void operator()(size_t count) { rotateVectors(Q, in, out, count); }
+};
+
+// Blend count rotations towards targets 90 degrees away, with t spread over
+// [0, 1]: slerp one at a time (LOOP), slerpMany, slerpMany with
+// PRECISION_FAST or nlerpMany
+struct BlendQuats : ArrayKernel<Quat, Quat> {
+  enum Op { LOOP, SLERP, SLERP_FAST, NLERP };
+  std::vector<Quat> targets;
+  std::vector<float> t;
+  Op op;
+  explicit BlendQuats(Op op) : ArrayKernel<Quat, Quat>(Quat(30, 0, 1, 0)), op(op) { }
+  void setup(size_t count) {
+    ArrayKernel<Quat, Quat>::setup(count);
+    targets.assign(count, Quat(120, 0, 1, 0));
+    t.resize(count);
+    for (size_t i = 0 ; i < count ; i++)
+      t[i] = (i % 64) / 63.0f;
+  }
+  void operator()(size_t count) {
+    switch (op) {
+      case LOOP:
+        for (size_t i = 0 ; i < count ; i++)
+          out[i] = slerp(in[i], targets[i], t[i]);
+        break;
+      case SLERP: slerpMany(in, &targets[0], &t[0], out, count, PRECISION_EXACT); break;
+      case SLERP_FAST: slerpMany(in, &targets[0], &t[0], out, count, PRECISION_FAST); break;
+      default: nlerpMany(in, &targets[0], &t[0], out, count); break;
+    }
+  }
+};
+
+// Trigonometry of count angles (or x, y pairs): libm one value at a time
+// (LIBM) or the fast:: arrays
+struct Trig : ArrayKernel<float, float> {
+  enum Op { SINCOS, ACOS, ATAN2 };
+  std::vector<float> other;
+  Op op;
+  bool libm;
+  Trig(Op op, bool libm) : ArrayKernel<float, float>(0.0f), op(op), libm(libm) { }
+  void setup(size_t count) {
+    ArrayKernel<float, float>::setup(count);
+    other.resize(count);
+    for (size_t i = 0 ; i < count ; i++) {
+      float u = (i % 1024) / 1023.0f;
+      in[i] = (op == SINCOS) ? 8.0f * u - 4.0f : 2.0f * u - 1.0f;
+      other[i] = 1.0f - u;
+    }
+  }
+  void operator()(size_t count) {
+    switch (op) {
+      case SINCOS:
+        if (!libm) {
+          fast::sincosMany(in, out, &other[0], count);
+          break;
+        }
+        for (size_t i = 0 ; i < count ; i++) {
+          out[i] = std::sin(in[i]);
+          other[i] = std::cos(in[i]);
+        }
+        break;
+      case ACOS:
+        if (!libm) {
+          fast::acosMany(in, out, count);
+          break;
+        }
+        for (size_t i = 0 ; i < count ; i++)
+          out[i] = std::acos(in[i]);
+        break;
+      default:
+        if (!libm) {
+          fast::atan2Many(in, &other[0], out, count);
+          break;
+        }
+        for (size_t i = 0 ; i < count ; i++)
+          out[i] = std::atan2(in[i], other[i]);
+        break;
+    }
+  }
+};
+
+// Quaternions from count angles and axes, with axisAngleMany
+struct AxisAngles : ArrayKernel<float, Quat> {
+  std::vector<Vec3f> axes;
+  Precision precision;
+  explicit AxisAngles(Precision precision) : ArrayKernel<float, Quat>(0.0f), precision(precision) { }
+  void setup(size_t count) {
+    ArrayKernel<float, Quat>::setup(count);
+    axes.assign(count, Vec3f(0.6f, 0.0f, 0.8f));
+    for (size_t i = 0 ; i < count ; i++)
+      in[i] = (float) (i % 720) - 360.0f;
+  }
+  void operator()(size_t count) { axisAngleMany(in, &axes[0], out, count, precision); }
+};
+
+// Pack count elements into a storage type of packed.h (packMany), or unpack
+// them back (unpackMany)
+template<typename In, typename Packed> struct PackArray : ArrayKernel<In, Packed> {
+  std::vector<In> unpacked;
+  bool unpack;
+  PackArray(const In& seed, bool unpack) : ArrayKernel<In, Packed>(seed), unpack(unpack) { }
+  void setup(size_t count) {
+    ArrayKernel<In, Packed>::setup(count);
+    unpacked.resize(count);
+    packMany(this->in, this->out, count);
+  }
+  void operator()(size_t count) {
+    if (unpack)
+      unpackMany(this->out, &unpacked[0], count);
+    else
+      packMany(this->in, this->out, count);
+  }
+};
+
+// Text of count matrices (format.h), one per line: formatMany, parseMany
+// back, or operator<< into a string stream
+struct MatrixText : ArrayKernel<Mat4f, Mat4f> {
+  enum Mode { FORMAT, PARSE, OSTREAM };
+  std::vector<char> text;
+  size_t length;
+  std::ostringstream stream;
+  TextFormat textFormat;
+  Mode mode;
+  MatrixText(const TextFormat& f, Mode mode) :
+    ArrayKernel<Mat4f, Mat4f>(translated()), length(0), textFormat(f), mode(mode) { }
+  static Mat4f translated() {
+    Mat4f M(rotationY<float>(30));
+    M[12] = 1.5f;
+    M[13] = -20.25f;
+    M[14] = 310.0f;
+    return M;
+  }
+  void setup(size_t count) {
+    ArrayKernel<Mat4f, Mat4f>::setup(count);
+    text.resize(count * 16 * (FLOAT_TEXT_SIZE + 1) + count * 16);
+    formatMany(&text[0], text.size(), in, count, length, textFormat);
+  }
+  void operator()(size_t count) {
+    if (mode == FORMAT) {
+      formatMany(&text[0], text.size(), in, count, length, textFormat);
+    } else if (mode == PARSE) {
+      parseMany(&text[0], &text[0] + length, out, count, textFormat);
+    } else {
+      stream.str(std::string());
+      for (size_t i = 0 ; i < count ; i++)
+        stream << in[i];
+    }
+  }
+};
+
+// Section checksum of binary.h over count matrices, as BinaryWriter::append
+// and BinaryReader::verify compute it
+struct Checksum : ArrayKernel<Mat4f, uint32_t> {
+  Checksum() : ArrayKernel<Mat4f, uint32_t>(rotationY<float>(30)) { }
+  void operator()(size_t count) { out[0] = crc32c(in, count * sizeof(Mat4f)); }
+};
+
+template<typename T> struct Mat4Batch : ArrayKernel<Mat4Base<T>, Mat4Base<T> > {
+  void (*function)(const Mat4Base<T>*, Mat4Base<T>*, size_t);
+  Mat4Batch(void (*function)(const Mat4Base<T>*, Mat4Base<T>*, size_t)) :
+    ArrayKernel<Mat4Base<T>, Mat4Base<T> >(rotationY<T>(30)), function(function) { }
+  void operator()(size_t count) { function(this->in, this->out, count); }
+};
+
+template<typename T> struct Determinants : ArrayKernel<Mat4Base<T>, T> {
+  Determinants() : ArrayKernel<Mat4Base<T>, T>(rotationY<T>(30)) { }
+  void operator()(size_t count) { determinantMany(this->in, this->out, count); }
+};
+
+struct Compose3x4 : ArrayKernel<Mat3x4Base<float>, Mat3x4Base<float> > {
+  Compose3x4() : ArrayKernel<Mat3x4Base<float>, Mat3x4Base<float> >(Mat3x4f(Mat4f(rotationY<float>(30)))) { }
+  void operator()(size_t count) { composeMany(in, in, out, count); }
+};
+
+struct Inverse3x4 : Compose3x4 {
+  void operator()(size_t count) { inverseMany(in, out, count); }
+};
+
+// Expression templates (expr.h) against the eager operators: a Vec3 physics
+// step over count particles, in place, and P * V * M * v over count vectors
+struct PhysicsStep {
+  std::vector<Vec3f> x, v, f;
+  bool lazy;
+  explicit PhysicsStep(bool lazy) : lazy(lazy) { }
+  void setup(size_t count) {
+    x.assign(count, Vec3f(1, 2, 3));
+    v.assign(count, Vec3f(0.5f, 0, -0.25f));
+    // No zero component: damped to a terminal velocity, never to denormals
+    f.assign(count, Vec3f(1.5f, -9.81f, 0.5f));
+  }
+  void operator()(size_t count) {
+    const float dt = 1.0f / 60.0f, damping = 0.99f;
+    if (lazy) {
+      for (size_t i = 0 ; i < count ; i++) {
+        x[i] = qm::lazy(x[i]) + qm::lazy(v[i]) * dt + qm::lazy(f[i]) * (0.5f * dt * dt);
+        v[i] = (qm::lazy(v[i]) + qm::lazy(f[i]) * dt) * damping;
+      }
+    } else {
+      for (size_t i = 0 ; i < count ; i++) {
+        x[i] += v[i] * dt + f[i] * (0.5f * dt * dt);
+        v[i] = (v[i] + f[i] * dt) * damping;
+      }
+    }
+  }
+};
+
+template<typename T> struct MatrixChain : ArrayKernel<Vec4<T>, Vec4<T> > {
+  Mat4<T> P, V, M;
+  bool lazy;
+  explicit MatrixChain(bool lazy) : ArrayKernel<Vec4<T>, Vec4<T> >(Vec4<T>(1, 2, 3, 1)),
+    P(rotationY<T>(10)), V(rotationY<T>(20)), M(rotationY<T>(30)), lazy(lazy) { }
+  void operator()(size_t count) {
+    if (lazy) {
+      for (size_t i = 0 ; i < count ; i++)
+        this->out[i] = qm::lazy(P) * V * M * this->in[i];
+    } else {
+      for (size_t i = 0 ; i < count ; i++)
+        this->out[i] = P * V * M * this->in[i];
+    }
+  }
+};
+
+// Camera-relative float matrices from double world matrices far from the
+// world origin: cameraRelativeMany, or the naive conversion (every element
+// rounded to float, then the float camera position subtracted)
+const Vec3d CAMERA_POSITION(6378137.0, 1250.5, -3.0e5);
+
+Mat4d worldMatrix(size_t i) {
+  Mat4d M(rotationY<double>((double) (i % 360)));
+  M[12] = CAMERA_POSITION[0] + (double) (i % 1000) * 0.37;
+  M[13] = CAMERA_POSITION[1] - (double) (i % 100) * 1.1;
+  M[14] = CAMERA_POSITION[2] + 25.0;
+  return M;
+}
+
+void naiveRelative(const Mat4d* in, const Vec3d& origin, Mat4f* out, size_t count) {
+  Vec3f o((float) origin[0], (float) origin[1], (float) origin[2]);
+  for (size_t i = 0 ; i < count ; i++) {
+    for (int k = 0 ; k < 16 ; k++)
+      out[i][k] = (float) in[i][k];
+    for (int k = 0 ; k < 3 ; k++)
+      out[i][12 + k] -= o[k];
+  }
+}
+
+template<typename Out> struct CameraRelative : ArrayKernel<Mat4d, Out> {
+  bool naive;
+  explicit CameraRelative(bool naive) : ArrayKernel<Mat4d, Out>(worldMatrix(0)), naive(naive) { }
+  void setup(size_t count) {
+    ArrayKernel<Mat4d, Out>::setup(count);
+    for (size_t i = 0 ; i < count ; i++)
+      this->in[i] = worldMatrix(i);
+  }
+  void operator()(size_t count) { run(this->in, this->out, count); }
+  void run(const Mat4d* in, Mat4f* out, size_t count) {
+    if (naive)
+      naiveRelative(in, CAMERA_POSITION, out, count);
+    else
+      cameraRelativeMany(in, CAMERA_POSITION, out, count);
+  }
+  void run(const Mat4d* in, Mat3x4f* out, size_t count) {
+    cameraRelativeMany(in, CAMERA_POSITION, out, count);
+  }
+};
+
+// SoA kernels: a op b -> r, on count vectors
+template<typename T, typename SoA> struct SoAKernel {
+  SoA a, b, r;
+  std::vector<T> scalars;
+  int op;
+  explicit SoAKernel(int op) : op(op) { }
+  void setup(size_t count) {
+    a.resize(count);
+    b.resize(count);
+    r.resize(count);
+    scalars.resize(count);
+    for (size_t i = 0 ; i < count ; i++) {
+      a.set(i, Vec3<T>(1, 2, 3));
+      b.set(i, Vec3<T>(0, 0.6f, 0.8f));
+    }
+  }
+  void operator()(size_t count) {
+    (void) count;
+    switch (op) {
+      case 0: r = a; r += b; break;
+      case 1: SoA::dotProduct(a, b, &scalars[0]); break;
+      case 2: r = SoA::crossProduct(a, b); break;
+      case 3: r = a; r.normalize(); break;
+      default: r = a; r.normalize(0, PRECISION_FAST); break;
+    }
+  }
+};
+
+template<typename T> void soaCases(Suite& suite) {
+  const char* type = TypeName<T>::get();
+  const char* names[] = {"soa.vec3.add", "soa.vec3.dot", "soa.vec3.cross", "soa.vec3.normalize",
+    "soa.vec3.normalize.fast"};
+  const size_t bytes[] = {9 * sizeof(T), 7 * sizeof(T), 9 * sizeof(T), 6 * sizeof(T), 6 * sizeof(T)};
+  for (int op = 0 ; op < 5 ; op++) {
+    SoAKernel<T, Vec3SoA<T> > kernel(op);
+    suite.batch(names[op], type, bytes[op], kernel);
+  }
+}
+
+// Hierarchy of 4-ary trees of 1000 nodes. Each frame moves every node
+// (step 1) or one node out of 20 (step 20), drawn at random, then updates.
+struct TransformUpdate {
+  TransformHierarchy hierarchy;
+  std::vector<int> moved;
+  size_t step;
+  explicit TransformUpdate(size_t step) : step(step) { }
+  void setup(size_t count) {
+    hierarchy = TransformHierarchy();
+    hierarchy.reserve(count);
+    for (size_t i = 0 ; i < count ; i++) {
+      int parent = (i % 1000 == 0) ? TransformHierarchy::NO_PARENT : (int) (i - i % 1000 + (i % 1000 - 1) / 4);
+      hierarchy.addNode(parent, Vec3f(1, 0, 0), Quat((float) (i % 90), 0, 1, 0));
+    }
+    hierarchy.update();
+    moved.clear();
+    unsigned int seed = 1;
+    for (size_t i = 0 ; i < count ; i += step) {
+      seed = seed * 1664525u + 1013904223u;
+      moved.push_back(step == 1 ? (int) i : (int) (seed % count));
+    }
+  }
+  void operator()(size_t count) {
+    (void) count;
+    for (size_t i = 0 ; i < moved.size() ; i++)
+      hierarchy.setRotation(moved[i], hierarchy.getRotation(moved[i]));
+    hierarchy.update();
+  }
+};
+
+// Objects in clusters of 64 spread over a cube of side 200 around a camera
+// looking down -z (90 degrees field of view, far plane at 100): about one
+// object out of 6 is visible. Spheres or boxes, tested one by one or by
+// clusters, and optionally compacted to an index list.
+struct Cull {
+  Frustum frustum;
+  Vec4SoA<float> spheres;
+  Vec3SoA<float> min, max, groupMin, groupMax;
+  std::vector<uint32_t> mask, indices;
+  bool boxes, groups, compact;
+  Cull(bool boxes, bool groups, bool compact) : boxes(boxes), groups(groups), compact(compact) {
+    float n = 1.0f, f = 100.0f;
+    frustum.init(Mat4f(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, -(f + n) / (f - n), -1, 0, 0, -2 * f * n / (f - n), 0));
+  }
+  void setup(size_t count) {
+    spheres.resize(count);
+    min.resize(count);
+    max.resize(count);
+    mask.resize((count + 31) / 32);
+    indices.resize(count);
+    unsigned int seed = 1;
+    Vec3f center;
+    for (size_t i = 0 ; i < count ; i++) {
+      float r[4];
+      for (int k = 0 ; k < 4 ; k++) {
+        seed = seed * 1664525u + 1013904223u;
+        r[k] = (seed >> 8) / 16777216.0f;
+      }
+      if (i % 64 == 0)
+        center = Vec3f(200 * r[0] - 100, 200 * r[1] - 100, 200 * r[2] - 100);
+      Vec3f p = center + Vec3f(4 * r[1] - 2, 4 * r[2] - 2, 4 * r[3] - 2);
+      float radius = 0.1f + r[0];
+      spheres.set(i, Vec4f(p[0], p[1], p[2], radius));
+      min.set(i, p - Vec3f(radius, radius, radius));
+      max.set(i, p + Vec3f(radius, radius, radius));
+    }
+    if (boxes)
+      groupBounds(min, max, 64, groupMin, groupMax);
+    else
+      groupBounds(spheres, 64, groupMin, groupMax);
+  }
+  void operator()(size_t count) {
+    if (boxes && groups)
+      cullAabbs(frustum, min, max, groupMin, groupMax, 64, &mask[0]);
+    else if (boxes)
+      cullAabbs(frustum, min, max, &mask[0]);
+    else if (groups)
+      cullSpheres(frustum, spheres, groupMin, groupMax, 64, &mask[0]);
+    else
+      cullSpheres(frustum, spheres, &mask[0]);
+    if (compact) {
+      size_t visible = visibleIndices(&mask[0], count, &indices[0]);
+      keep(visible);
+    }
+  }
+};
+
+// BVH over count random points in a cube of side 100: build, refit, and
+// queries (8 nearest, radius 1) from count probes, batched or one at a time.
+// Probes come in spatially coherent runs of 64.
+struct BvhCase {
+  enum Op { BUILD, REFIT, NEAREST, NEAREST_SINGLE, RADIUS };
+  Bvh bvh;
+  std::vector<Vec3f> points, probes;
+  std::vector<uint32_t> result;
+  std::vector<float> distances;
+  std::vector<size_t> counts;
+  Op op;
+  explicit BvhCase(Op op) : op(op) { }
+  void setup(size_t count) {
+    points.resize(count);
+    probes.resize(count);
+    unsigned int seed = 1;
+    float r[3];
+    for (size_t i = 0 ; i < count + probes.size() ; i++) {
+      for (int k = 0 ; k < 3 ; k++) {
+        seed = seed * 1664525u + 1013904223u;
+        r[k] = (seed >> 8) / 16777216.0f;
+      }
+      if (i < count)
+        points[i] = Vec3f(100 * r[0], 100 * r[1], 100 * r[2]);
+      else if ((i - count) % 64 == 0)
+        probes[i - count] = Vec3f(100 * r[0], 100 * r[1], 100 * r[2]);
+      else
+        probes[i - count] = probes[i - count - 1] + Vec3f(r[0] - 0.5f, r[1] - 0.5f, r[2] - 0.5f);
+    }
+    bvh.build(&points[0], count);
+    result.resize(8 * probes.size());
+    distances.resize(8 * probes.size());
+    counts.resize(probes.size());
+  }
+  void operator()(size_t count) {
+    switch (op) {
+      case BUILD: bvh.build(&points[0], count); break;
+      case REFIT: bvh.refit(&points[0]); break;
+      case NEAREST: bvh.nearest(&probes[0], probes.size(), 8, &result[0], &distances[0]); break;
+      case NEAREST_SINGLE:
+        for (size_t i = 0 ; i < probes.size() ; i++)
+          bvh.nearest(probes[i], 8, &result[8 * i], &distances[8 * i]);
+        break;
+      default: bvh.queryRadius(&probes[0], probes.size(), 1.0f, 8, &result[0], &counts[0]); break;
+    }
+  }
+};
+
+// 8 rays from a camera at z = -60 through count random triangles (or boxes)
+// of size about 1 in a cube of side 100, closest hit by brute force: as a
+// packet of 8, two packets of 4 or one ray at a time. Each element is one
+// primitive tested against the 8 rays: rays/s = 8e9 / (ns_per_op * count),
+// count being working_set_bytes / bytes per element.
+struct RayCase {
+  TriangleSoA triangles;
+  Vec3SoA<float> min, max;
+  RayPacket8 rays;
+  bool boxes;
+  int packetSize;
+  RayCase(bool boxes, int packetSize) : boxes(boxes), packetSize(packetSize) { }
+  void setup(size_t count) {
+    triangles.resize(boxes ? 0 : count);
+    min.resize(boxes ? count : 0);
+    max.resize(boxes ? count : 0);
+    unsigned int seed = 1;
+    float r[9];
+    for (size_t i = 0 ; i < count + 8 ; i++) {
+      for (int k = 0 ; k < 9 ; k++) {
+        seed = seed * 1664525u + 1013904223u;
+        r[k] = (seed >> 8) / 16777216.0f;
+      }
+      Vec3f p(100 * r[0] - 50, 100 * r[1] - 50, 100 * r[2] - 50);
+      if (i >= count)
+        rays.set((int) (i - count), Vec3f(0.0f, 0.0f, -60.0f), Vec3f(r[0] - 0.5f, r[1] - 0.5f, 1.0f));
+      else if (boxes) {
+        min.set(i, p);
+        max.set(i, p + Vec3f(r[3], r[4], r[5]));
+      } else
+        triangles.set(i, p, p + Vec3f(r[3], r[4], r[5]) - Vec3f(0.5f, 0.5f, 0.5f),
+          p + Vec3f(r[6], r[7], r[8]) - Vec3f(0.5f, 0.5f, 0.5f));
+    }
+  }
+  void operator()(size_t count) {
+    (void) count;
+    HitPacket8 hits;
+    if (packetSize == 8) {
+      int mask = boxes ? intersect(rays, min, max, hits) : intersect(rays, triangles, hits);
+      keep(mask);
+    } else if (packetSize == 4) {
+      RayPacket4 half;
+      HitPacket4 halfHits;
+      for (int j = 0 ; j < 8 ; j++) {
+        half.set(j % 4, Vec3f(rays.originX[j], rays.originY[j], rays.originZ[j]),
+          Vec3f(rays.directionX[j], rays.directionY[j], rays.directionZ[j]), rays.tMax[j]);
+        if (j % 4 == 3) {
+          int mask = intersect(half, triangles, halfHits);
+          keep(mask);
+        }
+      }
+    } else {
+      for (int j = 0 ; j < 8 ; j++) {
+        Vec3f origin(rays.originX[j], rays.originY[j], rays.originZ[j]);
+        Vec3f direction(rays.directionX[j], rays.directionY[j], rays.directionZ[j]);
+        RayHit hit;
+        bool found = boxes ? intersect(origin, direction, min, max, hit)
+          : intersect(origin, direction, triangles, hit);
+        keep(found);
+      }
+    }
+  }
+};
+
+// Instances of a clip of 64 tracks with 31 keys per channel over one second,
+// each a frame of 1/60 s further than in the previous run, with a phase of
+// its own. Each element is one track of one instance: with cursors into TRS
+// or matrices, or as keyframe arrays searched by binary search and slerp.
+struct AnimationCase {
+  enum Op { SEARCH, TRS, MATRICES };
+  static const size_t TRACKS = 64;
+  static const size_t KEYS = 31;
+  AnimationClip clip;
+  std::vector<float> keyTimes;
+  std::vector<Vec3f> vectors;
+  std::vector<Quat> rotations;
+  std::vector<AnimationCursor> cursors;
+  std::vector<float> times;
+  std::vector<Vec3f> translationsOut, scalesOut;
+  std::vector<Quat> rotationsOut;
+  std::vector<Mat4f> matrices;
+  Op op;
+  explicit AnimationCase(Op op) : op(op) {
+    for (size_t k = 0 ; k < KEYS ; k++)
+      keyTimes.push_back(k / (KEYS - 1.0f));
+    for (size_t i = 0 ; i < TRACKS * KEYS ; i++) {
+      vectors.push_back(Vec3f((float) (i % 7), (float) (i % 5), 1.0f));
+      rotations.push_back(Quat((float) (i % 90), 0, 1, 0));
+    }
+    for (size_t j = 0 ; j < TRACKS ; j++) {
+      Keyframes<Vec3f> v = {&keyTimes[0], &vectors[j * KEYS], KEYS};
+      Keyframes<Quat> r = {&keyTimes[0], &rotations[j * KEYS], KEYS};
+      clip.addTrack(v, r, v);
+    }
+  }
+  void setup(size_t count) {
+    size_t instances = (count + TRACKS - 1) / TRACKS;
+    cursors.assign(instances, AnimationCursor(clip));
+    times.resize(instances);
+    for (size_t i = 0 ; i < instances ; i++)
+      times[i] = (i % 97) / 97.0f;
+    translationsOut.resize(instances * TRACKS);
+    scalesOut.resize(instances * TRACKS);
+    rotationsOut.resize(instances * TRACKS);
+    matrices.resize(op == MATRICES ? instances * TRACKS : 0);
+  }
+  // Binary search in the keys of track j, then blend
+  void search(float time, size_t j, Vec3f& translation, Quat& rotation, Vec3f& scale) const {
+    size_t k = std::upper_bound(keyTimes.begin(), keyTimes.end(), time) - keyTimes.begin();
+    k = std::min(std::max(k, (size_t) 1), KEYS - 1);
+    float u = std::min(std::max((time - keyTimes[k - 1]) / (keyTimes[k] - keyTimes[k - 1]), 0.0f), 1.0f);
+    const Vec3f& a = vectors[j * KEYS + k - 1];
+    const Vec3f& b = vectors[j * KEYS + k];
+    translation = a + (b - a) * u;
+    scale = translation;
+    rotation = slerp(rotations[j * KEYS + k - 1], rotations[j * KEYS + k], u);
+  }
+  void operator()(size_t count) {
+    (void) count;
+    for (size_t i = 0 ; i < times.size() ; i++) {
+      times[i] += 1.0f / 60.0f;
+      if (times[i] > 1.0f)
+        times[i] -= 1.0f;
+    }
+    if (op == SEARCH) {
+      for (size_t i = 0 ; i < times.size() ; i++)
+        for (size_t j = 0 ; j < TRACKS ; j++) {
+          size_t n = i * TRACKS + j;
+          search(times[i], j, translationsOut[n], rotationsOut[n], scalesOut[n]);
+        }
+    } else if (op == TRS)
+      clip.sampleMany(&cursors[0], &times[0], times.size(), &translationsOut[0], &rotationsOut[0],
+        &scalesOut[0]);
+    else
+      clip.sampleMany(&cursors[0], &times[0], times.size(), &matrices[0]);
+  }
+};
+
+// Vertices with 4 or 8 influences among a palette of 64 joints, positions
+// and normals skinned with linear blending or dual quaternions, or with a
+// Mat4f palette applied per influence to AoS vertices. elements_per_s is the
+// number of vertices skinned per second.
+struct SkinCase {
+  enum Op { LOOP, LINEAR, DUAL_QUAT };
+  static const int JOINTS = 64;
+  std::vector<Mat4f> matrices;
+  std::vector<Mat3x4f> palette;
+  std::vector<DualQuat> dualQuats;
+  SkinWeights4 weights4;
+  SkinWeights8 weights8;
+  Vec3SoA<float> positions, normals, outPositions, outNormals;
+  std::vector<Vec3f> aosPositions, aosNormals, aosOutPositions, aosOutNormals;
+  Op op;
+  int influences;
+  SkinCase(Op op, int influences) : op(op), influences(influences) {
+    for (int j = 0 ; j < JOINTS ; j++) {
+      Quat q((float) (5 * j), 0.6f, 0.0f, 0.8f);
+      Vec3f t(0.1f * j, 1.0f, 0.0f);
+      Mat4f M = q.toMatrix();
+      M[12] = t[0];
+      M[13] = t[1];
+      M[14] = t[2];
+      matrices.push_back(M);
+      palette.push_back(Mat3x4f(M));
+      dualQuats.push_back(DualQuat(q, t));
+    }
+  }
+  void setup(size_t count) {
+    weights4.resize(influences == 4 ? count : 0);
+    weights8.resize(influences == 8 ? count : 0);
+    positions.resize(count);
+    normals.resize(count);
+    aosPositions.resize(count);
+    aosNormals.resize(count);
+    aosOutPositions.resize(count);
+    aosOutNormals.resize(count);
+    unsigned int seed = 1;
+    for (size_t i = 0 ; i < count ; i++) {
+      Vec3f p((float) (i % 17), (float) (i % 13), 1.0f);
+      positions.set(i, p);
+      normals.set(i, Vec3f(0.0f, 1.0f, 0.0f));
+      aosPositions[i] = p;
+      aosNormals[i] = Vec3f(0.0f, 1.0f, 0.0f);
+      for (int k = 0 ; k < influences ; k++) {
+        seed = seed * 1664525u + 1013904223u;
+        uint16_t joint = (uint16_t) ((seed >> 8) % JOINTS);
+        float weight = (k == 0) ? 0.5f : 0.5f / (influences - 1);
+        if (influences == 4)
+          weights4.set(i, k, joint, weight);
+        else
+          weights8.set(i, k, joint, weight);
+      }
+    }
+  }
+  void operator()(size_t count) {
+    if (op == LOOP) {
+      for (size_t i = 0 ; i < count ; i++) {
+        Vec4f p(aosPositions[i][0], aosPositions[i][1], aosPositions[i][2], 1.0f);
+        Vec4f n(aosNormals[i][0], aosNormals[i][1], aosNormals[i][2], 0.0f);
+        Vec4f sumP, sumN;
+        for (int k = 0 ; k < influences ; k++) {
+          uint16_t joint = (influences == 4) ? weights4.getJoint(i, k) : weights8.getJoint(i, k);
+          float weight = (influences == 4) ? weights4.getWeight(i, k) : weights8.getWeight(i, k);
+          sumP += (matrices[joint] * p) * weight;
+          sumN += (matrices[joint] * n) * weight;
+        }
+        aosOutPositions[i] = Vec3f(sumP[0], sumP[1], sumP[2]);
+        aosOutNormals[i] = Vec3f(sumN[0], sumN[1], sumN[2]);
+        aosOutNormals[i].normalize();
+      }
+    } else if (influences == 4) {
+      if (op == LINEAR)
+        skinLinear(&palette[0], JOINTS, weights4, positions, &normals, outPositions, &outNormals);
+      else
+        skinDualQuat(&dualQuats[0], JOINTS, weights4, positions, &normals, outPositions, &outNormals);
+    } else {
+      if (op == LINEAR)
+        skinLinear(&palette[0], JOINTS, weights8, positions, &normals, outPositions, &outNormals);
+      else
+        skinDualQuat(&dualQuats[0], JOINTS, weights8, positions, &normals, outPositions, &outNormals);
+    }
+  }
+};
+
+// Batched 4x4 kernels of both precisions
+template<typename T> void mat4BatchCases(Suite& suite) {
+  const char* type = TypeName<T>::get();
+  TransformPoints<T> points;
+  suite.batch("batch.transformPoints", type, 2 * sizeof(Vec3<T>), points);
+  TransformVec4<T> vec4;
+  suite.batch("batch.transformVec4", type, 2 * sizeof(Vec4<T>), vec4);
+  Determinants<T> determinants;
+  suite.batch("batch.mat4.determinant", type, sizeof(Mat4Base<T>) + sizeof(T), determinants);
+  Mat4Batch<T> inverse(inverseMany);
+  suite.batch("batch.mat4.inverse", type, 2 * sizeof(Mat4Base<T>), inverse);
+  Mat4Batch<T> inverseAffine(inverseAffineMany);
+  suite.batch("batch.mat4.inverseAffine", type, 2 * sizeof(Mat4Base<T>), inverseAffine);
+  Mat4Batch<T> inverseRigid(inverseRigidMany);
+  suite.batch("batch.mat4.inverseRigid", type, 2 * sizeof(Mat4Base<T>), inverseRigid);
+  Mat4Batch<T> transpose(transposeMany);
+  suite.batch("batch.mat4.transpose", type, 2 * sizeof(Mat4Base<T>), transpose);
+}
+
+void batchCases(Suite& suite) {
+  const char* type = "float";
+  mat4BatchCases<float>(suite);
+  mat4BatchCases<double>(suite);
+  TransformDirections directions;
+  suite.batch("batch.transformDirections", type, 2 * sizeof(Vec3f), directions);
+  TransformPointsA pointsA;
+  suite.batch("batch.transformPoints.vec3a", type, 2 * sizeof(Vec3fA), pointsA);
+  TransformPoints3x4 points3x4;
+  suite.batch("batch.mat3x4.transformPoints", type, 2 * sizeof(Vec3f), points3x4);
+  NormalizeVec3 normalize(PRECISION_EXACT);
+  suite.batch("batch.normalize", type, sizeof(Vec3f) + sizeof(float), normalize);
+  NormalizeVec3 normalizeFast(PRECISION_FAST);
+  suite.batch("batch.normalize.fast", type, sizeof(Vec3f) + sizeof(float), normalizeFast);
+  NormalizeQuat normalizeQuat(PRECISION_EXACT);
+  suite.batch("batch.quat.normalize", type, sizeof(Quat) + sizeof(float), normalizeQuat);
+  NormalizeQuat normalizeQuatFast(PRECISION_FAST);
+  suite.batch("batch.quat.normalize.fast", type, sizeof(Quat) + sizeof(float), normalizeQuatFast);
+  MultiplyQuats multiplyQuats;
+  suite.batch("batch.quat.multiply", type, 2 * sizeof(Quat), multiplyQuats);
+  RotateVectors rotate;
+  suite.batch("batch.quat.rotateVectors", type, 2 * sizeof(Vec3f), rotate);
+  const size_t blendBytes = 3 * sizeof(Quat) + sizeof(float);
+  BlendQuats slerpLoop(BlendQuats::LOOP);
+  suite.batch("batch.quat.slerp.loop", type, blendBytes, slerpLoop);
+  BlendQuats slerps(BlendQuats::SLERP);
+  suite.batch("batch.quat.slerp", type, blendBytes, slerps);
+  BlendQuats slerpsFast(BlendQuats::SLERP_FAST);
+  suite.batch("batch.quat.slerp.fast", type, blendBytes, slerpsFast);
+  BlendQuats nlerps(BlendQuats::NLERP);
+  suite.batch("batch.quat.nlerp", type, blendBytes, nlerps);
+  Trig sincosLibm(Trig::SINCOS, true);
+  suite.batch("batch.sincos.libm", type, 3 * sizeof(float), sincosLibm);
+  Trig sincosFast(Trig::SINCOS, false);
+  suite.batch("batch.fast.sincos", type, 3 * sizeof(float), sincosFast);
+  Trig acosLibm(Trig::ACOS, true);
+  suite.batch("batch.acos.libm", type, 2 * sizeof(float), acosLibm);
+  Trig acosFast(Trig::ACOS, false);
+  suite.batch("batch.fast.acos", type, 2 * sizeof(float), acosFast);
+  Trig atan2Libm(Trig::ATAN2, true);
+  suite.batch("batch.atan2.libm", type, 3 * sizeof(float), atan2Libm);
+  Trig atan2Fast(Trig::ATAN2, false);
+  suite.batch("batch.fast.atan2", type, 3 * sizeof(float), atan2Fast);
+  AxisAngles axisAngles(PRECISION_EXACT);
+  suite.batch("batch.quat.axisAngle", type, sizeof(float) + sizeof(Vec3f) + sizeof(Quat), axisAngles);
+  AxisAngles axisAnglesFast(PRECISION_FAST);
+  suite.batch("batch.quat.axisAngle.fast", type, sizeof(float) + sizeof(Vec3f) + sizeof(Quat), axisAnglesFast);
+  const Vec3f position(1.5f, -2.25f, 3.0f), normal(0.48f, 0.6f, -0.64f);
+  const Quat rotation(30, 0.6f, 0, 0.8f);
+  PackArray<Vec3f, Vec3h> packHalves(position, false), unpackHalves(position, true);
+  suite.batch("batch.pack.vec3h", type, sizeof(Vec3f) + sizeof(Vec3h), packHalves);
+  suite.batch("batch.unpack.vec3h", type, sizeof(Vec3f) + sizeof(Vec3h), unpackHalves);
+  PackArray<Vec3f, OctNormal> packNormals(normal, false), unpackNormals(normal, true);
+  suite.batch("batch.pack.octNormal", type, sizeof(Vec3f) + sizeof(OctNormal), packNormals);
+  suite.batch("batch.unpack.octNormal", type, sizeof(Vec3f) + sizeof(OctNormal), unpackNormals);
+  PackArray<Quat, PackedQuat32> packQuats32(rotation, false), unpackQuats32(rotation, true);
+  suite.batch("batch.pack.quat32", type, sizeof(Quat) + sizeof(PackedQuat32), packQuats32);
+  suite.batch("batch.unpack.quat32", type, sizeof(Quat) + sizeof(PackedQuat32), unpackQuats32);
+  PackArray<Quat, PackedQuat48> packQuats48(rotation, false), unpackQuats48(rotation, true);
+  suite.batch("batch.pack.quat48", type, sizeof(Quat) + sizeof(PackedQuat48), packQuats48);
+  suite.batch("batch.unpack.quat48", type, sizeof(Quat) + sizeof(PackedQuat48), unpackQuats48);
+  MatrixText formatCsv(TextFormat(TEXT_CSV), MatrixText::FORMAT), parseCsv(TextFormat(TEXT_CSV), MatrixText::PARSE);
+  MatrixText formatJson(TextFormat(TEXT_JSON), MatrixText::FORMAT), parseJson(TextFormat(TEXT_JSON), MatrixText::PARSE);
+  MatrixText formatStream(TextFormat(), MatrixText::OSTREAM);
+  suite.batch("batch.format.mat4.csv", type, sizeof(Mat4f), formatCsv);
+  suite.batch("batch.format.mat4.json", type, sizeof(Mat4f), formatJson);
+  suite.batch("batch.format.mat4.ostream", type, sizeof(Mat4f), formatStream);
+  suite.batch("batch.parse.mat4.csv", type, sizeof(Mat4f), parseCsv);
+  suite.batch("batch.parse.mat4.json", type, sizeof(Mat4f), parseJson);
+  Checksum checksum;
+  suite.batch("batch.binary.crc32c", type, sizeof(Mat4f), checksum);
+  Compose3x4 compose;
+  suite.batch("batch.mat3x4.compose", type, 2 * sizeof(Mat3x4f), compose);
+  Inverse3x4 inverse3x4;
+  suite.batch("batch.mat3x4.inverse", type, 2 * sizeof(Mat3x4f), inverse3x4);
+  PhysicsStep physics(false), physicsLazy(true);
+  suite.batch("batch.expr.physics.eager", type, 3 * sizeof(Vec3f), physics);
+  suite.batch("batch.expr.physics.lazy", type, 3 * sizeof(Vec3f), physicsLazy);
+  MatrixChain<float> chain(false), chainLazy(true);
+  suite.batch("batch.expr.pvmv.eager", type, 2 * sizeof(Vec4f), chain);
+  suite.batch("batch.expr.pvmv.lazy", type, 2 * sizeof(Vec4f), chainLazy);
+  MatrixChain<double> chainD(false), chainDLazy(true);
+  suite.batch("batch.expr.pvmv.eager", "double", 2 * sizeof(Vec4d), chainD);
+  suite.batch("batch.expr.pvmv.lazy", "double", 2 * sizeof(Vec4d), chainDLazy);
+  CameraRelative<Mat4f> relative(false), relativeNaive(true);
+  suite.batch("batch.cameraRelative.mat4", "double", sizeof(Mat4d) + sizeof(Mat4f), relative);
+  suite.batch("batch.cameraRelative.mat4.naive", "double", sizeof(Mat4d) + sizeof(Mat4f), relativeNaive);
+  CameraRelative<Mat3x4f> relative3x4(false);
+  suite.batch("batch.cameraRelative.mat3x4", "double", sizeof(Mat4d) + sizeof(Mat3x4f), relative3x4);
+  soaCases<float>(suite);
+  soaCases<double>(suite);
+  const size_t nodeBytes = sizeof(int) + 1 + 2 * sizeof(Vec3f) + sizeof(Quat) + sizeof(Mat4f);
+  TransformUpdate updateAll(1);
+  suite.batch("transform.update.all", type, nodeBytes, updateAll);
+  TransformUpdate updateSparse(20);
+  suite.batch("transform.update.5%", type, nodeBytes, updateSparse);
+  Cull spheres(false, false, false);
+  suite.batch("cull.spheres", type, sizeof(Vec4f), spheres);
+  Cull spheresIndices(false, false, true);
+  suite.batch("cull.spheres.indices", type, sizeof(Vec4f), spheresIndices);
+  Cull spheresGroups(false, true, false);
+  suite.batch("cull.spheres.groups", type, sizeof(Vec4f), spheresGroups);
+  Cull aabbs(true, false, false);
+  suite.batch("cull.aabbs", type, 2 * sizeof(Vec3f), aabbs);
+  Cull aabbsGroups(true, true, false);
+  suite.batch("cull.aabbs.groups", type, 2 * sizeof(Vec3f), aabbsGroups);
+  BvhCase bvhBuild(BvhCase::BUILD);
+  suite.batch("bvh.build", type, sizeof(Vec3f), bvhBuild);
+  BvhCase bvhRefit(BvhCase::REFIT);
+  suite.batch("bvh.refit", type, sizeof(Vec3f), bvhRefit);
+  BvhCase bvhNearest(BvhCase::NEAREST);
+  suite.batch("bvh.nearest8", type, 2 * sizeof(Vec3f), bvhNearest);
+  BvhCase bvhNearestSingle(BvhCase::NEAREST_SINGLE);
+  suite.batch("bvh.nearest8.single", type, 2 * sizeof(Vec3f), bvhNearestSingle);
+  BvhCase bvhRadius(BvhCase::RADIUS);
+  suite.batch("bvh.radius", type, 2 * sizeof(Vec3f), bvhRadius);
+  const size_t trackBytes = 2 * sizeof(Vec3f) + sizeof(Quat) + 3 * sizeof(uint32_t);
+  AnimationCase animationSearch(AnimationCase::SEARCH);
+  suite.batch("animation.sample.search", type, trackBytes, animationSearch);
+  AnimationCase animationTrs(AnimationCase::TRS);
+  suite.batch("animation.sample", type, trackBytes, animationTrs);
+  AnimationCase animationMatrices(AnimationCase::MATRICES);
+  suite.batch("animation.sample.matrices", type, trackBytes + sizeof(Mat4f), animationMatrices);
+  const size_t vertexBytes = 4 * sizeof(Vec3f);
+  SkinCase skinLoop(SkinCase::LOOP, 4);
+  suite.batch("skin.mat4.loop4", type, vertexBytes + 4 * 6, skinLoop);
+  SkinCase skinLinear4(SkinCase::LINEAR, 4);
+  suite.batch("skin.linear4", type, vertexBytes + 4 * 6, skinLinear4);
+  SkinCase skinDualQuat4(SkinCase::DUAL_QUAT, 4);
+  suite.batch("skin.dualQuat4", type, vertexBytes + 4 * 6, skinDualQuat4);
+  SkinCase skinLinear8(SkinCase::LINEAR, 8);
+  suite.batch("skin.linear8", type, vertexBytes + 8 * 6, skinLinear8);
+  SkinCase skinDualQuat8(SkinCase::DUAL_QUAT, 8);
+  suite.batch("skin.dualQuat8", type, vertexBytes + 8 * 6, skinDualQuat8);
+  RayCase rayTriangles(false, 8);
+  suite.batch("ray.triangles.packet8", type, 3 * sizeof(Vec3f), rayTriangles);
+  RayCase rayTriangles4(false, 4);
+  suite.batch("ray.triangles.packet4", type, 3 * sizeof(Vec3f), rayTriangles4);
+  RayCase rayTrianglesSingle(false, 1);
+  suite.batch("ray.triangles.single", type, 3 * sizeof(Vec3f), rayTrianglesSingle);
+  RayCase rayBoxes(true, 8);
+  suite.batch("ray.boxes.packet8", type, 2 * sizeof(Vec3f), rayBoxes);
+  RayCase rayBoxesSingle(true, 1);
+  suite.batch("ray.boxes.single", type, 2 * sizeof(Vec3f), rayBoxesSingle);
+}
+
+//
+// Thread scaling: the batches split in chunks with parallel_for
+//
+
+struct ParallelTransformPoints : TransformPoints<float> {
+  ThreadPool* pool;
+  void operator()(size_t count) {
+    parallel_for(0, count, chunkSize<Vec3f>(), [this](size_t first, size_t last) {
+      transformPoints(M, in + first, out + first, last - first);
+    }, *pool);
+  }
+};
+
+struct ParallelNormalize {
+  Vec3SoA<float> v;
+  ThreadPool* pool;
+  void setup(size_t count) {
+    v.resize(count);
+    for (size_t i = 0 ; i < count ; i++)
+      v.set(i, Vec3f(1, 2, 3));
+  }
+  // Chunks of whole cache lines of each lane
+  void operator()(size_t count) {
+    parallel_for(0, count, chunkSize<float>(), [this](size_t first, size_t last) {
+      detail::soaNormalize3(v.x() + first, (float*) 0, v.getStride(), last - first, PRECISION_EXACT);
+    }, *pool);
+  }
+};
+
+struct ParallelInverse : Mat4Batch<float> {
+  ThreadPool* pool;
+  ParallelInverse() : Mat4Batch<float>(inverseMany) { }
+  void operator()(size_t count) {
+    parallel_for(0, count, chunkSize<Mat4Base<float> >(), [this](size_t first, size_t last) {
+      inverseMany(in + first, out + first, last - first);
+    }, *pool);
+  }
+};
+
+struct ParallelSlerp : ArrayKernel<Quat, Quat> {
+  ThreadPool* pool;
+  Quat target;
+  ParallelSlerp() : ArrayKernel<Quat, Quat>(Quat(30, 0, 1, 0)), target(90, 0.6f, 0, 0.8f) { }
+  void operator()(size_t count) {
+    parallel_for(0, count, chunkSize<Quat>(), [this](size_t first, size_t last) {
+      for (size_t i = first ; i < last ; i++) {
+        Quat a(in[i]), b(target);
+        out[i] = slerp(a, b, 0.3f);
+      }
+    }, *pool);
+  }
+};
+
+void scalingCases(Suite& suite) {
+  const char* type = "float";
+  ParallelTransformPoints points;
+  suite.scaling("parallel.transformPoints", type, 2 * sizeof(Vec3f), points);
+  ParallelNormalize normalize;
+  suite.scaling("parallel.soa.vec3.normalize", type, 3 * sizeof(float), normalize);
+  ParallelInverse inverse;
+  suite.scaling("parallel.mat4.inverse", type, 2 * sizeof(Mat4f), inverse);
+  ParallelSlerp slerps;
+  suite.scaling("parallel.quat.slerp", type, 2 * sizeof(Quat), slerps);
+}
+
+//
+// Output
+//
+
+void printCsv(const std::vector<Result>& results, SimdIsa isa) {
+  printf("benchmark,type,mode,threads,isa,working_set_bytes,elements,ns_per_op,elements_per_s,cycles_per_op\n");
+  for (size_t i = 0 ; i < results.size() ; i++) {
+    const Result& r = results[i];
+    printf("%s,%s,%s,%u,%s,%lu,%.0f,%.4f,%.6g,", r.name.c_str(), r.type, r.mode, r.threads, simdIsaName(isa),
+      (unsigned long) r.workingSet, r.elements, r.nsPerOp, 1e9 / r.nsPerOp);
+    if (r.cyclesPerOp >= 0)
+      printf("%.3f", r.cyclesPerOp);
+    printf("\n");
+  }
+}
+
+void printJson(const std::vector<Result>& results, SimdIsa isa) {
+  printf("{\n  \"isa\": \"%s\",\n  \"results\": [\n", simdIsaName(isa));
+  for (size_t i = 0 ; i < results.size() ; i++) {
+    const Result& r = results[i];
+    printf("    {\"benchmark\": \"%s\", \"type\": \"%s\", \"mode\": \"%s\", \"threads\": %u, \"working_set_bytes\": %lu, "
+      "\"elements\": %.0f, \"ns_per_op\": %.4f, \"elements_per_s\": %.6g, \"cycles_per_op\": ",
+      r.name.c_str(), r.type, r.mode, r.threads, (unsigned long) r.workingSet, r.elements, r.nsPerOp, 1e9 / r.nsPerOp);
+    if (r.cyclesPerOp >= 0)
+      printf("%.3f}", r.cyclesPerOp);
+    else
+      printf("null}");
+    printf(i + 1 < results.size() ? ",\n" : "\n");
+  }
+  printf("  ]\n}\n");
+}
+
+//
+// Accuracy
+//
+
+// Largest relative error of the PRECISION_FAST normalizations on the active
+// instruction set, against double precision, over vectors in every direction
+// with lengths up to 2^60 (documented bound: 2^-21, see config.h)
+double fastNormalizeError() {
+  const size_t count = 1 << 16;
+  std::vector<Vec3f> v(count);
+  std::vector<float> lengths(count);
+  unsigned int seed = 1;
+  for (size_t i = 0 ; i < count ; i++) {
+    float r[3];
+    for (int k = 0 ; k < 3 ; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      r[k] = (seed >> 8) / 8388608.0f - 1.0f;
+    }
+    v[i] = Vec3f(r[0], r[1], r[2]) * std::ldexp(1.0f, (int) (i % 121) - 60);
+  }
+  std::vector<Vec3f> normalized(v);
+  normalizeMany(&normalized[0], count, &lengths[0], PRECISION_FAST);
+  double error = 0;
+  for (size_t i = 0 ; i < count ; i++) {
+    double length = std::sqrt((double) v[i][0] * v[i][0] + (double) v[i][1] * v[i][1] + (double) v[i][2] * v[i][2]);
+    // Shorter vectors are left untouched
+    if (length * length < std::numeric_limits<float>::min())
+      continue;
+    error = std::max(error, std::fabs(lengths[i] - length) / length);
+    for (int k = 0 ; k < 3 ; k++) {
+      double exact = v[i][k] / length;
+      if (std::fabs(exact) > 1e-3)
+        error = std::max(error, std::fabs(normalized[i][k] - exact) / std::fabs(exact));
+    }
+  }
+  return error;
+}
+
+// Largest angle, in radians, between the OctNormal round trips (packMany,
+// unpackMany) on the active instruction set and random unit vectors, a quarter
+// of them close to the z = 0 fold (documented bound: 7e-5, see packed.h)
+double octNormalError() {
+  const size_t count = 1 << 20;
+  std::vector<Vec3f> normals(count), decoded(count);
+  std::vector<OctNormal> packed(count);
+  unsigned int seed = 1;
+  for (size_t i = 0 ; i < count ; i++) {
+    float r[3];
+    for (int k = 0 ; k < 3 ; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      r[k] = (seed >> 8) / 8388608.0f - 1.0f;
+    }
+    if (i % 4 == 0)
+      r[2] *= 1e-3f;
+    float norm = std::sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    normals[i] = (0.0f < norm) ? Vec3f(r[0] / norm, r[1] / norm, r[2] / norm) : Vec3f(0.0f, 0.0f, 1.0f);
+  }
+  packMany(&normals[0], &packed[0], count);
+  unpackMany(&packed[0], &decoded[0], count);
+  double error = 0;
+  for (size_t i = 0 ; i < count ; i++) {
+    double a[3], b[3];
+    for (int k = 0 ; k < 3 ; k++) {
+      a[k] = normals[i][k];
+      b[k] = decoded[i][k];
+    }
+    double cx = a[1] * b[2] - a[2] * b[1], cy = a[2] * b[0] - a[0] * b[2], cz = a[0] * b[1] - a[1] * b[0];
+    double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    error = std::max(error, std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot));
+  }
+  return error;
+}
+
+// Largest component error of the PackedQuat32 and PackedQuat48 round trips
+// (packMany, unpackMany) on the active instruction set, up to the sign of the
+// decoded quaternion, over random unit quaternions, half of them near the
+// worst case (all components 1/2) (documented bounds: 2.1e-3 and 6.6e-5, see
+// packed.h)
+template<typename Packed> double packedQuatError() {
+  const size_t count = 1 << 20;
+  std::vector<Quat> q(count), decoded(count);
+  std::vector<Packed> packed(count);
+  unsigned int seed = 1;
+  for (size_t i = 0 ; i < count ; i++) {
+    float r[4], norm = 0.0f;
+    for (int k = 0 ; k < 4 ; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      r[k] = (seed >> 8) / 8388608.0f - 1.0f;
+      if (i & 1)
+        r[k] = ((k == (int) (i / 2 % 4)) ? -0.5f : 0.5f) + 0.004f * r[k];
+      norm += r[k] * r[k];
+    }
+    norm = std::sqrt(norm);
+    q[i] = Quat::fromComponents(r[0] / norm, r[1] / norm, r[2] / norm, r[3] / norm);
+  }
+  packMany(&q[0], &packed[0], count);
+  unpackMany(&packed[0], &decoded[0], count);
+  double error = 0;
+  for (size_t i = 0 ; i < count ; i++) {
+    float sign = (Quat::dotProduct(q[i], decoded[i]) < 0.0f) ? -1.0f : 1.0f;
+    for (int k = 0 ; k < 4 ; k++)
+      error = std::max(error, std::fabs((double) sign * decoded[i][k] - q[i][k]));
+  }
+  return error;
+}
+
+// Largest component errors of slerpMany (PRECISION_EXACT and PRECISION_FAST)
+// and nlerpMany on the active instruction set, against a long double slerp,
+// over random pairs of unit quaternions, a quarter of them nearly the same
+// rotation, with random t in [0, 1] (documented bounds: 5e-7, 4e-4 and 0.0711,
+// see quat.h)
+struct SlerpErrors {
+  double exact;
+  double fast;
+  double nlerp;
+};
+
+SlerpErrors slerpErrors() {
+  const size_t count = 1 << 20;
+  std::vector<Quat> a(count), b(count), blended(count);
+  std::vector<float> t(count);
+  unsigned int seed = 1;
+  for (size_t i = 0 ; i < count ; i++) {
+    float r[9], normA = 0.0f, normB = 0.0f;
+    for (int k = 0 ; k < 9 ; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      r[k] = (seed >> 8) / 8388608.0f - 1.0f;
+    }
+    for (int k = 0 ; k < 4 ; k++) {
+      if (i % 4 == 0)
+        r[4 + k] = r[k] + 1e-3f * r[4 + k];
+      normA += r[k] * r[k];
+      normB += r[4 + k] * r[4 + k];
+    }
+    normA = std::sqrt(normA);
+    normB = std::sqrt(normB);
+    a[i] = Quat::fromComponents(r[0] / normA, r[1] / normA, r[2] / normA, r[3] / normA);
+    b[i] = Quat::fromComponents(r[4] / normB, r[5] / normB, r[6] / normB, r[7] / normB);
+    t[i] = 0.5f * (r[8] + 1.0f);
+  }
+  SlerpErrors errors = {0, 0, 0};
+  for (int method = 0 ; method < 3 ; method++) {
+    if (method == 2)
+      nlerpMany(&a[0], &b[0], &t[0], &blended[0], count);
+    else
+      slerpMany(&a[0], &b[0], &t[0], &blended[0], count, method ? PRECISION_FAST : PRECISION_EXACT);
+    double error = 0;
+    for (size_t i = 0 ; i < count ; i++) {
+      long double d = 0, sign = 1;
+      for (int k = 0 ; k < 4 ; k++)
+        d += (long double) a[i][k] * b[i][k];
+      if (d < 0) {
+        d = -d;
+        sign = -1;
+      }
+      long double theta = std::acos(std::min(d, (long double) 1)), s = std::sin(theta);
+      long double wa = 1 - t[i], wb = t[i];
+      if (s > 1e-12L) {
+        wa = std::sin((1 - t[i]) * theta) / s;
+        wb = std::sin(t[i] * theta) / s;
+      }
+      for (int k = 0 ; k < 4 ; k++)
+        error = std::max(error, (double) std::fabs(blended[i][k] - (sign * wa * a[i][k] + wb * b[i][k])));
+    }
+    (method == 0 ? errors.exact : method == 1 ? errors.fast : errors.nlerp) = error;
+  }
+  return errors;
+}
+
+// Largest absolute errors of the PRECISION_FAST trigonometry array forms on
+// the active instruction set, against double precision libm, over 2^20
+// inputs each: sin and cos for |x| <= 8192, acos over floats evenly spaced in
+// [-1, 1] and atan2 over every direction (documented bounds: 8e-8, 4.4e-7 and
+// 3e-7, see fastmath.h)
+struct TrigErrors {
+  double sincos;
+  double acos;
+  double atan2;
+};
+
+TrigErrors fastTrigErrors() {
+  const size_t count = 1 << 20;
+  std::vector<float> x(count), y(count), a(count), b(count);
+  TrigErrors errors = {0, 0, 0};
+  for (size_t i = 0 ; i < count ; i++)
+    x[i] = 16384.0f * ((float) i / count - 0.5f);
+  fast::sincosMany(&x[0], &a[0], &b[0], count);
+  for (size_t i = 0 ; i < count ; i++) {
+    errors.sincos = std::max(errors.sincos, std::fabs(a[i] - std::sin((double) x[i])));
+    errors.sincos = std::max(errors.sincos, std::fabs(b[i] - std::cos((double) x[i])));
+  }
+  // Every float of [0, 1] is 0x3f800001 bit patterns: even steps over them,
+  // both signs
+  for (size_t i = 0 ; i < count ; i++) {
+    uint32_t bits = (uint32_t) ((uint64_t) 0x3f800000 * (i / 2) / (count / 2 - 1)) | ((i & 1) ? 0x80000000u : 0);
+    memcpy(&x[i], &bits, sizeof(float));
+  }
+  fast::acosMany(&x[0], &a[0], count);
+  for (size_t i = 0 ; i < count ; i++)
+    errors.acos = std::max(errors.acos, std::fabs(a[i] - std::acos((double) x[i])));
+  // Directions of all angles, with lengths from 2^-20 to 2^20
+  const double pi = 3.14159265358979323846;
+  for (size_t i = 0 ; i < count ; i++) {
+    double angle = 2.0 * pi * (double) i / count - pi;
+    double length = std::ldexp(1.0, (int) (i % 41) - 20);
+    x[i] = (float) (length * std::cos(angle));
+    y[i] = (float) (length * std::sin(angle));
+  }
+  fast::atan2Many(&y[0], &x[0], &a[0], count);
+  for (size_t i = 0 ; i < count ; i++)
+    errors.atan2 = std::max(errors.atan2, std::fabs(a[i] - std::atan2((double) y[i], (double) x[i])));
+  return errors;
+}
+
+// Number of batched BVH query results (16 nearest, radius 2, over 2^14
+// probes) that differ from the single queries, summed over every instruction
+// set the CPU supports (documented: none, see bvh.h)
+size_t bvhMismatches() {
+  const size_t count = 1 << 14, k = 16, maxPerQuery = 64;
+  BvhCase points(BvhCase::NEAREST);
+  points.setup(count);
+  const Bvh& bvh = points.bvh;
+  const std::vector<Vec3f>& probes = points.probes;
+  std::vector<uint32_t> ids(k * count), radiusIds(maxPerQuery * count), batchIds(maxPerQuery * count);
+  std::vector<float> distances(k * count), batchDistances(k * count);
+  std::vector<size_t> counts(count), batchCounts(count);
+  for (size_t i = 0 ; i < count ; i++) {
+    size_t found = bvh.nearest(probes[i], k, &ids[k * i], &distances[k * i]);
+    for (size_t s = found ; s < k ; s++) {
+      ids[k * i + s] = Bvh::NONE;
+      distances[k * i + s] = INFINITY;
+    }
+    counts[i] = bvh.queryRadius(probes[i], 2.0f, &radiusIds[maxPerQuery * i], maxPerQuery);
+  }
+  SimdIsa active = simdIsa();
+  size_t mismatches = 0;
+  for (int isa = 0 ; isa <= detectSimdIsa() ; isa++) {
+    setSimdIsa((SimdIsa) isa);
+    bvh.nearest(&probes[0], count, k, &batchIds[0], &batchDistances[0]);
+    for (size_t i = 0 ; i < k * count ; i++)
+      mismatches += (batchIds[i] != ids[i] || batchDistances[i] != distances[i]);
+    bvh.queryRadius(&probes[0], count, 2.0f, maxPerQuery, &batchIds[0], &batchCounts[0]);
+    for (size_t i = 0 ; i < count ; i++) {
+      if (batchCounts[i] != counts[i]) {
+        mismatches++;
+        continue;
+      }
+      for (size_t s = 0 ; s < std::min(counts[i], maxPerQuery) ; s++)
+        mismatches += (batchIds[maxPerQuery * i + s] != radiusIds[maxPerQuery * i + s]);
+    }
+  }
+  setSimdIsa(active);
+  return mismatches;
+}
+
+// Objects of cullSpheres and cullAabbs (both flat and by groups of 64 for
+// the boxes) classified differently than by Frustum::testSphere and
+// Frustum::testAabb, on every instruction set without FMA up to the detected
+// one, over random objects touching the planes of the Cull frustum within a
+// few ulps (documented: none, see frustum.h)
+size_t cullMismatches() {
+  const size_t count = 1 << 16;
+  Cull boxes(true, true, false);
+  boxes.setup(count);
+  const Frustum& F = boxes.frustum;
+  Vec4SoA<float>& spheres = boxes.spheres;
+  unsigned int seed = 1;
+  for (size_t i = 0 ; i < count ; i++) {
+    float r[5];
+    for (int k = 0 ; k < 5 ; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      r[k] = (seed >> 8) / 16777216.0f;
+    }
+    // Center at distance -|n|.e or -radius (plus a few ulps) of plane i % 6
+    const Vec4f& plane = F[i % Frustum::PLANE_COUNT];
+    Vec3f n(plane[0], plane[1], plane[2]), p(200 * r[0] - 100, 200 * r[1] - 100, 200 * r[2] - 100);
+    float radius = 0.1f + r[3], offset = (r[4] - 0.5f) * 4e-5f;
+    float extent = radius * (std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]));
+    Vec3f box = p - n * (F.distance(i % Frustum::PLANE_COUNT, p) + extent + offset);
+    Vec3f sphere = p - n * (F.distance(i % Frustum::PLANE_COUNT, p) + radius + offset);
+    spheres.set(i, Vec4f(sphere[0], sphere[1], sphere[2], radius));
+    boxes.min.set(i, box - Vec3f(radius, radius, radius));
+    boxes.max.set(i, box + Vec3f(radius, radius, radius));
+  }
+  groupBounds(boxes.min, boxes.max, 64, boxes.groupMin, boxes.groupMax);
+  std::vector<bool> sphereVisible(count), boxVisible(count);
+  for (size_t i = 0 ; i < count ; i++) {
+    Vec4f s = spheres.get(i);
+    sphereVisible[i] = F.testSphere(Vec3f(s[0], s[1], s[2]), s[3]);
+    boxVisible[i] = F.testAabb(boxes.min.get(i), boxes.max.get(i));
+  }
+  SimdIsa active = simdIsa();
+  size_t mismatches = 0;
+  for (int isa = 0 ; isa <= std::min((int) detectSimdIsa(), (int) SIMD_AVX) ; isa++) {
+    setSimdIsa((SimdIsa) isa);
+    std::vector<uint32_t>& mask = boxes.mask;
+    cullSpheres(F, spheres, &mask[0]);
+    for (size_t i = 0 ; i < count ; i++)
+      mismatches += (((mask[i / 32] >> (i % 32)) & 1) != sphereVisible[i]);
+    cullAabbs(F, boxes.min, boxes.max, &mask[0]);
+    for (size_t i = 0 ; i < count ; i++)
+      mismatches += (((mask[i / 32] >> (i % 32)) & 1) != boxVisible[i]);
+    cullAabbs(F, boxes.min, boxes.max, boxes.groupMin, boxes.groupMax, 64, &mask[0]);
+    for (size_t i = 0 ; i < count ; i++)
+      mismatches += (((mask[i / 32] >> (i % 32)) & 1) != boxVisible[i]);
+  }
+  setSimdIsa(active);
+  return mismatches;
+}
+
+// Numbers not read back bit for bit by parseMany from the text of formatMany,
+// CSV and JSON, over matrices of random finite bit patterns (documented:
+// exact round trips, see format.h)
+template<typename T> size_t textMismatches() {
+  const size_t count = 1 << 15;
+  std::vector<Mat4Base<T> > in(count), out(count);
+  uint64_t seed = 1;
+  for (size_t i = 0 ; i < count ; i++) {
+    for (int j = 0 ; j < 16 ; j++) {
+      T x;
+      do {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t bits = seed >> (64 - 8 * sizeof(T));
+        memcpy(&x, &bits, sizeof(T));
+      } while (!std::isfinite(x));
+      in[i][j] = x;
+    }
+  }
+  std::vector<char> text(count * 16 * (detail::TextTraits<T>::SIZE + 4));
+  size_t mismatches = 0;
+  for (int layout = TEXT_CSV ; layout <= TEXT_JSON ; layout++) {
+    TextFormat f((TextLayout) layout);
+    size_t length;
+    size_t written = formatMany(&text[0], text.size(), &in[0], count, length, f);
+    if (written != count || !parseMany(&text[0], &text[0] + length, &out[0], count, f))
+      return count * 16;
+    for (size_t i = 0 ; i < count ; i++)
+      for (int j = 0 ; j < 16 ; j++)
+        mismatches += (memcmp(&in[i][j], &out[i][j], sizeof(T)) != 0);
+  }
+  return mismatches;
+}
+
+// Largest errors of the general inverses and determinants, single matrix
+// (Mat4::inverse, Mat4::determinant) and batched (inverseMany,
+// determinantMany), on the active instruction set, against long double
+// Gauss-Jordan elimination, over random diagonally dominant matrices: inverse
+// errors relative to the largest element of the exact inverse, determinant
+// errors relative to the exact determinant (documented: 1e-6 for float and
+// 2e-15 for double, see mat4.h)
+struct InverseErrors {
+  double inverse;
+  double determinant;
+  double inverseMany;
+  double determinantMany;
+};
+
+template<typename T> InverseErrors inverseErrors() {
+  const size_t count = 1 << 16;
+  std::vector<Mat4Base<T> > m(count), inverses(count);
+  std::vector<T> determinants(count);
+  std::vector<long double> exact(17 * count);
+  unsigned int seed = 1;
+  for (size_t i = 0 ; i < count ; i++) {
+    for (int k = 0 ; k < 16 ; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      // Diagonal in [3, 5], other elements in [-1, 1]
+      m[i][k] = T((seed >> 8) / 8388608.0 - 1.0) + ((k % 5 == 0) ? T(4) : T(0));
+    }
+    // [m | I] reduced to [I | m^-1], partial pivoting, det from the pivots
+    long double a[4][8], det = 1;
+    for (int r = 0 ; r < 4 ; r++)
+      for (int c = 0 ; c < 8 ; c++)
+        a[r][c] = (c < 4) ? (long double) m[i][4*c + r] : (long double) (c - 4 == r);
+    for (int c = 0 ; c < 4 ; c++) {
+      int pivot = c;
+      for (int r = c + 1 ; r < 4 ; r++)
+        if (std::fabs(a[r][c]) > std::fabs(a[pivot][c]))
+          pivot = r;
+      if (pivot != c) {
+        std::swap(a[pivot], a[c]);
+        det = -det;
+      }
+      det *= a[c][c];
+      for (int k = 7 ; k >= c ; k--)
+        a[c][k] /= a[c][c];
+      for (int r = 0 ; r < 4 ; r++)
+        for (int k = 7 ; r != c && k >= c ; k--)
+          a[r][k] -= a[r][c] * a[c][k];
+    }
+    for (int r = 0 ; r < 4 ; r++)
+      for (int c = 0 ; c < 4 ; c++)
+        exact[17 * i + 4*c + r] = a[r][c + 4];
+    exact[17 * i + 16] = det;
+  }
+  InverseErrors errors = {0, 0, 0, 0};
+  for (int single = 0 ; single < 2 ; single++) {
+    if (single) {
+      for (size_t i = 0 ; i < count ; i++) {
+        inverses[i] = Mat4<T>(m[i]).inverse();
+        determinants[i] = Mat4<T>(m[i]).determinant();
+      }
+    } else {
+      inverseMany(&m[0], &inverses[0], count);
+      determinantMany(&m[0], &determinants[0], count);
+    }
+    double inverse = 0, determinant = 0;
+    for (size_t i = 0 ; i < count ; i++) {
+      const long double* e = &exact[17 * i];
+      long double largest = 0;
+      for (int k = 0 ; k < 16 ; k++)
+        largest = std::max(largest, std::fabs(e[k]));
+      for (int k = 0 ; k < 16 ; k++)
+        inverse = std::max(inverse, (double) (std::fabs(inverses[i][k] - e[k]) / largest));
+      determinant = std::max(determinant, (double) (std::fabs(determinants[i] - e[16]) / std::fabs(e[16])));
+    }
+    (single ? errors.inverse : errors.inverseMany) = inverse;
+    (single ? errors.determinant : errors.determinantMany) = determinant;
+  }
+  return errors;
+}
+
+// Largest error, in world units, of points up to 10 units from objects up
+// to 400 units from a camera far from the world origin, transformed by the
+// float camera-relative matrices (naive conversion or cameraRelativeMany),
+// against double precision
+double cameraRelativeError(bool naive) {
+  const size_t count = 1 << 12;
+  std::vector<Mat4d> worlds(count);
+  std::vector<Mat4f> relative(count);
+  for (size_t i = 0 ; i < count ; i++)
+    worlds[i] = worldMatrix(i);
+  if (naive)
+    naiveRelative(&worlds[0], CAMERA_POSITION, &relative[0], count);
+  else
+    cameraRelativeMany(&worlds[0], CAMERA_POSITION, &relative[0], count);
+  double error = 0;
+  for (size_t i = 0 ; i < count ; i++) {
+    Vec3d p((double) (i % 21) - 10.0, 0.5 * (double) (i % 7), -3.25);
+    Vec4d exact = worlds[i] * Vec4d(p[0], p[1], p[2], 1.0);
+    Vec4f local = relative[i] * Vec4f((float) p[0], (float) p[1], (float) p[2], 1.0f);
+    for (int k = 0 ; k < 3 ; k++)
+      error = std::max(error, std::fabs((exact[k] - CAMERA_POSITION[k]) - (double) local[k]));
+  }
+  return error;
+}
+
+//
+// Command line
+//
+
+// "16K", "8M", "1G" or a plain number of bytes
+bool parseSize(const char* text, size_t& size) {
+  char* end = 0;
+  double value = strtod(text, &end);
+  if (end == text || value <= 0)
+    return false;
+  switch (*end) {
+    case 'k': case 'K': value *= 1024; end++; break;
+    case 'm': case 'M': value *= 1024 * 1024; end++; break;
+    case 'g': case 'G': value *= 1024 * 1024 * 1024; end++; break;
+  }
+  size = (size_t) value;
+  return *end == '\0';
+}
+
+bool parseSizes(const char* text, std::vector<size_t>& sizes) {
+  sizes.clear();
+  std::string list(text);
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t comma = list.find(',', start);
+    if (comma == std::string::npos)
+      comma = list.size();
+    size_t size = 0;
+    if (!parseSize(list.substr(start, comma - start).c_str(), size))
+      return false;
+    sizes.push_back(size);
+    start = comma + 1;
+  }
+  return !sizes.empty();
+}
+
+// simdIsaName() names, or avx2 for avx2+fma
+bool parseIsa(const char* name, SimdIsa& isa) {
+  if (!strcmp(name, "avx2"))
+    name = simdIsaName(SIMD_AVX2_FMA);
+  for (int i = 0 ; i < SIMD_ISA_COUNT ; i++) {
+    if (!strcmp(name, simdIsaName((SimdIsa) i))) {
+      isa = (SimdIsa) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the cases named name run with --filter=filter (0 for all)
+bool matches(const char* filter, const char* name) {
+  return !filter || std::string(name).find(filter) != std::string::npos;
+}
+
+int usage(const char* program) {
+  fprintf(stderr,
+    "usage: %s [--format=csv|json] [--mode=latency|throughput|scaling|all] [--filter=text]\n"
+    "          [--isa=scalar|sse2|avx|avx2+fma] [--sizes=16K,256K,8M,128M] [--min-time=ms]\n"
+    "          [--threads=N]\n",
+    program);
+  return 2;
+}
+
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  options.json = false;
+  options.modes = LATENCY | THROUGHPUT | SCALING;
+  options.maxThreads = ThreadPool::global().size();
+  options.filter = 0;
+  options.minTime = 0.02;
+  parseSizes("16K,256K,8M,128M", options.sizes);
+
+  for (int i = 1 ; i < argc ; i++) {
+    const char* arg = argv[i];
+    const char* value = strchr(arg, '=');
+    std::string key(arg, value ? value - arg : strlen(arg));
+    if (value)
+      value++;
+    if (key == "--format" && value && (!strcmp(value, "csv") || !strcmp(value, "json"))) {
+      options.json = !strcmp(value, "json");
+    } else if (key == "--mode" && value && !strcmp(value, "latency")) {
+      options.modes = LATENCY;
+    } else if (key == "--mode" && value && !strcmp(value, "throughput")) {
+      options.modes = THROUGHPUT;
+    } else if (key == "--mode" && value && !strcmp(value, "scaling")) {
+      options.modes = SCALING;
+    } else if (key == "--mode" && value && !strcmp(value, "all")) {
+      options.modes = LATENCY | THROUGHPUT | SCALING;
+    } else if (key == "--threads" && value && atoi(value) > 0) {
+      options.maxThreads = (unsigned) atoi(value);
+    } else if (key == "--filter" && value) {
+      options.filter = value;
+    } else if (key == "--min-time" && value && atof(value) > 0) {
+      options.minTime = atof(value) / 1000;
+    } else if (key == "--sizes" && value && parseSizes(value, options.sizes)) {
+    } else if (key == "--isa" && value) {
+      SimdIsa isa;
+      if (!parseIsa(value, isa)) {
+        fprintf(stderr, "bench: unknown instruction set %s\n", value);
+        return 2;
+      }
+      if (setSimdIsa(isa) != isa) {
+        fprintf(stderr, "bench: %s is not supported by this CPU\n", simdIsaName(isa));
+        return 1;
+      }
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  Suite suite(options);
+  vectorCases<float>(suite);
+  vectorCases<double>(suite);
+  matrixCases<float>(suite);
+  matrixCases<double>(suite);
+  floatCases(suite);
+  batchCases(suite);
+  scalingCases(suite);
+
+  if (options.json)
+    printJson(suite.getResults(), simdIsa());
+  else
+    printCsv(suite.getResults(), simdIsa());
+
+  if (matches(options.filter, "batch.normalize.fast")) {
+    double error = fastNormalizeError(), bound = std::ldexp(1.0, -21);
+    fprintf(stderr, "bench: fast normalize max relative error %.3g (bound %.3g)\n", error, bound);
+    if (error > bound)
+      return 1;
+  }
+  if (matches(options.filter, "batch.quat.slerp") || matches(options.filter, "batch.quat.nlerp")) {
+    SlerpErrors errors = slerpErrors();
+    fprintf(stderr, "bench: quat blend max component error slerp %.3g (bound 5e-7), slerp fast %.3g (bound 4e-4), "
+      "nlerp %.3g (bound 0.0711)\n", errors.exact, errors.fast, errors.nlerp);
+    if (errors.exact > 5e-7 || errors.fast > 4e-4 || errors.nlerp > 0.0711)
+      return 1;
+  }
+  if (matches(options.filter, "batch.fast.sincos") || matches(options.filter, "batch.fast.acos")
+      || matches(options.filter, "batch.fast.atan2")) {
+    TrigErrors errors = fastTrigErrors();
+    fprintf(stderr, "bench: fast trig max error sin/cos %.3g (bound 8e-8), acos %.3g (bound 4.4e-7), "
+      "atan2 %.3g (bound 3e-7)\n", errors.sincos, errors.acos, errors.atan2);
+    if (errors.sincos > 8e-8 || errors.acos > 4.4e-7 || errors.atan2 > 3e-7)
+      return 1;
+  }
+  if (matches(options.filter, "batch.unpack.octNormal")) {
+    double error = octNormalError();
+    fprintf(stderr, "bench: octahedral normal max angle error %.3g (bound 7e-5)\n", error);
+    if (error > 7e-5)
+      return 1;
+  }
+  if (matches(options.filter, "batch.unpack.quat32") || matches(options.filter, "batch.unpack.quat48")) {
+    double error32 = packedQuatError<PackedQuat32>(), error48 = packedQuatError<PackedQuat48>();
+    fprintf(stderr, "bench: packed quat max component error quat32 %.3g (bound 2.1e-3), quat48 %.3g "
+      "(bound 6.6e-5)\n", error32, error48);
+    if (error32 > 2.1e-3 || error48 > 6.6e-5)
+      return 1;
+  }
+  if (matches(options.filter, "mat4.inverse") || matches(options.filter, "mat4.determinant")) {
+    InverseErrors f = inverseErrors<float>(), d = inverseErrors<double>();
+    fprintf(stderr, "bench: mat4 inverse/determinant max relative error float single %.3g/%.3g, batched "
+      "%.3g/%.3g (bound 1e-6), double single %.3g/%.3g, batched %.3g/%.3g (bound 2e-15)\n", f.inverse,
+      f.determinant, f.inverseMany, f.determinantMany, d.inverse, d.determinant, d.inverseMany,
+      d.determinantMany);
+    if (std::max(std::max(f.inverse, f.determinant), std::max(f.inverseMany, f.determinantMany)) > 1e-6
+        || std::max(std::max(d.inverse, d.determinant), std::max(d.inverseMany, d.determinantMany)) > 2e-15)
+      return 1;
+  }
+  if (matches(options.filter, "cull.spheres") || matches(options.filter, "cull.aabbs")) {
+    size_t mismatches = cullMismatches();
+    fprintf(stderr, "bench: culling kernels differing from the single object tests %lu (bound 0)\n",
+      (unsigned long) mismatches);
+    if (mismatches != 0)
+      return 1;
+  }
+  if (matches(options.filter, "batch.format.mat4.csv") || matches(options.filter, "batch.format.mat4.json")
+      || matches(options.filter, "batch.parse.mat4.csv") || matches(options.filter, "batch.parse.mat4.json")) {
+    size_t floats = textMismatches<float>(), doubles = textMismatches<double>();
+    fprintf(stderr, "bench: text round trips not exact float %lu, double %lu (bound 0)\n",
+      (unsigned long) floats, (unsigned long) doubles);
+    if (floats != 0 || doubles != 0)
+      return 1;
+  }
+  if (matches(options.filter, "bvh.nearest8") || matches(options.filter, "bvh.radius")) {
+    size_t mismatches = bvhMismatches();
+    fprintf(stderr, "bench: bvh batched results differing from single queries %lu (bound 0)\n",
+      (unsigned long) mismatches);
+    if (mismatches != 0)
+      return 1;
+  }
+  if (matches(options.filter, "batch.cameraRelative"))
+    fprintf(stderr, "bench: camera-relative max position error %.3g (naive conversion %.3g)\n",
+      cameraRelativeError(false), cameraRelativeError(true));
+  return 0;
+}
@@ -0,0 +1,349 @@
+#include "binary.h"
+
+#include <cstring>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "memory.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+const char MAGIC[8] = {'Q', 'M', 'B', 'I', 'N', 0, 0, 0};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint64_t ALIGNMENT = CACHE_LINE_SIZE;
+
+static_assert(sizeof(BinaryHeader) == 64 && sizeof(BinarySection) == 64, "binary records must be 64 bytes");
+
+/**
+ * CRC-32C tables for slicing by 8 bytes: table[k][b] is the CRC of byte b
+ * followed by k zero bytes.
+ */
+struct Crc32cTables {
+  uint32_t table[8][256];
+
+  Crc32cTables() {
+    for (uint32_t b = 0 ; b < 256 ; b++) {
+      uint32_t crc = b;
+      for (int bit = 0 ; bit < 8 ; bit++)
+        crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78u : 0);
+      table[0][b] = crc;
+    }
+    for (uint32_t b = 0 ; b < 256 ; b++)
+      for (int k = 1 ; k < 8 ; k++)
+        table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+  }
+};
+
+const Crc32cTables& crcTables() {
+  static const Crc32cTables tables;
+  return tables;
+}
+
+inline uint64_t alignUp(uint64_t offset) {
+  return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+#if QM_SIMD_X86
+// The SSE4.2 crc32 instruction computes CRC-32C. Every CPU with AVX has it.
+QM_TARGET("sse4.2") uint32_t crc32cSse42(const uint8_t* p, size_t bytes, uint32_t crc) {
+#if defined(__x86_64__)
+  uint64_t wide = crc;
+  for ( ; bytes >= 8 ; bytes -= 8, p += 8) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+  crc = (uint32_t) wide;
+#endif
+  for ( ; bytes >= 4 ; bytes -= 4, p += 4) {
+    uint32_t word;
+    std::memcpy(&word, p, sizeof(word));
+    crc = _mm_crc32_u32(crc, word);
+  }
+  for ( ; bytes > 0 ; bytes--, p++)
+    crc = _mm_crc32_u8(crc, *p);
+  return crc;
+}
+#endif
+
+uint32_t headerChecksum(const BinaryHeader& header) {
+  return crc32c(&header, offsetof(BinaryHeader, headerChecksum));
+}
+
+}
+
+namespace qm {
+
+size_t binaryTypeSize(BinaryType type) {
+  static const size_t sizes[BINARY_TYPE_COUNT] = {
+    1, sizeof(float), sizeof(double), sizeof(Vec3f), sizeof(Quat), sizeof(Mat4f), sizeof(Mat3x4f)
+  };
+  return (type < BINARY_TYPE_COUNT) ? sizes[type] : 0;
+}
+
+uint32_t crc32c(const void* data, size_t bytes, uint32_t crc) {
+  const uint8_t* p = (const uint8_t*) data;
+  crc = ~crc;
+#if QM_SIMD_X86
+  if (simdIsa() >= SIMD_AVX)
+    return ~crc32cSse42(p, bytes, crc);
+#endif
+  const uint32_t (*t)[256] = crcTables().table;
+  // 8 bytes at a time, read as little endian
+  for ( ; bytes >= 8 ; bytes -= 8, p += 8) {
+    uint32_t low = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24);
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+      t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+  }
+  for ( ; bytes > 0 ; bytes--, p++)
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+  return ~crc;
+}
+
+// BinaryWriter
+
+BinaryWriter::BinaryWriter() :
+  file(0), offset(0), failed(false), inSection(false), sections(0), sectionCount(0), capacity(0) {
+}
+
+BinaryWriter::~BinaryWriter() {
+  close();
+  delete[] sections;
+}
+
+bool BinaryWriter::open(const char* path) {
+  close();
+  file = std::fopen(path, "wb");
+  offset = 0;
+  failed = (file == 0);
+  inSection = false;
+  sectionCount = 0;
+  // Room for the header, written by close()
+  BinaryHeader header;
+  std::memset(&header, 0, sizeof(header));
+  return writeBytes(&header, sizeof(header));
+}
+
+bool BinaryWriter::close() {
+  if (!file)
+    return false;
+  if (inSection)
+    endSection();
+  BinaryHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.tableOffset = offset;
+  writeBytes(sections, sectionCount * sizeof(BinarySection));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.byteOrder = BYTE_ORDER_MARK;
+  header.versionMajor = BINARY_VERSION_MAJOR;
+  header.versionMinor = BINARY_VERSION_MINOR;
+  header.fileSize = offset;
+  header.sectionCount = sectionCount;
+  header.tableChecksum = crc32c(sections, sectionCount * sizeof(BinarySection));
+  header.headerChecksum = headerChecksum(header);
+  if (!failed && std::fseek(file, 0, SEEK_SET) == 0)
+    writeBytes(&header, sizeof(header));
+  else
+    failed = true;
+  if (std::fclose(file) != 0)
+    failed = true;
+  file = 0;
+  return !failed;
+}
+
+bool BinaryWriter::beginSection(const char* name, BinaryType type) {
+  if (!file || failed || inSection || std::strlen(name) >= BINARY_NAME_SIZE || binaryTypeSize(type) == 0)
+    return false;
+  if (sectionCount == capacity) {
+    capacity = (capacity == 0) ? 16 : 2 * capacity;
+    BinarySection* grown = new BinarySection[capacity];
+    if (sectionCount > 0)
+      std::memcpy(grown, sections, sectionCount * sizeof(BinarySection));
+    delete[] sections;
+    sections = grown;
+  }
+  BinarySection& s = sections[sectionCount];
+  std::memset(&s, 0, sizeof(s));
+  std::strcpy(s.name, name);
+  s.type = type;
+  s.lanes = 1;
+  s.offset = offset;
+  inSection = true;
+  return true;
+}
+
+bool BinaryWriter::append(const void* elements, size_t count) {
+  if (!inSection || failed)
+    return false;
+  BinarySection& s = sections[sectionCount];
+  size_t bytes = count * binaryTypeSize((BinaryType) s.type);
+  s.checksum = crc32c(elements, bytes, s.checksum);
+  s.count += count;
+  return writeBytes(elements, bytes);
+}
+
+bool BinaryWriter::endSection() {
+  if (!inSection)
+    return false;
+  inSection = false;
+  BinarySection& s = sections[sectionCount++];
+  if (s.lanes == 1)
+    s.stride = s.count;
+  return pad();
+}
+
+bool BinaryWriter::writeSoA(const char* name, const float* data, int lanes, size_t count, size_t stride) {
+  if (!beginSection(name, BINARY_FLOAT))
+    return false;
+  // Every lane with its padding, so that views keep the SIMD alignment
+  bool written = append(data, lanes * stride);
+  BinarySection& s = sections[sectionCount];
+  s.lanes = lanes;
+  s.count = count;
+  s.stride = stride;
+  return endSection() && written;
+}
+
+bool BinaryWriter::writeBytes(const void* data, size_t bytes) {
+  if (failed || !file)
+    return false;
+  if (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes)
+    failed = true;
+  offset += bytes;
+  return !failed;
+}
+
+// Zeros up to the next aligned offset
+bool BinaryWriter::pad() {
+  static const uint8_t zeros[ALIGNMENT] = {0};
+  return writeBytes(zeros, (size_t) (alignUp(offset) - offset));
+}
+
+// BinaryReader
+
+BinaryReader::BinaryReader() :
+  base(0), mappedSize(0), sections(0), sectionCount(0)
+#if defined(_WIN32)
+  , fileHandle(0), mappingHandle(0)
+#endif
+{
+}
+
+BinaryReader::~BinaryReader() {
+  close();
+}
+
+bool BinaryReader::open(const char* path, bool verifySections) {
+  close();
+#if defined(_WIN32)
+  HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if (f == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  HANDLE mapping = 0;
+  if (GetFileSizeEx(f, &size) && size.QuadPart >= (LONGLONG) sizeof(BinaryHeader) &&
+      (uint64_t) size.QuadPart <= (size_t) -1)
+    mapping = CreateFileMappingA(f, 0, PAGE_READONLY, 0, 0, 0);
+  if (mapping)
+    base = (const uint8_t*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!base) {
+    if (mapping)
+      CloseHandle(mapping);
+    CloseHandle(f);
+    return false;
+  }
+  fileHandle = f;
+  mappingHandle = mapping;
+  mappedSize = (size_t) size.QuadPart;
+#else
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  void* mapped = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size >= (off_t) sizeof(BinaryHeader) &&
+      (uint64_t) info.st_size <= (size_t) -1)
+    mapped = mmap(0, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping keeps the file alive
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+  base = (const uint8_t*) mapped;
+  mappedSize = (size_t) info.st_size;
+#endif
+  bool valid = check();
+  for (size_t i = 0 ; valid && verifySections && i < sectionCount ; i++)
+    valid = verify(sections[i]);
+  if (!valid)
+    close();
+  return valid;
+}
+
+void BinaryReader::close() {
+  if (!base)
+    return;
+#if defined(_WIN32)
+  UnmapViewOfFile(base);
+  CloseHandle((HANDLE) mappingHandle);
+  CloseHandle((HANDLE) fileHandle);
+  fileHandle = mappingHandle = 0;
+#else
+  munmap((void*) base, mappedSize);
+#endif
+  base = 0;
+  mappedSize = 0;
+  sections = 0;
+  sectionCount = 0;
+}
+
+const BinarySection* BinaryReader::find(const char* name) const {
+  for (size_t i = 0 ; i < sectionCount ; i++)
+    if (std::strncmp(sections[i].name, name, BINARY_NAME_SIZE) == 0)
+      return sections + i;
+  return 0;
+}
+
+bool BinaryReader::verify(const BinarySection& section) const {
+  size_t bytes = (size_t) (section.lanes * section.stride * binaryTypeSize((BinaryType) section.type));
+  return crc32c(data(section), bytes) == section.checksum;
+}
+
+// Header, table and section bounds; sections must not reach into the table
+bool BinaryReader::check() {
+  BinaryHeader header;
+  std::memcpy(&header, base, sizeof(header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.byteOrder != BYTE_ORDER_MARK ||
+      header.versionMajor != BINARY_VERSION_MAJOR || header.headerChecksum != headerChecksum(header) ||
+      header.fileSize != mappedSize)
+    return false;
+  uint64_t tableEnd = header.tableOffset + header.sectionCount * sizeof(BinarySection);
+  if (header.tableOffset % ALIGNMENT != 0 || header.tableOffset < sizeof(BinaryHeader) ||
+      header.sectionCount > mappedSize / sizeof(BinarySection) || tableEnd > mappedSize)
+    return false;
+  const BinarySection* table = (const BinarySection*) (base + header.tableOffset);
+  if (crc32c(table, (size_t) (header.sectionCount * sizeof(BinarySection))) != header.tableChecksum)
+    return false;
+  for (uint64_t i = 0 ; i < header.sectionCount ; i++) {
+    const BinarySection& s = table[i];
+    uint64_t size = binaryTypeSize((BinaryType) s.type);
+    uint64_t limit = header.tableOffset - s.offset;
+    if (size == 0 || s.name[BINARY_NAME_SIZE - 1] != 0 || s.offset % ALIGNMENT != 0 ||
+        s.offset < sizeof(BinaryHeader) || s.offset > header.tableOffset || (s.lanes != 1 && s.lanes != 3 &&
+        s.lanes != 4) || s.count > s.stride || s.stride > limit / size / s.lanes)
+      return false;
+  }
+  sections = table;
+  sectionCount = (size_t) header.sectionCount;
+  return true;
+}
+
+}
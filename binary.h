@@ -0,0 +1,252 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "vec3.h"
+#include "quat.h"
+#include "mat4.h"
+#include "mat3x4.h"
+#include "vecsoa.h"
+
+namespace qm {
+
+/**
+ * Binary container of named arrays, versioned and mapped without parsing.
+ *
+ * Layout, little endian, every part 64-byte aligned:
+ * - a 64-byte BinaryHeader, written last so that an interrupted file is
+ *   rejected,
+ * - the sections, raw arrays of their element type,
+ * - the section table, one 64-byte BinarySection per section.
+ * The header and the table have a CRC-32C each, checked when the file is
+ * opened. Every section has one too, checked on demand (the verify flag of
+ * BinaryReader::open, or BinaryReader::verify).
+ *
+ * Structure-of-arrays sections hold their lanes back to back, getStride()
+ * floats apart (padding included), as SoABase.
+ */
+enum BinaryType {
+  BINARY_BYTES = 0,
+  BINARY_FLOAT,
+  BINARY_DOUBLE,
+  BINARY_VEC3F,
+  BINARY_QUAT,
+  BINARY_MAT4F,
+  BINARY_MAT3X4F,
+  BINARY_TYPE_COUNT
+};
+
+// Size in bytes of one element of type
+size_t binaryTypeSize(BinaryType type);
+
+// Element type of the arrays of T
+template<typename T> struct BinaryTypeOf;
+template<> struct BinaryTypeOf<uint8_t> { static const BinaryType value = BINARY_BYTES; };
+template<> struct BinaryTypeOf<float> { static const BinaryType value = BINARY_FLOAT; };
+template<> struct BinaryTypeOf<double> { static const BinaryType value = BINARY_DOUBLE; };
+template<> struct BinaryTypeOf<Vec3f> { static const BinaryType value = BINARY_VEC3F; };
+template<> struct BinaryTypeOf<Quat> { static const BinaryType value = BINARY_QUAT; };
+template<> struct BinaryTypeOf<Mat4f> { static const BinaryType value = BINARY_MAT4F; };
+template<> struct BinaryTypeOf<Mat3x4f> { static const BinaryType value = BINARY_MAT3X4F; };
+
+const uint16_t BINARY_VERSION_MAJOR = 1;
+const uint16_t BINARY_VERSION_MINOR = 0;
+const size_t BINARY_NAME_SIZE = 24;
+
+struct BinaryHeader {
+  char magic[8];
+  // 0x01020304 as written by the host, to reject files of the other byte order
+  uint32_t byteOrder;
+  // Readers open files of their major version, of any minor version
+  uint16_t versionMajor;
+  uint16_t versionMinor;
+  uint64_t fileSize;
+  uint64_t tableOffset;
+  uint64_t sectionCount;
+  uint32_t tableChecksum;
+  // CRC-32C of the bytes above
+  uint32_t headerChecksum;
+  uint8_t reserved[16];
+};
+
+struct BinarySection {
+  // Zero-terminated
+  char name[BINARY_NAME_SIZE];
+  uint32_t type;
+  // 1 for arrays of structures, 3 or 4 for structure-of-arrays
+  uint32_t lanes;
+  // From the start of the file, in bytes
+  uint64_t offset;
+  uint64_t count;
+  // Distance between two lanes, in elements
+  uint64_t stride;
+  uint32_t checksum;
+  uint32_t reserved;
+};
+
+// CRC-32C (Castagnoli) of bytes, continuing crc (0 for a new checksum)
+uint32_t crc32c(const void* data, size_t bytes, uint32_t crc = 0);
+
+/**
+ * Read-only view of count contiguous T.
+ */
+template<typename T> struct Span {
+  const T* data;
+  size_t count;
+
+  inline Span() : data(0), count(0) { }
+  inline Span(const T* d, size_t c) : data(d), count(c) { }
+  inline size_t size() const {
+    return count;
+  }
+  inline bool empty() const {
+    return count == 0;
+  }
+  inline const T& operator[](size_t i) const {
+    return data[i];
+  }
+  inline const T* begin() const {
+    return data;
+  }
+  inline const T* end() const {
+    return data + count;
+  }
+};
+
+/**
+ * Read-only view of a structure-of-arrays: N lanes of count T, stride T apart.
+ */
+template<typename T, int N> struct SoAView {
+  const T* data;
+  size_t count;
+  size_t stride;
+
+  inline SoAView() : data(0), count(0), stride(0) { }
+  inline SoAView(const T* d, size_t c, size_t s) : data(d), count(c), stride(s) { }
+  inline size_t size() const {
+    return count;
+  }
+  inline const T* lane(int index) const {
+    return data + index * stride;
+  }
+};
+
+/**
+ * Streaming writer: sections go to the file as they are appended, in chunks
+ * of any size, so that files may be larger than memory. Only the section
+ * table is kept until close(). Functions return false once any write failed.
+ */
+class BinaryWriter {
+
+  public:
+    // Constructors
+    BinaryWriter();
+    // Closes the file
+    ~BinaryWriter();
+    // Create or truncate path
+    bool open(const char* path);
+    // Write the section table and the header, and close the file
+    bool close();
+    // Start a section of name (at most BINARY_NAME_SIZE - 1 characters),
+    // then append its elements in as many chunks as needed
+    bool beginSection(const char* name, BinaryType type);
+    bool append(const void* elements, size_t count);
+    bool endSection();
+    // Whole sections
+    template<typename T> inline bool write(const char* name, const T* elements, size_t count) {
+      return beginSection(name, BinaryTypeOf<T>::value) && append(elements, count) && endSection();
+    }
+    template<int N> bool write(const char* name, const SoABase<float, N>& soa) {
+      return writeSoA(name, soa.getArray(), N, soa.size(), soa.getStride());
+    }
+
+  private:
+    BinaryWriter(const BinaryWriter&);
+    BinaryWriter& operator=(const BinaryWriter&);
+
+    bool writeSoA(const char* name, const float* data, int lanes, size_t count, size_t stride);
+    bool writeBytes(const void* data, size_t bytes);
+    bool pad();
+
+    FILE* file;
+    uint64_t offset;
+    bool failed;
+    bool inSection;
+    BinarySection* sections;
+    size_t sectionCount;
+    size_t capacity;
+
+};
+
+/**
+ * Memory-mapped reader: open() maps the file and checks its header and
+ * section table, then the arrays are used in place, without copies.
+ * Spans stay valid until close().
+ */
+class BinaryReader {
+
+  public:
+    // Constructors
+    BinaryReader();
+    // Unmaps the file
+    ~BinaryReader();
+    // Map path, checking its header and table, and with verify the
+    // checksums of every section. Returns false (and stays closed) if the file
+    // cannot be mapped or is not a valid container.
+    bool open(const char* path, bool verify = false);
+    void close();
+    inline bool isOpen() const {
+      return base != 0;
+    }
+    // Sections
+    inline size_t size() const {
+      return sectionCount;
+    }
+    inline const BinarySection& section(size_t index) const {
+      return sections[index];
+    }
+    // Section named name, 0 if there is none
+    const BinarySection* find(const char* name) const;
+    // Whether the checksum of section matches its data
+    bool verify(const BinarySection& section) const;
+    inline const void* data(const BinarySection& section) const {
+      return base + section.offset;
+    }
+    // Elements of the section named name, empty if there is none or if it
+    // holds other elements
+    template<typename T> Span<T> get(const char* name) const {
+      const BinarySection* s = find(name);
+      if (!s || s->type != (uint32_t) BinaryTypeOf<T>::value || s->lanes != 1)
+        return Span<T>();
+      return Span<T>((const T*) data(*s), s->count);
+    }
+    template<int N> SoAView<float, N> getSoA(const char* name) const {
+      const BinarySection* s = find(name);
+      if (!s || s->type != (uint32_t) BINARY_FLOAT || s->lanes != (uint32_t) N)
+        return SoAView<float, N>();
+      return SoAView<float, N>((const float*) data(*s), s->count, s->stride);
+    }
+
+  private:
+    BinaryReader(const BinaryReader&);
+    BinaryReader& operator=(const BinaryReader&);
+
+    bool check();
+
+    const uint8_t* base;
+    size_t mappedSize;
+    const BinarySection* sections;
+    size_t sectionCount;
+#if defined(_WIN32)
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+
+};
+
+}
+
+#endif // BINARY_H
@@ -0,0 +1,619 @@
+#include <algorithm>
+#include <cstring>
+
+#include "bvh.h"
+#include "memory.h"
+#include "parallel.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+// Deeper nodes split at the median, which bounds the depth of the tree (and
+// the traversal stacks) to MAX_SAH_DEPTH + 32
+const int MAX_SAH_DEPTH = 64;
+const int STACK_SIZE = 2 * (MAX_SAH_DEPTH + 32);
+// Bins per axis of the SAH splits, fewer for small ranges
+const int BIN_COUNT = 16;
+// Ranges of at most TASK_SIZE primitives are built serially by one thread
+const size_t TASK_SIZE = 4096;
+// Probes per parallel chunk of the batched queries
+const size_t PROBE_CHUNK = 64;
+
+struct Tree {
+  const Bvh::Node* nodes;
+  const Vec3f* min;
+  const Vec3f* max;
+  const uint32_t* indices;
+};
+
+// Insert (id, d) in the list of the found nearest primitives, sorted by
+// distance then id. Returns false if it is not among the k nearest.
+inline bool insertNearest(uint32_t* ids, float* distances, size_t k, size_t& found, uint32_t id, float d) {
+  size_t s = found;
+  while (s > 0 && (d < distances[s - 1] || (d == distances[s - 1] && id < ids[s - 1])))
+    s--;
+  if (s == k)
+    return false;
+  size_t last = (found < k) ? found : k - 1;
+  for (size_t t = last ; t > s ; t--) {
+    ids[t] = ids[t - 1];
+    distances[t] = distances[t - 1];
+  }
+  ids[s] = id;
+  distances[s] = d;
+  if (found < k)
+    found++;
+  return true;
+}
+
+// A batched probe must get the same distances as a single query, so the
+// kernels must not contract a*b+c into FMAs on the targets that have them
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+#define QM_SIMD_KERNELS "bvh_kernels.inl"
+#include "simd_foreach.h"
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+typedef void (*NearestManyFn)(const Tree&, const Vec3f*, size_t, size_t, float, uint32_t*, float*);
+typedef void (*RadiusManyFn)(const Tree&, const Vec3f*, size_t, float, size_t, uint32_t*, size_t*);
+
+/**
+ * Traversal kernels compiled for one instruction set.
+ */
+struct BvhKernels {
+  NearestManyFn nearestMany;
+  RadiusManyFn radiusMany;
+};
+
+const BvhKernels& kernels() {
+  static const BvhKernels table[SIMD_ISA_COUNT] = {
+    {scalar::nearestMany, scalar::radiusMany},
+#if QM_SIMD_X86
+    {sse2::nearestMany, sse2::radiusMany},
+    {avx::nearestMany, avx::radiusMany},
+    {avx2::nearestMany, avx2::radiusMany}
+#endif
+  };
+  return table[simdIsa()];
+}
+
+//
+// Build
+//
+
+inline void grow(Vec3f& min, Vec3f& max, const Vec3f& pmin, const Vec3f& pmax) {
+  for (int a = 0 ; a < 3 ; a++) {
+    min[a] = std::min(min[a], pmin[a]);
+    max[a] = std::max(max[a], pmax[a]);
+  }
+}
+
+inline float halfArea(const Vec3f& min, const Vec3f& max) {
+  Vec3f e(max[0] - min[0], max[1] - min[1], max[2] - min[2]);
+  return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+}
+
+const uint32_t LEAF = 0x80000000u;
+const uint32_t SUBTREE = 0x80000000u;
+
+/**
+ * Node of the tree being built. The nodes of any two ranges of primitives
+ * get different slots whatever the build order: slot 2b for a leaf starting
+ * at b, slot 2m - 1 for an inner node split at m. Leaves have their first
+ * primitive in left and their count | LEAF in right. SUBTREE marks the roots
+ * of the subtrees built serially.
+ */
+struct BuildNode {
+  Vec3f min;
+  uint32_t left;
+  Vec3f max;
+  uint32_t right;
+};
+
+// Primitive being sorted into the tree, with its index in the build input
+struct BuildPrimitive {
+  Vec3f min;
+  uint32_t index;
+  Vec3f max;
+  uint32_t padding;
+  // Twice the center of the box
+  inline float center(int axis) const {
+    return min[axis] + max[axis];
+  }
+};
+
+struct Bins {
+  Vec3f min[BIN_COUNT];
+  Vec3f max[BIN_COUNT];
+  size_t count[BIN_COUNT];
+};
+
+// Bounds of the primitives of a range, and of their centers
+struct RangeBounds {
+  Vec3f min, max;
+  Vec3f centerMin, centerMax;
+  inline void clear() {
+    min = centerMin = Vec3f(INFINITY, INFINITY, INFINITY);
+    max = centerMax = Vec3f(-INFINITY, -INFINITY, -INFINITY);
+  }
+  inline void add(const BuildPrimitive& p) {
+    grow(min, max, p.min, p.max);
+    Vec3f center(p.center(0), p.center(1), p.center(2));
+    grow(centerMin, centerMax, center, center);
+  }
+};
+
+struct Builder {
+  BuildPrimitive* primitives;
+  BuildNode* slots;
+  unsigned maxLeafSize;
+
+  // Write the node of [begin, end) and return its slot. Inner nodes are split
+  // at mid, their children not built yet: the bounds of their ranges are
+  // gathered while partitioning.
+  uint32_t makeNode(size_t begin, size_t end, int depth, const RangeBounds& bounds, size_t& mid,
+    RangeBounds& leftBounds, RangeBounds& rightBounds) {
+    const Vec3f& nodeMin = bounds.min;
+    const Vec3f& nodeMax = bounds.max;
+    const Vec3f& centerMin = bounds.centerMin;
+    const Vec3f& centerMax = bounds.centerMax;
+    size_t n = end - begin;
+    if (n <= maxLeafSize) {
+      uint32_t slot = (uint32_t) (2 * begin);
+      BuildNode& leaf = slots[slot];
+      leaf.min = nodeMin;
+      leaf.max = nodeMax;
+      leaf.left = (uint32_t) begin;
+      leaf.right = (uint32_t) n | LEAF;
+      return slot;
+    }
+    // Binned SAH: cost of the split after each bin on each axis, binned in a
+    // single pass over the primitives
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = INFINITY;
+    int binCount = (n < (size_t) BIN_COUNT) ? (int) n : BIN_COUNT;
+    float scale[3];
+    Bins bins[3];
+    for (int a = 0 ; a < 3 ; a++) {
+      float extent = centerMax[a] - centerMin[a];
+      scale[a] = (depth < MAX_SAH_DEPTH && extent > 0.0f) ? binCount * 0.9999f / extent : 0.0f;
+      for (int b = 0 ; b < binCount ; b++) {
+        bins[a].min[b] = Vec3f(INFINITY, INFINITY, INFINITY);
+        bins[a].max[b] = Vec3f(-INFINITY, -INFINITY, -INFINITY);
+        bins[a].count[b] = 0;
+      }
+    }
+    if (scale[0] > 0.0f || scale[1] > 0.0f || scale[2] > 0.0f) {
+      for (size_t i = begin ; i < end ; i++) {
+        const BuildPrimitive& p = primitives[i];
+        for (int a = 0 ; a < 3 ; a++) {
+          int b = bin(p, a, centerMin[a], scale[a], binCount);
+          grow(bins[a].min[b], bins[a].max[b], p.min, p.max);
+          bins[a].count[b]++;
+        }
+      }
+    }
+    for (int a = 0 ; a < 3 ; a++) {
+      if (scale[a] == 0.0f)
+        continue;
+      const Bins& axis = bins[a];
+      // Right side costs, swept from the last bin
+      float rightCost[BIN_COUNT];
+      Vec3f sweepMin = axis.min[binCount - 1], sweepMax = axis.max[binCount - 1];
+      size_t sweepCount = axis.count[binCount - 1];
+      for (int b = binCount - 2 ; b >= 0 ; b--) {
+        rightCost[b] = sweepCount ? halfArea(sweepMin, sweepMax) * sweepCount : 0.0f;
+        grow(sweepMin, sweepMax, axis.min[b], axis.max[b]);
+        sweepCount += axis.count[b];
+      }
+      sweepMin = Vec3f(INFINITY, INFINITY, INFINITY);
+      sweepMax = Vec3f(-INFINITY, -INFINITY, -INFINITY);
+      sweepCount = 0;
+      for (int b = 0 ; b < binCount - 1 ; b++) {
+        grow(sweepMin, sweepMax, axis.min[b], axis.max[b]);
+        sweepCount += axis.count[b];
+        if (sweepCount == 0 || sweepCount == n)
+          continue;
+        float cost = halfArea(sweepMin, sweepMax) * sweepCount + rightCost[b];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = a;
+          bestBin = b;
+        }
+      }
+    }
+    leftBounds.clear();
+    rightBounds.clear();
+    if (bestAxis >= 0) {
+      // Primitives of bins <= bestBin first
+      size_t i = begin, j = end;
+      while (i < j) {
+        if (bin(primitives[i], bestAxis, centerMin[bestAxis], scale[bestAxis], binCount) <= bestBin) {
+          leftBounds.add(primitives[i]);
+          i++;
+        } else {
+          std::swap(primitives[i], primitives[--j]);
+          rightBounds.add(primitives[j]);
+        }
+      }
+      mid = i;
+    } else {
+      // Too deep, or all centers equal: median along the largest extent
+      int axis = 0;
+      for (int a = 1 ; a < 3 ; a++)
+        if (centerMax[a] - centerMin[a] > centerMax[axis] - centerMin[axis])
+          axis = a;
+      mid = begin + n / 2;
+      std::nth_element(primitives + begin, primitives + mid, primitives + end,
+        [axis](const BuildPrimitive& a, const BuildPrimitive& b) {
+          return a.center(axis) < b.center(axis) || (a.center(axis) == b.center(axis) && a.index < b.index);
+        });
+      for (size_t i = begin ; i < end ; i++)
+        (i < mid ? leftBounds : rightBounds).add(primitives[i]);
+    }
+    uint32_t slot = (uint32_t) (2 * mid - 1);
+    BuildNode& node = slots[slot];
+    node.min = nodeMin;
+    node.max = nodeMax;
+    node.left = node.right = 0;
+    return slot;
+  }
+
+  static inline int bin(const BuildPrimitive& p, int axis, float origin, float scale, int binCount) {
+    int b = (int) ((p.center(axis) - origin) * scale);
+    return (b < binCount - 1) ? b : binCount - 1;
+  }
+
+  // Build the subtree of [begin, end) serially and return its slot
+  uint32_t buildRange(size_t begin, size_t end, int depth, const RangeBounds& bounds) {
+    size_t mid;
+    RangeBounds leftBounds, rightBounds;
+    uint32_t slot = makeNode(begin, end, depth, bounds, mid, leftBounds, rightBounds);
+    if (slots[slot].right & LEAF)
+      return slot;
+    uint32_t left = buildRange(begin, mid, depth + 1, leftBounds);
+    uint32_t right = buildRange(mid, end, depth + 1, rightBounds);
+    slots[slot].left = left;
+    slots[slot].right = right;
+    return slot;
+  }
+};
+
+// Range of a level of the top of the tree, built in parallel. Its slot is
+// written to *link (the left or right of its parent).
+struct TopRange {
+  size_t begin;
+  size_t end;
+  uint32_t* link;
+  RangeBounds bounds;
+};
+
+}
+
+namespace qm {
+
+Bvh::Bvh() :
+  nodes(0), nodeCount(0), primitiveMin(0), primitiveMax(0), indices(0), count(0), subtrees(0), subtreeCount(0) {
+}
+
+Bvh::~Bvh() {
+  clear();
+}
+
+void Bvh::clear() {
+  if (primitiveMax != primitiveMin)
+    alignedFree(primitiveMax);
+  alignedFree(primitiveMin);
+  alignedFree(nodes);
+  alignedFree(indices);
+  alignedFree(subtrees);
+  nodes = 0;
+  primitiveMin = primitiveMax = 0;
+  indices = 0;
+  subtrees = 0;
+  nodeCount = count = subtreeCount = 0;
+}
+
+void Bvh::build(const Vec3f* points, size_t count, unsigned maxLeafSize) {
+  build(points, points, count, maxLeafSize);
+}
+
+void Bvh::build(const Vec3f* min, const Vec3f* max, size_t count, unsigned maxLeafSize) {
+  clear();
+  if (count == 0)
+    return;
+  this->count = count;
+  indices = (uint32_t*) alignedMalloc(count * sizeof(uint32_t));
+  primitiveMin = (Vec3f*) alignedMalloc(count * sizeof(Vec3f));
+  primitiveMax = (min == max) ? primitiveMin : (Vec3f*) alignedMalloc(count * sizeof(Vec3f));
+  buildTree(min, max, maxLeafSize < 1 ? 1 : maxLeafSize);
+}
+
+void Bvh::buildTree(const Vec3f* min, const Vec3f* max, unsigned maxLeafSize) {
+  // Primitives are moved around with their bounds, to partition contiguous
+  // memory
+  Builder builder;
+  builder.primitives = (BuildPrimitive*) alignedMalloc(count * sizeof(BuildPrimitive));
+  builder.slots = (BuildNode*) alignedMalloc(2 * count * sizeof(BuildNode));
+  builder.maxLeafSize = maxLeafSize;
+  parallel_for(0, count, chunkSize<BuildPrimitive>(), [&](size_t first, size_t last) {
+    for (size_t i = first ; i < last ; i++) {
+      BuildPrimitive& p = builder.primitives[i];
+      p.min = min[i];
+      p.max = max[i];
+      p.index = (uint32_t) i;
+    }
+  });
+
+  // Top levels one level at a time, each range of a level on its own thread;
+  // ranges of at most TASK_SIZE primitives are built entirely. Slots do not
+  // depend on the build order, so neither does the tree.
+  uint32_t root;
+  size_t capacity = 2 * (count / TASK_SIZE + 1);
+  TopRange* level = (TopRange*) alignedMalloc(capacity * sizeof(TopRange));
+  TopRange* next = (TopRange*) alignedMalloc(2 * capacity * sizeof(TopRange));
+  level[0].begin = 0;
+  level[0].end = count;
+  level[0].link = &root;
+  level[0].bounds.clear();
+  for (size_t i = 0 ; i < count ; i++)
+    level[0].bounds.add(builder.primitives[i]);
+  size_t levelCount = 1;
+  int depth = 0;
+  size_t tasks = 0;
+  while (levelCount > 0) {
+    parallel_for(0, levelCount, 1, [&](size_t begin, size_t end) {
+      for (size_t r = begin ; r < end ; r++) {
+        const TopRange& range = level[r];
+        next[2*r].link = next[2*r + 1].link = 0;
+        if (range.end - range.begin <= TASK_SIZE) {
+          uint32_t slot = builder.buildRange(range.begin, range.end, depth, range.bounds);
+          *range.link = slot;
+          builder.slots[slot].left |= SUBTREE;
+          continue;
+        }
+        size_t mid;
+        TopRange& left = next[2*r];
+        TopRange& right = next[2*r + 1];
+        uint32_t slot = builder.makeNode(range.begin, range.end, depth, range.bounds, mid, left.bounds, right.bounds);
+        *range.link = slot;
+        left.begin = range.begin;
+        left.end = right.begin = mid;
+        right.end = range.end;
+        left.link = &builder.slots[slot].left;
+        right.link = &builder.slots[slot].right;
+      }
+    });
+    size_t nextCount = 0;
+    for (size_t r = 0 ; r < levelCount ; r++) {
+      if (next[2*r].link) {
+        level[nextCount++] = next[2*r];
+        level[nextCount++] = next[2*r + 1];
+      } else
+        tasks++;
+    }
+    levelCount = nextCount;
+    depth++;
+  }
+  alignedFree(level);
+  alignedFree(next);
+
+  // Depth-first copy of the slots, recording the node ranges of the subtrees
+  nodes = (Node*) alignedMalloc((2 * count - 1) * sizeof(Node));
+  subtrees = (uint32_t*) alignedMalloc(2 * tasks * sizeof(uint32_t));
+  struct Entry {
+    uint32_t slot;
+    uint32_t parent;
+    bool inSubtree;
+  };
+  Entry stack[STACK_SIZE];
+  int top = 0;
+  Entry rootEntry = {root, NONE, false};
+  stack[top++] = rootEntry;
+  bool open = false;
+  while (top > 0) {
+    Entry entry = stack[--top];
+    const BuildNode& slot = builder.slots[entry.slot];
+    uint32_t index = (uint32_t) nodeCount++;
+    bool subtreeRoot = (slot.left & SUBTREE) != 0;
+    if (!entry.inSubtree && open) {
+      subtrees[2 * subtreeCount++ + 1] = index;
+      open = false;
+    }
+    if (subtreeRoot) {
+      subtrees[2 * subtreeCount] = index;
+      open = true;
+    }
+    if (entry.parent != NONE)
+      nodes[entry.parent].offset = index;
+    Node& node = nodes[index];
+    node.min = slot.min;
+    node.max = slot.max;
+    bool inSubtree = entry.inSubtree || subtreeRoot;
+    if (slot.right & LEAF) {
+      node.offset = slot.left & ~SUBTREE;
+      node.count = slot.right & ~LEAF;
+    } else {
+      node.offset = 0;
+      node.count = 0;
+      Entry right = {slot.right, index, inSubtree};
+      Entry left = {slot.left & ~SUBTREE, NONE, inSubtree};
+      stack[top++] = right;
+      stack[top++] = left;
+    }
+  }
+  if (open)
+    subtrees[2 * subtreeCount++ + 1] = (uint32_t) nodeCount;
+  parallel_for(0, count, chunkSize<BuildPrimitive>(), [&](size_t first, size_t last) {
+    for (size_t i = first ; i < last ; i++) {
+      const BuildPrimitive& p = builder.primitives[i];
+      indices[i] = p.index;
+      primitiveMin[i] = p.min;
+      if (primitiveMax != primitiveMin)
+        primitiveMax[i] = p.max;
+    }
+  });
+  alignedFree(builder.primitives);
+  alignedFree(builder.slots);
+}
+
+void Bvh::setPrimitives(const Vec3f* min, const Vec3f* max) {
+  Vec3f* newMin = (Vec3f*) alignedMalloc(count * sizeof(Vec3f));
+  Vec3f* newMax = (min == max) ? newMin : (Vec3f*) alignedMalloc(count * sizeof(Vec3f));
+  parallel_for(0, count, chunkSize<Vec3f>(), [&](size_t first, size_t last) {
+    for (size_t i = first ; i < last ; i++) {
+      newMin[i] = min[indices[i]];
+      if (newMax != newMin)
+        newMax[i] = max[indices[i]];
+    }
+  });
+  if (primitiveMax != primitiveMin)
+    alignedFree(primitiveMax);
+  alignedFree(primitiveMin);
+  primitiveMin = newMin;
+  primitiveMax = newMax;
+}
+
+void Bvh::refit(const Vec3f* points) {
+  refit(points, points);
+}
+
+void Bvh::refit(const Vec3f* min, const Vec3f* max) {
+  if (count == 0)
+    return;
+  setPrimitives(min, max);
+  refitNodes();
+}
+
+void Bvh::refitNodes() {
+  // Children follow their parent: update nodes from the last one
+  struct Refit {
+    Node* nodes;
+    const Vec3f* min;
+    const Vec3f* max;
+    inline void node(uint32_t i) const {
+      Node& node = nodes[i];
+      if (node.count > 0) {
+        node.min = min[node.offset];
+        node.max = max[node.offset];
+        for (uint32_t j = node.offset + 1 ; j < node.offset + node.count ; j++)
+          grow(node.min, node.max, min[j], max[j]);
+      } else {
+        node.min = nodes[i + 1].min;
+        node.max = nodes[i + 1].max;
+        grow(node.min, node.max, nodes[node.offset].min, nodes[node.offset].max);
+      }
+    }
+  } refit = {nodes, primitiveMin, primitiveMax};
+  parallel_for(0, subtreeCount, 1, [&](size_t first, size_t last) {
+    for (size_t s = first ; s < last ; s++)
+      for (uint32_t i = subtrees[2*s + 1] ; i > subtrees[2*s] ; i--)
+        refit.node(i - 1);
+  });
+  // Then the nodes above the subtrees
+  size_t s = subtreeCount;
+  for (size_t i = nodeCount ; i > 0 ; i--) {
+    if (s > 0 && i == subtrees[2*s - 1]) {
+      i = subtrees[2*s - 2] + 1;
+      s--;
+      continue;
+    }
+    refit.node((uint32_t) (i - 1));
+  }
+}
+
+//
+// Queries
+//
+
+size_t Bvh::nearest(const Vec3f& p, size_t k, uint32_t* result, float* squaredDistances,
+  float maxSquaredDistance) const {
+  if (count == 0 || k == 0)
+    return 0;
+  Tree tree = {nodes, primitiveMin, primitiveMax, indices};
+  scalar::nearestMany(tree, &p, 1, k, maxSquaredDistance, result, squaredDistances);
+  size_t found = 0;
+  while (found < k && result[found] != NONE)
+    found++;
+  return found;
+}
+
+size_t Bvh::queryRadius(const Vec3f& center, float radius, uint32_t* result, size_t maxCount) const {
+  if (count == 0)
+    return 0;
+  Tree tree = {nodes, primitiveMin, primitiveMax, indices};
+  size_t found;
+  scalar::radiusMany(tree, &center, 1, radius * radius, maxCount, result, &found);
+  return found;
+}
+
+size_t Bvh::queryBox(const Vec3f& min, const Vec3f& max, uint32_t* result, size_t maxCount) const {
+  if (count == 0)
+    return 0;
+  size_t found = 0;
+  uint32_t stack[STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    uint32_t index = stack[--top];
+    const Node& node = nodes[index];
+    if (!(min <= node.max && node.min <= max))
+      continue;
+    if (node.count == 0) {
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+      continue;
+    }
+    for (uint32_t j = node.offset ; j < node.offset + node.count ; j++) {
+      if (min <= primitiveMax[j] && primitiveMin[j] <= max) {
+        if (found < maxCount)
+          result[found] = indices[j];
+        found++;
+      }
+    }
+  }
+  return found;
+}
+
+void Bvh::nearest(const Vec3f* probes, size_t probeCount, size_t k, uint32_t* result, float* squaredDistances,
+  float maxSquaredDistance) const {
+  if (k == 0)
+    return;
+  if (count == 0) {
+    for (size_t i = 0 ; i < probeCount * k ; i++) {
+      result[i] = NONE;
+      squaredDistances[i] = INFINITY;
+    }
+    return;
+  }
+  Tree tree = {nodes, primitiveMin, primitiveMax, indices};
+  NearestManyFn kernel = kernels().nearestMany;
+  parallel_for(0, probeCount, PROBE_CHUNK, [&](size_t first, size_t last) {
+    kernel(tree, probes + first, last - first, k, maxSquaredDistance, result + first * k, squaredDistances + first * k);
+  });
+}
+
+void Bvh::queryRadius(const Vec3f* centers, size_t probeCount, float radius, size_t maxPerQuery,
+  uint32_t* result, size_t* counts) const {
+  if (count == 0) {
+    for (size_t i = 0 ; i < probeCount ; i++)
+      counts[i] = 0;
+    return;
+  }
+  Tree tree = {nodes, primitiveMin, primitiveMax, indices};
+  RadiusManyFn kernel = kernels().radiusMany;
+  parallel_for(0, probeCount, PROBE_CHUNK, [&](size_t first, size_t last) {
+    kernel(tree, centers + first, last - first, radius * radius, maxPerQuery,
+      result + first * maxPerQuery, counts + first);
+  });
+}
+
+}
@@ -0,0 +1,109 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vec3.h"
+
+namespace qm {
+
+/**
+ * Bounding volume hierarchy over points or axis-aligned boxes, built with
+ * binned SAH splits and stored as a flat depth-first node array: the left
+ * child of an inner node follows it, the right child is at its offset.
+ *
+ * Distances are squared Euclidean distances to the primitive boxes (0 inside).
+ * Queries report the indices of the primitives as given to build(). Building
+ * and batched queries run on the global thread pool (see parallel.h); the tree
+ * and every result are the same for any number of threads and instruction set.
+ */
+class Bvh {
+
+  public:
+    // No primitive, in the results of batched queries
+    static const uint32_t NONE = 0xffffffffu;
+
+    struct Node {
+      Vec3f min;
+      uint32_t offset; // right child (inner node) or first primitive (leaf)
+      Vec3f max;
+      uint32_t count;  // number of primitives, 0 for inner nodes
+    };
+
+    // Constructors
+    Bvh();
+    ~Bvh();
+    // Build over count points, or count boxes (min[i], max[i]), with at most
+    // maxLeafSize primitives per leaf
+    void build(const Vec3f* points, size_t count, unsigned maxLeafSize = 4);
+    void build(const Vec3f* min, const Vec3f* max, size_t count, unsigned maxLeafSize = 4);
+    // Update the node bounds after the primitives moved, keeping the topology
+    // (the same count as the last build)
+    void refit(const Vec3f* points);
+    void refit(const Vec3f* min, const Vec3f* max);
+    // Tree
+    inline size_t size() const {
+      return count;
+    }
+    inline size_t getNodeCount() const {
+      return nodeCount;
+    }
+    inline const Node* getNodes() const {
+      return nodes;
+    }
+    // Primitive of leaf slot i (Node::offset <= i < Node::offset + Node::count)
+    inline uint32_t getPrimitive(size_t i) const {
+      return indices[i];
+    }
+
+    // Nearest k primitives to p within sqrt(maxSquaredDistance), sorted by
+    // increasing distance then index. Returns how many were found (<= k).
+    size_t nearest(const Vec3f& p, size_t k, uint32_t* result, float* squaredDistances,
+      float maxSquaredDistance = INFINITY) const;
+    // Primitives within radius of center, or overlapping the box [min, max],
+    // in tree order. The first maxCount are written to result; returns how
+    // many there are.
+    size_t queryRadius(const Vec3f& center, float radius, uint32_t* result, size_t maxCount) const;
+    size_t queryBox(const Vec3f& min, const Vec3f& max, uint32_t* result, size_t maxCount) const;
+
+    /**
+     * Batched queries: W probes at a time (see simd.h) traverse the tree
+     * together, each node being tested against all of them at once. Probes
+     * close to each other share most of their traversal, so spatially sorted
+     * probes run fastest. Query q writes to result[q * k] (and
+     * squaredDistances), or result[q * maxPerQuery] and counts[q], with the
+     * same results as the single query; unused k-NN slots are NONE, INFINITY.
+     */
+    void nearest(const Vec3f* probes, size_t probeCount, size_t k, uint32_t* result, float* squaredDistances,
+      float maxSquaredDistance = INFINITY) const;
+    void queryRadius(const Vec3f* centers, size_t probeCount, float radius, size_t maxPerQuery,
+      uint32_t* result, size_t* counts) const;
+
+  private:
+    Bvh(const Bvh&);
+    Bvh& operator=(const Bvh&);
+
+    void buildTree(const Vec3f* min, const Vec3f* max, unsigned maxLeafSize);
+    void setPrimitives(const Vec3f* min, const Vec3f* max);
+    void refitNodes();
+    void clear();
+
+    Node* nodes;
+    size_t nodeCount;
+    // Primitive bounds in leaf order, and their indices in the build input.
+    // primitiveMax is primitiveMin for points.
+    Vec3f* primitiveMin;
+    Vec3f* primitiveMax;
+    uint32_t* indices;
+    size_t count;
+    // Node ranges [first, last) of the subtrees built in parallel, refitted in
+    // parallel as well
+    uint32_t* subtrees;
+    size_t subtreeCount;
+
+};
+
+}
+
+#endif // BVH_H
@@ -0,0 +1,136 @@
+// Traversal kernels of bvh.cpp, expanded once per instruction set by
+// simd_foreach.h. Probes are processed Pack<float>::W at a time: each node
+// is tested against the W probes at once, and visited if any of them may
+// have a result in it. Lanes past the last probe get a negative squared
+// radius, so they never select anything.
+//
+// Distances are computed without FMA (bvh.cpp turns off a*b+c contraction
+// around these kernels), in the same order for every width, so that a probe
+// gets the same results alone (scalar kernels, single queries) or in a packet.
+
+template<typename P> inline typename P::V boxDistance(const Vec3f& min, const Vec3f& max,
+  typename P::V px, typename P::V py, typename P::V pz) {
+  typename P::V zero = P::set1(0.0f);
+  typename P::V dx = P::max(P::max(P::set1(min[0]) - px, px - P::set1(max[0])), zero);
+  typename P::V dy = P::max(P::max(P::set1(min[1]) - py, py - P::set1(max[1])), zero);
+  typename P::V dz = P::max(P::max(P::set1(min[2]) - pz, pz - P::set1(max[2])), zero);
+  return dx * dx + dy * dy + dz * dz;
+}
+
+// Probe coordinates of a packet, lanes >= lanes repeating the first probe
+inline void loadProbes(const Vec3f* probes, int lanes, float* x, float* y, float* z) {
+  for (int l = 0 ; l < Pack<float>::W ; l++) {
+    const Vec3f& p = probes[(l < lanes) ? l : 0];
+    x[l] = p[0];
+    y[l] = p[1];
+    z[l] = p[2];
+  }
+}
+
+// k nearest primitives of each probe, sorted, unused slots set to NONE
+void nearestMany(const Tree& tree, const Vec3f* probes, size_t probeCount, size_t k, float maxSquaredDistance,
+  uint32_t* result, float* squaredDistances) {
+  typedef Pack<float> P;
+  const int W = P::W;
+  for (size_t first = 0 ; first < probeCount ; first += W) {
+    int lanes = (probeCount - first < (size_t) W) ? (int) (probeCount - first) : W;
+    float x[W], y[W], z[W], worst[W], d[W];
+    size_t found[W];
+    loadProbes(probes + first, lanes, x, y, z);
+    for (int l = 0 ; l < W ; l++) {
+      worst[l] = (l < lanes) ? maxSquaredDistance : -1.0f;
+      found[l] = 0;
+    }
+    typename P::V px = P::load(x), py = P::load(y), pz = P::load(z), radius = P::load(worst);
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      uint32_t index = stack[--top];
+      const Bvh::Node& node = tree.nodes[index];
+      if (!P::bits(P::le(boxDistance<P>(node.min, node.max, px, py, pz), radius)))
+        continue;
+      if (node.count == 0) {
+        // Push the child closest to the probes last, to visit it first
+        const Bvh::Node& left = tree.nodes[index + 1];
+        const Bvh::Node& right = tree.nodes[node.offset];
+        float dl[W], dr[W];
+        P::store(dl, boxDistance<P>(left.min, left.max, px, py, pz));
+        P::store(dr, boxDistance<P>(right.min, right.max, px, py, pz));
+        float sumLeft = 0.0f, sumRight = 0.0f;
+        for (int l = 0 ; l < lanes ; l++) {
+          sumLeft += dl[l];
+          sumRight += dr[l];
+        }
+        bool leftFirst = (sumLeft <= sumRight);
+        stack[top++] = leftFirst ? node.offset : index + 1;
+        stack[top++] = leftFirst ? index + 1 : node.offset;
+        continue;
+      }
+      for (uint32_t j = node.offset ; j < node.offset + node.count ; j++) {
+        typename P::V distance = boxDistance<P>(tree.min[j], tree.max[j], px, py, pz);
+        int hits = P::bits(P::le(distance, radius));
+        if (!hits)
+          continue;
+        P::store(d, distance);
+        for (int l = 0 ; l < lanes ; l++) {
+          if (!(hits & (1 << l)))
+            continue;
+          uint32_t* ids = result + (first + l) * k;
+          float* distances = squaredDistances + (first + l) * k;
+          if (insertNearest(ids, distances, k, found[l], tree.indices[j], d[l]) && found[l] == k)
+            worst[l] = distances[k - 1];
+        }
+        radius = P::load(worst);
+      }
+    }
+    for (int l = 0 ; l < lanes ; l++) {
+      for (size_t s = found[l] ; s < k ; s++) {
+        result[(first + l) * k + s] = Bvh::NONE;
+        squaredDistances[(first + l) * k + s] = INFINITY;
+      }
+    }
+  }
+}
+
+// Primitives within sqrt(squaredRadius) of each probe, in tree order
+void radiusMany(const Tree& tree, const Vec3f* probes, size_t probeCount, float squaredRadius, size_t maxPerQuery,
+  uint32_t* result, size_t* counts) {
+  typedef Pack<float> P;
+  const int W = P::W;
+  for (size_t first = 0 ; first < probeCount ; first += W) {
+    int lanes = (probeCount - first < (size_t) W) ? (int) (probeCount - first) : W;
+    float x[W], y[W], z[W], radii[W];
+    loadProbes(probes + first, lanes, x, y, z);
+    for (int l = 0 ; l < W ; l++)
+      radii[l] = (l < lanes) ? squaredRadius : -1.0f;
+    for (int l = 0 ; l < lanes ; l++)
+      counts[first + l] = 0;
+    typename P::V px = P::load(x), py = P::load(y), pz = P::load(z), radius = P::load(radii);
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      uint32_t index = stack[--top];
+      const Bvh::Node& node = tree.nodes[index];
+      if (!P::bits(P::le(boxDistance<P>(node.min, node.max, px, py, pz), radius)))
+        continue;
+      if (node.count == 0) {
+        stack[top++] = node.offset;
+        stack[top++] = index + 1;
+        continue;
+      }
+      for (uint32_t j = node.offset ; j < node.offset + node.count ; j++) {
+        int hits = P::bits(P::le(boxDistance<P>(tree.min[j], tree.max[j], px, py, pz), radius));
+        for (int l = 0 ; hits != 0 ; l++, hits >>= 1) {
+          if (!(hits & 1))
+            continue;
+          size_t& n = counts[first + l];
+          if (n < maxPerQuery)
+            result[(first + l) * maxPerQuery + n] = tree.indices[j];
+          n++;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// Functions that can only be constexpr from C++14 on (loops, local variables,
+// mutation of *this). C++11 keeps the single-return constexpr functions.
+#if __cplusplus >= 201402L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#define QM_CONSTEXPR14 constexpr
+#else
+#define QM_CONSTEXPR14 inline
+#endif
+
+namespace qm {
+
+/**
+ * Precision of the batched kernels that have a cheaper approximation. In the
+ * normalizations of vecsoa.h, PRECISION_FAST multiplies float vectors by the
+ * hardware reciprocal square root estimate refined by one Newton step: every
+ * component and length is within 2^-21 (4.8e-7) relative error of the exact
+ * result, and vectors shorter than 1e-19 are left untouched (length 0).
+ * Double vectors and the scalar kernels are always exact. slerpMany (quat.h)
+ * runs a corrected nlerp instead. Define QM_DEFAULT_PRECISION to change the
+ * default.
+ */
+enum Precision {
+  PRECISION_EXACT = 0,
+  PRECISION_FAST
+};
+
+}
+
+#ifndef QM_DEFAULT_PRECISION
+#define QM_DEFAULT_PRECISION qm::PRECISION_EXACT
+#endif
+
+// Default precision of the trigonometry of the rotation builders (Quat::init,
+// Mat4f::rotateY, Mat3x4f::rotateY, axisAngleMany): PRECISION_EXACT calls
+// libm, PRECISION_FAST the float polynomials of fastmath.h.
+#ifndef QM_TRIG_PRECISION
+#define QM_TRIG_PRECISION qm::PRECISION_EXACT
+#endif
+
+#endif // CONFIG_H
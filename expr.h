@@ -0,0 +1,305 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "mat3.h"
+#include "mat4.h"
+#include "mat3x4.h"
+
+namespace qm {
+
+/**
+ * Opt-in expression templates. Wrapping one operand with lazy() turns an
+ * arithmetic expression into a tree of lightweight nodes, evaluated in a
+ * single pass when converted back to a concrete type:
+ *
+ *   Vec3f x = lazy(x0) + lazy(v) * dt - lazy(g) * (0.5f * dt * dt); // no Vec3 temporary
+ *   Vec4f p = lazy(P) * V * M * v;     // 3 matrix-vector products, right to left
+ *   Mat4f PVM((lazy(P) * V * M).eval()); // 2 matrix products, left to right
+ *
+ * Nodes hold references to their operands: evaluate them within the full
+ * expression and never store them (e.g. with auto).
+ */
+namespace expr {
+
+template<typename T> struct Identity { typedef T Type; };
+
+// Size, scalar type and element-wise construction of each vector type
+template<typename V> struct VecTraits;
+
+template<typename T> struct VecTraits<Vec2<T> > {
+  typedef T Scalar;
+  static const int N = 2;
+  template<typename E> static inline Vec2<T> make(const E& e) {
+    return Vec2<T>(e[0], e[1]);
+  }
+};
+
+template<typename T> struct VecTraits<Vec3<T> > {
+  typedef T Scalar;
+  static const int N = 3;
+  template<typename E> static inline Vec3<T> make(const E& e) {
+    return Vec3<T>(e[0], e[1], e[2]);
+  }
+};
+
+template<typename T> struct VecTraits<Vec4<T> > {
+  typedef T Scalar;
+  static const int N = 4;
+  template<typename E> static inline Vec4<T> make(const E& e) {
+    return Vec4<T>(e[0], e[1], e[2], e[3]);
+  }
+};
+
+/**
+ * Base class of the vector expressions evaluating to a V.
+ */
+template<typename E, typename V> struct VecExpr {
+  typedef V Vector;
+  typedef typename VecTraits<V>::Scalar Scalar;
+  static const int N = VecTraits<V>::N;
+
+  inline const E& self() const {
+    return static_cast<const E&>(*this);
+  }
+  inline Scalar operator[](int index) const {
+    return self()[index];
+  }
+  inline V eval() const {
+    return VecTraits<V>::make(self());
+  }
+  inline operator V() const {
+    return eval();
+  }
+};
+
+template<typename V> struct VecRef : public VecExpr<VecRef<V>, V> {
+  const V& v;
+  inline explicit VecRef(const V& v) : v(v) { }
+  inline typename VecTraits<V>::Scalar operator[](int index) const {
+    return v[index];
+  }
+};
+
+template<typename L, typename R, typename V> struct VecAdd : public VecExpr<VecAdd<L, R, V>, V> {
+  L l;
+  R r;
+  inline VecAdd(const L& l, const R& r) : l(l), r(r) { }
+  inline typename VecTraits<V>::Scalar operator[](int index) const {
+    return l[index] + r[index];
+  }
+};
+
+template<typename L, typename R, typename V> struct VecSub : public VecExpr<VecSub<L, R, V>, V> {
+  L l;
+  R r;
+  inline VecSub(const L& l, const R& r) : l(l), r(r) { }
+  inline typename VecTraits<V>::Scalar operator[](int index) const {
+    return l[index] - r[index];
+  }
+};
+
+template<typename E, typename V> struct VecNeg : public VecExpr<VecNeg<E, V>, V> {
+  E e;
+  inline explicit VecNeg(const E& e) : e(e) { }
+  inline typename VecTraits<V>::Scalar operator[](int index) const {
+    return -e[index];
+  }
+};
+
+template<typename E, typename V> struct VecScale : public VecExpr<VecScale<E, V>, V> {
+  typedef typename VecTraits<V>::Scalar T;
+  E e;
+  T s;
+  inline VecScale(const E& e, T s) : e(e), s(s) { }
+  inline T operator[](int index) const {
+    return e[index] * s;
+  }
+};
+
+template<typename E, typename V> struct VecDiv : public VecExpr<VecDiv<E, V>, V> {
+  typedef typename VecTraits<V>::Scalar T;
+  E e;
+  T s;
+  inline VecDiv(const E& e, T s) : e(e), s(s) { }
+  inline T operator[](int index) const {
+    return e[index] / s;
+  }
+};
+
+// Result of a matrix expression applied to a vector, computed on construction
+template<typename V> struct VecValue : public VecExpr<VecValue<V>, V> {
+  V v;
+  inline explicit VecValue(const V& v) : v(v) { }
+  inline typename VecTraits<V>::Scalar operator[](int index) const {
+    return v[index];
+  }
+};
+
+// Vector expression operators
+template<typename L, typename R, typename V>
+inline VecAdd<L, R, V> operator+(const VecExpr<L, V>& a, const VecExpr<R, V>& b) {
+  return VecAdd<L, R, V>(a.self(), b.self());
+}
+
+template<typename L, typename R, typename V>
+inline VecSub<L, R, V> operator-(const VecExpr<L, V>& a, const VecExpr<R, V>& b) {
+  return VecSub<L, R, V>(a.self(), b.self());
+}
+
+template<typename E, typename V>
+inline VecNeg<E, V> operator-(const VecExpr<E, V>& a) {
+  return VecNeg<E, V>(a.self());
+}
+
+template<typename E, typename V>
+inline VecScale<E, V> operator*(const VecExpr<E, V>& a, typename VecTraits<V>::Scalar s) {
+  return VecScale<E, V>(a.self(), s);
+}
+
+template<typename E, typename V>
+inline VecScale<E, V> operator*(typename VecTraits<V>::Scalar s, const VecExpr<E, V>& a) {
+  return VecScale<E, V>(a.self(), s);
+}
+
+template<typename E, typename V>
+inline VecDiv<E, V> operator/(const VecExpr<E, V>& a, typename VecTraits<V>::Scalar s) {
+  return VecDiv<E, V>(a.self(), s);
+}
+
+template<typename L, typename R, typename V>
+inline typename VecTraits<V>::Scalar dot(const VecExpr<L, V>& a, const VecExpr<R, V>& b) {
+  typename VecTraits<V>::Scalar sum = a[0] * b[0];
+  for (int i = 1 ; i < VecTraits<V>::N ; i++)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+// Expressions mixed with concrete vectors: only one operand needs lazy()
+#define QM_EXPR_MIXED_OPERATORS(Vec) \
+  template<typename E, typename T> \
+  inline VecAdd<E, VecRef<Vec<T> >, Vec<T> > operator+(const VecExpr<E, Vec<T> >& a, const Vec<T>& b) { \
+    return VecAdd<E, VecRef<Vec<T> >, Vec<T> >(a.self(), VecRef<Vec<T> >(b)); \
+  } \
+  template<typename E, typename T> \
+  inline VecAdd<VecRef<Vec<T> >, E, Vec<T> > operator+(const Vec<T>& a, const VecExpr<E, Vec<T> >& b) { \
+    return VecAdd<VecRef<Vec<T> >, E, Vec<T> >(VecRef<Vec<T> >(a), b.self()); \
+  } \
+  template<typename E, typename T> \
+  inline VecSub<E, VecRef<Vec<T> >, Vec<T> > operator-(const VecExpr<E, Vec<T> >& a, const Vec<T>& b) { \
+    return VecSub<E, VecRef<Vec<T> >, Vec<T> >(a.self(), VecRef<Vec<T> >(b)); \
+  } \
+  template<typename E, typename T> \
+  inline VecSub<VecRef<Vec<T> >, E, Vec<T> > operator-(const Vec<T>& a, const VecExpr<E, Vec<T> >& b) { \
+    return VecSub<VecRef<Vec<T> >, E, Vec<T> >(VecRef<Vec<T> >(a), b.self()); \
+  }
+
+QM_EXPR_MIXED_OPERATORS(Vec2)
+QM_EXPR_MIXED_OPERATORS(Vec3)
+QM_EXPR_MIXED_OPERATORS(Vec4)
+
+#undef QM_EXPR_MIXED_OPERATORS
+
+/**
+ * Base class of the matrix expressions evaluating to a M. Products are only
+ * computed when the expression is evaluated (left to right) or applied to a
+ * vector (right to left, one matrix-vector product per factor).
+ */
+template<typename E, typename M> struct MatExpr {
+  typedef M Matrix;
+
+  inline const E& self() const {
+    return static_cast<const E&>(*this);
+  }
+  inline M eval() const {
+    return self().eval();
+  }
+  inline operator M() const {
+    return self().eval();
+  }
+  template<typename V> inline V apply(const V& v) const {
+    return self().apply(v);
+  }
+};
+
+template<typename M> struct MatRef : public MatExpr<MatRef<M>, M> {
+  const M& m;
+  inline explicit MatRef(const M& m) : m(m) { }
+  inline M eval() const {
+    return m;
+  }
+  template<typename V> inline V apply(const V& v) const {
+    return m * v;
+  }
+};
+
+template<typename L, typename R, typename M> struct MatMul : public MatExpr<MatMul<L, R, M>, M> {
+  L l;
+  R r;
+  inline MatMul(const L& l, const R& r) : l(l), r(r) { }
+  inline M eval() const {
+    return l.eval() * r.eval();
+  }
+  template<typename V> inline V apply(const V& v) const {
+    return l.apply(r.apply(v));
+  }
+};
+
+template<typename L, typename R, typename M>
+inline MatMul<L, R, M> operator*(const MatExpr<L, M>& a, const MatExpr<R, M>& b) {
+  return MatMul<L, R, M>(a.self(), b.self());
+}
+
+// b may be of a type derived from M (Mat4f for Mat4Base<float>...)
+template<typename L, typename M>
+inline MatMul<L, MatRef<M>, M> operator*(const MatExpr<L, M>& a, const typename Identity<M>::Type& b) {
+  return MatMul<L, MatRef<M>, M>(a.self(), MatRef<M>(b));
+}
+
+template<typename E, typename M, typename F, typename V>
+inline VecValue<V> operator*(const MatExpr<E, M>& a, const VecExpr<F, V>& v) {
+  return VecValue<V>(a.self().apply(v.eval()));
+}
+
+template<typename E, typename M, typename T>
+inline VecValue<Vec3<T> > operator*(const MatExpr<E, M>& a, const Vec3<T>& v) {
+  return VecValue<Vec3<T> >(a.self().apply(v));
+}
+
+template<typename E, typename M, typename T>
+inline VecValue<Vec4<T> > operator*(const MatExpr<E, M>& a, const Vec4<T>& v) {
+  return VecValue<Vec4<T> >(a.self().apply(v));
+}
+
+}
+
+// Entry points of the expression templates
+template<typename T> inline expr::VecRef<Vec2<T> > lazy(const Vec2<T>& v) {
+  return expr::VecRef<Vec2<T> >(v);
+}
+
+template<typename T> inline expr::VecRef<Vec3<T> > lazy(const Vec3<T>& v) {
+  return expr::VecRef<Vec3<T> >(v);
+}
+
+template<typename T> inline expr::VecRef<Vec4<T> > lazy(const Vec4<T>& v) {
+  return expr::VecRef<Vec4<T> >(v);
+}
+
+template<typename T> inline expr::MatRef<Mat3Base<T> > lazy(const Mat3Base<T>& m) {
+  return expr::MatRef<Mat3Base<T> >(m);
+}
+
+template<typename T> inline expr::MatRef<Mat4Base<T> > lazy(const Mat4Base<T>& m) {
+  return expr::MatRef<Mat4Base<T> >(m);
+}
+
+template<typename T> inline expr::MatRef<Mat3x4Base<T> > lazy(const Mat3x4Base<T>& m) {
+  return expr::MatRef<Mat3x4Base<T> >(m);
+}
+
+}
+
+#endif // EXPR_H
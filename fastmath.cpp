@@ -0,0 +1,54 @@
+#include "fastmath.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+#define QM_SIMD_KERNELS "fastmath_kernels.inl"
+#include "simd_foreach.h"
+
+typedef void (*SincosFn)(const float*, float*, float*, size_t);
+typedef void (*UnaryFn)(const float*, float*, size_t);
+typedef void (*BinaryFn)(const float*, const float*, float*, size_t);
+
+/**
+ * Trigonometry kernels compiled for one instruction set.
+ */
+struct FastMathKernels {
+  SincosFn sincos;
+  UnaryFn acos;
+  BinaryFn atan2;
+};
+
+const FastMathKernels& kernels() {
+  static const FastMathKernels table[SIMD_ISA_COUNT] = {
+    {scalar::sincosMany, scalar::acosMany, scalar::atan2Many},
+#if QM_SIMD_X86
+    {sse2::sincosMany, sse2::acosMany, sse2::atan2Many},
+    {avx::sincosMany, avx::acosMany, avx::atan2Many},
+    {avx2::sincosMany, avx2::acosMany, avx2::atan2Many}
+#endif
+  };
+  return table[simdIsa()];
+}
+
+}
+
+namespace qm {
+namespace fast {
+
+void sincosMany(const float* x, float* s, float* c, size_t count) {
+  kernels().sincos(x, s, c, count);
+}
+
+void acosMany(const float* x, float* out, size_t count) {
+  kernels().acos(x, out, count);
+}
+
+void atan2Many(const float* y, const float* x, float* out, size_t count) {
+  kernels().atan2(y, x, out, count);
+}
+
+}
+}
@@ -0,0 +1,132 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "config.h"
+
+namespace qm {
+
+/**
+ * Float trigonometry with minimax polynomials, without the double precision
+ * round trip of the libm functions. Two accuracy tiers:
+ * - PRECISION_EXACT: the libm functions (std::sin, std::cos...), correctly
+ *   rounded or nearly so, over the whole float range.
+ * - PRECISION_FAST: the functions below, in float only, for finite inputs.
+ *   sin and cos are within 2 ulp (absolute error 8e-8) for |x| <= 8192.
+ *   Past that the range reduction loses bits: the absolute error grows to
+ *   1e-6 at 65536, and the functions are not meant for larger arguments.
+ *   acos is within 4.4e-7 (an exhaustive sweep of [-1, 1] gives 4.38e-7) and
+ *   atan2 within 3e-7 (radians). bench checks these bounds.
+ * The array forms evaluate the same polynomials W values at a time (see
+ * simd.h), with the same results except for the rounding of the multiply-adds
+ * fused on AVX2. QM_TRIG_PRECISION (config.h) selects the tier of the
+ * rotation builders (Quat::init, rotateY, axisAngleMany).
+ */
+namespace fast {
+
+const float PI = 3.14159265358979f;
+const float HALF_PI = 1.57079632679490f;
+const float TWO_OVER_PI = 0.636619772367581f;
+const float DEG_TO_RAD = 0.0174532925199433f;
+
+// pi/2 = PIO2_1 + PIO2_2 + PIO2_3 (Cody-Waite, from cephes): j * PIO2_1 and
+// j * PIO2_2 are exact for the quadrants j of |x| <= 8192
+const float PIO2_1 = 1.5703125f;
+const float PIO2_2 = 4.837512969970703125e-4f;
+const float PIO2_3 = 7.54978995489188216e-8f;
+
+// (x + ROUND_MAGIC) - ROUND_MAGIC rounds x to the nearest integer for
+// |x| < 2^22
+const float ROUND_MAGIC = 12582912.0f;
+
+// sin and cos on [-pi/4, pi/4] (cephes sinf and cosf)
+const float SIN_C1 = -1.6666654611e-1f;
+const float SIN_C2 = 8.3321608736e-3f;
+const float SIN_C3 = -1.9515295891e-4f;
+const float COS_C1 = 4.166664568298827e-2f;
+const float COS_C2 = -1.388731625493765e-3f;
+const float COS_C3 = 2.443315711809948e-5f;
+
+// acos on [0, 1] divided by sqrt(1 - x) (Abramowitz and Stegun 4.4.46)
+const float ACOS_C[8] = {1.5707963050f, -0.2145988016f, 0.0889789874f, -0.0501743046f,
+  0.0308918810f, -0.0170881256f, 0.0066700901f, -0.0012624911f};
+
+// (atan(x) - x) / x^3 on [0, 1] in powers of x^2 (Abramowitz and Stegun 4.4.49)
+const float ATAN_C[8] = {-0.3333314528f, 0.1999355085f, -0.1420889944f, 0.1065626393f,
+  -0.0752896400f, 0.0429096138f, -0.0161657367f, 0.0028662257f};
+
+// sin and cos of x (radians)
+inline void sincos(float x, float& s, float& c) {
+  float j = (x * TWO_OVER_PI + ROUND_MAGIC) - ROUND_MAGIC;
+  float r = ((x - j * PIO2_1) - j * PIO2_2) - j * PIO2_3;
+  float z = r * r;
+  float p = SIN_C3;
+  p = p * z + SIN_C2;
+  p = p * z + SIN_C1;
+  float sr = r + r * z * p;
+  p = COS_C3;
+  p = p * z + COS_C2;
+  p = p * z + COS_C1;
+  float cr = (z * z * p - 0.5f * z) + 1.0f;
+  switch ((int) j & 3) {
+    case 0: s = sr; c = cr; break;
+    case 1: s = cr; c = -sr; break;
+    case 2: s = -sr; c = -cr; break;
+    default: s = -cr; c = sr; break;
+  }
+}
+
+inline float sin(float x) {
+  float s, c;
+  sincos(x, s, c);
+  return s;
+}
+
+inline float cos(float x) {
+  float s, c;
+  sincos(x, s, c);
+  return c;
+}
+
+// acos of x in [-1, 1], in [0, pi]. Inputs beyond are clamped, so that dot
+// products of unit vectors rounded past 1 give 0 or pi.
+inline float acos(float x) {
+  float a = (x < 0.0f) ? -x : x;
+  a = (a < 1.0f) ? a : 1.0f;
+  float p = ACOS_C[7];
+  for (int k = 6 ; k >= 0 ; k--)
+    p = p * a + ACOS_C[k];
+  p = std::sqrt(1.0f - a) * p;
+  return (x < 0.0f) ? PI - p : p;
+}
+
+// Angle of (x, y) in [-pi, pi]. Signed zeros count as +0: atan2(0, 0) = 0.
+inline float atan2(float y, float x) {
+  float ax = (x < 0.0f) ? -x : x;
+  float ay = (y < 0.0f) ? -y : y;
+  float hi = (ax < ay) ? ay : ax;
+  float lo = (ax < ay) ? ax : ay;
+  float t = (0.0f < hi) ? lo / hi : 0.0f;
+  float z = t * t;
+  float p = ATAN_C[7];
+  for (int k = 6 ; k >= 0 ; k--)
+    p = p * z + ATAN_C[k];
+  float r = t + t * z * p;
+  r = (ax < ay) ? HALF_PI - r : r;
+  r = (x < 0.0f) ? PI - r : r;
+  return (y < 0.0f) ? -r : r;
+}
+
+// Array forms over count contiguous values, W at a time. Outputs may be the
+// inputs.
+void sincosMany(const float* x, float* s, float* c, size_t count);
+void acosMany(const float* x, float* out, size_t count);
+void atan2Many(const float* y, const float* x, float* out, size_t count);
+
+}
+
+}
+
+#endif // FASTMATH_H
@@ -0,0 +1,59 @@
+// Trigonometry kernels of fastmath.cpp, expanded once per instruction set by
+// simd_foreach.h: the polynomials of fastmath.h (fastmath_poly.inl), one
+// value per SIMD lane. A tail of fewer than W values goes through a
+// zero-padded buffer.
+
+#include "fastmath_poly.inl"
+
+void sincosMany(const float* x, float* s, float* c, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W) {
+    V vs, vc;
+    sincos(P::load(x + n), vs, vc);
+    P::store(s + n, vs);
+    P::store(c + n, vc);
+  }
+  if (n == count)
+    return;
+  float buffer[3 * P::W] = {};
+  for (size_t k = n ; k < count ; k++)
+    buffer[k - n] = x[k];
+  V vs, vc;
+  sincos(P::load(buffer), vs, vc);
+  P::store(buffer + P::W, vs);
+  P::store(buffer + 2 * P::W, vc);
+  for (size_t k = n ; k < count ; k++) {
+    s[k] = buffer[P::W + k - n];
+    c[k] = buffer[2 * P::W + k - n];
+  }
+}
+
+void acosMany(const float* x, float* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    P::store(out + n, acos(P::load(x + n)));
+  if (n == count)
+    return;
+  float buffer[P::W] = {};
+  for (size_t k = n ; k < count ; k++)
+    buffer[k - n] = x[k];
+  P::store(buffer, acos(P::load(buffer)));
+  for (size_t k = n ; k < count ; k++)
+    out[k] = buffer[k - n];
+}
+
+void atan2Many(const float* y, const float* x, float* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    P::store(out + n, atan2(P::load(y + n), P::load(x + n)));
+  if (n == count)
+    return;
+  float buffer[2 * P::W] = {};
+  for (size_t k = n ; k < count ; k++) {
+    buffer[k - n] = y[k];
+    buffer[P::W + k - n] = x[k];
+  }
+  P::store(buffer, atan2(P::load(buffer), P::load(buffer + P::W)));
+  for (size_t k = n ; k < count ; k++)
+    out[k] = buffer[k - n];
+}
@@ -0,0 +1,95 @@
+// Polynomials of fastmath.h on Pack<float> lanes, for the kernel files that
+// simd_foreach.h expands once per instruction set (fastmath_kernels.inl,
+// quat_kernels.inl). Branches become selects, and the quadrant of sincos is
+// found from j - 4 round(j / 4) in float, without integer vectors.
+
+typedef Pack<float> P;
+typedef P::V V;
+typedef P::M M;
+
+inline V round(V x) {
+  V magic = P::set1(qm::fast::ROUND_MAGIC);
+  return (x + magic) - magic;
+}
+
+inline V negate(M m, V x) {
+  return P::select(m, P::set1(0.0f) - x, x);
+}
+
+inline V abs(V x) {
+  return P::max(x, P::set1(0.0f) - x);
+}
+
+// sin and cos of r in [-pi/4, pi/4], z being r * r
+inline V sinPolynomial(V r, V z) {
+  using namespace qm::fast;
+  V p = P::set1(SIN_C3);
+  p = p * z + P::set1(SIN_C2);
+  p = p * z + P::set1(SIN_C1);
+  return r + r * z * p;
+}
+
+inline V cosPolynomial(V z) {
+  using namespace qm::fast;
+  V p = P::set1(COS_C3);
+  p = p * z + P::set1(COS_C2);
+  p = p * z + P::set1(COS_C1);
+  return (z * z * p - P::set1(0.5f) * z) + P::set1(1.0f);
+}
+
+inline void sincos(V x, V& s, V& c) {
+  using namespace qm::fast;
+  V j = round(x * P::set1(TWO_OVER_PI));
+  V r = ((x - j * P::set1(PIO2_1)) - j * P::set1(PIO2_2)) - j * P::set1(PIO2_3);
+  V z = r * r;
+  V sr = sinPolynomial(r, z);
+  V cr = cosPolynomial(z);
+  // Quadrant q in {-2, -1, 0, 1, 2}: 1 and -1 (3) swap sin and cos, -2, -1
+  // and 2 negate sin, 1, -2 and 2 negate cos
+  V q = j - P::set1(4.0f) * round(j * P::set1(0.25f));
+  M swap = P::eq(abs(q), P::set1(1.0f));
+  M negS = P::either(P::lt(q, P::set1(0.0f)), P::lt(P::set1(1.5f), q));
+  M negC = P::either(P::lt(P::set1(0.5f), q), P::lt(q, P::set1(-1.5f)));
+  s = negate(negS, P::select(swap, cr, sr));
+  c = negate(negC, P::select(swap, sr, cr));
+}
+
+// sin of x in [0, pi/2], without range reduction: 2 sin(x/2) cos(x/2)
+inline V sinHalfPi(V x) {
+  V h = x * P::set1(0.5f);
+  V z = h * h;
+  V s = sinPolynomial(h, z);
+  return (s + s) * cosPolynomial(z);
+}
+
+// acos of a in [0, 1]
+inline V acosPositive(V a) {
+  using namespace qm::fast;
+  V p = P::set1(ACOS_C[7]);
+  for (int k = 6 ; k >= 0 ; k--)
+    p = p * a + P::set1(ACOS_C[k]);
+  return P::sqrt(P::set1(1.0f) - a) * p;
+}
+
+inline V acos(V x) {
+  using namespace qm::fast;
+  V p = acosPositive(P::min(abs(x), P::set1(1.0f)));
+  return P::select(P::lt(x, P::set1(0.0f)), P::set1(PI) - p, p);
+}
+
+inline V atan2(V y, V x) {
+  using namespace qm::fast;
+  V zero = P::set1(0.0f);
+  V ax = abs(x), ay = abs(y);
+  M steep = P::lt(ax, ay);
+  V hi = P::max(ax, ay), lo = P::min(ax, ay);
+  V t = P::select(P::lt(zero, hi), lo / hi, zero);
+  V z = t * t;
+  V p = P::set1(ATAN_C[7]);
+  for (int k = 6 ; k >= 0 ; k--)
+    p = p * z + P::set1(ATAN_C[k]);
+  V r = t + t * z * p;
+  r = P::select(steep, P::set1(HALF_PI) - r, r);
+  r = P::select(P::lt(x, zero), P::set1(PI) - r, r);
+  return negate(P::lt(y, zero), r);
+}
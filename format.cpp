@@ -0,0 +1,435 @@
+#include "format.h"
+
+#include <cstdint>
+#include <clocale>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+
+using namespace qm;
+
+namespace {
+
+/**
+ * Grisu2 (F. Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers", 2010), after the implementation of nlohmann/json:
+ * the digits of a number between the boundaries of the interval of values
+ * that round to it, scaled by a cached power of 10 into 64-bit integers.
+ */
+struct DiyFp {
+  uint64_t f;
+  int e;
+
+  DiyFp(uint64_t f, int e) : f(f), e(e) { }
+};
+
+// Upper 64 bits of the product, rounded
+DiyFp multiply(const DiyFp& x, const DiyFp& y) {
+  uint64_t xLow = x.f & 0xffffffffu, xHigh = x.f >> 32;
+  uint64_t yLow = y.f & 0xffffffffu, yHigh = y.f >> 32;
+  uint64_t p0 = xLow * yLow, p1 = xLow * yHigh, p2 = xHigh * yLow, p3 = xHigh * yHigh;
+  uint64_t middle = (p0 >> 32) + (p1 & 0xffffffffu) + (p2 & 0xffffffffu) + (1u << 31);
+  return DiyFp(p3 + (p1 >> 32) + (p2 >> 32) + (middle >> 32), x.e + y.e + 64);
+}
+
+DiyFp normalize(DiyFp x) {
+  while ((x.f >> 63) == 0) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+// v and the boundaries m- and m+ of the values that round to it, m+ normalized
+// and m- with the exponent of m+
+template<typename T> void boundaries(T value, DiyFp& v, DiyFp& minus, DiyFp& plus) {
+  const int precision = std::numeric_limits<T>::digits;
+  const int bias = std::numeric_limits<T>::max_exponent - 1 + (precision - 1);
+  const uint64_t hidden = uint64_t(1) << (precision - 1);
+  uint64_t bits;
+  if (sizeof(T) == sizeof(uint32_t)) {
+    uint32_t b;
+    std::memcpy(&b, &value, sizeof(b));
+    bits = b;
+  } else {
+    std::memcpy(&bits, &value, sizeof(bits));
+  }
+  uint64_t exponent = bits >> (precision - 1), fraction = bits & (hidden - 1);
+  v = (exponent == 0) ? DiyFp(fraction, 1 - bias) : DiyFp(fraction + hidden, (int) exponent - bias);
+  // The gap below powers of 2 is half the gap above
+  bool lowerCloser = (fraction == 0 && exponent > 1);
+  plus = normalize(DiyFp(2 * v.f + 1, v.e - 1));
+  minus = lowerCloser ? DiyFp(4 * v.f - 1, v.e - 2) : DiyFp(2 * v.f - 1, v.e - 1);
+  minus = DiyFp(minus.f << (minus.e - plus.e), plus.e);
+  v = normalize(v);
+}
+
+struct CachedPower {
+  uint64_t f;
+  int e;
+  int k;
+};
+
+// 10^k for k = -300, -292... 324, normalized and rounded
+const CachedPower CACHED_POWERS[] = {
+  {0xab70fe17c79ac6caull, -1060, -300},
+  {0xff77b1fcbebcdc4full, -1034, -292},
+  {0xbe5691ef416bd60cull, -1007, -284},
+  {0x8dd01fad907ffc3cull, -980, -276},
+  {0xd3515c2831559a83ull, -954, -268},
+  {0x9d71ac8fada6c9b5ull, -927, -260},
+  {0xea9c227723ee8bcbull, -901, -252},
+  {0xaecc49914078536dull, -874, -244},
+  {0x823c12795db6ce57ull, -847, -236},
+  {0xc21094364dfb5637ull, -821, -228},
+  {0x9096ea6f3848984full, -794, -220},
+  {0xd77485cb25823ac7ull, -768, -212},
+  {0xa086cfcd97bf97f4ull, -741, -204},
+  {0xef340a98172aace5ull, -715, -196},
+  {0xb23867fb2a35b28eull, -688, -188},
+  {0x84c8d4dfd2c63f3bull, -661, -180},
+  {0xc5dd44271ad3cdbaull, -635, -172},
+  {0x936b9fcebb25c996ull, -608, -164},
+  {0xdbac6c247d62a584ull, -582, -156},
+  {0xa3ab66580d5fdaf6ull, -555, -148},
+  {0xf3e2f893dec3f126ull, -529, -140},
+  {0xb5b5ada8aaff80b8ull, -502, -132},
+  {0x87625f056c7c4a8bull, -475, -124},
+  {0xc9bcff6034c13053ull, -449, -116},
+  {0x964e858c91ba2655ull, -422, -108},
+  {0xdff9772470297ebdull, -396, -100},
+  {0xa6dfbd9fb8e5b88full, -369, -92},
+  {0xf8a95fcf88747d94ull, -343, -84},
+  {0xb94470938fa89bcfull, -316, -76},
+  {0x8a08f0f8bf0f156bull, -289, -68},
+  {0xcdb02555653131b6ull, -263, -60},
+  {0x993fe2c6d07b7facull, -236, -52},
+  {0xe45c10c42a2b3b06ull, -210, -44},
+  {0xaa242499697392d3ull, -183, -36},
+  {0xfd87b5f28300ca0eull, -157, -28},
+  {0xbce5086492111aebull, -130, -20},
+  {0x8cbccc096f5088ccull, -103, -12},
+  {0xd1b71758e219652cull, -77, -4},
+  {0x9c40000000000000ull, -50, 4},
+  {0xe8d4a51000000000ull, -24, 12},
+  {0xad78ebc5ac620000ull, 3, 20},
+  {0x813f3978f8940984ull, 30, 28},
+  {0xc097ce7bc90715b3ull, 56, 36},
+  {0x8f7e32ce7bea5c70ull, 83, 44},
+  {0xd5d238a4abe98068ull, 109, 52},
+  {0x9f4f2726179a2245ull, 136, 60},
+  {0xed63a231d4c4fb27ull, 162, 68},
+  {0xb0de65388cc8ada8ull, 189, 76},
+  {0x83c7088e1aab65dbull, 216, 84},
+  {0xc45d1df942711d9aull, 242, 92},
+  {0x924d692ca61be758ull, 269, 100},
+  {0xda01ee641a708deaull, 295, 108},
+  {0xa26da3999aef774aull, 322, 116},
+  {0xf209787bb47d6b85ull, 348, 124},
+  {0xb454e4a179dd1877ull, 375, 132},
+  {0x865b86925b9bc5c2ull, 402, 140},
+  {0xc83553c5c8965d3dull, 428, 148},
+  {0x952ab45cfa97a0b3ull, 455, 156},
+  {0xde469fbd99a05fe3ull, 481, 164},
+  {0xa59bc234db398c25ull, 508, 172},
+  {0xf6c69a72a3989f5cull, 534, 180},
+  {0xb7dcbf5354e9beceull, 561, 188},
+  {0x88fcf317f22241e2ull, 588, 196},
+  {0xcc20ce9bd35c78a5ull, 614, 204},
+  {0x98165af37b2153dfull, 641, 212},
+  {0xe2a0b5dc971f303aull, 667, 220},
+  {0xa8d9d1535ce3b396ull, 694, 228},
+  {0xfb9b7cd9a4a7443cull, 720, 236},
+  {0xbb764c4ca7a44410ull, 747, 244},
+  {0x8bab8eefb6409c1aull, 774, 252},
+  {0xd01fef10a657842cull, 800, 260},
+  {0x9b10a4e5e9913129ull, 827, 268},
+  {0xe7109bfba19c0c9dull, 853, 276},
+  {0xac2820d9623bf429ull, 880, 284},
+  {0x80444b5e7aa7cf85ull, 907, 292},
+  {0xbf21e44003acdd2dull, 933, 300},
+  {0x8e679c2f5e44ff8full, 960, 308},
+  {0xd433179d9c8cb841ull, 986, 316},
+  {0x9e19db92b4e31ba9ull, 1013, 324},
+};
+
+// Scaled numbers have their binary exponent in [ALPHA, GAMMA]
+const int ALPHA = -60;
+const int GAMMA = -32;
+
+const CachedPower& cachedPower(int e) {
+  int f = ALPHA - e - 1;
+  // ceil(f * log10(2))
+  int k = (f * 78913) / (1 << 18) + (f > 0);
+  return CACHED_POWERS[(300 + k + 7) / 8];
+}
+
+// Largest power of 10 <= n, and its number of digits
+int largestPow10(uint32_t n, uint32_t& pow10) {
+  static const uint32_t POWERS[10] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+  int digits = 10;
+  while (digits > 1 && n < POWERS[digits - 1])
+    digits--;
+  pow10 = POWERS[digits - 1];
+  return digits;
+}
+
+// Move the last digit down while that gets closer to w and stays in range
+void roundDigits(char* digits, int length, uint64_t distance, uint64_t delta, uint64_t rest, uint64_t tenK) {
+  while (rest < distance && delta - rest >= tenK &&
+      (rest + tenK < distance || distance - rest > rest + tenK - distance)) {
+    digits[length - 1]--;
+    rest += tenK;
+  }
+}
+
+// Digits of a number in [minus, plus], close to w; the value is
+// digits * 10^exponent
+void generateDigits(char* digits, int& length, int& exponent, DiyFp minus, DiyFp w, DiyFp plus) {
+  uint64_t delta = plus.f - minus.f;
+  uint64_t distance = plus.f - w.f;
+  const DiyFp one(uint64_t(1) << -plus.e, plus.e);
+  uint32_t integral = (uint32_t) (plus.f >> -one.e);
+  uint64_t fractional = plus.f & (one.f - 1);
+  uint32_t pow10;
+  int n = largestPow10(integral, pow10);
+  while (n > 0) {
+    digits[length++] = (char) ('0' + integral / pow10);
+    integral %= pow10;
+    n--;
+    uint64_t rest = ((uint64_t) integral << -one.e) + fractional;
+    if (rest <= delta) {
+      exponent += n;
+      roundDigits(digits, length, distance, delta, rest, (uint64_t) pow10 << -one.e);
+      return;
+    }
+    pow10 /= 10;
+  }
+  int m = 0;
+  for (;;) {
+    fractional *= 10;
+    digits[length++] = (char) ('0' + (fractional >> -one.e));
+    fractional &= one.f - 1;
+    m++;
+    delta *= 10;
+    distance *= 10;
+    if (fractional <= delta)
+      break;
+  }
+  exponent -= m;
+  roundDigits(digits, length, distance, delta, fractional, one.f);
+}
+
+template<typename T> void grisu2(char* digits, int& length, int& exponent, T value) {
+  DiyFp v(0, 0), minus(0, 0), plus(0, 0);
+  boundaries(value, v, minus, plus);
+  const CachedPower& cached = cachedPower(plus.e);
+  DiyFp c(cached.f, cached.e);
+  DiyFp w = multiply(v, c), wMinus = multiply(minus, c), wPlus = multiply(plus, c);
+  // Shrink the interval by 1 ulp of the products, for their rounding
+  length = 0;
+  exponent = -cached.k;
+  generateDigits(digits, length, exponent, DiyFp(wMinus.f + 1, wMinus.e), w, DiyFp(wPlus.f - 1, wPlus.e));
+}
+
+// digits * 10^exponent as "123", "1.25", "0.001" or "1.5e+20": plain notation
+// for decimal exponents (of the first digit) in (-5, maxExponent]
+char* writeDecimal(char* p, const char* digits, int length, int exponent, int maxExponent) {
+  int point = length + exponent;
+  if (length <= point && point <= maxExponent) {
+    std::memcpy(p, digits, length);
+    std::memset(p + length, '0', point - length);
+    return p + point;
+  }
+  if (0 < point && point <= maxExponent) {
+    std::memcpy(p, digits, point);
+    p[point] = '.';
+    std::memcpy(p + point + 1, digits + point, length - point);
+    return p + length + 1;
+  }
+  if (-4 < point && point <= 0) {
+    p[0] = '0';
+    p[1] = '.';
+    std::memset(p + 2, '0', -point);
+    std::memcpy(p + 2 - point, digits, length);
+    return p + 2 - point + length;
+  }
+  *p++ = digits[0];
+  if (length > 1) {
+    *p++ = '.';
+    std::memcpy(p, digits + 1, length - 1);
+    p += length - 1;
+  }
+  int e = point - 1;
+  *p++ = 'e';
+  *p++ = (e < 0) ? '-' : '+';
+  e = (e < 0) ? -e : e;
+  if (e >= 100)
+    *p++ = (char) ('0' + e / 100);
+  *p++ = (char) ('0' + e / 10 % 10);
+  *p++ = (char) ('0' + e % 10);
+  return p;
+}
+
+template<typename T> size_t formatNumber(char* out, T x) {
+  char* p = out;
+  if (x != x) {
+    std::memcpy(p, "nan", 3);
+    return 3;
+  }
+  if (std::signbit(x)) {
+    *p++ = '-';
+    x = -x;
+  }
+  if (x == std::numeric_limits<T>::infinity()) {
+    std::memcpy(p, "inf", 3);
+    return p + 3 - out;
+  }
+  if (x == 0) {
+    *p++ = '0';
+    return p - out;
+  }
+  char digits[20];
+  int length, exponent;
+  grisu2(digits, length, exponent, x);
+  return writeDecimal(p, digits, length, exponent, std::numeric_limits<T>::max_digits10) - out;
+}
+
+// Powers of 10 exact in double
+const double EXACT_POWERS[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+inline double toNumber(const char* text, char** end, double) {
+  return std::strtod(text, end);
+}
+
+inline float toNumber(const char* text, char** end, float) {
+  return std::strtof(text, end);
+}
+
+// The correctly rounded double d converted to float rounds again: only
+// wrong if d fell exactly halfway between two floats (or in the subnormals)
+inline bool exactConversion(double d, float) {
+  uint64_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  double magnitude = (d < 0) ? -d : d;
+  return magnitude == 0 || (magnitude >= std::numeric_limits<float>::min() &&
+    (bits & 0x1fffffffu) != 0x10000000u);
+}
+
+inline bool exactConversion(double, double) {
+  return true;
+}
+
+inline bool isDigit(char c) {
+  return '0' <= c && c <= '9';
+}
+
+template<typename T> const char* parseNumber(const char* begin, const char* end, T& x) {
+  const char* p = detail::skipSpaces(begin, end);
+  const char* start = p;
+  bool negative = (p < end && *p == '-');
+  if (p < end && (*p == '-' || *p == '+'))
+    p++;
+  if (end - p >= 3 && (std::memcmp(p, "nan", 3) == 0 || std::memcmp(p, "inf", 3) == 0)) {
+    T infinity = std::numeric_limits<T>::infinity();
+    x = (*p == 'n') ? std::numeric_limits<T>::quiet_NaN() : (negative ? -infinity : infinity);
+    return p + 3;
+  }
+  // Up to 19 significant digits in mantissa, the others only counted
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+  for ( ; p < end && isDigit(*p) ; p++, any = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa != 0);
+    } else {
+      exponent++;
+      digits++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++ ; p < end && isDigit(*p) ; p++, any = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        exponent--;
+      } else {
+        digits++;
+      }
+    }
+  }
+  if (!any)
+    return 0;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negativeExponent = (q < end && *q == '-');
+    if (q < end && (*q == '-' || *q == '+'))
+      q++;
+    if (q < end && isDigit(*q)) {
+      int e = 0;
+      for ( ; q < end && isDigit(*q) ; q++)
+        e = (e < 100000) ? e * 10 + (*q - '0') : e;
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+  if (digits <= 19 && mantissa <= (uint64_t(1) << 53) && -22 <= exponent && exponent <= 22) {
+    double d = (double) mantissa;
+    d = (exponent < 0) ? d / EXACT_POWERS[-exponent] : d * EXACT_POWERS[exponent];
+    d = negative ? -d : d;
+    if (exactConversion(d, T())) {
+      x = (T) d;
+      return p;
+    }
+  }
+  // Correctly rounded by the C library, through a zero-terminated copy whose
+  // '.' is replaced by the decimal point of the current LC_NUMERIC locale
+  // (possibly several bytes), so that "0.5" reads the same under any locale
+  const char* decimalPoint = std::localeconv()->decimal_point;
+  size_t size = p - start, pointSize = std::strlen(decimalPoint);
+  const char* point = (std::strcmp(decimalPoint, ".") != 0) ? (const char*) std::memchr(start, '.', size) : 0;
+  size_t length = point ? size - 1 + pointSize : size;
+  char buffer[64];
+  std::string longText;
+  char* text = buffer;
+  if (length >= sizeof(buffer)) {
+    longText.resize(length + 1);
+    text = &longText[0];
+  }
+  if (point) {
+    size_t before = point - start;
+    std::memcpy(text, start, before);
+    std::memcpy(text + before, decimalPoint, pointSize);
+    std::memcpy(text + before + pointSize, point + 1, size - before - 1);
+  } else {
+    std::memcpy(text, start, size);
+  }
+  text[length] = 0;
+  x = toNumber(text, 0, T());
+  return p;
+}
+
+}
+
+namespace qm {
+
+size_t format(char* out, float x) {
+  return formatNumber(out, x);
+}
+
+size_t format(char* out, double x) {
+  return formatNumber(out, x);
+}
+
+const char* parse(const char* begin, const char* end, float& x) {
+  return parseNumber(begin, end, x);
+}
+
+const char* parse(const char* begin, const char* end, double& x) {
+  return parseNumber(begin, end, x);
+}
+
+}
@@ -0,0 +1,254 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <cstddef>
+#include <cstring>
+
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "mat3.h"
+#include "mat4.h"
+#include "mat3x4.h"
+#include "quat.h"
+
+namespace qm {
+
+/**
+ * Text forms of the vectors and matrices, written to and read from buffers
+ * of the caller, without allocation or streams.
+ *
+ * Numbers are written in the shortest form that parses back to the same
+ * float or double (Grisu2: shortest in all but rare cases, always exact on
+ * the way back), as "0.5", "-12", "1e+20", "nan" or "inf". Reading uses an
+ * exact fast path for up to 19 significant digits and |exponent| <= 22, and
+ * strtof/strtod otherwise. Both read "." as the decimal point under any locale.
+ *
+ * A vector (or quaternion) is a row of numbers, a matrix rows or columns of
+ * them (TextOrder): with TEXT_CSV "1,2,3", with TEXT_JSON "[1,2,3]" and
+ * "[[1,0],[0,1]]". Spaces, tabs and line breaks are skipped between tokens
+ * when reading.
+ */
+enum TextLayout {
+  TEXT_CSV = 0,
+  TEXT_JSON
+};
+
+enum TextOrder {
+  TEXT_ROW_MAJOR = 0,
+  TEXT_COLUMN_MAJOR
+};
+
+struct TextFormat {
+  TextLayout layout;
+  TextOrder order;
+
+  inline TextFormat(TextLayout l = TEXT_CSV, TextOrder o = TEXT_ROW_MAJOR) : layout(l), order(o) { }
+};
+
+// Longest number written by format(char*, float) and format(char*, double)
+const size_t FLOAT_TEXT_SIZE = 17;
+const size_t DOUBLE_TEXT_SIZE = 25;
+
+// Write x to out (at least FLOAT_TEXT_SIZE or DOUBLE_TEXT_SIZE chars, not
+// zero-terminated) and return the number of chars written
+size_t format(char* out, float x);
+size_t format(char* out, double x);
+// Read a number at the start of [begin, end), after optional whitespace.
+// Returns the end of the number, 0 if there is none.
+const char* parse(const char* begin, const char* end, float& x);
+const char* parse(const char* begin, const char* end, double& x);
+
+namespace detail {
+
+template<typename T> struct TextTraits;
+template<> struct TextTraits<float> { static const size_t SIZE = FLOAT_TEXT_SIZE; };
+template<> struct TextTraits<double> { static const size_t SIZE = DOUBLE_TEXT_SIZE; };
+
+inline const char* skipSpaces(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    p++;
+  return p;
+}
+
+inline const char* expect(const char* p, const char* end, char c) {
+  p = skipSpaces(p, end);
+  return (p < end && *p == c) ? p + 1 : 0;
+}
+
+// Elements of a rows x cols column-major grid, rows or columns first
+inline int gridIndex(int group, int k, int rows, TextOrder order) {
+  return (order == TEXT_ROW_MAJOR) ? k * rows + group : group * rows + k;
+}
+
+template<typename T> size_t formatGrid(char* out, const T* m, int rows, int cols, const TextFormat& f) {
+  int groups = (f.order == TEXT_ROW_MAJOR) ? rows : cols;
+  int groupSize = rows * cols / groups;
+  bool json = (f.layout == TEXT_JSON);
+  char* p = out;
+  if (json && groups > 1)
+    *p++ = '[';
+  for (int g = 0 ; g < groups ; g++) {
+    if (g > 0)
+      *p++ = ',';
+    if (json)
+      *p++ = '[';
+    for (int k = 0 ; k < groupSize ; k++) {
+      if (k > 0)
+        *p++ = ',';
+      p += format(p, m[gridIndex(g, k, rows, f.order)]);
+    }
+    if (json)
+      *p++ = ']';
+  }
+  if (json && groups > 1)
+    *p++ = ']';
+  return p - out;
+}
+
+// Into out if it has room for the longest text, else through a local buffer.
+// Returns 0 if size is too small.
+template<typename T> size_t formatGrid(char* out, size_t size, const T* m, int rows, int cols,
+    const TextFormat& f) {
+  const size_t longest = 16 * (TextTraits<T>::SIZE + 1) + 2 * 4 + 2;
+  if (size >= longest)
+    return formatGrid(out, m, rows, cols, f);
+  char buffer[longest];
+  size_t length = formatGrid(buffer, m, rows, cols, f);
+  if (length > size)
+    return 0;
+  std::memcpy(out, buffer, length);
+  return length;
+}
+
+template<typename T> const char* parseGrid(const char* p, const char* end, T* m, int rows, int cols,
+    const TextFormat& f) {
+  int groups = (f.order == TEXT_ROW_MAJOR) ? rows : cols;
+  int groupSize = rows * cols / groups;
+  bool json = (f.layout == TEXT_JSON);
+  if (json && groups > 1 && !(p = expect(p, end, '[')))
+    return 0;
+  for (int g = 0 ; g < groups ; g++) {
+    if (g > 0 && !(p = expect(p, end, ',')))
+      return 0;
+    if (json && !(p = expect(p, end, '[')))
+      return 0;
+    for (int k = 0 ; k < groupSize ; k++) {
+      if (k > 0 && !(p = expect(p, end, ',')))
+        return 0;
+      if (!(p = parse(p, end, m[gridIndex(g, k, rows, f.order)])))
+        return 0;
+    }
+    if (json && !(p = expect(p, end, ']')))
+      return 0;
+  }
+  if (json && groups > 1 && !(p = expect(p, end, ']')))
+    return 0;
+  return p;
+}
+
+}
+
+// Write a vector or matrix to out (size chars, not zero-terminated) and return
+// the number of chars written, 0 if they do not fit
+template<typename T> inline size_t format(char* out, size_t size, const Vec2<T>& V,
+    const TextFormat& f = TextFormat()) {
+  return detail::formatGrid(out, size, &V[0], 1, 2, f);
+}
+
+template<typename T> inline size_t format(char* out, size_t size, const Vec3<T>& V,
+    const TextFormat& f = TextFormat()) {
+  return detail::formatGrid(out, size, &V[0], 1, 3, f);
+}
+
+template<typename T> inline size_t format(char* out, size_t size, const Vec4<T>& V,
+    const TextFormat& f = TextFormat()) {
+  return detail::formatGrid(out, size, &V[0], 1, 4, f);
+}
+
+template<typename T> inline size_t format(char* out, size_t size, const Quaternion<T>& Q,
+    const TextFormat& f = TextFormat()) {
+  return detail::formatGrid(out, size, &Q[0], 1, 4, f);
+}
+
+template<typename T> inline size_t format(char* out, size_t size, const Mat3Base<T>& M,
+    const TextFormat& f = TextFormat()) {
+  return detail::formatGrid(out, size, M.getArray(), 3, 3, f);
+}
+
+template<typename T> inline size_t format(char* out, size_t size, const Mat4Base<T>& M,
+    const TextFormat& f = TextFormat()) {
+  return detail::formatGrid(out, size, M.getArray(), 4, 4, f);
+}
+
+template<typename T> inline size_t format(char* out, size_t size, const Mat3x4Base<T>& M,
+    const TextFormat& f = TextFormat()) {
+  return detail::formatGrid(out, size, M.getArray(), 3, 4, f);
+}
+
+// Read a vector or matrix written by format with the same TextFormat, after
+// optional whitespace. Returns the end of its text, 0 if it is malformed.
+template<typename T> inline const char* parse(const char* begin, const char* end, Vec2<T>& V,
+    const TextFormat& f = TextFormat()) {
+  return detail::parseGrid(begin, end, &V[0], 1, 2, f);
+}
+
+template<typename T> inline const char* parse(const char* begin, const char* end, Vec3<T>& V,
+    const TextFormat& f = TextFormat()) {
+  return detail::parseGrid(begin, end, &V[0], 1, 3, f);
+}
+
+template<typename T> inline const char* parse(const char* begin, const char* end, Vec4<T>& V,
+    const TextFormat& f = TextFormat()) {
+  return detail::parseGrid(begin, end, &V[0], 1, 4, f);
+}
+
+template<typename T> inline const char* parse(const char* begin, const char* end, Quaternion<T>& Q,
+    const TextFormat& f = TextFormat()) {
+  return detail::parseGrid(begin, end, &Q[0], 1, 4, f);
+}
+
+template<typename T> inline const char* parse(const char* begin, const char* end, Mat3Base<T>& M,
+    const TextFormat& f = TextFormat()) {
+  return detail::parseGrid(begin, end, &M[0], 3, 3, f);
+}
+
+template<typename T> inline const char* parse(const char* begin, const char* end, Mat4Base<T>& M,
+    const TextFormat& f = TextFormat()) {
+  return detail::parseGrid(begin, end, &M[0], 4, 4, f);
+}
+
+template<typename T> inline const char* parse(const char* begin, const char* end, Mat3x4Base<T>& M,
+    const TextFormat& f = TextFormat()) {
+  return detail::parseGrid(begin, end, &M[0], 3, 4, f);
+}
+
+// Write count elements, one per line, while they fit in out (size chars).
+// Returns the number of elements written; length receives the number of
+// chars. Dumps larger than the buffer go out in several calls.
+template<typename V> size_t formatMany(char* out, size_t size, const V* in, size_t count, size_t& length,
+    const TextFormat& f = TextFormat()) {
+  length = 0;
+  size_t n = 0;
+  for ( ; n < count ; n++) {
+    size_t written = format(out + length, size - length, in[n], f);
+    if (written == 0 || length + written == size)
+      break;
+    length += written;
+    out[length++] = '\n';
+  }
+  return n;
+}
+
+// Read count elements written by formatMany. Returns the end of the last one,
+// 0 if one is malformed or missing.
+template<typename V> const char* parseMany(const char* begin, const char* end, V* out, size_t count,
+    const TextFormat& f = TextFormat()) {
+  for (size_t n = 0 ; n < count && begin ; n++)
+    begin = parse(begin, end, out[n], f);
+  return begin;
+}
+
+}
+
+#endif // FORMAT_H
@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstring>
+
+#include "frustum.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+#define QM_SIMD_KERNELS "frustum_kernels.inl"
+#include "simd_foreach.h"
+
+typedef void (*CullSpheresFn)(const float*, int, const float*, const float*, const float*, const float*,
+  size_t, size_t, uint32_t*);
+typedef void (*CullAabbsFn)(const float*, int, const float*, const float*, const float*,
+  const float*, const float*, const float*, size_t, size_t, uint32_t*);
+
+/**
+ * Culling kernels compiled for one instruction set.
+ */
+struct CullKernels {
+  CullSpheresFn spheres;
+  CullAabbsFn aabbs;
+};
+
+const CullKernels& kernels() {
+  static const CullKernels table[SIMD_ISA_COUNT] = {
+    {scalar::cullSpheres, scalar::cullAabbs},
+#if QM_SIMD_X86
+    {sse2::cullSpheres, sse2::cullAabbs},
+    {avx::cullSpheres, avx::cullAabbs},
+    {avx2::cullSpheres, avx2::cullAabbs}
+#endif
+  };
+  return table[simdIsa()];
+}
+
+// Planes as 6 packed (a, b, c, d)
+void packPlanes(const Frustum& F, float* planes) {
+  for (int k = 0 ; k < Frustum::PLANE_COUNT ; k++)
+    for (int j = 0 ; j < 4 ; j++)
+      planes[4*k + j] = F[k][j];
+}
+
+// Set the bits of objects [begin, end), begin being a multiple of 32
+void setBits(uint32_t* mask, size_t begin, size_t end, bool visible) {
+  size_t first = begin / 32, last = (end + 31) / 32;
+  memset(mask + first, visible ? 0xff : 0, (last - first) * sizeof(uint32_t));
+  if (visible && end % 32 != 0)
+    mask[last - 1] = (1u << (end % 32)) - 1;
+}
+
+/**
+ * Classify each group box against the planes, and call
+ * cull(planes, planeCount, begin, end) on the objects of the groups crossing
+ * the frustum, with the planes they cross only.
+ */
+template<typename Cull> void cullGroups(const Frustum& F, const Vec3SoA<float>& groupMin,
+  const Vec3SoA<float>& groupMax, size_t groupSize, size_t count, uint32_t* mask, const Cull& cull) {
+  for (size_t g = 0, begin = 0 ; begin < count ; g++, begin += groupSize) {
+    size_t end = (count - begin > groupSize) ? begin + groupSize : count;
+    Vec3f min = groupMin.get(g), max = groupMax.get(g);
+    float crossed[4 * Frustum::PLANE_COUNT];
+    int crossedCount = 0;
+    bool outside = false;
+    for (int k = 0 ; k < Frustum::PLANE_COUNT && !outside ; k++) {
+      const Vec4f& plane = F[k];
+      // Corners furthest along and against the normal
+      Vec3f outer, inner;
+      for (int j = 0 ; j < 3 ; j++) {
+        outer[j] = (plane[j] >= 0.0f) ? max[j] : min[j];
+        inner[j] = (plane[j] >= 0.0f) ? min[j] : max[j];
+      }
+      if (F.distance(k, outer) < 0.0f)
+        outside = true;
+      else if (F.distance(k, inner) < 0.0f) {
+        for (int j = 0 ; j < 4 ; j++)
+          crossed[4*crossedCount + j] = plane[j];
+        crossedCount++;
+      }
+    }
+    if (outside || crossedCount == 0)
+      setBits(mask, begin, end, !outside);
+    else
+      cull(crossed, crossedCount, begin, end);
+  }
+}
+
+inline int lowestBit(uint32_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(word);
+#else
+  int bit = 0;
+  while (!(word & 1u)) {
+    word >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+}
+
+namespace qm {
+
+Frustum::Frustum() {
+  // Planes at infinity: everything is inside
+  for (int k = 0 ; k < PLANE_COUNT ; k++)
+    planes[k] = Vec4f(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const Mat4Base<float>& viewProjection, bool zeroToOneDepth) {
+  init(viewProjection, zeroToOneDepth);
+}
+
+void Frustum::init(const Mat4Base<float>& M, bool zeroToOneDepth) {
+  // Clip coordinates are (row i of M).p: inside means -w <= x, y, z <= w
+  // (0 <= z with zeroToOneDepth), i.e. row 3 +/- row i >= 0
+  for (int j = 0 ; j < 4 ; j++) {
+    float r0 = M[4*j], r1 = M[4*j + 1], r2 = M[4*j + 2], r3 = M[4*j + 3];
+    planes[PLANE_LEFT][j] = r3 + r0;
+    planes[PLANE_RIGHT][j] = r3 - r0;
+    planes[PLANE_BOTTOM][j] = r3 + r1;
+    planes[PLANE_TOP][j] = r3 - r1;
+    planes[PLANE_NEAR][j] = zeroToOneDepth ? r2 : r3 + r2;
+    planes[PLANE_FAR][j] = r3 - r2;
+  }
+  for (int k = 0 ; k < PLANE_COUNT ; k++) {
+    Vec4f& p = planes[k];
+    float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    if (length > 0.0f)
+      p = Vec4f(p[0] / length, p[1] / length, p[2] / length, p[3] / length);
+  }
+}
+
+bool Frustum::testSphere(const Vec3f& center, float radius) const {
+  for (int k = 0 ; k < PLANE_COUNT ; k++)
+    if (distance(k, center) + radius < 0.0f)
+      return false;
+  return true;
+}
+
+bool Frustum::testAabb(const Vec3f& min, const Vec3f& max) const {
+  for (int k = 0 ; k < PLANE_COUNT ; k++) {
+    const Vec4f& p = planes[k];
+    Vec3f outer((p[0] >= 0.0f) ? max[0] : min[0], (p[1] >= 0.0f) ? max[1] : min[1], (p[2] >= 0.0f) ? max[2] : min[2]);
+    if (distance(k, outer) < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+void cullSpheres(const Frustum& F, const Vec4SoA<float>& spheres, uint32_t* mask) {
+  float planes[4 * Frustum::PLANE_COUNT];
+  packPlanes(F, planes);
+  kernels().spheres(planes, Frustum::PLANE_COUNT, spheres.x(), spheres.y(), spheres.z(), spheres.w(),
+    0, spheres.size(), mask);
+}
+
+void cullAabbs(const Frustum& F, const Vec3SoA<float>& min, const Vec3SoA<float>& max, uint32_t* mask) {
+  float planes[4 * Frustum::PLANE_COUNT];
+  packPlanes(F, planes);
+  kernels().aabbs(planes, Frustum::PLANE_COUNT, min.x(), min.y(), min.z(), max.x(), max.y(), max.z(),
+    0, min.size(), mask);
+}
+
+void cullSpheres(const Frustum& F, const Vec4SoA<float>& spheres, const Vec3SoA<float>& groupMin,
+  const Vec3SoA<float>& groupMax, size_t groupSize, uint32_t* mask) {
+  if (groupSize == 0 || groupSize % 32 != 0) {
+    cullSpheres(F, spheres, mask);
+    return;
+  }
+  CullSpheresFn cull = kernels().spheres;
+  cullGroups(F, groupMin, groupMax, groupSize, spheres.size(), mask,
+    [&](const float* planes, int planeCount, size_t begin, size_t end) {
+      cull(planes, planeCount, spheres.x(), spheres.y(), spheres.z(), spheres.w(), begin, end, mask);
+    });
+}
+
+void cullAabbs(const Frustum& F, const Vec3SoA<float>& min, const Vec3SoA<float>& max,
+  const Vec3SoA<float>& groupMin, const Vec3SoA<float>& groupMax, size_t groupSize, uint32_t* mask) {
+  if (groupSize == 0 || groupSize % 32 != 0) {
+    cullAabbs(F, min, max, mask);
+    return;
+  }
+  CullAabbsFn cull = kernels().aabbs;
+  cullGroups(F, groupMin, groupMax, groupSize, min.size(), mask,
+    [&](const float* planes, int planeCount, size_t begin, size_t end) {
+      cull(planes, planeCount, min.x(), min.y(), min.z(), max.x(), max.y(), max.z(), begin, end, mask);
+    });
+}
+
+void groupBounds(const Vec4SoA<float>& spheres, size_t groupSize, Vec3SoA<float>& groupMin, Vec3SoA<float>& groupMax) {
+  size_t count = spheres.size();
+  size_t groups = (groupSize == 0) ? 0 : (count + groupSize - 1) / groupSize;
+  groupMin.resize(groups);
+  groupMax.resize(groups);
+  const float* x = spheres.x();
+  const float* y = spheres.y();
+  const float* z = spheres.z();
+  const float* r = spheres.w();
+  for (size_t g = 0 ; g < groups ; g++) {
+    size_t begin = g * groupSize, end = (count - begin > groupSize) ? begin + groupSize : count;
+    float x0 = x[begin] - r[begin], y0 = y[begin] - r[begin], z0 = z[begin] - r[begin];
+    float x1 = x[begin] + r[begin], y1 = y[begin] + r[begin], z1 = z[begin] + r[begin];
+    for (size_t i = begin + 1 ; i < end ; i++) {
+      x0 = std::min(x0, x[i] - r[i]);
+      y0 = std::min(y0, y[i] - r[i]);
+      z0 = std::min(z0, z[i] - r[i]);
+      x1 = std::max(x1, x[i] + r[i]);
+      y1 = std::max(y1, y[i] + r[i]);
+      z1 = std::max(z1, z[i] + r[i]);
+    }
+    groupMin.set(g, Vec3f(x0, y0, z0));
+    groupMax.set(g, Vec3f(x1, y1, z1));
+  }
+}
+
+void groupBounds(const Vec3SoA<float>& min, const Vec3SoA<float>& max, size_t groupSize,
+  Vec3SoA<float>& groupMin, Vec3SoA<float>& groupMax) {
+  size_t count = min.size();
+  size_t groups = (groupSize == 0) ? 0 : (count + groupSize - 1) / groupSize;
+  groupMin.resize(groups);
+  groupMax.resize(groups);
+  for (size_t g = 0 ; g < groups ; g++) {
+    size_t begin = g * groupSize, end = (count - begin > groupSize) ? begin + groupSize : count;
+    float x0 = min.x()[begin], y0 = min.y()[begin], z0 = min.z()[begin];
+    float x1 = max.x()[begin], y1 = max.y()[begin], z1 = max.z()[begin];
+    for (size_t i = begin + 1 ; i < end ; i++) {
+      x0 = std::min(x0, min.x()[i]);
+      y0 = std::min(y0, min.y()[i]);
+      z0 = std::min(z0, min.z()[i]);
+      x1 = std::max(x1, max.x()[i]);
+      y1 = std::max(y1, max.y()[i]);
+      z1 = std::max(z1, max.z()[i]);
+    }
+    groupMin.set(g, Vec3f(x0, y0, z0));
+    groupMax.set(g, Vec3f(x1, y1, z1));
+  }
+}
+
+size_t visibleIndices(const uint32_t* mask, size_t count, uint32_t* indices) {
+  size_t visible = 0;
+  for (size_t w = 0 ; w < (count + 31) / 32 ; w++) {
+    uint32_t word = mask[w];
+    while (word != 0) {
+      indices[visible++] = (uint32_t) (32 * w + lowestBit(word));
+      word &= word - 1;
+    }
+  }
+  return visible;
+}
+
+}
@@ -0,0 +1,86 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vec3.h"
+#include "vec4.h"
+#include "mat4.h"
+#include "vecsoa.h"
+
+namespace qm {
+
+/**
+ * View frustum as 6 planes (a, b, c, d), normals pointing inwards and
+ * normalized: a point p is inside a plane when a*p.x + b*p.y + c*p.z + d >= 0,
+ * and that value is its distance to the plane.
+ * Planes are extracted from a view-projection matrix (Gribb & Hartmann), with
+ * clip space depth in [-w, w] (OpenGL) or [0, w] (zeroToOneDepth, Direct3D and
+ * Vulkan).
+ */
+class Frustum {
+
+  public:
+    enum PlaneIndex { PLANE_LEFT = 0, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, PLANE_COUNT };
+
+    // Constructors
+    Frustum();
+    explicit Frustum(const Mat4Base<float>& viewProjection, bool zeroToOneDepth = false);
+    void init(const Mat4Base<float>& viewProjection, bool zeroToOneDepth = false);
+    // Planes
+    inline const Vec4f& operator[](int index) const {
+      return planes[index];
+    }
+    inline const Vec4f* getPlanes() const {
+      return planes;
+    }
+    inline float distance(int plane, const Vec3f& p) const {
+      return planes[plane][0] * p[0] + planes[plane][1] * p[1] + planes[plane][2] * p[2] + planes[plane][3];
+    }
+    // Single object tests (false: certainly outside, true: possibly visible)
+    bool testSphere(const Vec3f& center, float radius) const;
+    bool testAabb(const Vec3f& min, const Vec3f& max) const;
+
+  private:
+    Vec4f planes[PLANE_COUNT];
+
+};
+
+/**
+ * Batched culling, W objects at a time on the SIMD lanes (see simd.h).
+ * Spheres are Vec4SoA lanes (center x, y, z, radius), boxes two Vec3SoA of
+ * minimum and maximum corners. The visibility of object i is written to bit
+ * i % 32 of mask[i / 32], with (count + 31) / 32 words for count objects.
+ * The kernels evaluate the same plane distances as testSphere and testAabb
+ * (furthest corner of the boxes), so the results are identical, except for
+ * objects closer to a plane than the rounding error with the AVX2 (FMA)
+ * kernels.
+ */
+void cullSpheres(const Frustum& F, const Vec4SoA<float>& spheres, uint32_t* mask);
+void cullAabbs(const Frustum& F, const Vec3SoA<float>& min, const Vec3SoA<float>& max, uint32_t* mask);
+
+/**
+ * Hierarchical versions: objects are grouped by groupSize consecutive
+ * objects (a multiple of 32), each group bounded by the box of the same index
+ * in groupMin/groupMax (see groupBounds). Groups outside the frustum are
+ * rejected and groups inside accepted without testing their objects; objects
+ * of the other groups are only tested against the planes their group crosses.
+ */
+void cullSpheres(const Frustum& F, const Vec4SoA<float>& spheres, const Vec3SoA<float>& groupMin,
+  const Vec3SoA<float>& groupMax, size_t groupSize, uint32_t* mask);
+void cullAabbs(const Frustum& F, const Vec3SoA<float>& min, const Vec3SoA<float>& max,
+  const Vec3SoA<float>& groupMin, const Vec3SoA<float>& groupMax, size_t groupSize, uint32_t* mask);
+
+// Boxes of the groups of groupSize consecutive objects
+void groupBounds(const Vec4SoA<float>& spheres, size_t groupSize, Vec3SoA<float>& groupMin, Vec3SoA<float>& groupMax);
+void groupBounds(const Vec3SoA<float>& min, const Vec3SoA<float>& max, size_t groupSize,
+  Vec3SoA<float>& groupMin, Vec3SoA<float>& groupMax);
+
+// Write the indices of the set bits of mask (count objects) in increasing
+// order to indices, and return how many there are
+size_t visibleIndices(const uint32_t* mask, size_t count, uint32_t* indices);
+
+}
+
+#endif // FRUSTUM_H
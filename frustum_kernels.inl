@@ -0,0 +1,71 @@
+// Culling kernels of frustum.cpp, expanded once per instruction set by
+// simd_foreach.h. Objects [begin, end) are read a whole pack at a time from
+// SoA lanes (padded to 64 bytes, see vecsoa.h), begin being a multiple of 32.
+// planes holds planeCount planes (a, b, c, d). Bit i % 32 of mask[i / 32] is
+// set when object i is on the inner side of every plane; bits past end are
+// cleared.
+
+// Shift the visibility bits of the pack at i into word, and store the word
+// once it is full or the range ends
+inline void pushBits(uint32_t& word, int outside, size_t i, size_t end, uint32_t* mask) {
+  const int W = Pack<float>::W;
+  word |= (uint32_t) (~outside & ((1 << W) - 1)) << (i % 32);
+  if ((i + W) % 32 == 0 || i + W >= end) {
+    if (end - (i & ~(size_t) 31) < 32)
+      word &= (1u << (end % 32)) - 1;
+    mask[i / 32] = word;
+    word = 0;
+  }
+}
+
+// Visible iff n.c + d + r >= 0 for every plane, n.c + d being evaluated as
+// Frustum::distance does
+void cullSpheres(const float* planes, int planeCount, const float* x, const float* y, const float* z,
+  const float* r, size_t begin, size_t end, uint32_t* mask) {
+  typedef Pack<float> P;
+  typename P::V a[6], b[6], c[6], d[6];
+  for (int k = 0 ; k < planeCount ; k++) {
+    a[k] = P::set1(planes[4*k]);
+    b[k] = P::set1(planes[4*k + 1]);
+    c[k] = P::set1(planes[4*k + 2]);
+    d[k] = P::set1(planes[4*k + 3]);
+  }
+  typename P::V zero = P::set1(0.0f);
+  uint32_t word = 0;
+  for (size_t i = begin ; i < end ; i += P::W) {
+    typename P::V px = P::load(x + i), py = P::load(y + i), pz = P::load(z + i), pr = P::load(r + i);
+    typename P::V nearest = zero;
+    for (int k = 0 ; k < planeCount ; k++)
+      nearest = P::min(nearest, P::fmadd(c[k], pz, P::fmadd(b[k], py, a[k] * px)) + d[k] + pr);
+    pushBits(word, P::bits(P::lt(nearest, zero)), i, end, mask);
+  }
+}
+
+// Visible iff n.p + d >= 0 for every plane, p being the corner furthest along
+// n: the same test as Frustum::testAabb and the group tests of frustum.cpp
+void cullAabbs(const float* planes, int planeCount, const float* minX, const float* minY, const float* minZ,
+  const float* maxX, const float* maxY, const float* maxZ, size_t begin, size_t end, uint32_t* mask) {
+  typedef Pack<float> P;
+  typename P::V a[6], b[6], c[6], d[6];
+  bool positive[6][3];
+  for (int k = 0 ; k < planeCount ; k++) {
+    a[k] = P::set1(planes[4*k]);
+    b[k] = P::set1(planes[4*k + 1]);
+    c[k] = P::set1(planes[4*k + 2]);
+    d[k] = P::set1(planes[4*k + 3]);
+    for (int j = 0 ; j < 3 ; j++)
+      positive[k][j] = planes[4*k + j] >= 0.0f;
+  }
+  typename P::V zero = P::set1(0.0f);
+  uint32_t word = 0;
+  for (size_t i = begin ; i < end ; i += P::W) {
+    typename P::V x0 = P::load(minX + i), y0 = P::load(minY + i), z0 = P::load(minZ + i);
+    typename P::V x1 = P::load(maxX + i), y1 = P::load(maxY + i), z1 = P::load(maxZ + i);
+    typename P::V nearest = zero;
+    for (int k = 0 ; k < planeCount ; k++) {
+      typename P::V x = positive[k][0] ? x1 : x0, y = positive[k][1] ? y1 : y0, z = positive[k][2] ? z1 : z0;
+      nearest = P::min(nearest, P::fmadd(c[k], z, P::fmadd(b[k], y, a[k] * x)) + d[k]);
+    }
+    pushBits(word, P::bits(P::lt(nearest, zero)), i, end, mask);
+  }
+}
@@ -3,6 +3,7 @@
 
 #include <iostream>
 
+#include "config.h"
 #include "vec3.h"
 
 namespace qm {
@@ -14,31 +15,20 @@ template<typename T> class Mat3Base {
 
   public:
     // Constructors
-    inline Mat3Base() {
-      m[0] = m[1] = m[2] = m[3] = m[4] = m[5] = m[6] = m[7] = m[8] = T();
-    }
-    inline Mat3Base(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8) {
-      m[0] = m0;
-      m[1] = m1;
-      m[2] = m2;
-      m[3] = m3;
-      m[4] = m4;
-      m[5] = m5;
-      m[6] = m6;
-      m[7] = m7;
-      m[8] = m8;
-    }
-    inline const T* getArray() const {
+    constexpr Mat3Base() : m{T(), T(), T(), T(), T(), T(), T(), T(), T()} { }
+    constexpr Mat3Base(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8) :
+      m{m0, m1, m2, m3, m4, m5, m6, m7, m8} { }
+    constexpr const T* getArray() const {
       return m;
     }
     // Operators
-    inline T& operator[](int index) {
+    QM_CONSTEXPR14 T& operator[](int index) {
       return m[index];
     }
-    inline const T& operator[](int index) const {
+    constexpr const T& operator[](int index) const {
       return m[index];
     }
-    inline Mat3Base& operator=(const Mat3Base& M) {
+    QM_CONSTEXPR14 Mat3Base& operator=(const Mat3Base& M) {
       m[0] = M[0];
       m[1] = M[1];
       m[2] = M[2];
@@ -50,7 +40,7 @@ template<typename T> class Mat3Base {
       m[8] = M[8];
       return *this;
     }
-    inline Mat3Base& operator+=(const Mat3Base& M) {
+    QM_CONSTEXPR14 Mat3Base& operator+=(const Mat3Base& M) {
       m[0] += M[0];
       m[1] += M[1];
       m[2] += M[2];
@@ -62,7 +52,7 @@ template<typename T> class Mat3Base {
       m[8] += M[8];
       return *this;
     }
-    inline Mat3Base& operator-=(const Mat3Base& M) {
+    QM_CONSTEXPR14 Mat3Base& operator-=(const Mat3Base& M) {
       m[0] -= M[0];
       m[1] -= M[1];
       m[2] -= M[2];
@@ -74,7 +64,7 @@ template<typename T> class Mat3Base {
       m[8] -= M[8];
       return *this;
     }
-    inline Mat3Base& operator*=(T s) {
+    QM_CONSTEXPR14 Mat3Base& operator*=(T s) {
       m[0] *= s;
       m[1] *= s;
       m[2] *= s;
@@ -86,7 +76,7 @@ template<typename T> class Mat3Base {
       m[8] *= s;
       return *this;
     }
-    inline Mat3Base& operator/=(T s) {
+    QM_CONSTEXPR14 Mat3Base& operator/=(T s) {
       m[0] /= s;
       m[1] /= s;
       m[2] /= s;
@@ -104,7 +94,7 @@ template<typename T> class Mat3Base {
 
 };
 
-template<typename T> const Mat3Base<T>& operator*(const Mat3Base<T>& A, const Mat3Base<T>& B) {
+template<typename T> QM_CONSTEXPR14 const Mat3Base<T> operator*(const Mat3Base<T>& A, const Mat3Base<T>& B) {
   Mat3Base<T> result;
   int index = 0;
   for (int j = 0 ; j < 3 ; j++) {
@@ -119,7 +109,7 @@ template<typename T> const Mat3Base<T>& operator*(const Mat3Base<T>& A, const Ma
   return result;
 }
 
-template<typename T> const Vec3<T> operator*(const Mat3Base<T>& A, const Vec3<T>& B) {
+template<typename T> QM_CONSTEXPR14 const Vec3<T> operator*(const Mat3Base<T>& A, const Vec3<T>& B) {
   Vec3<T> result;
   int index = 0;
   for (int i = 0 ; i < 3 ; i++) {
@@ -147,10 +137,10 @@ class Mat3 : public Mat3Base<T> {
 
   public:
     // Constructors
-    inline Mat3() : Mat3Base<T>() { }
-    inline Mat3(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8) :
+    constexpr Mat3() : Mat3Base<T>() { }
+    constexpr Mat3(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8) :
       Mat3Base<T>(m0, m1, m2, m3, m4, m5, m6, m7, m8) {}
-    inline Mat3(const Mat3Base<T>& M) : Mat3Base<T>(M) {}
+    constexpr Mat3(const Mat3Base<T>& M) : Mat3Base<T>(M) {}
 
 };
 
@@ -159,13 +149,13 @@ class Mat3<float> : public Mat3Base<float> {
 
   public:
     // Constructors
-    inline Mat3<float>() : Mat3Base<float>() { }
-    inline Mat3<float>(float m0, float m1, float m2, float m3, float m4, float m5, float m6, float m7, float m8) :
+    constexpr Mat3<float>() : Mat3Base<float>() { }
+    constexpr Mat3<float>(float m0, float m1, float m2, float m3, float m4, float m5, float m6, float m7, float m8) :
       Mat3Base<float>(m0, m1, m2, m3, m4, m5, m6, m7, m8) {}
-    inline Mat3<float>(const Mat3Base<float>& M) : Mat3Base<float>(M) {}
+    constexpr Mat3<float>(const Mat3Base<float>& M) : Mat3Base<float>(M) {}
 
     // Static methods
-    static inline Mat3<float> zeroMatrix() {
+    static constexpr Mat3<float> zeroMatrix() {
       return Mat3<float>(
         0.0f, 0.0f, 0.0f,
         0.0f, 0.0f, 0.0f,
@@ -173,7 +163,7 @@ class Mat3<float> : public Mat3Base<float> {
       );
     }
 
-    static inline Mat3<float> identityMatrix() {
+    static constexpr Mat3<float> identityMatrix() {
       return Mat3<float>(
         1.0f, 0.0f, 0.0f,
         0.0f, 1.0f, 0.0f,
@@ -183,7 +173,37 @@ class Mat3<float> : public Mat3Base<float> {
 
 };
 
+template<>
+class Mat3<double> : public Mat3Base<double> {
+
+  public:
+    // Constructors
+    constexpr Mat3<double>() : Mat3Base<double>() { }
+    constexpr Mat3<double>(double m0, double m1, double m2, double m3, double m4, double m5, double m6, double m7, double m8) :
+      Mat3Base<double>(m0, m1, m2, m3, m4, m5, m6, m7, m8) {}
+    constexpr Mat3<double>(const Mat3Base<double>& M) : Mat3Base<double>(M) {}
+
+    // Static methods
+    static constexpr Mat3<double> zeroMatrix() {
+      return Mat3<double>(
+        0.0, 0.0, 0.0,
+        0.0, 0.0, 0.0,
+        0.0, 0.0, 0.0
+      );
+    }
+
+    static constexpr Mat3<double> identityMatrix() {
+      return Mat3<double>(
+        1.0, 0.0, 0.0,
+        0.0, 1.0, 0.0,
+        0.0, 0.0, 1.0
+      );
+    }
+
+};
+
 typedef Mat3<float> Mat3f;
+typedef Mat3<double> Mat3d;
 
 }
 
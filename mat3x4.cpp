@@ -0,0 +1,164 @@
+#include "mat3x4.h"
+#include "simd.h"
+
+#if QM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace qm;
+
+namespace {
+
+#define QM_SIMD_KERNELS "mat3x4_kernels.inl"
+#include "simd_foreach.h"
+
+/**
+ * Set of kernels compiled for one instruction set.
+ */
+struct Mat3x4Kernels {
+  void (*mul)(const float* a, const float* b, float* r);
+  void (*compose)(const float* a, const float* b, float* out, size_t count);
+  void (*inverse)(const float* in, float* out, size_t count);
+  void (*relative)(const double* in, const double* origin, float* out, size_t count);
+};
+
+void mulMat3x4Scalar(const float* a, const float* b, float* r) {
+  const Mat3x4Base<float>& A = *reinterpret_cast<const Mat3x4Base<float>*>(a);
+  const Mat3x4Base<float>& B = *reinterpret_cast<const Mat3x4Base<float>*>(b);
+  *reinterpret_cast<Mat3x4Base<float>*>(r) = operator*<float>(A, B);
+}
+
+// Camera-relative transforms from Mat4 doubles (last row dropped):
+// translation - origin in double, then rounded to float
+void relativeMat3x4Scalar(const double* in, const double* origin, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 12) {
+    for (int j = 0 ; j < 3 ; j++)
+      for (int i = 0 ; i < 3 ; i++)
+        out[3*j + i] = (float) in[4*j + i];
+    for (int i = 0 ; i < 3 ; i++)
+      out[9 + i] = (float) (in[12 + i] - origin[i]);
+  }
+}
+
+#if QM_SIMD_X86
+
+// Store the xyz lanes of 4 columns as 12 packed floats, with 3 full stores
+QM_TARGET("sse2") inline void storeColumns(float* r, const __m128 col[4]) {
+  __m128 t0 = _mm_shuffle_ps(col[0], col[1], _MM_SHUFFLE(0, 0, 2, 2));
+  __m128 t2 = _mm_shuffle_ps(col[2], col[3], _MM_SHUFFLE(0, 0, 2, 2));
+  _mm_storeu_ps(r, _mm_shuffle_ps(col[0], t0, _MM_SHUFFLE(2, 0, 1, 0)));
+  _mm_storeu_ps(r + 4, _mm_shuffle_ps(col[1], col[2], _MM_SHUFFLE(1, 0, 2, 1)));
+  _mm_storeu_ps(r + 8, _mm_shuffle_ps(t2, col[3], _MM_SHUFFLE(2, 1, 2, 0)));
+}
+
+// One column per register, same operation order as the generic operator*.
+// The 12 floats are moved with 3 full loads/stores and shuffled into columns
+// (the w lanes are garbage and never stored).
+QM_TARGET("sse2") void mulMat3x4Sse2(const float* a, const float* b, float* r) {
+  __m128 a0 = _mm_loadu_ps(a);
+  __m128 a1 = _mm_loadu_ps(a + 4);
+  __m128 a2 = _mm_loadu_ps(a + 8);
+  __m128 c[4];
+  c[0] = a0;
+  c[1] = _mm_shuffle_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(0, 0, 3, 3)), a1, _MM_SHUFFLE(1, 1, 2, 0));
+  c[2] = _mm_shuffle_ps(a1, a2, _MM_SHUFFLE(0, 0, 3, 2));
+  c[3] = _mm_shuffle_ps(a2, a2, _MM_SHUFFLE(3, 3, 2, 1));
+  __m128 col[4];
+  for (int j = 0 ; j < 4 ; j++) {
+    col[j] = _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(c[0], _mm_set1_ps(b[3*j])),
+      _mm_mul_ps(c[1], _mm_set1_ps(b[3*j + 1]))),
+      _mm_mul_ps(c[2], _mm_set1_ps(b[3*j + 2])));
+  }
+  col[3] = _mm_add_ps(col[3], c[3]);
+  storeColumns(r, col);
+}
+
+// Half a double column per register, converted pairwise and joined
+QM_TARGET("sse2") void relativeMat3x4Sse2(const double* in, const double* origin, float* out, size_t count) {
+  const __m128d originXY = _mm_loadu_pd(origin);
+  const __m128d originZ = _mm_load_sd(origin + 2);
+  __m128 col[4];
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 12) {
+    for (int j = 0 ; j < 3 ; j++)
+      col[j] = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(in + 4*j)), _mm_cvtpd_ps(_mm_loadu_pd(in + 4*j + 2)));
+    col[3] = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(in + 12), originXY)),
+      _mm_cvtpd_ps(_mm_sub_pd(_mm_load_sd(in + 14), originZ)));
+    storeColumns(out, col);
+  }
+}
+
+// One double column converted to a float column per register
+QM_TARGET("avx") void relativeMat3x4Avx(const double* in, const double* origin, float* out, size_t count) {
+  const __m256d o = _mm256_setr_pd(origin[0], origin[1], origin[2], 0.0);
+  __m128 col[4];
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 12) {
+    col[0] = _mm256_cvtpd_ps(_mm256_loadu_pd(in));
+    col[1] = _mm256_cvtpd_ps(_mm256_loadu_pd(in + 4));
+    col[2] = _mm256_cvtpd_ps(_mm256_loadu_pd(in + 8));
+    col[3] = _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(in + 12), o));
+    storeColumns(out, col);
+  }
+}
+
+#endif // QM_SIMD_X86
+
+#define QM_MAT3X4_KERNELS(ns) ns::composeMat3x4<float>, ns::inverseMat3x4<float>
+
+const Mat3x4Kernels& kernels() {
+  static const Mat3x4Kernels table[SIMD_ISA_COUNT] = {
+    { mulMat3x4Scalar, QM_MAT3X4_KERNELS(scalar), relativeMat3x4Scalar },
+#if QM_SIMD_X86
+    { mulMat3x4Sse2, QM_MAT3X4_KERNELS(sse2), relativeMat3x4Sse2 },
+    { mulMat3x4Sse2, QM_MAT3X4_KERNELS(avx), relativeMat3x4Avx },
+    { mulMat3x4Sse2, QM_MAT3X4_KERNELS(avx2), relativeMat3x4Avx }
+#endif
+  };
+  return table[simdIsa()];
+}
+
+#undef QM_MAT3X4_KERNELS
+
+}
+
+namespace qm {
+
+static_assert(sizeof(Mat3x4Base<float>) == 12 * sizeof(float), "Mat3x4Base<float> must be 12 packed floats");
+
+const Mat3x4Base<float> operator*(const Mat3x4Base<float>& A, const Mat3x4Base<float>& B) {
+  Mat3x4Base<float> result;
+  kernels().mul(A.getArray(), B.getArray(), &result[0]);
+  return result;
+}
+
+void composeMany(const Mat3x4Base<float>* A, const Mat3x4Base<float>* B, Mat3x4Base<float>* out, size_t count) {
+  kernels().compose(reinterpret_cast<const float*>(A), reinterpret_cast<const float*>(B), reinterpret_cast<float*>(out), count);
+}
+
+void inverseMany(const Mat3x4Base<float>* in, Mat3x4Base<float>* out, size_t count) {
+  kernels().inverse(reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void cameraRelativeMany(const Mat4Base<double>* in, const Vec3<double>& origin, Mat3x4Base<float>* out, size_t count) {
+  kernels().relative(reinterpret_cast<const double*>(in), &origin[0], reinterpret_cast<float*>(out), count);
+}
+
+// The Mat4 kernels keep the matrix in registers, so the 4th row costs nothing
+// per vector: expand once and reuse them.
+void transformPoints(const Mat3x4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count) {
+  transformPoints(M.toMat4(), in, out, count);
+}
+
+void transformDirections(const Mat3x4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count) {
+  transformDirections(M.toMat4(), in, out, count);
+}
+
+void transformPoints(const Mat3x4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count) {
+  transformPoints(M.toMat4(), in, out, count);
+}
+
+void transformDirections(const Mat3x4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count) {
+  transformDirections(M.toMat4(), in, out, count);
+}
+
+}
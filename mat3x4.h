@@ -0,0 +1,286 @@
+#ifndef MAT3X4_H
+#define MAT3X4_H
+
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+
+#include "config.h"
+#include "fastmath.h"
+#include "vec3.h"
+#include "mat3.h"
+#include "mat4.h"
+
+namespace qm {
+
+/**
+ * Base class for an affine transform: a 4x4 matrix whose last row is
+ * implicitly 0 0 0 1, so only its 3 first rows are stored.
+ * Column-order (0->2 first column, ..., 9->11 translation), as Mat4Base
+ * without the elements 3, 7, 11 and 15.
+ */
+template<typename T> class Mat3x4Base {
+
+  public:
+    // Constructors
+    constexpr Mat3x4Base() : m{T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T()} { }
+    constexpr Mat3x4Base(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11) :
+      m{m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11} { }
+    // Linear part and translation
+    constexpr Mat3x4Base(const Mat3Base<T>& A, const Vec3<T>& t) :
+      m{A[0], A[1], A[2], A[3], A[4], A[5], A[6], A[7], A[8], t[0], t[1], t[2]} { }
+    // Drops the last row of M, which should be 0 0 0 1
+    constexpr explicit Mat3x4Base(const Mat4Base<T>& M) :
+      m{M[0], M[1], M[2], M[4], M[5], M[6], M[8], M[9], M[10], M[12], M[13], M[14]} { }
+    QM_CONSTEXPR14 void init(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11) {
+      m[0] = m0;
+      m[1] = m1;
+      m[2] = m2;
+      m[3] = m3;
+      m[4] = m4;
+      m[5] = m5;
+      m[6] = m6;
+      m[7] = m7;
+      m[8] = m8;
+      m[9] = m9;
+      m[10] = m10;
+      m[11] = m11;
+    }
+    constexpr const T* getArray() const {
+      return m;
+    }
+    // Operators
+    QM_CONSTEXPR14 T& operator[](int index) {
+      return m[index];
+    }
+    constexpr const T& operator[](int index) const {
+      return m[index];
+    }
+    QM_CONSTEXPR14 bool operator==(const Mat3x4Base& M) const {
+      for (int i = 0 ; i < 12 ; i++)
+        if (m[i] != M[i])
+          return false;
+      return true;
+    }
+    // Others
+    constexpr Mat3Base<T> toMat3() const {
+      return Mat3Base<T>(
+        m[0], m[1], m[2],
+        m[3], m[4], m[5],
+        m[6], m[7], m[8]
+      );
+    }
+    constexpr Mat4Base<T> toMat4() const {
+      return Mat4Base<T>(
+        m[0], m[1], m[2], T(0),
+        m[3], m[4], m[5], T(0),
+        m[6], m[7], m[8], T(0),
+        m[9], m[10], m[11], T(1)
+      );
+    }
+    constexpr Vec3<T> getTranslation() const {
+      return Vec3<T>(m[9], m[10], m[11]);
+    }
+    // M * (p, 1)
+    constexpr Vec3<T> transformPoint(const Vec3<T>& p) const {
+      return Vec3<T>(
+        m[0] * p[0] + m[3] * p[1] + m[6] * p[2] + m[9],
+        m[1] * p[0] + m[4] * p[1] + m[7] * p[2] + m[10],
+        m[2] * p[0] + m[5] * p[1] + m[8] * p[2] + m[11]
+      );
+    }
+    // M * (d, 0)
+    constexpr Vec3<T> transformDirection(const Vec3<T>& d) const {
+      return Vec3<T>(
+        m[0] * d[0] + m[3] * d[1] + m[6] * d[2],
+        m[1] * d[0] + m[4] * d[1] + m[7] * d[2],
+        m[2] * d[0] + m[5] * d[1] + m[8] * d[2]
+      );
+    }
+    constexpr T determinant() const {
+      return m[0] * (m[4] * m[8] - m[7] * m[5])
+        + m[1] * (m[6] * m[5] - m[3] * m[8])
+        + m[2] * (m[3] * m[7] - m[6] * m[4]);
+    }
+    // Inverse 3x3 block, then -A^-1 * t (zero matrix if singular)
+    QM_CONSTEXPR14 Mat3x4Base inverse() const {
+      Mat3x4Base result;
+      T c0 = m[4] * m[8] - m[7] * m[5];
+      T c1 = m[6] * m[5] - m[3] * m[8];
+      T c2 = m[3] * m[7] - m[6] * m[4];
+      T det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+      if (det == T(0))
+        return result;
+      T invDet = T(1) / det;
+      result[0] = c0 * invDet;
+      result[3] = c1 * invDet;
+      result[6] = c2 * invDet;
+      result[1] = (m[7] * m[2] - m[1] * m[8]) * invDet;
+      result[4] = (m[0] * m[8] - m[6] * m[2]) * invDet;
+      result[7] = (m[6] * m[1] - m[0] * m[7]) * invDet;
+      result[2] = (m[1] * m[5] - m[4] * m[2]) * invDet;
+      result[5] = (m[3] * m[2] - m[0] * m[5]) * invDet;
+      result[8] = (m[0] * m[4] - m[3] * m[1]) * invDet;
+      result.setInverseTranslation(*this);
+      return result;
+    }
+    // Inverse of a rotation + translation: transposed rotation, rotated -translation
+    QM_CONSTEXPR14 Mat3x4Base inverseRigid() const {
+      Mat3x4Base result(
+        m[0], m[3], m[6],
+        m[1], m[4], m[7],
+        m[2], m[5], m[8],
+        T(0), T(0), T(0)
+      );
+      result.setInverseTranslation(*this);
+      return result;
+    }
+
+  protected:
+    T m[12];
+
+  private:
+    // Translation of the inverse of M, once its 3x3 block holds the inverse
+    QM_CONSTEXPR14 void setInverseTranslation(const Mat3x4Base& M) {
+      m[9] = -(m[0] * M[9] + m[3] * M[10] + m[6] * M[11]);
+      m[10] = -(m[1] * M[9] + m[4] * M[10] + m[7] * M[11]);
+      m[11] = -(m[2] * M[9] + m[5] * M[10] + m[8] * M[11]);
+    }
+
+};
+
+// A * B without the implicit last row: 36 multiplies instead of 64 for Mat4
+template<typename T> QM_CONSTEXPR14 const Mat3x4Base<T> operator*(const Mat3x4Base<T>& A, const Mat3x4Base<T>& B) {
+  Mat3x4Base<T> result;
+  for (int j = 0 ; j < 4 ; j++) {
+    for (int i = 0 ; i < 3 ; i++) {
+      T sum = A[i] * B[3*j] + A[i + 3] * B[3*j + 1] + A[i + 6] * B[3*j + 2];
+      if (j == 3)
+        sum += A[i + 9];
+      result[i + 3*j] = sum;
+    }
+  }
+  return result;
+}
+
+template<typename T> constexpr const Vec3<T> operator*(const Mat3x4Base<T>& A, const Vec3<T>& p) {
+  return A.transformPoint(p);
+}
+
+// float products are dispatched at runtime (scalar or SSE2, see simd.h), with
+// the same results as the generic code above. Not constexpr: call
+// operator*<float>(A, B) in constant expressions.
+const Mat3x4Base<float> operator*(const Mat3x4Base<float>& A, const Mat3x4Base<float>& B);
+
+// Batched operations on count contiguous affine transforms, one per SIMD lane
+// (see mat3x4.cpp). in and out may be the same array.
+// - composeMany: out[i] = A[i] * B[i]
+// - inverseMany: out[i] = in[i].inverse()
+// - transformPoints / transformDirections: as the Mat4Base versions of mat4.h
+// - cameraRelativeMany: as the Mat4Base version of mat4.h, dropping the last
+//   row of in (which should be 0 0 0 1)
+void composeMany(const Mat3x4Base<float>* A, const Mat3x4Base<float>* B, Mat3x4Base<float>* out, size_t count);
+void inverseMany(const Mat3x4Base<float>* in, Mat3x4Base<float>* out, size_t count);
+void cameraRelativeMany(const Mat4Base<double>* in, const Vec3<double>& origin, Mat3x4Base<float>* out, size_t count);
+void transformPoints(const Mat3x4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count);
+void transformDirections(const Mat3x4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count);
+void transformPoints(const Mat3x4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count);
+void transformDirections(const Mat3x4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count);
+
+template<typename T> std::ostream& operator<<(std::ostream& output, const Mat3x4Base<T>& M) {
+    output << "[" << M[0] << "][" << M[3] << "][" << M[6] << "][" << M[9] << "]\n";
+    output << "[" << M[1] << "][" << M[4] << "][" << M[7] << "][" << M[10] << "]\n";
+    output << "[" << M[2] << "][" << M[5] << "][" << M[8] << "][" << M[11] << "]\n";
+    return output;
+}
+
+/**
+ * Affine transform stored as a 3x4 matrix.
+ */
+template<typename T>
+class Mat3x4 : public Mat3x4Base<T> {
+
+  public:
+    // Constructors
+    constexpr Mat3x4() : Mat3x4Base<T>() { }
+    constexpr Mat3x4(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11) :
+      Mat3x4Base<T>(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11) {}
+    constexpr Mat3x4(const Mat3Base<T>& A, const Vec3<T>& t) : Mat3x4Base<T>(A, t) {}
+    constexpr explicit Mat3x4(const Mat4Base<T>& M) : Mat3x4Base<T>(M) {}
+    constexpr Mat3x4(const Mat3x4Base<T>& M) : Mat3x4Base<T>(M) {}
+
+};
+
+template<>
+class Mat3x4<float> : public Mat3x4Base<float> {
+
+  public:
+    // Constructors
+    constexpr Mat3x4<float>() : Mat3x4Base<float>() { }
+    constexpr Mat3x4<float>(float m0, float m1, float m2, float m3, float m4, float m5, float m6, float m7, float m8, float m9, float m10, float m11) :
+      Mat3x4Base<float>(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11) {}
+    constexpr Mat3x4<float>(const Mat3Base<float>& A, const Vec3<float>& t) : Mat3x4Base<float>(A, t) {}
+    constexpr explicit Mat3x4<float>(const Mat4Base<float>& M) : Mat3x4Base<float>(M) {}
+    constexpr Mat3x4<float>(const Mat3x4Base<float>& M) : Mat3x4Base<float>(M) {}
+
+    QM_CONSTEXPR14 const Mat3x4<float> translate(const qm::Vec3<float>& v) const {
+      Mat3x4<float> result(*this);
+      result[9] += v[0];
+      result[10] += v[1];
+      result[11] += v[2];
+      return result;
+    }
+
+    inline const Mat3x4<float> rotateY(float deg, Precision precision = QM_TRIG_PRECISION) const {
+      float s, c;
+      if (precision == PRECISION_FAST) {
+        fast::sincos(deg * fast::DEG_TO_RAD, s, c);
+      } else {
+        float rad = deg * ONE_DEG_IN_RAD;
+        s = sin(rad);
+        c = cos(rad);
+      }
+      Mat3x4<float> rotation = Mat3x4<float>::identityMatrix();
+      rotation[0] = c;
+      rotation[6] = s;
+      rotation[2] = -s;
+      rotation[8] = c;
+      return rotation * *this;
+    }
+
+    // Static methods
+    static constexpr Mat3x4<float> identityMatrix() {
+      return Mat3x4<float>(
+        1.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 0.0f
+      );
+    }
+
+    static constexpr Mat3x4<float> translationMatrix(const qm::Vec3<float>& v) {
+      return Mat3x4<float>(
+        1.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,
+        v[0], v[1], v[2]
+      );
+    }
+
+    static constexpr Mat3x4<float> scaleMatrix(const qm::Vec3<float>& s) {
+      return Mat3x4<float>(
+        s[0], 0.0f, 0.0f,
+        0.0f, s[1], 0.0f,
+        0.0f, 0.0f, s[2],
+        0.0f, 0.0f, 0.0f
+      );
+    }
+
+};
+
+typedef Mat3x4<float> Mat3x4f;
+typedef Mat3x4<float> Affine3f;
+
+}
+
+#endif // MAT3X4_H
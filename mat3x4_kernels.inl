@@ -0,0 +1,88 @@
+// Batched affine transform kernels of mat3x4.cpp, expanded once per instruction
+// set by simd_foreach.h. Pack<T>::W transforms are processed at once, one per
+// lane: e[3*c + r] holds element (r, c) of each of them (as Mat3x4Base).
+
+template<typename T> inline void loadMat3x4(const T* p, typename Pack<T>::V e[12]) {
+  for (int k = 0 ; k < 3 ; k++)
+    Pack<T>::loadTransposed4(p + 4*k, 12, e[4*k], e[4*k + 1], e[4*k + 2], e[4*k + 3]);
+}
+
+template<typename T> inline void storeMat3x4(T* p, const typename Pack<T>::V e[12]) {
+  for (int k = 0 ; k < 3 ; k++)
+    Pack<T>::storeTransposed4(p + 4*k, 12, e[4*k], e[4*k + 1], e[4*k + 2], e[4*k + 3]);
+}
+
+// Runs Op on groups of W transforms read from a (and b if not null). The last
+// partial group goes through zeroed buffers, so out may alias a or b.
+template<typename T, typename Op> void forEachMat3x4Group(const T* a, const T* b, T* out, size_t count) {
+  const int W = Pack<T>::W;
+  size_t n = 0;
+  for ( ; n + W <= count ; n += W)
+    Op::run(a + 12*n, b ? b + 12*n : 0, out + 12*n);
+  if (n == count)
+    return;
+  T bufferA[12 * W] = { T(0) };
+  T bufferB[12 * W] = { T(0) };
+  T bufferOut[12 * W];
+  for (size_t k = 0 ; k < 12 * (count - n) ; k++) {
+    bufferA[k] = a[12*n + k];
+    if (b)
+      bufferB[k] = b[12*n + k];
+  }
+  Op::run(bufferA, bufferB, bufferOut);
+  for (size_t k = 0 ; k < 12 * (count - n) ; k++)
+    out[12*n + k] = bufferOut[k];
+}
+
+// Same operation order as the Mat3x4Base operator*
+template<typename T> struct ComposeOp {
+  static inline void run(const T* a, const T* b, T* out) {
+    typename Pack<T>::V ea[12], eb[12], r[12];
+    loadMat3x4<T>(a, ea);
+    loadMat3x4<T>(b, eb);
+    for (int j = 0 ; j < 4 ; j++) {
+      for (int i = 0 ; i < 3 ; i++) {
+        r[i + 3*j] = ea[i] * eb[3*j] + ea[i + 3] * eb[3*j + 1] + ea[i + 6] * eb[3*j + 2];
+        if (j == 3)
+          r[i + 3*j] = r[i + 3*j] + ea[i + 9];
+      }
+    }
+    storeMat3x4<T>(out, r);
+  }
+};
+
+// Same operations as Mat3x4Base::inverse; singular transforms give the zero matrix
+template<typename T> struct InverseOp {
+  static inline void run(const T* in, const T*, T* out) {
+    typedef Pack<T> P;
+    typename P::V m[12], r[12];
+    loadMat3x4<T>(in, m);
+    typename P::V c0 = m[4] * m[8] - m[7] * m[5];
+    typename P::V c1 = m[6] * m[5] - m[3] * m[8];
+    typename P::V c2 = m[3] * m[7] - m[6] * m[4];
+    typename P::V det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+    typename P::V zero = P::set1(T(0));
+    typename P::V invDet = P::select(P::eq(det, zero), zero, P::set1(T(1)) / det);
+    r[0] = c0 * invDet;
+    r[3] = c1 * invDet;
+    r[6] = c2 * invDet;
+    r[1] = (m[7] * m[2] - m[1] * m[8]) * invDet;
+    r[4] = (m[0] * m[8] - m[6] * m[2]) * invDet;
+    r[7] = (m[6] * m[1] - m[0] * m[7]) * invDet;
+    r[2] = (m[1] * m[5] - m[4] * m[2]) * invDet;
+    r[5] = (m[3] * m[2] - m[0] * m[5]) * invDet;
+    r[8] = (m[0] * m[4] - m[3] * m[1]) * invDet;
+    r[9] = zero - (r[0] * m[9] + r[3] * m[10] + r[6] * m[11]);
+    r[10] = zero - (r[1] * m[9] + r[4] * m[10] + r[7] * m[11]);
+    r[11] = zero - (r[2] * m[9] + r[5] * m[10] + r[8] * m[11]);
+    storeMat3x4<T>(out, r);
+  }
+};
+
+template<typename T> void composeMat3x4(const T* a, const T* b, T* out, size_t count) {
+  forEachMat3x4Group<T, ComposeOp<T> >(a, b, out, count);
+}
+
+template<typename T> void inverseMat3x4(const T* in, T* out, size_t count) {
+  forEachMat3x4Group<T, InverseOp<T> >(in, 0, out, count);
+}
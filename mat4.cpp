@@ -0,0 +1,1176 @@
+#include "mat4.h"
+#include "simd.h"
+
+#if QM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace qm;
+
+namespace {
+
+#define QM_SIMD_KERNELS "mat4_kernels.inl"
+#include "simd_foreach.h"
+
+typedef void (*MulMat4fFn)(const float* a, const float* b, float* r);
+typedef void (*MulVec4fFn)(const float* a, const float* v, float* r);
+typedef void (*MulMat4dFn)(const double* a, const double* b, double* r);
+typedef void (*MulVec4dFn)(const double* a, const double* v, double* r);
+typedef void (*TransformFn)(const float* m, const float* in, float* out, size_t count);
+typedef void (*Mat4fBatchFn)(const float* in, float* out, size_t count);
+typedef void (*TransformDFn)(const double* m, const double* in, double* out, size_t count);
+typedef void (*Mat4dBatchFn)(const double* in, double* out, size_t count);
+typedef void (*RelativeFn)(const double* in, const double* origin, float* out, size_t count);
+
+/**
+ * Set of kernels compiled for one instruction set.
+ */
+struct Mat4Kernels {
+  MulMat4fFn mulMat4f;
+  MulVec4fFn mulVec4f;
+  MulMat4dFn mulMat4d;
+  MulVec4dFn mulVec4d;
+  TransformFn transformPoints;
+  TransformFn transformDirections;
+  TransformFn transformVec4;
+  TransformFn transformPointsA;
+  TransformFn transformDirectionsA;
+  Mat4fBatchFn determinant;
+  Mat4fBatchFn inverse;
+  Mat4fBatchFn inverseAffine;
+  Mat4fBatchFn inverseRigid;
+  Mat4fBatchFn transpose;
+  // Same operations for a single matrix (count is 1 in practice)
+  Mat4fBatchFn determinant1;
+  Mat4fBatchFn inverse1;
+  Mat4fBatchFn inverseAffine1;
+  Mat4fBatchFn inverseRigid1;
+  Mat4fBatchFn transpose1;
+  // Double precision
+  TransformDFn transformPointsD;
+  TransformDFn transformDirectionsD;
+  TransformDFn transformVec4D;
+  Mat4dBatchFn determinantD;
+  Mat4dBatchFn inverseD;
+  Mat4dBatchFn inverseAffineD;
+  Mat4dBatchFn inverseRigidD;
+  Mat4dBatchFn transposeD;
+  Mat4dBatchFn determinantD1;
+  Mat4dBatchFn inverseD1;
+  Mat4dBatchFn inverseAffineD1;
+  Mat4dBatchFn inverseRigidD1;
+  Mat4dBatchFn transposeD1;
+  // Camera-relative double to float
+  RelativeFn relative;
+};
+
+//
+// Scalar kernels (same operation order as the generic templates)
+//
+
+template<typename T> void mulMat4Scalar(const T* a, const T* b, T* r) {
+  T result[16];
+  for (int j = 0 ; j < 4 ; j++) {
+    for (int i = 0 ; i < 4 ; i++) {
+      T sum = a[i] * b[4*j];
+      for (int k = 1 ; k < 4 ; k++)
+        sum += a[i + 4*k] * b[k + 4*j];
+      result[i + 4*j] = sum;
+    }
+  }
+  for (int i = 0 ; i < 16 ; i++)
+    r[i] = result[i];
+}
+
+template<typename T> void mulVec4Scalar(const T* a, const T* v, T* r) {
+  T result[4];
+  for (int i = 0 ; i < 4 ; i++) {
+    T sum = a[i] * v[0];
+    for (int k = 1 ; k < 4 ; k++)
+      sum += a[i + 4*k] * v[k];
+    result[i] = sum;
+  }
+  for (int i = 0 ; i < 4 ; i++)
+    r[i] = result[i];
+}
+
+// Vec3 batches: xyz of M * (v, 1) for points, M * (v, 0) for directions
+template<typename T, bool Point> void transformVec3Scalar(const T* m, const T* in, T* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 3, out += 3) {
+    T x = in[0];
+    T y = in[1];
+    T z = in[2];
+    T rx = m[0] * x + m[4] * y + m[8] * z;
+    T ry = m[1] * x + m[5] * y + m[9] * z;
+    T rz = m[2] * x + m[6] * y + m[10] * z;
+    if (Point) {
+      rx += m[12];
+      ry += m[13];
+      rz += m[14];
+    }
+    out[0] = rx;
+    out[1] = ry;
+    out[2] = rz;
+  }
+}
+
+template<typename T> void transformVec4Scalar(const T* m, const T* in, T* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 4, out += 4)
+    mulVec4Scalar<T>(m, in, out);
+}
+
+// Vec3A batches: as transformVec3, 4 floats apart, padding set to 0
+template<bool Point> void transformVec3AScalar(const float* m, const float* in, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 4, out += 4) {
+    transformVec3Scalar<float, Point>(m, in, out, 1);
+    out[3] = 0.0f;
+  }
+}
+
+// Camera-relative matrices: translation - origin in double, then every
+// element rounded to float
+void relativeMat4Scalar(const double* in, const double* origin, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    for (int k = 0 ; k < 12 ; k++)
+      out[k] = (float) in[k];
+    for (int k = 0 ; k < 3 ; k++)
+      out[12 + k] = (float) (in[12 + k] - origin[k]);
+    out[15] = (float) in[15];
+  }
+}
+
+#if QM_SIMD_X86
+
+//
+// SSE2 kernels: one column (float) or half a column (double) per register
+//
+
+QM_TARGET("sse2") void mulMat4fSse2(const float* a, const float* b, float* r) {
+  __m128 c0 = _mm_loadu_ps(a);
+  __m128 c1 = _mm_loadu_ps(a + 4);
+  __m128 c2 = _mm_loadu_ps(a + 8);
+  __m128 c3 = _mm_loadu_ps(a + 12);
+  __m128 col[4];
+  for (int j = 0 ; j < 4 ; j++) {
+    const float* bj = b + 4*j;
+    __m128 sum = _mm_mul_ps(c0, _mm_set1_ps(bj[0]));
+    sum = _mm_add_ps(sum, _mm_mul_ps(c1, _mm_set1_ps(bj[1])));
+    sum = _mm_add_ps(sum, _mm_mul_ps(c2, _mm_set1_ps(bj[2])));
+    sum = _mm_add_ps(sum, _mm_mul_ps(c3, _mm_set1_ps(bj[3])));
+    col[j] = sum;
+  }
+  for (int j = 0 ; j < 4 ; j++)
+    _mm_storeu_ps(r + 4*j, col[j]);
+}
+
+QM_TARGET("sse2") void mulVec4fSse2(const float* a, const float* v, float* r) {
+  __m128 sum = _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(v[0]));
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + 4), _mm_set1_ps(v[1])));
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + 8), _mm_set1_ps(v[2])));
+  sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + 12), _mm_set1_ps(v[3])));
+  _mm_storeu_ps(r, sum);
+}
+
+QM_TARGET("sse2") void mulVec4dSse2(const double* a, const double* v, double* r) {
+  __m128d s = _mm_set1_pd(v[0]);
+  __m128d lo = _mm_mul_pd(_mm_loadu_pd(a), s);
+  __m128d hi = _mm_mul_pd(_mm_loadu_pd(a + 2), s);
+  for (int k = 1 ; k < 4 ; k++) {
+    s = _mm_set1_pd(v[k]);
+    lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(a + 4*k), s));
+    hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(a + 4*k + 2), s));
+  }
+  _mm_storeu_pd(r, lo);
+  _mm_storeu_pd(r + 2, hi);
+}
+
+QM_TARGET("sse2") void mulMat4dSse2(const double* a, const double* b, double* r) {
+  double result[16];
+  for (int j = 0 ; j < 4 ; j++)
+    mulVec4dSse2(a, b + 4*j, result + 4*j);
+  for (int i = 0 ; i < 16 ; i++)
+    r[i] = result[i];
+}
+
+// Vec3 batches through the transposes of the SSE2 pack (simdpack.h)
+template<bool Point> QM_TARGET("sse2") void transformVec3Sse2(const float* m, const float* in, float* out, size_t count) {
+  __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+  __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6 = _mm_set1_ps(m[6]);
+  __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]);
+  __m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+  size_t n = 0;
+  for ( ; n + 4 <= count ; n += 4) {
+    __m128 x, y, z;
+    sse2::Pack<float>::loadTransposed3(in + 3*n, x, y, z);
+    __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_mul_ps(m8, z));
+    __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_mul_ps(m9, z));
+    __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_mul_ps(m10, z));
+    if (Point) {
+      rx = _mm_add_ps(rx, m12);
+      ry = _mm_add_ps(ry, m13);
+      rz = _mm_add_ps(rz, m14);
+    }
+    sse2::Pack<float>::storeTransposed3(out + 3*n, rx, ry, rz);
+  }
+  transformVec3Scalar<float, Point>(m, in + 3*n, out + 3*n, count - n);
+}
+
+QM_TARGET("sse2") void transformVec4Sse2(const float* m, const float* in, float* out, size_t count) {
+  __m128 c0 = _mm_loadu_ps(m);
+  __m128 c1 = _mm_loadu_ps(m + 4);
+  __m128 c2 = _mm_loadu_ps(m + 8);
+  __m128 c3 = _mm_loadu_ps(m + 12);
+  for (size_t n = 0 ; n < count ; n++, in += 4, out += 4) {
+    __m128 v = _mm_loadu_ps(in);
+    __m128 sum = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, 0x00));
+    sum = _mm_add_ps(sum, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, 0x55)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, 0xAA)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, 0xFF)));
+    _mm_storeu_ps(out, sum);
+  }
+}
+
+// One Vec3A per register, the padding lane cleared
+template<bool Point> QM_TARGET("sse2") void transformVec3ASse2(const float* m, const float* in, float* out, size_t count) {
+  __m128 c0 = _mm_loadu_ps(m);
+  __m128 c1 = _mm_loadu_ps(m + 4);
+  __m128 c2 = _mm_loadu_ps(m + 8);
+  __m128 c3 = _mm_loadu_ps(m + 12);
+  __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  for (size_t n = 0 ; n < count ; n++, in += 4, out += 4) {
+    __m128 v = _mm_loadu_ps(in);
+    __m128 sum = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(v, v, 0x00)), _mm_mul_ps(c1, _mm_shuffle_ps(v, v, 0x55)));
+    sum = _mm_add_ps(sum, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, 0xAA)));
+    if (Point)
+      sum = _mm_add_ps(sum, c3);
+    _mm_storeu_ps(out, _mm_and_ps(sum, xyz));
+  }
+}
+
+//
+// Single-matrix SSE2 kernels: one column per register. Batches of one or two
+// matrices are faster this way than through the lane-per-matrix kernels.
+//
+
+#define QM_SWIZZLE(v, x, y, z, w) _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(v), _MM_SHUFFLE(w, z, y, x)))
+#define QM_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+
+// 2x2 blocks are stored as (m00 m01 m10 m11). A * B
+QM_TARGET("sse2") inline __m128 mat2Mul(__m128 a, __m128 b) {
+  return _mm_add_ps(_mm_mul_ps(a, QM_SWIZZLE(b, 0, 3, 0, 3)),
+    _mm_mul_ps(QM_SWIZZLE(a, 1, 0, 3, 2), QM_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// adj(A) * B
+QM_TARGET("sse2") inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+  return _mm_sub_ps(_mm_mul_ps(QM_SWIZZLE(a, 3, 3, 0, 0), b),
+    _mm_mul_ps(QM_SWIZZLE(a, 1, 1, 2, 2), QM_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+// A * adj(B)
+QM_TARGET("sse2") inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+  return _mm_sub_ps(_mm_mul_ps(a, QM_SWIZZLE(b, 3, 0, 3, 0)),
+    _mm_mul_ps(QM_SWIZZLE(a, 1, 0, 3, 2), QM_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/**
+ * 2x2 block decomposition of a 4x4 matrix, used for the determinant and the
+ * inverse. Columns are read as rows: the inverse of the transpose is the
+ * transpose of the inverse, so the result comes out column-major as well.
+ */
+struct Mat4Blocks {
+  __m128 a, b, c, d;
+  __m128 detA, detB, detC, detD;
+  __m128 dc, ab;
+  __m128 det;
+
+  QM_TARGET("sse2") inline explicit Mat4Blocks(const float* m) {
+    __m128 r0 = _mm_loadu_ps(m);
+    __m128 r1 = _mm_loadu_ps(m + 4);
+    __m128 r2 = _mm_loadu_ps(m + 8);
+    __m128 r3 = _mm_loadu_ps(m + 12);
+    a = _mm_movelh_ps(r0, r1);
+    b = _mm_movehl_ps(r1, r0);
+    c = _mm_movelh_ps(r2, r3);
+    d = _mm_movehl_ps(r3, r2);
+    // (|A| |B| |C| |D|)
+    __m128 detSub = _mm_sub_ps(
+      _mm_mul_ps(QM_SHUFFLE(r0, r2, 0, 2, 0, 2), QM_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+      _mm_mul_ps(QM_SHUFFLE(r0, r2, 1, 3, 1, 3), QM_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+    detA = QM_SWIZZLE(detSub, 0, 0, 0, 0);
+    detB = QM_SWIZZLE(detSub, 1, 1, 1, 1);
+    detC = QM_SWIZZLE(detSub, 2, 2, 2, 2);
+    detD = QM_SWIZZLE(detSub, 3, 3, 3, 3);
+    dc = mat2AdjMul(d, c);
+    ab = mat2AdjMul(a, b);
+    // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+    __m128 tr = _mm_mul_ps(ab, QM_SWIZZLE(dc, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, QM_SWIZZLE(tr, 2, 3, 0, 1));
+    tr = _mm_add_ps(tr, QM_SWIZZLE(tr, 1, 0, 3, 2));
+    det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+  }
+};
+
+QM_TARGET("sse2") void determinantMat4fSse2(const float* in, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++)
+    _mm_store_ss(out + n, Mat4Blocks(in + 16*n).det);
+}
+
+QM_TARGET("sse2") void inverseMat4fSse2(const float* in, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    Mat4Blocks m(in);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(m.detD, m.a), mat2Mul(m.b, m.dc));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(m.detA, m.d), mat2Mul(m.c, m.ab));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(m.detB, m.c), mat2MulAdj(m.d, m.ab));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(m.detC, m.b), mat2MulAdj(m.a, m.dc));
+    // (1/|M|, -1/|M|, -1/|M|, 1/|M|), or zero if singular
+    __m128 invDet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), m.det);
+    invDet = _mm_and_ps(invDet, _mm_cmpneq_ps(m.det, _mm_setzero_ps()));
+    x = _mm_mul_ps(x, invDet);
+    y = _mm_mul_ps(y, invDet);
+    z = _mm_mul_ps(z, invDet);
+    w = _mm_mul_ps(w, invDet);
+    // Adjugate shuffles merged with the store shuffles
+    _mm_storeu_ps(out, QM_SHUFFLE(x, y, 3, 1, 3, 1));
+    _mm_storeu_ps(out + 4, QM_SHUFFLE(x, y, 2, 0, 2, 0));
+    _mm_storeu_ps(out + 8, QM_SHUFFLE(z, w, 3, 1, 3, 1));
+    _mm_storeu_ps(out + 12, QM_SHUFFLE(z, w, 2, 0, 2, 0));
+  }
+}
+
+QM_TARGET("sse2") inline __m128 cross3(__m128 a, __m128 b) {
+  return _mm_sub_ps(
+    _mm_mul_ps(QM_SWIZZLE(a, 1, 2, 0, 3), QM_SWIZZLE(b, 2, 0, 1, 3)),
+    _mm_mul_ps(QM_SWIZZLE(a, 2, 0, 1, 3), QM_SWIZZLE(b, 1, 2, 0, 3)));
+}
+
+// Writes the columns x, y, z of the 3x3 block and -(x*t0 + y*t1 + z*t2), w = 1
+QM_TARGET("sse2") inline void storeAffine(float* out, __m128 x, __m128 y, __m128 z, __m128 t, float w) {
+  __m128 translation = _mm_add_ps(_mm_add_ps(
+    _mm_mul_ps(x, QM_SWIZZLE(t, 0, 0, 0, 0)),
+    _mm_mul_ps(y, QM_SWIZZLE(t, 1, 1, 1, 1))),
+    _mm_mul_ps(z, QM_SWIZZLE(t, 2, 2, 2, 2)));
+  _mm_storeu_ps(out, x);
+  _mm_storeu_ps(out + 4, y);
+  _mm_storeu_ps(out + 8, z);
+  _mm_storeu_ps(out + 12, _mm_sub_ps(_mm_setzero_ps(), translation));
+  out[15] = w;
+}
+
+QM_TARGET("sse2") void inverseAffineMat4fSse2(const float* in, float* out, size_t count) {
+  const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    __m128 c0 = _mm_and_ps(_mm_loadu_ps(in), xyzMask);
+    __m128 c1 = _mm_and_ps(_mm_loadu_ps(in + 4), xyzMask);
+    __m128 c2 = _mm_and_ps(_mm_loadu_ps(in + 8), xyzMask);
+    __m128 t = _mm_loadu_ps(in + 12);
+    // Rows of the inverse are the cross products of the columns over |A|
+    __m128 r0 = cross3(c1, c2);
+    __m128 r1 = cross3(c2, c0);
+    __m128 r2 = cross3(c0, c1);
+    __m128 r3 = _mm_setzero_ps();
+    __m128 det = _mm_mul_ps(c0, r0);
+    det = _mm_add_ps(_mm_add_ps(QM_SWIZZLE(det, 0, 0, 0, 0), QM_SWIZZLE(det, 1, 1, 1, 1)), QM_SWIZZLE(det, 2, 2, 2, 2));
+    __m128 nonSingular = _mm_cmpneq_ps(det, _mm_setzero_ps());
+    __m128 invDet = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), det), nonSingular);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    storeAffine(out, _mm_mul_ps(r0, invDet), _mm_mul_ps(r1, invDet), _mm_mul_ps(r2, invDet), t,
+      _mm_movemask_ps(nonSingular) ? 1.0f : 0.0f);
+  }
+}
+
+QM_TARGET("sse2") void inverseRigidMat4fSse2(const float* in, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    __m128 c0 = _mm_loadu_ps(in);
+    __m128 c1 = _mm_loadu_ps(in + 4);
+    __m128 c2 = _mm_loadu_ps(in + 8);
+    __m128 c3 = _mm_setzero_ps();
+    __m128 t = _mm_loadu_ps(in + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    storeAffine(out, c0, c1, c2, t, 1.0f);
+  }
+}
+
+QM_TARGET("sse2") void transposeMat4fSse2(const float* in, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    __m128 c0 = _mm_loadu_ps(in);
+    __m128 c1 = _mm_loadu_ps(in + 4);
+    __m128 c2 = _mm_loadu_ps(in + 8);
+    __m128 c3 = _mm_loadu_ps(in + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(out, c0);
+    _mm_storeu_ps(out + 4, c1);
+    _mm_storeu_ps(out + 8, c2);
+    _mm_storeu_ps(out + 12, c3);
+  }
+}
+
+#undef QM_SWIZZLE
+#undef QM_SHUFFLE
+
+// Half a double column per register, converted pairwise and joined
+QM_TARGET("sse2") void relativeMat4Sse2(const double* in, const double* origin, float* out, size_t count) {
+  const __m128d originXY = _mm_loadu_pd(origin);
+  const __m128d originZ = _mm_load_sd(origin + 2);
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    for (int j = 0 ; j < 3 ; j++) {
+      __m128 low = _mm_cvtpd_ps(_mm_loadu_pd(in + 4*j));
+      __m128 high = _mm_cvtpd_ps(_mm_loadu_pd(in + 4*j + 2));
+      _mm_storeu_ps(out + 4*j, _mm_movelh_ps(low, high));
+    }
+    __m128 low = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(in + 12), originXY));
+    __m128 high = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(in + 14), originZ));
+    _mm_storeu_ps(out + 12, _mm_movelh_ps(low, high));
+  }
+}
+
+//
+// AVX kernels: two float columns or one double column per register
+//
+
+QM_TARGET("avx") void mulMat4fAvx(const float* a, const float* b, float* r) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*) a);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*) (a + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*) (a + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*) (a + 12));
+  __m256 b01 = _mm256_loadu_ps(b);
+  __m256 b23 = _mm256_loadu_ps(b + 8);
+  __m256 sum01 = _mm256_mul_ps(c0, _mm256_permute_ps(b01, 0x00));
+  sum01 = _mm256_add_ps(sum01, _mm256_mul_ps(c1, _mm256_permute_ps(b01, 0x55)));
+  sum01 = _mm256_add_ps(sum01, _mm256_mul_ps(c2, _mm256_permute_ps(b01, 0xAA)));
+  sum01 = _mm256_add_ps(sum01, _mm256_mul_ps(c3, _mm256_permute_ps(b01, 0xFF)));
+  __m256 sum23 = _mm256_mul_ps(c0, _mm256_permute_ps(b23, 0x00));
+  sum23 = _mm256_add_ps(sum23, _mm256_mul_ps(c1, _mm256_permute_ps(b23, 0x55)));
+  sum23 = _mm256_add_ps(sum23, _mm256_mul_ps(c2, _mm256_permute_ps(b23, 0xAA)));
+  sum23 = _mm256_add_ps(sum23, _mm256_mul_ps(c3, _mm256_permute_ps(b23, 0xFF)));
+  _mm256_storeu_ps(r, sum01);
+  _mm256_storeu_ps(r + 8, sum23);
+}
+
+QM_TARGET("avx") void mulVec4dAvx(const double* a, const double* v, double* r) {
+  __m256d sum = _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_set1_pd(v[0]));
+  sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(a + 4), _mm256_set1_pd(v[1])));
+  sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(a + 8), _mm256_set1_pd(v[2])));
+  sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(a + 12), _mm256_set1_pd(v[3])));
+  _mm256_storeu_pd(r, sum);
+}
+
+QM_TARGET("avx") void mulMat4dAvx(const double* a, const double* b, double* r) {
+  __m256d c0 = _mm256_loadu_pd(a);
+  __m256d c1 = _mm256_loadu_pd(a + 4);
+  __m256d c2 = _mm256_loadu_pd(a + 8);
+  __m256d c3 = _mm256_loadu_pd(a + 12);
+  __m256d col[4];
+  for (int j = 0 ; j < 4 ; j++) {
+    const double* bj = b + 4*j;
+    __m256d sum = _mm256_mul_pd(c0, _mm256_broadcast_sd(bj));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(c1, _mm256_broadcast_sd(bj + 1)));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(c2, _mm256_broadcast_sd(bj + 2)));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(c3, _mm256_broadcast_sd(bj + 3)));
+    col[j] = sum;
+  }
+  for (int j = 0 ; j < 4 ; j++)
+    _mm256_storeu_pd(r + 4*j, col[j]);
+}
+
+template<bool Point> QM_TARGET("avx") void transformVec3Avx(const float* m, const float* in, float* out, size_t count) {
+  __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+  __m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6 = _mm256_set1_ps(m[6]);
+  __m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+  __m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+  size_t n = 0;
+  for ( ; n + 8 <= count ; n += 8) {
+    __m256 x, y, z;
+    avx::Pack<float>::loadTransposed3(in + 3*n, x, y, z);
+    __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), _mm256_mul_ps(m4, y)), _mm256_mul_ps(m8, z));
+    __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, x), _mm256_mul_ps(m5, y)), _mm256_mul_ps(m9, z));
+    __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, x), _mm256_mul_ps(m6, y)), _mm256_mul_ps(m10, z));
+    if (Point) {
+      rx = _mm256_add_ps(rx, m12);
+      ry = _mm256_add_ps(ry, m13);
+      rz = _mm256_add_ps(rz, m14);
+    }
+    avx::Pack<float>::storeTransposed3(out + 3*n, rx, ry, rz);
+  }
+  transformVec3Sse2<Point>(m, in + 3*n, out + 3*n, count - n);
+}
+
+QM_TARGET("avx") void transformVec4Avx(const float* m, const float* in, float* out, size_t count) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*) m);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*) (m + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*) (m + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*) (m + 12));
+  size_t n = 0;
+  for ( ; n + 2 <= count ; n += 2) {
+    __m256 v = _mm256_loadu_ps(in + 4*n);
+    __m256 sum = _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(c2, _mm256_permute_ps(v, 0xAA)));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xFF)));
+    _mm256_storeu_ps(out + 4*n, sum);
+  }
+  transformVec4Sse2(m, in + 4*n, out + 4*n, count - n);
+}
+
+template<bool Point> QM_TARGET("avx") void transformVec3AAvx(const float* m, const float* in, float* out, size_t count) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*) m);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*) (m + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*) (m + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*) (m + 12));
+  __m256 xyz = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+  size_t n = 0;
+  for ( ; n + 2 <= count ; n += 2) {
+    __m256 v = _mm256_loadu_ps(in + 4*n);
+    __m256 sum = _mm256_add_ps(_mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00)), _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(c2, _mm256_permute_ps(v, 0xAA)));
+    if (Point)
+      sum = _mm256_add_ps(sum, c3);
+    _mm256_storeu_ps(out + 4*n, _mm256_and_ps(sum, xyz));
+  }
+  transformVec3ASse2<Point>(m, in + 4*n, out + 4*n, count - n);
+}
+
+// Vec3 batches through the transposes of the AVX double pack (simdpack.h)
+template<bool Point> QM_TARGET("avx") void transformVec3dAvx(const double* m, const double* in, double* out, size_t count) {
+  __m256d m0 = _mm256_set1_pd(m[0]), m1 = _mm256_set1_pd(m[1]), m2 = _mm256_set1_pd(m[2]);
+  __m256d m4 = _mm256_set1_pd(m[4]), m5 = _mm256_set1_pd(m[5]), m6 = _mm256_set1_pd(m[6]);
+  __m256d m8 = _mm256_set1_pd(m[8]), m9 = _mm256_set1_pd(m[9]), m10 = _mm256_set1_pd(m[10]);
+  __m256d m12 = _mm256_set1_pd(m[12]), m13 = _mm256_set1_pd(m[13]), m14 = _mm256_set1_pd(m[14]);
+  double tail[12] = { 0.0 };
+  for (size_t n = 0 ; n < count ; n += 4) {
+    const double* src = in + 3*n;
+    size_t block = (count - n < 4) ? count - n : 4;
+    if (block < 4) {
+      for (size_t k = 0 ; k < 3*block ; k++)
+        tail[k] = src[k];
+      src = tail;
+    }
+    __m256d x, y, z;
+    avx::Pack<double>::loadTransposed3(src, x, y, z);
+    __m256d rx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m0, x), _mm256_mul_pd(m4, y)), _mm256_mul_pd(m8, z));
+    __m256d ry = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m1, x), _mm256_mul_pd(m5, y)), _mm256_mul_pd(m9, z));
+    __m256d rz = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(m2, x), _mm256_mul_pd(m6, y)), _mm256_mul_pd(m10, z));
+    if (Point) {
+      rx = _mm256_add_pd(rx, m12);
+      ry = _mm256_add_pd(ry, m13);
+      rz = _mm256_add_pd(rz, m14);
+    }
+    if (block < 4) {
+      avx::Pack<double>::storeTransposed3(tail, rx, ry, rz);
+      for (size_t k = 0 ; k < 3*block ; k++)
+        out[3*n + k] = tail[k];
+    } else {
+      avx::Pack<double>::storeTransposed3(out + 3*n, rx, ry, rz);
+    }
+  }
+}
+
+QM_TARGET("avx") void transformVec4dAvx(const double* m, const double* in, double* out, size_t count) {
+  __m256d c0 = _mm256_loadu_pd(m);
+  __m256d c1 = _mm256_loadu_pd(m + 4);
+  __m256d c2 = _mm256_loadu_pd(m + 8);
+  __m256d c3 = _mm256_loadu_pd(m + 12);
+  for (size_t n = 0 ; n < count ; n++, in += 4, out += 4) {
+    __m256d sum = _mm256_mul_pd(c0, _mm256_broadcast_sd(in));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(c1, _mm256_broadcast_sd(in + 1)));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(c2, _mm256_broadcast_sd(in + 2)));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(c3, _mm256_broadcast_sd(in + 3)));
+    _mm256_storeu_pd(out, sum);
+  }
+}
+
+// Single double matrices, one column per register
+QM_TARGET("avx") inline void transpose4d(__m256d& c0, __m256d& c1, __m256d& c2, __m256d& c3) {
+  __m256d t0 = _mm256_unpacklo_pd(c0, c1);
+  __m256d t1 = _mm256_unpackhi_pd(c0, c1);
+  __m256d t2 = _mm256_unpacklo_pd(c2, c3);
+  __m256d t3 = _mm256_unpackhi_pd(c2, c3);
+  c0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+  c1 = _mm256_permute2f128_pd(t1, t3, 0x20);
+  c2 = _mm256_permute2f128_pd(t0, t2, 0x31);
+  c3 = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+// As storeAffine
+QM_TARGET("avx") inline void storeAffined(double* out, __m256d x, __m256d y, __m256d z, __m256d t, double w) {
+  __m256d translation = _mm256_add_pd(_mm256_add_pd(
+    _mm256_mul_pd(x, _mm256_permute_pd(_mm256_permute2f128_pd(t, t, 0x00), 0x0)),
+    _mm256_mul_pd(y, _mm256_permute_pd(_mm256_permute2f128_pd(t, t, 0x00), 0xF))),
+    _mm256_mul_pd(z, _mm256_permute_pd(_mm256_permute2f128_pd(t, t, 0x11), 0x0)));
+  _mm256_storeu_pd(out, x);
+  _mm256_storeu_pd(out + 4, y);
+  _mm256_storeu_pd(out + 8, z);
+  _mm256_storeu_pd(out + 12, _mm256_sub_pd(_mm256_setzero_pd(), translation));
+  out[15] = w;
+}
+
+QM_TARGET("avx") void inverseRigidMat4dAvx(const double* in, double* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    __m256d c0 = _mm256_loadu_pd(in);
+    __m256d c1 = _mm256_loadu_pd(in + 4);
+    __m256d c2 = _mm256_loadu_pd(in + 8);
+    __m256d c3 = _mm256_setzero_pd();
+    __m256d t = _mm256_loadu_pd(in + 12);
+    transpose4d(c0, c1, c2, c3);
+    storeAffined(out, c0, c1, c2, t, 1.0);
+  }
+}
+
+QM_TARGET("avx") void transposeMat4dAvx(const double* in, double* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    __m256d c0 = _mm256_loadu_pd(in);
+    __m256d c1 = _mm256_loadu_pd(in + 4);
+    __m256d c2 = _mm256_loadu_pd(in + 8);
+    __m256d c3 = _mm256_loadu_pd(in + 12);
+    transpose4d(c0, c1, c2, c3);
+    _mm256_storeu_pd(out, c0);
+    _mm256_storeu_pd(out + 4, c1);
+    _mm256_storeu_pd(out + 8, c2);
+    _mm256_storeu_pd(out + 12, c3);
+  }
+}
+
+// One double column converted to a float column per register
+QM_TARGET("avx") void relativeMat4Avx(const double* in, const double* origin, float* out, size_t count) {
+  const __m256d o = _mm256_setr_pd(origin[0], origin[1], origin[2], 0.0);
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    _mm_storeu_ps(out, _mm256_cvtpd_ps(_mm256_loadu_pd(in)));
+    _mm_storeu_ps(out + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(in + 4)));
+    _mm_storeu_ps(out + 8, _mm256_cvtpd_ps(_mm256_loadu_pd(in + 8)));
+    _mm_storeu_ps(out + 12, _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(in + 12), o)));
+  }
+}
+
+//
+// AVX2+FMA kernels: same layout as AVX with fused multiply-adds
+//
+
+QM_TARGET("avx2,fma") void mulMat4fFma(const float* a, const float* b, float* r) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*) a);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*) (a + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*) (a + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*) (a + 12));
+  __m256 b01 = _mm256_loadu_ps(b);
+  __m256 b23 = _mm256_loadu_ps(b + 8);
+  __m256 sum01 = _mm256_mul_ps(c0, _mm256_permute_ps(b01, 0x00));
+  sum01 = _mm256_fmadd_ps(c1, _mm256_permute_ps(b01, 0x55), sum01);
+  sum01 = _mm256_fmadd_ps(c2, _mm256_permute_ps(b01, 0xAA), sum01);
+  sum01 = _mm256_fmadd_ps(c3, _mm256_permute_ps(b01, 0xFF), sum01);
+  __m256 sum23 = _mm256_mul_ps(c0, _mm256_permute_ps(b23, 0x00));
+  sum23 = _mm256_fmadd_ps(c1, _mm256_permute_ps(b23, 0x55), sum23);
+  sum23 = _mm256_fmadd_ps(c2, _mm256_permute_ps(b23, 0xAA), sum23);
+  sum23 = _mm256_fmadd_ps(c3, _mm256_permute_ps(b23, 0xFF), sum23);
+  _mm256_storeu_ps(r, sum01);
+  _mm256_storeu_ps(r + 8, sum23);
+}
+
+QM_TARGET("avx2,fma") void mulVec4fFma(const float* a, const float* v, float* r) {
+  __m128 sum = _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(v[0]));
+  sum = _mm_fmadd_ps(_mm_loadu_ps(a + 4), _mm_set1_ps(v[1]), sum);
+  sum = _mm_fmadd_ps(_mm_loadu_ps(a + 8), _mm_set1_ps(v[2]), sum);
+  sum = _mm_fmadd_ps(_mm_loadu_ps(a + 12), _mm_set1_ps(v[3]), sum);
+  _mm_storeu_ps(r, sum);
+}
+
+QM_TARGET("avx2,fma") void mulVec4dFma(const double* a, const double* v, double* r) {
+  __m256d sum = _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_set1_pd(v[0]));
+  sum = _mm256_fmadd_pd(_mm256_loadu_pd(a + 4), _mm256_set1_pd(v[1]), sum);
+  sum = _mm256_fmadd_pd(_mm256_loadu_pd(a + 8), _mm256_set1_pd(v[2]), sum);
+  sum = _mm256_fmadd_pd(_mm256_loadu_pd(a + 12), _mm256_set1_pd(v[3]), sum);
+  _mm256_storeu_pd(r, sum);
+}
+
+QM_TARGET("avx2,fma") void mulMat4dFma(const double* a, const double* b, double* r) {
+  __m256d c0 = _mm256_loadu_pd(a);
+  __m256d c1 = _mm256_loadu_pd(a + 4);
+  __m256d c2 = _mm256_loadu_pd(a + 8);
+  __m256d c3 = _mm256_loadu_pd(a + 12);
+  __m256d col[4];
+  for (int j = 0 ; j < 4 ; j++) {
+    const double* bj = b + 4*j;
+    __m256d sum = _mm256_mul_pd(c0, _mm256_broadcast_sd(bj));
+    sum = _mm256_fmadd_pd(c1, _mm256_broadcast_sd(bj + 1), sum);
+    sum = _mm256_fmadd_pd(c2, _mm256_broadcast_sd(bj + 2), sum);
+    sum = _mm256_fmadd_pd(c3, _mm256_broadcast_sd(bj + 3), sum);
+    col[j] = sum;
+  }
+  for (int j = 0 ; j < 4 ; j++)
+    _mm256_storeu_pd(r + 4*j, col[j]);
+}
+
+template<bool Point> QM_TARGET("avx2,fma") void transformVec3Fma(const float* m, const float* in, float* out, size_t count) {
+  __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+  __m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6 = _mm256_set1_ps(m[6]);
+  __m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+  __m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+  float tail[24] = { 0.0f };
+  for (size_t n = 0 ; n < count ; n += 8) {
+    // The last partial block goes through a padded copy so that every
+    // vector sees the same fused operations
+    const float* src = in + 3*n;
+    size_t block = (count - n < 8) ? count - n : 8;
+    if (block < 8) {
+      for (size_t k = 0 ; k < 3*block ; k++)
+        tail[k] = src[k];
+      src = tail;
+    }
+    __m256 x, y, z;
+    avx::Pack<float>::loadTransposed3(src, x, y, z);
+    __m256 rx = _mm256_fmadd_ps(m8, z, _mm256_fmadd_ps(m4, y, _mm256_mul_ps(m0, x)));
+    __m256 ry = _mm256_fmadd_ps(m9, z, _mm256_fmadd_ps(m5, y, _mm256_mul_ps(m1, x)));
+    __m256 rz = _mm256_fmadd_ps(m10, z, _mm256_fmadd_ps(m6, y, _mm256_mul_ps(m2, x)));
+    if (Point) {
+      rx = _mm256_add_ps(rx, m12);
+      ry = _mm256_add_ps(ry, m13);
+      rz = _mm256_add_ps(rz, m14);
+    }
+    if (block < 8) {
+      avx::Pack<float>::storeTransposed3(tail, rx, ry, rz);
+      for (size_t k = 0 ; k < 3*block ; k++)
+        out[3*n + k] = tail[k];
+    } else {
+      avx::Pack<float>::storeTransposed3(out + 3*n, rx, ry, rz);
+    }
+  }
+}
+
+QM_TARGET("avx2,fma") void transformVec4Fma(const float* m, const float* in, float* out, size_t count) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*) m);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*) (m + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*) (m + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*) (m + 12));
+  size_t n = 0;
+  for ( ; n + 2 <= count ; n += 2) {
+    __m256 v = _mm256_loadu_ps(in + 4*n);
+    __m256 sum = _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00));
+    sum = _mm256_fmadd_ps(c1, _mm256_permute_ps(v, 0x55), sum);
+    sum = _mm256_fmadd_ps(c2, _mm256_permute_ps(v, 0xAA), sum);
+    sum = _mm256_fmadd_ps(c3, _mm256_permute_ps(v, 0xFF), sum);
+    _mm256_storeu_ps(out + 4*n, sum);
+  }
+  if (n < count)
+    mulVec4fFma(m, in + 4*n, out + 4*n);
+}
+
+template<bool Point> QM_TARGET("avx2,fma") void transformVec3AFma(const float* m, const float* in, float* out, size_t count) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*) m);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*) (m + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*) (m + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*) (m + 12));
+  __m256i xyz = _mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1);
+  for (size_t n = 0 ; n < count ; n += 2) {
+    // A last single vector is loaded and stored with a mask
+    __m256i mask = (n + 2 <= count) ? xyz : _mm256_set_epi32(0, 0, 0, 0, 0, -1, -1, -1);
+    __m256 v = _mm256_maskload_ps(in + 4*n, mask);
+    __m256 sum = _mm256_fmadd_ps(c2, _mm256_permute_ps(v, 0xAA),
+      _mm256_fmadd_ps(c1, _mm256_permute_ps(v, 0x55), _mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00))));
+    if (Point)
+      sum = _mm256_add_ps(sum, c3);
+    __m256 result = _mm256_and_ps(sum, _mm256_castsi256_ps(xyz));
+    if (n + 2 <= count)
+      _mm256_storeu_ps(out + 4*n, result);
+    else
+      _mm_storeu_ps(out + 4*n, _mm256_castps256_ps128(result));
+  }
+}
+
+template<bool Point> QM_TARGET("avx2,fma") void transformVec3dFma(const double* m, const double* in, double* out, size_t count) {
+  __m256d m0 = _mm256_set1_pd(m[0]), m1 = _mm256_set1_pd(m[1]), m2 = _mm256_set1_pd(m[2]);
+  __m256d m4 = _mm256_set1_pd(m[4]), m5 = _mm256_set1_pd(m[5]), m6 = _mm256_set1_pd(m[6]);
+  __m256d m8 = _mm256_set1_pd(m[8]), m9 = _mm256_set1_pd(m[9]), m10 = _mm256_set1_pd(m[10]);
+  __m256d m12 = _mm256_set1_pd(m[12]), m13 = _mm256_set1_pd(m[13]), m14 = _mm256_set1_pd(m[14]);
+  double tail[12] = { 0.0 };
+  for (size_t n = 0 ; n < count ; n += 4) {
+    const double* src = in + 3*n;
+    size_t block = (count - n < 4) ? count - n : 4;
+    if (block < 4) {
+      for (size_t k = 0 ; k < 3*block ; k++)
+        tail[k] = src[k];
+      src = tail;
+    }
+    __m256d x, y, z;
+    avx::Pack<double>::loadTransposed3(src, x, y, z);
+    __m256d rx = _mm256_fmadd_pd(m8, z, _mm256_fmadd_pd(m4, y, _mm256_mul_pd(m0, x)));
+    __m256d ry = _mm256_fmadd_pd(m9, z, _mm256_fmadd_pd(m5, y, _mm256_mul_pd(m1, x)));
+    __m256d rz = _mm256_fmadd_pd(m10, z, _mm256_fmadd_pd(m6, y, _mm256_mul_pd(m2, x)));
+    if (Point) {
+      rx = _mm256_add_pd(rx, m12);
+      ry = _mm256_add_pd(ry, m13);
+      rz = _mm256_add_pd(rz, m14);
+    }
+    if (block < 4) {
+      avx::Pack<double>::storeTransposed3(tail, rx, ry, rz);
+      for (size_t k = 0 ; k < 3*block ; k++)
+        out[3*n + k] = tail[k];
+    } else {
+      avx::Pack<double>::storeTransposed3(out + 3*n, rx, ry, rz);
+    }
+  }
+}
+
+QM_TARGET("avx2,fma") void transformVec4dFma(const double* m, const double* in, double* out, size_t count) {
+  __m256d c0 = _mm256_loadu_pd(m);
+  __m256d c1 = _mm256_loadu_pd(m + 4);
+  __m256d c2 = _mm256_loadu_pd(m + 8);
+  __m256d c3 = _mm256_loadu_pd(m + 12);
+  for (size_t n = 0 ; n < count ; n++, in += 4, out += 4) {
+    __m256d sum = _mm256_mul_pd(c0, _mm256_broadcast_sd(in));
+    sum = _mm256_fmadd_pd(c1, _mm256_broadcast_sd(in + 1), sum);
+    sum = _mm256_fmadd_pd(c2, _mm256_broadcast_sd(in + 2), sum);
+    sum = _mm256_fmadd_pd(c3, _mm256_broadcast_sd(in + 3), sum);
+    _mm256_storeu_pd(out, sum);
+  }
+}
+
+//
+// Single-matrix AVX2 double kernels: the SSE2 block decomposition above, one
+// double column per register
+//
+
+#define QM_SWIZZLE(v, x, y, z, w) _mm256_permute4x64_pd(v, _MM_SHUFFLE(w, z, y, x))
+
+QM_TARGET("avx2,fma") inline __m256d mat2MulD(__m256d a, __m256d b) {
+  return _mm256_add_pd(_mm256_mul_pd(a, QM_SWIZZLE(b, 0, 3, 0, 3)),
+    _mm256_mul_pd(QM_SWIZZLE(a, 1, 0, 3, 2), QM_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+QM_TARGET("avx2,fma") inline __m256d mat2AdjMulD(__m256d a, __m256d b) {
+  return _mm256_sub_pd(_mm256_mul_pd(QM_SWIZZLE(a, 3, 3, 0, 0), b),
+    _mm256_mul_pd(QM_SWIZZLE(a, 1, 1, 2, 2), QM_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+QM_TARGET("avx2,fma") inline __m256d mat2MulAdjD(__m256d a, __m256d b) {
+  return _mm256_sub_pd(_mm256_mul_pd(a, QM_SWIZZLE(b, 3, 0, 3, 0)),
+    _mm256_mul_pd(QM_SWIZZLE(a, 1, 0, 3, 2), QM_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+// (a0 a2 b0 b2) and (a1 a3 b1 b3)
+QM_TARGET("avx2,fma") inline __m256d evensD(__m256d a, __m256d b) {
+  return QM_SWIZZLE(_mm256_unpacklo_pd(a, b), 0, 2, 1, 3);
+}
+
+QM_TARGET("avx2,fma") inline __m256d oddsD(__m256d a, __m256d b) {
+  return QM_SWIZZLE(_mm256_unpackhi_pd(a, b), 0, 2, 1, 3);
+}
+
+/**
+ * Mat4Blocks for a double matrix.
+ */
+struct Mat4dBlocks {
+  __m256d a, b, c, d;
+  __m256d detA, detB, detC, detD;
+  __m256d dc, ab;
+  __m256d det;
+
+  QM_TARGET("avx2,fma") inline explicit Mat4dBlocks(const double* m) {
+    __m256d r0 = _mm256_loadu_pd(m);
+    __m256d r1 = _mm256_loadu_pd(m + 4);
+    __m256d r2 = _mm256_loadu_pd(m + 8);
+    __m256d r3 = _mm256_loadu_pd(m + 12);
+    a = _mm256_permute2f128_pd(r0, r1, 0x20);
+    b = _mm256_permute2f128_pd(r0, r1, 0x31);
+    c = _mm256_permute2f128_pd(r2, r3, 0x20);
+    d = _mm256_permute2f128_pd(r2, r3, 0x31);
+    // (|A| |B| |C| |D|)
+    __m256d detSub = _mm256_sub_pd(
+      _mm256_mul_pd(evensD(r0, r2), oddsD(r1, r3)),
+      _mm256_mul_pd(oddsD(r0, r2), evensD(r1, r3)));
+    detA = QM_SWIZZLE(detSub, 0, 0, 0, 0);
+    detB = QM_SWIZZLE(detSub, 1, 1, 1, 1);
+    detC = QM_SWIZZLE(detSub, 2, 2, 2, 2);
+    detD = QM_SWIZZLE(detSub, 3, 3, 3, 3);
+    dc = mat2AdjMulD(d, c);
+    ab = mat2AdjMulD(a, b);
+    __m256d tr = _mm256_mul_pd(ab, QM_SWIZZLE(dc, 0, 2, 1, 3));
+    tr = _mm256_add_pd(tr, QM_SWIZZLE(tr, 2, 3, 0, 1));
+    tr = _mm256_add_pd(tr, QM_SWIZZLE(tr, 1, 0, 3, 2));
+    det = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(detA, detD), _mm256_mul_pd(detB, detC)), tr);
+  }
+};
+
+QM_TARGET("avx2,fma") void determinantMat4dAvx2(const double* in, double* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++)
+    _mm_store_sd(out + n, _mm256_castpd256_pd128(Mat4dBlocks(in + 16*n).det));
+}
+
+QM_TARGET("avx2,fma") void inverseMat4dAvx2(const double* in, double* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    Mat4dBlocks m(in);
+    __m256d x = _mm256_sub_pd(_mm256_mul_pd(m.detD, m.a), mat2MulD(m.b, m.dc));
+    __m256d w = _mm256_sub_pd(_mm256_mul_pd(m.detA, m.d), mat2MulD(m.c, m.ab));
+    __m256d y = _mm256_sub_pd(_mm256_mul_pd(m.detB, m.c), mat2MulAdjD(m.d, m.ab));
+    __m256d z = _mm256_sub_pd(_mm256_mul_pd(m.detC, m.b), mat2MulAdjD(m.a, m.dc));
+    __m256d invDet = _mm256_div_pd(_mm256_setr_pd(1.0, -1.0, -1.0, 1.0), m.det);
+    invDet = _mm256_and_pd(invDet, _mm256_cmp_pd(m.det, _mm256_setzero_pd(), _CMP_NEQ_UQ));
+    x = _mm256_mul_pd(x, invDet);
+    y = _mm256_mul_pd(y, invDet);
+    z = _mm256_mul_pd(z, invDet);
+    w = _mm256_mul_pd(w, invDet);
+    // (x3 x1 y3 y1), (x2 x0 y2 y0)...
+    _mm256_storeu_pd(out, _mm256_blend_pd(QM_SWIZZLE(x, 3, 1, 3, 1), QM_SWIZZLE(y, 3, 1, 3, 1), 0xC));
+    _mm256_storeu_pd(out + 4, _mm256_blend_pd(QM_SWIZZLE(x, 2, 0, 2, 0), QM_SWIZZLE(y, 2, 0, 2, 0), 0xC));
+    _mm256_storeu_pd(out + 8, _mm256_blend_pd(QM_SWIZZLE(z, 3, 1, 3, 1), QM_SWIZZLE(w, 3, 1, 3, 1), 0xC));
+    _mm256_storeu_pd(out + 12, _mm256_blend_pd(QM_SWIZZLE(z, 2, 0, 2, 0), QM_SWIZZLE(w, 2, 0, 2, 0), 0xC));
+  }
+}
+
+QM_TARGET("avx2,fma") inline __m256d cross3d(__m256d a, __m256d b) {
+  return _mm256_sub_pd(
+    _mm256_mul_pd(QM_SWIZZLE(a, 1, 2, 0, 3), QM_SWIZZLE(b, 2, 0, 1, 3)),
+    _mm256_mul_pd(QM_SWIZZLE(a, 2, 0, 1, 3), QM_SWIZZLE(b, 1, 2, 0, 3)));
+}
+
+QM_TARGET("avx2,fma") void inverseAffineMat4dAvx2(const double* in, double* out, size_t count) {
+  const __m256d xyzMask = _mm256_castsi256_pd(_mm256_setr_epi64x(-1, -1, -1, 0));
+  for (size_t n = 0 ; n < count ; n++, in += 16, out += 16) {
+    __m256d c0 = _mm256_and_pd(_mm256_loadu_pd(in), xyzMask);
+    __m256d c1 = _mm256_and_pd(_mm256_loadu_pd(in + 4), xyzMask);
+    __m256d c2 = _mm256_and_pd(_mm256_loadu_pd(in + 8), xyzMask);
+    __m256d t = _mm256_loadu_pd(in + 12);
+    __m256d r0 = cross3d(c1, c2);
+    __m256d r1 = cross3d(c2, c0);
+    __m256d r2 = cross3d(c0, c1);
+    __m256d r3 = _mm256_setzero_pd();
+    __m256d det = _mm256_mul_pd(c0, r0);
+    det = _mm256_add_pd(_mm256_add_pd(QM_SWIZZLE(det, 0, 0, 0, 0), QM_SWIZZLE(det, 1, 1, 1, 1)),
+      QM_SWIZZLE(det, 2, 2, 2, 2));
+    __m256d nonSingular = _mm256_cmp_pd(det, _mm256_setzero_pd(), _CMP_NEQ_UQ);
+    __m256d invDet = _mm256_and_pd(_mm256_div_pd(_mm256_set1_pd(1.0), det), nonSingular);
+    transpose4d(r0, r1, r2, r3);
+    storeAffined(out, _mm256_mul_pd(r0, invDet), _mm256_mul_pd(r1, invDet), _mm256_mul_pd(r2, invDet), t,
+      _mm256_movemask_pd(nonSingular) ? 1.0 : 0.0);
+  }
+}
+
+#undef QM_SWIZZLE
+
+#endif // QM_SIMD_X86
+
+#define QM_MAT4_BATCH_KERNELS(ns, T) \
+  ns::determinantMat4<T>, ns::inverseMat4<T>, ns::inverseAffineMat4<T>, \
+  ns::inverseRigidMat4<T>, ns::transposeMat4<T>
+#define QM_MAT4_SINGLE_SSE2 \
+  determinantMat4fSse2, inverseMat4fSse2, inverseAffineMat4fSse2, \
+  inverseRigidMat4fSse2, transposeMat4fSse2
+#define QM_MAT4D_SINGLE_AVX \
+  scalar::determinantMat4<double>, scalar::inverseMat4<double>, scalar::inverseAffineMat4<double>, \
+  inverseRigidMat4dAvx, transposeMat4dAvx
+#define QM_MAT4D_SINGLE_AVX2 \
+  determinantMat4dAvx2, inverseMat4dAvx2, inverseAffineMat4dAvx2, \
+  inverseRigidMat4dAvx, transposeMat4dAvx
+
+const Mat4Kernels& kernels() {
+  static const Mat4Kernels table[SIMD_ISA_COUNT] = {
+    { mulMat4Scalar<float>, mulVec4Scalar<float>, mulMat4Scalar<double>, mulVec4Scalar<double>,
+      transformVec3Scalar<float, true>, transformVec3Scalar<float, false>, transformVec4Scalar<float>,
+      transformVec3AScalar<true>, transformVec3AScalar<false>,
+      QM_MAT4_BATCH_KERNELS(scalar, float), QM_MAT4_BATCH_KERNELS(scalar, float),
+      transformVec3Scalar<double, true>, transformVec3Scalar<double, false>, transformVec4Scalar<double>,
+      QM_MAT4_BATCH_KERNELS(scalar, double), QM_MAT4_BATCH_KERNELS(scalar, double),
+      relativeMat4Scalar },
+#if QM_SIMD_X86
+    { mulMat4fSse2, mulVec4fSse2, mulMat4dSse2, mulVec4dSse2,
+      transformVec3Sse2<true>, transformVec3Sse2<false>, transformVec4Sse2,
+      transformVec3ASse2<true>, transformVec3ASse2<false>,
+      QM_MAT4_BATCH_KERNELS(sse2, float), QM_MAT4_SINGLE_SSE2,
+      transformVec3Scalar<double, true>, transformVec3Scalar<double, false>, transformVec4Scalar<double>,
+      QM_MAT4_BATCH_KERNELS(sse2, double), QM_MAT4_BATCH_KERNELS(scalar, double),
+      relativeMat4Sse2 },
+    { mulMat4fAvx, mulVec4fSse2, mulMat4dAvx, mulVec4dAvx,
+      transformVec3Avx<true>, transformVec3Avx<false>, transformVec4Avx,
+      transformVec3AAvx<true>, transformVec3AAvx<false>,
+      QM_MAT4_BATCH_KERNELS(avx, float), QM_MAT4_SINGLE_SSE2,
+      transformVec3dAvx<true>, transformVec3dAvx<false>, transformVec4dAvx,
+      QM_MAT4_BATCH_KERNELS(avx, double), QM_MAT4D_SINGLE_AVX,
+      relativeMat4Avx },
+    { mulMat4fFma, mulVec4fFma, mulMat4dFma, mulVec4dFma,
+      transformVec3Fma<true>, transformVec3Fma<false>, transformVec4Fma,
+      transformVec3AFma<true>, transformVec3AFma<false>,
+      QM_MAT4_BATCH_KERNELS(avx2, float), QM_MAT4_SINGLE_SSE2,
+      transformVec3dFma<true>, transformVec3dFma<false>, transformVec4dFma,
+      QM_MAT4_BATCH_KERNELS(avx2, double), QM_MAT4D_SINGLE_AVX2,
+      relativeMat4Avx }
+#endif
+  };
+  return table[simdIsa()];
+}
+
+#undef QM_MAT4_BATCH_KERNELS
+#undef QM_MAT4_SINGLE_SSE2
+#undef QM_MAT4D_SINGLE_AVX
+#undef QM_MAT4D_SINGLE_AVX2
+
+}
+
+namespace qm {
+
+const Mat4Base<float> operator*(const Mat4Base<float>& A, const Mat4Base<float>& B) {
+  Mat4Base<float> result;
+  kernels().mulMat4f(A.getArray(), B.getArray(), &result[0]);
+  return result;
+}
+
+const Vec4<float> operator*(const Mat4Base<float>& A, const Vec4<float>& B) {
+  Vec4<float> result;
+  kernels().mulVec4f(A.getArray(), &B[0], &result[0]);
+  return result;
+}
+
+const Mat4Base<double> operator*(const Mat4Base<double>& A, const Mat4Base<double>& B) {
+  Mat4Base<double> result;
+  kernels().mulMat4d(A.getArray(), B.getArray(), &result[0]);
+  return result;
+}
+
+const Vec4<double> operator*(const Mat4Base<double>& A, const Vec4<double>& B) {
+  Vec4<double> result;
+  kernels().mulVec4d(A.getArray(), &B[0], &result[0]);
+  return result;
+}
+
+// The batch kernels walk arrays of vectors as packed floats
+static_assert(sizeof(Vec3<float>) == 3 * sizeof(float), "Vec3<float> must be packed");
+static_assert(sizeof(Vec4<float>) == 4 * sizeof(float), "Vec4<float> must be packed");
+static_assert(sizeof(Vec3A<float>) == 4 * sizeof(float), "Vec3A<float> must be 4 packed floats");
+static_assert(sizeof(Mat4Base<float>) == 16 * sizeof(float), "Mat4Base<float> must be packed");
+
+void transformPoints(const Mat4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count) {
+  kernels().transformPoints(M.getArray(), reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void transformDirections(const Mat4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count) {
+  kernels().transformDirections(M.getArray(), reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void transformVec4(const Mat4Base<float>& M, const Vec4<float>* in, Vec4<float>* out, size_t count) {
+  kernels().transformVec4(M.getArray(), reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+static_assert(sizeof(Mat4Base<double>) == 16 * sizeof(double), "Mat4Base<double> must be packed");
+
+void transformPoints(const Mat4Base<double>& M, const Vec3<double>* in, Vec3<double>* out, size_t count) {
+  kernels().transformPointsD(M.getArray(), reinterpret_cast<const double*>(in), reinterpret_cast<double*>(out), count);
+}
+
+void transformDirections(const Mat4Base<double>& M, const Vec3<double>* in, Vec3<double>* out, size_t count) {
+  kernels().transformDirectionsD(M.getArray(), reinterpret_cast<const double*>(in), reinterpret_cast<double*>(out),
+    count);
+}
+
+void transformVec4(const Mat4Base<double>& M, const Vec4<double>* in, Vec4<double>* out, size_t count) {
+  kernels().transformVec4D(M.getArray(), reinterpret_cast<const double*>(in), reinterpret_cast<double*>(out), count);
+}
+
+void transformPoints(const Mat4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count) {
+  kernels().transformPointsA(M.getArray(), reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void transformDirections(const Mat4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count) {
+  kernels().transformDirectionsA(M.getArray(), reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void determinantMany(const Mat4Base<float>* in, float* out, size_t count) {
+  kernels().determinant(reinterpret_cast<const float*>(in), out, count);
+}
+
+void inverseMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count) {
+  kernels().inverse(reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void inverseAffineMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count) {
+  kernels().inverseAffine(reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void inverseRigidMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count) {
+  kernels().inverseRigid(reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void transposeMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count) {
+  kernels().transpose(reinterpret_cast<const float*>(in), reinterpret_cast<float*>(out), count);
+}
+
+void determinantMany(const Mat4Base<double>* in, double* out, size_t count) {
+  kernels().determinantD(reinterpret_cast<const double*>(in), out, count);
+}
+
+void inverseMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count) {
+  kernels().inverseD(reinterpret_cast<const double*>(in), reinterpret_cast<double*>(out), count);
+}
+
+void inverseAffineMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count) {
+  kernels().inverseAffineD(reinterpret_cast<const double*>(in), reinterpret_cast<double*>(out), count);
+}
+
+void inverseRigidMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count) {
+  kernels().inverseRigidD(reinterpret_cast<const double*>(in), reinterpret_cast<double*>(out), count);
+}
+
+void transposeMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count) {
+  kernels().transposeD(reinterpret_cast<const double*>(in), reinterpret_cast<double*>(out), count);
+}
+
+void cameraRelativeMany(const Mat4Base<double>* in, const Vec3<double>& origin, Mat4Base<float>* out, size_t count) {
+  kernels().relative(reinterpret_cast<const double*>(in), &origin[0], reinterpret_cast<float*>(out), count);
+}
+
+const Mat4<float> Mat4<float>::inverse() const {
+  Mat4<float> result;
+  kernels().inverse1(getArray(), &result[0], 1);
+  return result;
+}
+
+const Mat4<float> Mat4<float>::inverseAffine() const {
+  Mat4<float> result;
+  kernels().inverseAffine1(getArray(), &result[0], 1);
+  return result;
+}
+
+const Mat4<float> Mat4<float>::inverseRigid() const {
+  Mat4<float> result;
+  kernels().inverseRigid1(getArray(), &result[0], 1);
+  return result;
+}
+
+float Mat4<float>::determinant() const {
+  float result;
+  kernels().determinant1(getArray(), &result, 1);
+  return result;
+}
+
+const Mat4<float> Mat4<float>::transpose() const {
+  Mat4<float> result;
+  kernels().transpose1(getArray(), &result[0], 1);
+  return result;
+}
+
+const Mat4<double> Mat4<double>::inverse() const {
+  Mat4<double> result;
+  kernels().inverseD1(getArray(), &result[0], 1);
+  return result;
+}
+
+const Mat4<double> Mat4<double>::inverseAffine() const {
+  Mat4<double> result;
+  kernels().inverseAffineD1(getArray(), &result[0], 1);
+  return result;
+}
+
+const Mat4<double> Mat4<double>::inverseRigid() const {
+  Mat4<double> result;
+  kernels().inverseRigidD1(getArray(), &result[0], 1);
+  return result;
+}
+
+double Mat4<double>::determinant() const {
+  double result;
+  kernels().determinantD1(getArray(), &result, 1);
+  return result;
+}
+
+const Mat4<double> Mat4<double>::transpose() const {
+  Mat4<double> result;
+  kernels().transposeD1(getArray(), &result[0], 1);
+  return result;
+}
+
+}
@@ -3,7 +3,10 @@
 
 #include <iostream>
 #include <cmath>
+#include <cstddef>
 
+#include "config.h"
+#include "fastmath.h"
 #include "vec4.h"
 #include "vec3.h"
 #include "mat3.h"
@@ -20,13 +23,10 @@ template<typename T> class Mat4Base {
 
   public:
     // Constructors
-    inline Mat4Base() {
-      m[0] = m[1] = m[2] = m[3] = m[4] = m[5] = m[6] = m[7] = m[8] = m[9] = m[10] = m[11] = m[12] = m[13] = m[14] = m[15] = T();
-    }
-    inline Mat4Base(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11, T m12, T m13, T m14, T m15) {
-      init(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15);
-    }
-    inline void init(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11, T m12, T m13, T m14, T m15) {
+    constexpr Mat4Base() : m{T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T(), T()} { }
+    constexpr Mat4Base(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11, T m12, T m13, T m14, T m15) :
+      m{m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15} { }
+    QM_CONSTEXPR14 void init(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11, T m12, T m13, T m14, T m15) {
       m[0] = m0;
       m[1] = m1;
       m[2] = m2;
@@ -44,17 +44,17 @@ template<typename T> class Mat4Base {
       m[14] = m14;
       m[15] = m15;
     }
-    inline const T* getArray() const {
+    constexpr const T* getArray() const {
       return m;
     }
     // Operators
-    inline T& operator[](int index) {
+    QM_CONSTEXPR14 T& operator[](int index) {
       return m[index];
     }
-    inline const T& operator[](int index) const {
+    constexpr const T& operator[](int index) const {
       return m[index];
     }
-    inline Mat4Base& operator=(const Mat4Base& M) {
+    QM_CONSTEXPR14 Mat4Base& operator=(const Mat4Base& M) {
       m[0] = M[0];
       m[1] = M[1];
       m[2] = M[2];
@@ -73,7 +73,7 @@ template<typename T> class Mat4Base {
       m[15] = M[15];
       return *this;
     }
-    inline Mat4Base& operator+=(const Mat4Base& M) {
+    QM_CONSTEXPR14 Mat4Base& operator+=(const Mat4Base& M) {
       m[0] += M[0];
       m[1] += M[1];
       m[2] += M[2];
@@ -92,7 +92,7 @@ template<typename T> class Mat4Base {
       m[15] += M[15];
       return *this;
     }
-    inline Mat4Base& operator-=(const Mat4Base& M) {
+    QM_CONSTEXPR14 Mat4Base& operator-=(const Mat4Base& M) {
       m[0] -= M[0];
       m[1] -= M[1];
       m[2] -= M[2];
@@ -111,7 +111,7 @@ template<typename T> class Mat4Base {
       m[15] -= M[15];
       return *this;
     }
-    inline Mat4Base& operator*=(T s) {
+    QM_CONSTEXPR14 Mat4Base& operator*=(T s) {
       m[0] *= s;
       m[1] *= s;
       m[2] *= s;
@@ -130,7 +130,7 @@ template<typename T> class Mat4Base {
       m[15] *= s;
       return *this;
     }
-    inline Mat4Base& operator/=(T s) {
+    QM_CONSTEXPR14 Mat4Base& operator/=(T s) {
       m[0] /= s;
       m[1] /= s;
       m[2] /= s;
@@ -149,7 +149,7 @@ template<typename T> class Mat4Base {
       m[15] /= s;
       return *this;
     }
-    inline bool operator==(const Mat4Base& M) {
+    constexpr bool operator==(const Mat4Base& M) const {
       return (m[0] == M[0]
       && m[1] == M[1]
       && m[2] == M[2]
@@ -168,13 +168,12 @@ template<typename T> class Mat4Base {
       && m[15] == M[15]);
     }
     // Others
-    Mat3Base<T> toMat3() {
-      Mat3Base<T> res(
+    constexpr Mat3Base<T> toMat3() const {
+      return Mat3Base<T>(
         m[0], m[1], m[2],
         m[4], m[5], m[6],
         m[8], m[9], m[10]
       );
-      return res;
     }
 
   protected:
@@ -182,7 +181,7 @@ template<typename T> class Mat4Base {
 
 };
 
-template<typename T> const Mat4Base<T> operator*(const Mat4Base<T>& A, const Mat4Base<T>& B) {
+template<typename T> QM_CONSTEXPR14 const Mat4Base<T> operator*(const Mat4Base<T>& A, const Mat4Base<T>& B) {
   Mat4Base<T> result;
   int index = 0;
   for (int j = 0 ; j < 4 ; j++) {
@@ -197,7 +196,7 @@ template<typename T> const Mat4Base<T> operator*(const Mat4Base<T>& A, const Mat
   return result;
 }
 
-template<typename T> const Vec4<T> operator*(const Mat4Base<T>& A, const Vec4<T>& B) {
+template<typename T> QM_CONSTEXPR14 const Vec4<T> operator*(const Mat4Base<T>& A, const Vec4<T>& B) {
   Vec4<T> result;
   int index = 0;
   for (int i = 0 ; i < 4 ; i++) {
@@ -210,6 +209,65 @@ template<typename T> const Vec4<T> operator*(const Mat4Base<T>& A, const Vec4<T>
   return result;
 }
 
+// float and double products are dispatched at runtime to the scalar, SSE2,
+// AVX or AVX2+FMA kernels of mat4.cpp (see simd.h).
+// The SSE2 and AVX results are bit-identical to the generic code above. The
+// FMA kernels round once per multiply-add instead of twice: both results are
+// within 4u * sum(|A[i+4k] * B[k]|) of the exact value (u = 2^-24 for float,
+// 2^-53 for double), so they differ by at most 8u times that sum.
+// These overloads are not constexpr: in constant expressions (C++14), call
+// the generic templates above explicitly, e.g. operator*<float>(A, B).
+const Mat4Base<float> operator*(const Mat4Base<float>& A, const Mat4Base<float>& B);
+const Vec4<float> operator*(const Mat4Base<float>& A, const Vec4<float>& B);
+const Mat4Base<double> operator*(const Mat4Base<double>& A, const Mat4Base<double>& B);
+const Vec4<double> operator*(const Mat4Base<double>& A, const Vec4<double>& B);
+
+// Batched transforms of count contiguous vectors, keeping M in registers:
+// - transformPoints: out[i] = xyz of M * (in[i], 1) (no perspective divide)
+// - transformDirections: out[i] = xyz of M * (in[i], 0)
+// - transformVec4: out[i] = M * in[i]
+// in and out may be the same array, but must not partially overlap.
+// Results match the single-vector operator* for the same instruction set.
+void transformPoints(const Mat4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count);
+void transformDirections(const Mat4Base<float>& M, const Vec3<float>* in, Vec3<float>* out, size_t count);
+void transformVec4(const Mat4Base<float>& M, const Vec4<float>* in, Vec4<float>* out, size_t count);
+// Vec3A arrays: one vector per 16 bytes, the padding of out set to 0
+void transformPoints(const Mat4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count);
+void transformDirections(const Mat4Base<float>& M, const Vec3A<float>* in, Vec3A<float>* out, size_t count);
+// Double vectors: 4 at a time on AVX and AVX2+FMA, one at a time otherwise
+void transformPoints(const Mat4Base<double>& M, const Vec3<double>* in, Vec3<double>* out, size_t count);
+void transformDirections(const Mat4Base<double>& M, const Vec3<double>* in, Vec3<double>* out, size_t count);
+void transformVec4(const Mat4Base<double>& M, const Vec4<double>* in, Vec4<double>* out, size_t count);
+
+// Batched determinants, inverses and transposes of count contiguous matrices,
+// one matrix per SIMD lane. in and out may be the same array. Singular
+// matrices (determinant 0) invert to the zero matrix.
+// The general inverse and determinant use the cofactor expansion, while
+// Mat4::inverse() and determinant() use 2x2 blocks on SSE2 and up (float) or
+// AVX2+FMA (double): the same matrix may round differently through each.
+// Both stay within 1e-6 (float) and 2e-15 (double) of the exact inverse,
+// relative to its largest element, and of the exact determinant, for
+// well-conditioned matrices (diagonally dominant, checked by bench.cpp).
+// - inverseAffineMany expects a last row of 0 0 0 1
+// - inverseRigidMany expects a rotation + translation (no scale)
+void determinantMany(const Mat4Base<float>* in, float* out, size_t count);
+void inverseMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count);
+void inverseAffineMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count);
+void inverseRigidMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count);
+void transposeMany(const Mat4Base<float>* in, Mat4Base<float>* out, size_t count);
+void determinantMany(const Mat4Base<double>* in, double* out, size_t count);
+void inverseMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count);
+void inverseAffineMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count);
+void inverseRigidMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count);
+void transposeMany(const Mat4Base<double>* in, Mat4Base<double>* out, size_t count);
+
+// Camera-relative matrices for large worlds: out[i] is in[i] with origin (the
+// camera position) subtracted from its translation, rounded to float. The
+// subtraction is done in double, so objects near the camera keep float
+// precision however far from the world origin they are. The Mat3x4 version is
+// in mat3x4.h.
+void cameraRelativeMany(const Mat4Base<double>* in, const Vec3<double>& origin, Mat4Base<float>* out, size_t count);
+
 template<typename T> std::ostream& operator<<(std::ostream& output, const Mat4Base<T>& M) {
     output << "[" << M[0] << "][" << M[4] << "][" << M[8] << "][" << M[12] << "]\n";
     output << "[" << M[1] << "][" << M[5] << "][" << M[9] << "][" << M[13] << "]\n";
@@ -226,11 +284,11 @@ class Mat4 : public Mat4Base<T> {
 
   public:
     // Constructors
-    inline Mat4() : Mat4Base<T>() { }
-    inline Mat4(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11, T m12, T m13, T m14, T m15) :
+    constexpr Mat4() : Mat4Base<T>() { }
+    constexpr Mat4(T m0, T m1, T m2, T m3, T m4, T m5, T m6, T m7, T m8, T m9, T m10, T m11, T m12, T m13, T m14, T m15) :
       Mat4Base<T>(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15) {}
-    inline Mat4(const Mat4Base<T>& M) : Mat4Base<T>(M) {}
-    inline Mat4(Mat4Base<T>& M) : Mat4Base<T>(M) {}
+    constexpr Mat4(const Mat4Base<T>& M) : Mat4Base<T>(M) {}
+    constexpr Mat4(Mat4Base<T>& M) : Mat4Base<T>(M) {}
 
 };
 
@@ -239,29 +297,46 @@ class Mat4<float> : public Mat4Base<float> {
 
   public:
     // Constructors
-    inline Mat4<float>() : Mat4Base<float>() { }
-    inline Mat4<float>(float m0, float m1, float m2, float m3, float m4, float m5, float m6, float m7, float m8, float m9, float m10, float m11, float m12, float m13, float m14, float m15) :
+    constexpr Mat4<float>() : Mat4Base<float>() { }
+    constexpr Mat4<float>(float m0, float m1, float m2, float m3, float m4, float m5, float m6, float m7, float m8, float m9, float m10, float m11, float m12, float m13, float m14, float m15) :
       Mat4Base<float>(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15) {}
-    inline Mat4<float>(const Mat4Base<float>& M) : Mat4Base<float>(M) {}
-    inline Mat4<float>(Mat4Base<float>& M) : Mat4Base<float>(M) {}
+    constexpr Mat4<float>(const Mat4Base<float>& M) : Mat4Base<float>(M) {}
+    constexpr Mat4<float>(Mat4Base<float>& M) : Mat4Base<float>(M) {}
 
     inline const Mat4<float> translate(const qm::Vec3<float>& v) {
       Mat4<float> result = Mat4<float>::translationMatrix(v) * *this;
       return result;
     }
 
-    inline const Mat4<float> rotateY(float deg) {
-      float rad = deg * ONE_DEG_IN_RAD;
+    inline const Mat4<float> rotateY(float deg, Precision precision = QM_TRIG_PRECISION) {
+      float s, c;
+      if (precision == PRECISION_FAST) {
+        fast::sincos(deg * fast::DEG_TO_RAD, s, c);
+      } else {
+        float rad = deg * ONE_DEG_IN_RAD;
+        s = sin(rad);
+        c = cos(rad);
+      }
       Mat4<float> rotation = Mat4<float>::identityMatrix();
-      rotation[0] = cos(rad);
-      rotation[8] = sin(rad);
-      rotation[2] = -sin(rad);
-      rotation[10] = cos(rad);
+      rotation[0] = c;
+      rotation[8] = s;
+      rotation[2] = -s;
+      rotation[10] = c;
       return rotation * *this;
     }
 
+    // Inverse of a general matrix (zero matrix if singular). May round
+    // differently from inverseMany (see above).
+    const Mat4<float> inverse() const;
+    // Inverse of an affine matrix (last row 0 0 0 1)
+    const Mat4<float> inverseAffine() const;
+    // Inverse of a rotation + translation: transposed rotation, rotated -translation
+    const Mat4<float> inverseRigid() const;
+    float determinant() const;
+    const Mat4<float> transpose() const;
+
     // Static methods
-    static inline Mat4<float> zeroMatrix() {
+    static constexpr Mat4<float> zeroMatrix() {
       return Mat4<float>(
         0.0f, 0.0f, 0.0f, 0.0f,
         0.0f, 0.0f, 0.0f, 0.0f,
@@ -270,7 +345,7 @@ class Mat4<float> : public Mat4Base<float> {
       );
     }
 
-    static inline Mat4<float> identityMatrix() {
+    static constexpr Mat4<float> identityMatrix() {
       return Mat4<float>(
         1.0f, 0.0f, 0.0f, 0.0f,
         0.0f, 1.0f, 0.0f, 0.0f,
@@ -279,25 +354,104 @@ class Mat4<float> : public Mat4Base<float> {
       );
     }
 
-    static inline Mat4<float> translationMatrix(const qm::Vec3<float>& v) {
-      Mat4<float> matrix = identityMatrix();
-      matrix[12] = v[0];
-      matrix[13] = v[1];
-      matrix[14] = v[2];
-      return matrix;
+    static constexpr Mat4<float> translationMatrix(const qm::Vec3<float>& v) {
+      return Mat4<float>(
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        v[0], v[1], v[2], 1.0f
+      );
+    }
+
+    static constexpr Mat4<float> scaleMatrix(const qm::Vec3<float>& s) {
+      return Mat4<float>(
+        s[0], 0.0f, 0.0f, 0.0f,
+        0.0f, s[1], 0.0f, 0.0f,
+        0.0f, 0.0f, s[2], 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+      );
+    }
+
+};
+
+template<>
+class Mat4<double> : public Mat4Base<double> {
+
+  public:
+    // Constructors
+    constexpr Mat4<double>() : Mat4Base<double>() { }
+    constexpr Mat4<double>(double m0, double m1, double m2, double m3, double m4, double m5, double m6, double m7, double m8, double m9, double m10, double m11, double m12, double m13, double m14, double m15) :
+      Mat4Base<double>(m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15) {}
+    constexpr Mat4<double>(const Mat4Base<double>& M) : Mat4Base<double>(M) {}
+    constexpr Mat4<double>(Mat4Base<double>& M) : Mat4Base<double>(M) {}
+
+    inline const Mat4<double> translate(const qm::Vec3<double>& v) {
+      Mat4<double> result = Mat4<double>::translationMatrix(v) * *this;
+      return result;
+    }
+
+    // Always through libm: the fast polynomials are float only
+    inline const Mat4<double> rotateY(double deg, Precision precision = QM_TRIG_PRECISION) {
+      (void) precision;
+      double rad = deg * ONE_DEG_IN_RAD;
+      double s = sin(rad);
+      double c = cos(rad);
+      Mat4<double> rotation = Mat4<double>::identityMatrix();
+      rotation[0] = c;
+      rotation[8] = s;
+      rotation[2] = -s;
+      rotation[10] = c;
+      return rotation * *this;
+    }
+
+    // Same as Mat4<float>
+    const Mat4<double> inverse() const;
+    const Mat4<double> inverseAffine() const;
+    const Mat4<double> inverseRigid() const;
+    double determinant() const;
+    const Mat4<double> transpose() const;
+
+    // Static methods
+    static constexpr Mat4<double> zeroMatrix() {
+      return Mat4<double>(
+        0.0, 0.0, 0.0, 0.0,
+        0.0, 0.0, 0.0, 0.0,
+        0.0, 0.0, 0.0, 0.0,
+        0.0, 0.0, 0.0, 0.0
+      );
+    }
+
+    static constexpr Mat4<double> identityMatrix() {
+      return Mat4<double>(
+        1.0, 0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        0.0, 0.0, 0.0, 1.0
+      );
     }
 
-    static inline Mat4<float> scaleMatrix(const qm::Vec3<float>& s) {
-      Mat4<float> matrix = identityMatrix();
-      matrix[0] = s[0];
-      matrix[5] = s[1];
-      matrix[10] = s[2];
-      return matrix;
+    static constexpr Mat4<double> translationMatrix(const qm::Vec3<double>& v) {
+      return Mat4<double>(
+        1.0, 0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        v[0], v[1], v[2], 1.0
+      );
+    }
+
+    static constexpr Mat4<double> scaleMatrix(const qm::Vec3<double>& s) {
+      return Mat4<double>(
+        s[0], 0.0, 0.0, 0.0,
+        0.0, s[1], 0.0, 0.0,
+        0.0, 0.0, s[2], 0.0,
+        0.0, 0.0, 0.0, 1.0
+      );
     }
 
 };
 
 typedef Mat4<float> Mat4f;
+typedef Mat4<double> Mat4d;
 
 }
 
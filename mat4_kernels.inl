@@ -0,0 +1,175 @@
+// Batched 4x4 matrix kernels of mat4.cpp, expanded once per instruction set by
+// simd_foreach.h. Pack<T>::W matrices are processed at once, one per lane:
+// e[4*c + r] holds element (r, c) of each of them (column-major, as Mat4Base).
+
+template<typename T> inline void loadMat4(const T* p, typename Pack<T>::V e[16]) {
+  for (int c = 0 ; c < 4 ; c++)
+    Pack<T>::loadTransposed4(p + 4*c, 16, e[4*c], e[4*c + 1], e[4*c + 2], e[4*c + 3]);
+}
+
+template<typename T> inline void storeMat4(T* p, const typename Pack<T>::V e[16]) {
+  for (int c = 0 ; c < 4 ; c++)
+    Pack<T>::storeTransposed4(p + 4*c, 16, e[4*c], e[4*c + 1], e[4*c + 2], e[4*c + 3]);
+}
+
+// Runs Op on groups of W matrices. Op writes outSize T per matrix. The last
+// partial group goes through zeroed buffers, so in and out may be the same.
+template<typename T, typename Op> void forEachMat4Group(const T* in, T* out, size_t count, int outSize) {
+  const int W = Pack<T>::W;
+  size_t n = 0;
+  for ( ; n + W <= count ; n += W)
+    Op::run(in + 16*n, out + outSize*n);
+  if (n == count)
+    return;
+  T bufferIn[16 * W] = { T(0) };
+  T bufferOut[16 * W];
+  for (size_t k = 0 ; k < 16 * (count - n) ; k++)
+    bufferIn[k] = in[16*n + k];
+  Op::run(bufferIn, bufferOut);
+  for (size_t k = 0 ; k < outSize * (count - n) ; k++)
+    out[outSize*n + k] = bufferOut[k];
+}
+
+// 2x2 sub-determinants of the two top rows (a) and the two bottom rows (b)
+template<typename T> struct Mat4Minors {
+  typedef typename Pack<T>::V V;
+  V a0, a1, a2, a3, a4, a5;
+  V b0, b1, b2, b3, b4, b5;
+  inline Mat4Minors(const V e[16]) {
+    a0 = e[0] * e[5] - e[4] * e[1];
+    a1 = e[0] * e[9] - e[8] * e[1];
+    a2 = e[0] * e[13] - e[12] * e[1];
+    a3 = e[4] * e[9] - e[8] * e[5];
+    a4 = e[4] * e[13] - e[12] * e[5];
+    a5 = e[8] * e[13] - e[12] * e[9];
+    b0 = e[2] * e[7] - e[6] * e[3];
+    b1 = e[2] * e[11] - e[10] * e[3];
+    b2 = e[2] * e[15] - e[14] * e[3];
+    b3 = e[6] * e[11] - e[10] * e[7];
+    b4 = e[6] * e[15] - e[14] * e[7];
+    b5 = e[10] * e[15] - e[14] * e[11];
+  }
+  inline V determinant() const {
+    return a0 * b5 - a1 * b4 + a2 * b3 + a3 * b2 - a4 * b1 + a5 * b0;
+  }
+};
+
+template<typename T> struct DeterminantOp {
+  static inline void run(const T* in, T* out) {
+    typename Pack<T>::V e[16];
+    loadMat4<T>(in, e);
+    Pack<T>::store(out, Mat4Minors<T>(e).determinant());
+  }
+};
+
+// Adjugate over determinant; singular matrices give the zero matrix
+template<typename T> struct InverseOp {
+  static inline void run(const T* in, T* out) {
+    typedef Pack<T> P;
+    typename P::V e[16], r[16];
+    loadMat4<T>(in, e);
+    Mat4Minors<T> m(e);
+    typename P::V det = m.determinant();
+    typename P::V zero = P::set1(T(0));
+    typename P::M singular = P::eq(det, zero);
+    typename P::V invDet = P::select(singular, zero, P::set1(T(1)) / det);
+    r[0] = (e[5] * m.b5 - e[9] * m.b4 + e[13] * m.b3) * invDet;
+    r[1] = (e[9] * m.b2 - e[1] * m.b5 - e[13] * m.b1) * invDet;
+    r[2] = (e[1] * m.b4 - e[5] * m.b2 + e[13] * m.b0) * invDet;
+    r[3] = (e[5] * m.b1 - e[1] * m.b3 - e[9] * m.b0) * invDet;
+    r[4] = (e[8] * m.b4 - e[4] * m.b5 - e[12] * m.b3) * invDet;
+    r[5] = (e[0] * m.b5 - e[8] * m.b2 + e[12] * m.b1) * invDet;
+    r[6] = (e[4] * m.b2 - e[0] * m.b4 - e[12] * m.b0) * invDet;
+    r[7] = (e[0] * m.b3 - e[4] * m.b1 + e[8] * m.b0) * invDet;
+    r[8] = (e[7] * m.a5 - e[11] * m.a4 + e[15] * m.a3) * invDet;
+    r[9] = (e[11] * m.a2 - e[3] * m.a5 - e[15] * m.a1) * invDet;
+    r[10] = (e[3] * m.a4 - e[7] * m.a2 + e[15] * m.a0) * invDet;
+    r[11] = (e[7] * m.a1 - e[3] * m.a3 - e[11] * m.a0) * invDet;
+    r[12] = (e[10] * m.a4 - e[6] * m.a5 - e[14] * m.a3) * invDet;
+    r[13] = (e[2] * m.a5 - e[10] * m.a2 + e[14] * m.a1) * invDet;
+    r[14] = (e[6] * m.a2 - e[2] * m.a4 - e[14] * m.a0) * invDet;
+    r[15] = (e[2] * m.a3 - e[6] * m.a1 + e[10] * m.a0) * invDet;
+    storeMat4<T>(out, r);
+  }
+};
+
+// Last row assumed to be 0 0 0 1: inverse 3x3 block, then -A^-1 * t
+template<typename T> struct InverseAffineOp {
+  static inline void run(const T* in, T* out) {
+    typedef Pack<T> P;
+    typename P::V e[16], r[16];
+    loadMat4<T>(in, e);
+    typename P::V c00 = e[5] * e[10] - e[9] * e[6];
+    typename P::V c01 = e[8] * e[6] - e[4] * e[10];
+    typename P::V c02 = e[4] * e[9] - e[8] * e[5];
+    typename P::V det = e[0] * c00 + e[1] * c01 + e[2] * c02;
+    typename P::V zero = P::set1(T(0));
+    typename P::M singular = P::eq(det, zero);
+    typename P::V invDet = P::select(singular, zero, P::set1(T(1)) / det);
+    r[0] = c00 * invDet;
+    r[4] = c01 * invDet;
+    r[8] = c02 * invDet;
+    r[1] = (e[9] * e[2] - e[1] * e[10]) * invDet;
+    r[5] = (e[0] * e[10] - e[8] * e[2]) * invDet;
+    r[9] = (e[8] * e[1] - e[0] * e[9]) * invDet;
+    r[2] = (e[1] * e[6] - e[5] * e[2]) * invDet;
+    r[6] = (e[4] * e[2] - e[0] * e[6]) * invDet;
+    r[10] = (e[0] * e[5] - e[4] * e[1]) * invDet;
+    r[12] = zero - (r[0] * e[12] + r[4] * e[13] + r[8] * e[14]);
+    r[13] = zero - (r[1] * e[12] + r[5] * e[13] + r[9] * e[14]);
+    r[14] = zero - (r[2] * e[12] + r[6] * e[13] + r[10] * e[14]);
+    r[3] = r[7] = r[11] = zero;
+    r[15] = P::select(singular, zero, P::set1(T(1)));
+    storeMat4<T>(out, r);
+  }
+};
+
+// Rotation + translation: transposed rotation, then -R^T * t
+template<typename T> struct InverseRigidOp {
+  static inline void run(const T* in, T* out) {
+    typedef Pack<T> P;
+    typename P::V e[16], r[16];
+    loadMat4<T>(in, e);
+    typename P::V zero = P::set1(T(0));
+    for (int c = 0 ; c < 3 ; c++)
+      for (int k = 0 ; k < 3 ; k++)
+        r[4*c + k] = e[4*k + c];
+    r[12] = zero - (r[0] * e[12] + r[4] * e[13] + r[8] * e[14]);
+    r[13] = zero - (r[1] * e[12] + r[5] * e[13] + r[9] * e[14]);
+    r[14] = zero - (r[2] * e[12] + r[6] * e[13] + r[10] * e[14]);
+    r[3] = r[7] = r[11] = zero;
+    r[15] = P::set1(T(1));
+    storeMat4<T>(out, r);
+  }
+};
+
+template<typename T> struct TransposeOp {
+  static inline void run(const T* in, T* out) {
+    typename Pack<T>::V e[16], r[16];
+    loadMat4<T>(in, e);
+    for (int c = 0 ; c < 4 ; c++)
+      for (int k = 0 ; k < 4 ; k++)
+        r[4*c + k] = e[4*k + c];
+    storeMat4<T>(out, r);
+  }
+};
+
+template<typename T> void determinantMat4(const T* in, T* out, size_t count) {
+  forEachMat4Group<T, DeterminantOp<T> >(in, out, count, 1);
+}
+
+template<typename T> void inverseMat4(const T* in, T* out, size_t count) {
+  forEachMat4Group<T, InverseOp<T> >(in, out, count, 16);
+}
+
+template<typename T> void inverseAffineMat4(const T* in, T* out, size_t count) {
+  forEachMat4Group<T, InverseAffineOp<T> >(in, out, count, 16);
+}
+
+template<typename T> void inverseRigidMat4(const T* in, T* out, size_t count) {
+  forEachMat4Group<T, InverseRigidOp<T> >(in, out, count, 16);
+}
+
+template<typename T> void transposeMat4(const T* in, T* out, size_t count) {
+  forEachMat4Group<T, TransposeOp<T> >(in, out, count, 16);
+}
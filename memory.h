@@ -0,0 +1,365 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace qm {
+
+// Size of a cache line, and alignment of every buffer handed to SIMD kernels.
+const size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * Counters of the blocks of alignedMalloc and alignedFree (arenas and
+ * containers included), updated atomically from every thread.
+ */
+struct MemoryStats {
+  size_t allocations;
+  size_t frees;
+  // Requested bytes of the blocks not freed yet, and their maximum
+  size_t bytesInUse;
+  size_t peakBytes;
+  // Requested bytes of every allocation so far
+  size_t totalBytes;
+};
+
+namespace detail {
+
+struct MemoryCounters {
+  std::atomic<size_t> allocations;
+  std::atomic<size_t> frees;
+  std::atomic<size_t> bytesInUse;
+  std::atomic<size_t> peakBytes;
+  std::atomic<size_t> totalBytes;
+};
+
+inline MemoryCounters& memoryCounters() {
+  static MemoryCounters counters = {{0}, {0}, {0}, {0}, {0}};
+  return counters;
+}
+
+// Bytes in front of the blocks of alignedMalloc, holding their size and
+// alignment: a multiple of alignment
+inline size_t blockHeader(size_t alignment) {
+  return (2 * sizeof(size_t) + alignment - 1) / alignment * alignment;
+}
+
+}
+
+inline MemoryStats memoryStats() {
+  detail::MemoryCounters& c = detail::memoryCounters();
+  MemoryStats stats = {c.allocations.load(std::memory_order_relaxed), c.frees.load(std::memory_order_relaxed),
+    c.bytesInUse.load(std::memory_order_relaxed), c.peakBytes.load(std::memory_order_relaxed),
+    c.totalBytes.load(std::memory_order_relaxed)};
+  return stats;
+}
+
+// Allocate bytes aligned on alignment (a power of two, at least sizeof(void*)).
+// Returns 0 on failure or when bytes is 0.
+inline void* alignedMalloc(size_t bytes, size_t alignment = CACHE_LINE_SIZE) {
+  if (bytes == 0)
+    return 0;
+  size_t header = detail::blockHeader(alignment);
+#if defined(_WIN32)
+  char* base = (char*) _aligned_malloc(header + bytes, alignment);
+  if (!base)
+    return 0;
+#else
+  void* ptr = 0;
+  if (posix_memalign(&ptr, alignment, header + bytes) != 0)
+    return 0;
+  char* base = (char*) ptr;
+#endif
+  size_t* info = (size_t*) (base + header) - 2;
+  info[0] = alignment;
+  info[1] = bytes;
+  detail::MemoryCounters& c = detail::memoryCounters();
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  c.totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+  size_t inUse = c.bytesInUse.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  size_t peak = c.peakBytes.load(std::memory_order_relaxed);
+  while (peak < inUse && !c.peakBytes.compare_exchange_weak(peak, inUse, std::memory_order_relaxed))
+    ;
+  return base + header;
+}
+
+inline void alignedFree(void* ptr) {
+  if (!ptr)
+    return;
+  size_t* info = (size_t*) ptr - 2;
+  detail::MemoryCounters& c = detail::memoryCounters();
+  c.frees.fetch_add(1, std::memory_order_relaxed);
+  c.bytesInUse.fetch_sub(info[1], std::memory_order_relaxed);
+  char* base = (char*) ptr - detail::blockHeader(info[0]);
+#if defined(_WIN32)
+  _aligned_free(base);
+#else
+  free(base);
+#endif
+}
+
+// Move the first count elements of array (of a trivially copyable T) to a new
+// block of capacity elements. Returns false, and keeps array as it was, if the
+// allocation failed.
+template<typename T> inline bool alignedReallocate(T*& array, size_t count, size_t capacity) {
+  T* newArray = (T*) alignedMalloc(capacity * sizeof(T));
+  if (!newArray && capacity > 0)
+    return false;
+  if (count > 0)
+    memcpy((void*) newArray, array, count * sizeof(T));
+  alignedFree(array);
+  array = newArray;
+  return true;
+}
+
+// Round count up to a multiple of the number of T per cache line.
+template<typename T> inline size_t paddedCount(size_t count) {
+  const size_t perLine = CACHE_LINE_SIZE / sizeof(T);
+  return (count + perLine - 1) / perLine * perLine;
+}
+
+/**
+ * T aligned on Alignment bytes, with the constructors of T. Types whose size
+ * is a multiple of Alignment keep it (Aligned<Mat4f, 64>, Aligned<Quat, 16>):
+ * their arrays can be handed to the batched kernels as arrays of T. Vec3A
+ * (vec3.h) is the padded Vec3.
+ */
+template<typename T, size_t Alignment> struct alignas(Alignment) Aligned : public T {
+  using T::T;
+  inline Aligned() : T() { }
+  inline Aligned(const T& t) : T(t) { }
+};
+
+/**
+ * Frame arena: a linear allocator whose allocations are only released all
+ * at once, by reset(), typically once per frame. Allocating moves an offset
+ * in the current block; a full block chains a new one, twice as large. After
+ * a frame that needed several blocks, reset() replaces them by a single one
+ * large enough for it, so that the next frames allocate nothing from the
+ * system. Not thread-safe: use one arena per thread.
+ */
+class FrameArena {
+
+  public:
+    // Constructors: the first block holds capacity bytes
+    explicit FrameArena(size_t capacity = 1 << 20) : blocks(0), used(0), peak(0) {
+      blocks = newBlock(capacity, 0);
+    }
+    ~FrameArena() {
+      release(blocks);
+    }
+    // bytes aligned on alignment (a power of two, at most CACHE_LINE_SIZE).
+    // Returns 0 only if the system is out of memory.
+    void* allocate(size_t bytes, size_t alignment = CACHE_LINE_SIZE) {
+      size_t offset = blocks ? (blocks->offset + alignment - 1) & ~(alignment - 1) : 0;
+      if (!blocks || offset + bytes > blocks->size) {
+        size_t size = blocks ? 2 * blocks->size : 0;
+        Block* block = newBlock((size < bytes) ? bytes : size, blocks);
+        if (!block)
+          return 0;
+        blocks = block;
+        offset = 0;
+      }
+      used += offset + bytes - blocks->offset;
+      peak = (peak < used) ? used : peak;
+      blocks->offset = offset + bytes;
+      return blocks->data + offset;
+    }
+    // count value-initialized T, aligned on the cache line. Their destructors
+    // never run: T should be a vector, matrix or quaternion type.
+    template<typename T> T* allocate(size_t count) {
+      T* array = (T*) allocate(count * sizeof(T), CACHE_LINE_SIZE);
+      for (size_t i = 0 ; array && i < count ; i++)
+        new (array + i) T();
+      return array;
+    }
+    // Release every allocation
+    void reset() {
+      if (blocks && blocks->next) {
+        size_t total = 0;
+        for (Block* b = blocks ; b ; b = b->next)
+          total += b->size;
+        release(blocks);
+        blocks = newBlock(total, 0);
+      }
+      if (blocks)
+        blocks->offset = 0;
+      used = 0;
+    }
+    // Bytes allocated since the last reset (alignment padding included), and
+    // their maximum over all frames
+    inline size_t getUsed() const {
+      return used;
+    }
+    inline size_t getPeak() const {
+      return peak;
+    }
+    // Bytes of the blocks
+    inline size_t getCapacity() const {
+      size_t total = 0;
+      for (Block* b = blocks ; b ; b = b->next)
+        total += b->size;
+      return total;
+    }
+
+  private:
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+
+    // Header of a block, followed by its data on the next cache line
+    struct Block {
+      Block* next;
+      size_t size;
+      size_t offset;
+      char* data;
+    };
+
+    static Block* newBlock(size_t size, Block* next) {
+      char* memory = (char*) alignedMalloc(CACHE_LINE_SIZE + size);
+      if (!memory)
+        return 0;
+      Block* block = (Block*) memory;
+      block->next = next;
+      block->size = size;
+      block->offset = 0;
+      block->data = memory + CACHE_LINE_SIZE;
+      return block;
+    }
+
+    static void release(Block* block) {
+      while (block) {
+        Block* next = block->next;
+        alignedFree(block);
+        block = next;
+      }
+    }
+
+    Block* blocks;
+    size_t used;
+    size_t peak;
+
+};
+
+/**
+ * Growable array on cache-line aligned storage, for the inputs and outputs of
+ * the batched kernels (data() and size()). clear() and shrinking resizes keep
+ * the storage, so arrays rebuilt every frame stop allocating once they
+ * reached their largest size. Growing doubles the capacity.
+ */
+template<typename T> class AlignedArray {
+
+  public:
+    // Constructors
+    inline AlignedArray() : elements(0), count(0), allocated(0) { }
+    inline explicit AlignedArray(size_t size) : elements(0), count(0), allocated(0) {
+      resize(size);
+    }
+    inline AlignedArray(const AlignedArray& A) : elements(0), count(0), allocated(0) {
+      *this = A;
+    }
+    inline ~AlignedArray() {
+      clear();
+      alignedFree(elements);
+    }
+    // Operators: a failed allocation leaves the array empty
+    AlignedArray& operator=(const AlignedArray& A) {
+      if (this == &A)
+        return *this;
+      clear();
+      if (!reserve(A.count))
+        return *this;
+      for (size_t i = 0 ; i < A.count ; i++)
+        new (elements + i) T(A.elements[i]);
+      count = A.count;
+      return *this;
+    }
+    inline T& operator[](size_t i) {
+      return elements[i];
+    }
+    inline const T& operator[](size_t i) const {
+      return elements[i];
+    }
+    // Others
+    inline size_t size() const {
+      return count;
+    }
+    inline size_t capacity() const {
+      return allocated;
+    }
+    inline bool empty() const {
+      return count == 0;
+    }
+    inline T* data() {
+      return elements;
+    }
+    inline const T* data() const {
+      return elements;
+    }
+    inline T* begin() {
+      return elements;
+    }
+    inline T* end() {
+      return elements + count;
+    }
+    inline const T* begin() const {
+      return elements;
+    }
+    inline const T* end() const {
+      return elements + count;
+    }
+    // Make room for size elements. Returns false if the allocation failed.
+    bool reserve(size_t size) {
+      if (size <= allocated)
+        return true;
+      T* grown = (T*) alignedMalloc(size * sizeof(T));
+      if (!grown)
+        return false;
+      for (size_t i = 0 ; i < count ; i++) {
+        new (grown + i) T(elements[i]);
+        elements[i].~T();
+      }
+      alignedFree(elements);
+      elements = grown;
+      allocated = size;
+      return true;
+    }
+    // New elements are value-initialized
+    bool resize(size_t size) {
+      if (size > allocated && !reserve((size < 2 * allocated) ? 2 * allocated : size))
+        return false;
+      for (size_t i = size ; i < count ; i++)
+        elements[i].~T();
+      for (size_t i = count ; i < size ; i++)
+        new (elements + i) T();
+      count = size;
+      return true;
+    }
+    bool push_back(const T& t) {
+      // t may be an element of this array
+      T copy(t);
+      if (count == allocated && !reserve((allocated == 0) ? CACHE_LINE_SIZE / sizeof(T) + 1 : 2 * allocated))
+        return false;
+      new (elements + count) T(copy);
+      count++;
+      return true;
+    }
+    inline void clear() {
+      resize(0);
+    }
+
+  private:
+    T* elements;
+    size_t count;
+    size_t allocated;
+
+};
+
+}
+
+#endif // MEMORY_H
@@ -0,0 +1,89 @@
+#include "packed.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+#define QM_SIMD_KERNELS "packed_kernels.inl"
+#include "simd_foreach.h"
+
+/**
+ * Packing kernels compiled for one instruction set.
+ */
+struct PackKernels {
+  void (*packHalves)(const float*, uint16_t*, size_t);
+  void (*unpackHalves)(const uint16_t*, float*, size_t);
+  void (*packNormals)(const float*, int16_t*, size_t);
+  void (*unpackNormals)(const int16_t*, float*, size_t);
+  void (*packQuats32)(const float*, uint32_t*, size_t);
+  void (*unpackQuats32)(const uint32_t*, float*, size_t);
+  void (*packQuats48)(const float*, uint16_t*, size_t);
+  void (*unpackQuats48)(const uint16_t*, float*, size_t);
+};
+
+const PackKernels& kernels() {
+  static const PackKernels table[SIMD_ISA_COUNT] = {
+    {scalar::packHalves, scalar::unpackHalves, scalar::packNormals, scalar::unpackNormals,
+      scalar::packQuats32, scalar::unpackQuats32, scalar::packQuats48, scalar::unpackQuats48},
+#if QM_SIMD_X86
+    {sse2::packHalves, sse2::unpackHalves, sse2::packNormals, sse2::unpackNormals,
+      sse2::packQuats32, sse2::unpackQuats32, sse2::packQuats48, sse2::unpackQuats48},
+    {avx::packHalves, avx::unpackHalves, avx::packNormals, avx::unpackNormals,
+      avx::packQuats32, avx::unpackQuats32, avx::packQuats48, avx::unpackQuats48},
+    {avx2::packHalves, avx2::unpackHalves, avx2::packNormals, avx2::unpackNormals,
+      avx2::packQuats32, avx2::unpackQuats32, avx2::packQuats48, avx2::unpackQuats48}
+#endif
+  };
+  return table[simdIsa()];
+}
+
+// The packed types are arrays of their fields (see the static_assert below)
+template<typename To, typename From> inline const To* fields(const From* p) {
+  return reinterpret_cast<const To*>(p);
+}
+
+template<typename To, typename From> inline To* fields(From* p) {
+  return reinterpret_cast<To*>(p);
+}
+
+}
+
+namespace qm {
+
+static_assert(sizeof(Vec3f) == 12 && sizeof(Quat) == 16 && sizeof(Vec3h) == 6 && sizeof(OctNormal) == 4 &&
+  sizeof(PackedQuat32) == 4 && sizeof(PackedQuat48) == 6, "packed types must not be padded");
+
+void packMany(const Vec3f* in, Vec3h* out, size_t count) {
+  kernels().packHalves(fields<float>(in), fields<uint16_t>(out), 3 * count);
+}
+
+void unpackMany(const Vec3h* in, Vec3f* out, size_t count) {
+  kernels().unpackHalves(fields<uint16_t>(in), fields<float>(out), 3 * count);
+}
+
+void packMany(const Vec3f* normals, OctNormal* out, size_t count) {
+  kernels().packNormals(fields<float>(normals), fields<int16_t>(out), count);
+}
+
+void unpackMany(const OctNormal* in, Vec3f* out, size_t count) {
+  kernels().unpackNormals(fields<int16_t>(in), fields<float>(out), count);
+}
+
+void packMany(const Quat* in, PackedQuat32* out, size_t count) {
+  kernels().packQuats32(fields<float>(in), fields<uint32_t>(out), count);
+}
+
+void unpackMany(const PackedQuat32* in, Quat* out, size_t count) {
+  kernels().unpackQuats32(fields<uint32_t>(in), fields<float>(out), count);
+}
+
+void packMany(const Quat* in, PackedQuat48* out, size_t count) {
+  kernels().packQuats48(fields<float>(in), fields<uint16_t>(out), count);
+}
+
+void unpackMany(const PackedQuat48* in, Quat* out, size_t count) {
+  kernels().unpackQuats48(fields<uint16_t>(in), fields<float>(out), count);
+}
+
+}
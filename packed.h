@@ -0,0 +1,221 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "vec3.h"
+#include "quat.h"
+
+namespace qm {
+
+// IEEE binary16 bits of x, rounded to nearest even. Overflows give infinity,
+// NaNs a quiet NaN (F. Giesen, float_to_half_fast3_rtne).
+inline uint16_t floatToHalf(float x) {
+  uint32_t bits, sign;
+  std::memcpy(&bits, &x, sizeof(bits));
+  sign = bits & 0x80000000u;
+  bits ^= sign;
+  uint32_t h;
+  if (bits >= (127u + 16) << 23) {
+    h = (bits > 255u << 23) ? 0x7e00 : 0x7c00;
+  } else if (bits < (127u - 14) << 23) {
+    // Subnormal: the float addition rounds the mantissa
+    const uint32_t magicBits = ((127u - 15) + (23 - 10) + 1) << 23;
+    float f, magic;
+    std::memcpy(&f, &bits, sizeof(f));
+    std::memcpy(&magic, &magicBits, sizeof(magic));
+    f += magic;
+    std::memcpy(&h, &f, sizeof(h));
+    h -= magicBits;
+  } else {
+    uint32_t odd = (bits >> 13) & 1;
+    h = (bits + 0xfff - ((127u - 15) << 23) + odd) >> 13;
+  }
+  return (uint16_t) (h | (sign >> 16));
+}
+
+// Float value of the IEEE binary16 bits h (exact)
+inline float halfToFloat(uint16_t h) {
+  uint32_t expMant = h & 0x7fff;
+  uint32_t bits = expMant << 13;
+  float f, magic;
+  const uint32_t magicBits = (254u - 15) << 23;
+  std::memcpy(&f, &bits, sizeof(f));
+  std::memcpy(&magic, &magicBits, sizeof(magic));
+  f *= magic;
+  std::memcpy(&bits, &f, sizeof(bits));
+  if (expMant > 0x7bff)
+    bits |= 255u << 23;
+  bits |= (uint32_t) (h & 0x8000) << 16;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+/**
+ * Storage-only vector of 3 halves (6 bytes instead of 12). Halves keep 11
+ * significant bits: relative error 2^-11 (4.9e-4) in [6.1e-5, 65504]. NaNs
+ * stay NaNs, but their payload may change.
+ */
+struct Vec3h {
+  uint16_t v[3];
+
+  inline Vec3h() : v{0, 0, 0} { }
+  inline explicit Vec3h(const Vec3f& f) : v{floatToHalf(f[0]), floatToHalf(f[1]), floatToHalf(f[2])} { }
+  inline Vec3f toVec3f() const {
+    return Vec3f(halfToFloat(v[0]), halfToFloat(v[1]), halfToFloat(v[2]));
+  }
+};
+
+namespace detail {
+
+const float SNORM16_MAX = 32767.0f;
+const float INV_SQRT2 = 0.707106781186548f;
+
+// (x + ROUND_MAGIC) - ROUND_MAGIC rounds x to the nearest integer
+inline float roundNearest(float x) {
+  const float ROUND_MAGIC = 12582912.0f;
+  return (x + ROUND_MAGIC) - ROUND_MAGIC;
+}
+
+// Index of the largest |q[k]| (the first one on ties), and the other 3
+// components, negated if q[largest] < 0, quantized on Bits bits over
+// [-1/sqrt(2), 1/sqrt(2)]
+template<int Bits> inline int quantizeSmallestThree(const Quat& q, uint32_t c[3]) {
+  const float scale = ((1 << Bits) - 1) * INV_SQRT2;
+  int largest = 0;
+  float best = std::fabs(q[0]);
+  for (int k = 1 ; k < 4 ; k++) {
+    if (best < std::fabs(q[k])) {
+      largest = k;
+      best = std::fabs(q[k]);
+    }
+  }
+  for (int k = 0, n = 0 ; k < 4 ; k++) {
+    if (k == largest)
+      continue;
+    float o = (q[largest] < 0.0f) ? -q[k] : q[k];
+    float r = roundNearest((o + INV_SQRT2) * scale);
+    r = (r < 0.0f) ? 0.0f : r;
+    r = ((1 << Bits) - 1 < r) ? (float) ((1 << Bits) - 1) : r;
+    c[n++] = (uint32_t) r;
+  }
+  return largest;
+}
+
+template<int Bits> inline Quat dequantizeSmallestThree(int largest, const uint32_t c[3]) {
+  const float step = 1.0f / (((1 << Bits) - 1) * INV_SQRT2);
+  float o[3], sum = 0.0f;
+  for (int k = 0 ; k < 3 ; k++) {
+    o[k] = c[k] * step - INV_SQRT2;
+    sum += o[k] * o[k];
+  }
+  float l = std::sqrt((sum < 1.0f) ? 1.0f - sum : 0.0f);
+  float r[4];
+  for (int k = 0, n = 0 ; k < 4 ; k++)
+    r[k] = (k == largest) ? l : o[n++];
+  return Quat::fromComponents(r[0], r[1], r[2], r[3]);
+}
+
+}
+
+/**
+ * Unit vector in 2 snorm16 (4 bytes instead of 12): the octahedral
+ * projection x / (|x| + |y| + |z|), lower half folded over the upper one.
+ * Decoded normals are within 7e-5 radians of the encoded ones. The zero
+ * vector decodes to (0, 0, 1).
+ */
+struct OctNormal {
+  int16_t x;
+  int16_t y;
+
+  inline OctNormal() : x(0), y(0) { }
+  inline explicit OctNormal(const Vec3f& n) {
+    float sum = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    float inv = (0.0f < sum) ? 1.0f / sum : 0.0f;
+    float px = n[0] * inv, py = n[1] * inv;
+    if (n[2] < 0.0f) {
+      float fx = (1.0f - std::fabs(py)) * ((px < 0.0f) ? -1.0f : 1.0f);
+      float fy = (1.0f - std::fabs(px)) * ((py < 0.0f) ? -1.0f : 1.0f);
+      px = fx;
+      py = fy;
+    }
+    x = (int16_t) detail::roundNearest(px * detail::SNORM16_MAX);
+    y = (int16_t) detail::roundNearest(py * detail::SNORM16_MAX);
+  }
+  inline Vec3f toVec3f() const {
+    float px = x * (1.0f / detail::SNORM16_MAX), py = y * (1.0f / detail::SNORM16_MAX);
+    float pz = 1.0f - std::fabs(px) - std::fabs(py);
+    float t = (pz < 0.0f) ? -pz : 0.0f;
+    px += (px < 0.0f) ? t : -t;
+    py += (py < 0.0f) ? t : -t;
+    float inv = 1.0f / std::sqrt(px * px + py * py + pz * pz);
+    return Vec3f(px * inv, py * inv, pz * inv);
+  }
+};
+
+/**
+ * Unit quaternion in 32 bits, "smallest three": the index of its largest
+ * component (2 bits) and the other 3 on 10 bits each, the largest being
+ * rebuilt from the unit norm. The decoded quaternion may be the opposite of
+ * the encoded one (same rotation); components are within 2.1e-3 of it. The 3
+ * stored ones are within half a step h = 1 / (sqrt(2) (2^10 - 1)). The
+ * largest l >= 1/2 moves by at most sqrt(3) h sqrt(1 - l^2) / l to first
+ * order, 3h at l = 1/2, and exactly 2.08e-3 when all 4 components are 1/2.
+ */
+struct PackedQuat32 {
+  uint32_t bits;
+
+  inline PackedQuat32() : bits(0) { }
+  inline explicit PackedQuat32(const Quat& q) {
+    uint32_t c[3];
+    uint32_t largest = detail::quantizeSmallestThree<10>(q, c);
+    bits = c[0] | c[1] << 10 | c[2] << 20 | largest << 30;
+  }
+  inline Quat toQuat() const {
+    uint32_t c[3] = {bits & 0x3ff, (bits >> 10) & 0x3ff, (bits >> 20) & 0x3ff};
+    return detail::dequantizeSmallestThree<10>(bits >> 30, c);
+  }
+};
+
+/**
+ * Unit quaternion in 48 bits, as PackedQuat32 with 15 bits per component:
+ * word k holds component k in its low 15 bits and bit k of the index of the
+ * largest component in its high bit. Components are within 6.6e-5 (the
+ * same bound with h = 1 / (sqrt(2) (2^15 - 1)): 6.48e-5 at worst, plus float
+ * rounding).
+ */
+struct PackedQuat48 {
+  uint16_t words[3];
+
+  inline PackedQuat48() : words{0, 0, 0} { }
+  inline explicit PackedQuat48(const Quat& q) {
+    uint32_t c[3];
+    uint32_t largest = detail::quantizeSmallestThree<15>(q, c);
+    words[0] = (uint16_t) (c[0] | (largest & 1) << 15);
+    words[1] = (uint16_t) (c[1] | (largest >> 1) << 15);
+    words[2] = (uint16_t) c[2];
+  }
+  inline Quat toQuat() const {
+    uint32_t c[3] = {words[0] & 0x7fffu, words[1] & 0x7fffu, words[2] & 0x7fffu};
+    return detail::dequantizeSmallestThree<15>((words[0] >> 15) | (words[1] >> 15) << 1, c);
+  }
+};
+
+// Bulk conversions of count contiguous elements, W at a time (see simd.h).
+// Results match the constructors and toVec3f/toQuat, except for the rounding
+// of the multiply-adds fused on AVX2. Quaternions should be unit.
+void packMany(const Vec3f* in, Vec3h* out, size_t count);
+void unpackMany(const Vec3h* in, Vec3f* out, size_t count);
+void packMany(const Vec3f* normals, OctNormal* out, size_t count);
+void unpackMany(const OctNormal* in, Vec3f* out, size_t count);
+void packMany(const Quat* in, PackedQuat32* out, size_t count);
+void unpackMany(const PackedQuat32* in, Quat* out, size_t count);
+void packMany(const Quat* in, PackedQuat48* out, size_t count);
+void unpackMany(const PackedQuat48* in, Quat* out, size_t count);
+
+}
+
+#endif // PACKED_H
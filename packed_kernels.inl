@@ -0,0 +1,310 @@
+// Packing kernels of packed.cpp, expanded once per instruction set by
+// simd_foreach.h: the conversions of packed.h, one element per SIMD lane.
+// Halves go through Pack::loadHalf/storeHalf (one value at a time on the
+// scalar path). Normals and quaternions are quantized to integer-valued
+// floats, whose bit fields are assembled with exact float arithmetic and
+// converted by Pack::storeInt16/storeUint16. Tails of fewer than W elements
+// go through zero-padded buffers.
+
+typedef Pack<float> P;
+typedef P::V V;
+typedef P::M M;
+
+// 32-bit words from and to their low and high 16 bits, as integer-valued
+// floats. x86 is little endian: the SIMD paths convert 16-bit halves.
+#if QM_PACK_ISA == 0
+inline V loadHalf(const uint16_t* p) {
+  return qm::halfToFloat(*p);
+}
+inline void storeHalf(uint16_t* p, V v) {
+  *p = qm::floatToHalf(v);
+}
+inline void loadWords32(const uint32_t* p, V& low, V& high) {
+  low = (float) (*p & 0xffff);
+  high = (float) (*p >> 16);
+}
+inline void storeWords32(uint32_t* p, V low, V high) {
+  *p = (uint32_t) low | (uint32_t) high << 16;
+}
+#else
+inline V loadHalf(const uint16_t* p) {
+  return P::loadHalf(p);
+}
+inline void storeHalf(uint16_t* p, V v) {
+  P::storeHalf(p, v);
+}
+inline void loadWords32(const uint32_t* p, V& low, V& high) {
+  const uint16_t* halves = reinterpret_cast<const uint16_t*>(p);
+  P::deinterleave(P::loadUint16(halves), P::loadUint16(halves + P::W), low, high);
+}
+inline void storeWords32(uint32_t* p, V low, V high) {
+  uint16_t* halves = reinterpret_cast<uint16_t*>(p);
+  V a, b;
+  P::interleave(low, high, a, b);
+  P::storeUint16(halves, a);
+  P::storeUint16(halves + P::W, b);
+}
+#endif
+
+inline V roundNearest(V x) {
+  V magic = P::set1(12582912.0f);
+  return (x + magic) - magic;
+}
+
+inline V abs(V x) {
+  return P::max(x, P::set1(0.0f) - x);
+}
+
+// -1 where x < 0, else 1
+inline V signOf(V x) {
+  return P::select(P::lt(x, P::set1(0.0f)), P::set1(-1.0f), P::set1(1.0f));
+}
+
+// Elements [n, count) of size floats (or halves) each through a zero-padded
+// buffer of W elements
+template<typename T> inline const T* padIn(const T* in, size_t n, size_t count, size_t size, T* buffer) {
+  for (size_t k = 0 ; k < P::W * size ; k++)
+    buffer[k] = T();
+  for (size_t k = 0 ; k < (count - n) * size ; k++)
+    buffer[k] = in[n * size + k];
+  return buffer;
+}
+
+template<typename T> inline void padOut(const T* buffer, size_t n, size_t count, size_t size, T* out) {
+  for (size_t k = 0 ; k < (count - n) * size ; k++)
+    out[n * size + k] = buffer[k];
+}
+
+void packHalves(const float* in, uint16_t* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    storeHalf(out + n, P::load(in + n));
+  if (n == count)
+    return;
+  float buffer[P::W];
+  uint16_t halves[P::W];
+  storeHalf(halves, P::load(padIn(in, n, count, 1, buffer)));
+  padOut(halves, n, count, 1, out);
+}
+
+void unpackHalves(const uint16_t* in, float* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    P::store(out + n, loadHalf(in + n));
+  if (n == count)
+    return;
+  uint16_t halves[P::W];
+  float buffer[P::W];
+  P::store(buffer, loadHalf(padIn(in, n, count, 1, halves)));
+  padOut(buffer, n, count, 1, out);
+}
+
+// W normals (3 floats each) to 2 snorm16 each
+inline void packNormalsW(const float* in, int16_t* out) {
+  V x, y, z;
+  P::loadTransposed3(in, x, y, z);
+  V zero = P::set1(0.0f), one = P::set1(1.0f);
+  V sum = abs(x) + abs(y) + abs(z);
+  V inv = P::select(P::lt(zero, sum), one / sum, zero);
+  V px = x * inv, py = y * inv;
+  M lower = P::lt(z, zero);
+  V fx = (one - abs(py)) * signOf(px);
+  V fy = (one - abs(px)) * signOf(py);
+  V scale = P::set1(qm::detail::SNORM16_MAX);
+  V a, b;
+  P::interleave(roundNearest(P::select(lower, fx, px) * scale), roundNearest(P::select(lower, fy, py) * scale), a, b);
+  P::storeInt16(out, a);
+  P::storeInt16(out + P::W, b);
+}
+
+inline void unpackNormalsW(const int16_t* in, float* out) {
+  V x, y;
+  P::deinterleave(P::loadInt16(in), P::loadInt16(in + P::W), x, y);
+  V scale = P::set1(1.0f / qm::detail::SNORM16_MAX);
+  x = x * scale;
+  y = y * scale;
+  V zero = P::set1(0.0f);
+  V z = P::set1(1.0f) - abs(x) - abs(y);
+  V t = P::select(P::lt(z, zero), zero - z, zero);
+  x = x + P::select(P::lt(x, zero), t, zero - t);
+  y = y + P::select(P::lt(y, zero), t, zero - t);
+  V inv = P::set1(1.0f) / P::sqrt(x * x + y * y + z * z);
+  P::storeTransposed3(out, x * inv, y * inv, z * inv);
+}
+
+void packNormals(const float* in, int16_t* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    packNormalsW(in + 3 * n, out + 2 * n);
+  if (n == count)
+    return;
+  float buffer[3 * P::W];
+  int16_t packed[2 * P::W];
+  packNormalsW(padIn(in, n, count, 3, buffer), packed);
+  padOut(packed, n, count, 2, out);
+}
+
+void unpackNormals(const int16_t* in, float* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    unpackNormalsW(in + 2 * n, out + 3 * n);
+  if (n == count)
+    return;
+  int16_t packed[2 * P::W];
+  float buffer[3 * P::W];
+  unpackNormalsW(padIn(in, n, count, 2, packed), buffer);
+  padOut(buffer, n, count, 3, out);
+}
+
+// floor(x / d) of the integer-valued x in [0, 2^24) and the power of 2 d:
+// x / d - (d - 1) / 2d is within 1/2 - 1/2d of floor(x / d)
+inline V quotient(V x, float d) {
+  return roundNearest(x * P::set1(1.0f / d) - P::set1((d - 1.0f) / (2.0f * d)));
+}
+
+// W quaternions to the index of their largest component and the other 3
+// quantized on Bits bits (integer-valued floats), as
+// qm::detail::quantizeSmallestThree
+template<int Bits> inline void quantizeW(const float* in, V& largest, V c[3]) {
+  V q[4];
+  P::loadTransposed4(in, 4, q[0], q[1], q[2], q[3]);
+  V zero = P::set1(0.0f);
+  V m = zero, best = abs(q[0]), big = q[0];
+  for (int k = 1 ; k < 4 ; k++) {
+    M greater = P::lt(best, abs(q[k]));
+    m = P::select(greater, P::set1((float) k), m);
+    best = P::max(best, abs(q[k]));
+    big = P::select(greater, q[k], big);
+  }
+  // Components other than m, in order
+  V o[3];
+  o[0] = P::select(P::eq(m, zero), q[1], q[0]);
+  o[1] = P::select(P::lt(m, P::set1(1.5f)), q[2], q[1]);
+  o[2] = P::select(P::eq(m, P::set1(3.0f)), q[2], q[3]);
+  M negative = P::lt(big, zero);
+  V offset = P::set1(qm::detail::INV_SQRT2);
+  V scale = P::set1(((1 << Bits) - 1) * qm::detail::INV_SQRT2);
+  V top = P::set1((float) ((1 << Bits) - 1));
+  largest = m;
+  for (int k = 0 ; k < 3 ; k++) {
+    V r = roundNearest((P::select(negative, zero - o[k], o[k]) + offset) * scale);
+    c[k] = P::min(P::max(r, zero), top);
+  }
+}
+
+// Inverse of quantizeW, to W quaternions
+template<int Bits> inline void dequantizeW(V m, const V c[3], float* out) {
+  V step = P::set1(1.0f / (((1 << Bits) - 1) * qm::detail::INV_SQRT2));
+  V offset = P::set1(qm::detail::INV_SQRT2);
+  V zero = P::set1(0.0f), one = P::set1(1.0f);
+  V o[3], sum = zero;
+  for (int k = 0 ; k < 3 ; k++) {
+    o[k] = c[k] * step - offset;
+    sum = sum + o[k] * o[k];
+  }
+  V l = P::sqrt(P::select(P::lt(sum, one), one - sum, zero));
+  V r0 = P::select(P::eq(m, zero), l, o[0]);
+  V r1 = P::select(P::eq(m, one), l, P::select(P::eq(m, zero), o[0], o[1]));
+  V r2 = P::select(P::eq(m, P::set1(2.0f)), l, P::select(P::lt(m, P::set1(1.5f)), o[1], o[2]));
+  V r3 = P::select(P::eq(m, P::set1(3.0f)), l, o[2]);
+  P::storeTransposed4(out, 4, r0, r1, r2, r3);
+}
+
+// The low 16 bits hold c0 and the low 6 bits of c1, the high ones the high 4
+// bits of c1, c2 and the index
+inline void packQuats32W(const float* in, uint32_t* out) {
+  V m, c[3];
+  quantizeW<10>(in, m, c);
+  V c1High = quotient(c[1], 64.0f);
+  V low = c[0] + (c[1] - c1High * P::set1(64.0f)) * P::set1(1024.0f);
+  V high = c1High + c[2] * P::set1(16.0f) + m * P::set1(16384.0f);
+  storeWords32(out, low, high);
+}
+
+inline void unpackQuats32W(const uint32_t* in, float* out) {
+  V low, high, c[3];
+  loadWords32(in, low, high);
+  V c1Low = quotient(low, 1024.0f);
+  V rest = quotient(high, 16.0f);
+  V m = quotient(rest, 1024.0f);
+  c[0] = low - c1Low * P::set1(1024.0f);
+  c[1] = c1Low + (high - rest * P::set1(16.0f)) * P::set1(64.0f);
+  c[2] = rest - m * P::set1(1024.0f);
+  dequantizeW<10>(m, c, out);
+}
+
+// The 3 words of W quaternions go through a buffer of 3 packs, transposed
+inline void packQuats48W(const float* in, uint16_t* out) {
+  V m, c[3];
+  quantizeW<15>(in, m, c);
+  V top = P::set1(32768.0f);
+  V high = P::select(P::lt(m, P::set1(1.5f)), P::set1(0.0f), P::set1(1.0f));
+  V low = m - high - high;
+  float words[3 * P::W];
+  P::storeTransposed3(words, c[0] + low * top, c[1] + high * top, c[2]);
+  for (int k = 0 ; k < 3 ; k++)
+    P::storeUint16(out + k * P::W, P::load(words + k * P::W));
+}
+
+inline void unpackQuats48W(const uint16_t* in, float* out) {
+  float words[3 * P::W];
+  for (int k = 0 ; k < 3 ; k++)
+    P::store(words + k * P::W, P::loadUint16(in + k * P::W));
+  V w[3], c[3];
+  P::loadTransposed3(words, w[0], w[1], w[2]);
+  V top = P::set1(32768.0f), zero = P::set1(0.0f), one = P::set1(1.0f);
+  V low = P::select(P::le(top, w[0]), one, zero);
+  V high = P::select(P::le(top, w[1]), one, zero);
+  c[0] = w[0] - low * top;
+  c[1] = w[1] - high * top;
+  c[2] = w[2];
+  dequantizeW<15>(low + high + high, c, out);
+}
+
+void packQuats32(const float* in, uint32_t* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    packQuats32W(in + 4 * n, out + n);
+  if (n == count)
+    return;
+  float buffer[4 * P::W];
+  uint32_t packed[P::W];
+  packQuats32W(padIn(in, n, count, 4, buffer), packed);
+  padOut(packed, n, count, 1, out);
+}
+
+void unpackQuats32(const uint32_t* in, float* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    unpackQuats32W(in + n, out + 4 * n);
+  if (n == count)
+    return;
+  uint32_t packed[P::W];
+  float buffer[4 * P::W];
+  unpackQuats32W(padIn(in, n, count, 1, packed), buffer);
+  padOut(buffer, n, count, 4, out);
+}
+
+void packQuats48(const float* in, uint16_t* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    packQuats48W(in + 4 * n, out + 3 * n);
+  if (n == count)
+    return;
+  float buffer[4 * P::W];
+  uint16_t packed[3 * P::W];
+  packQuats48W(padIn(in, n, count, 4, buffer), packed);
+  padOut(packed, n, count, 3, out);
+}
+
+void unpackQuats48(const uint16_t* in, float* out, size_t count) {
+  size_t n = 0;
+  for ( ; n + P::W <= count ; n += P::W)
+    unpackQuats48W(in + 3 * n, out + 4 * n);
+  if (n == count)
+    return;
+  uint16_t packed[3 * P::W];
+  float buffer[4 * P::W];
+  unpackQuats48W(padIn(in, n, count, 3, packed), buffer);
+  padOut(buffer, n, count, 4, out);
+}
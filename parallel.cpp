@@ -0,0 +1,177 @@
+#include "parallel.h"
+
+namespace {
+
+// Set while the current thread runs a task, so that nested jobs run serially
+thread_local bool insideTask = false;
+
+}
+
+namespace qm {
+
+ThreadPool::ThreadPool(unsigned threads) :
+  threadCount(threads), workers(0), ranges(0), task(0), context(0),
+  generation(0), open(false), stopping(false), active(0), remaining(0), busy(false), failed(false) {
+  if (threadCount == 0)
+    threadCount = std::thread::hardware_concurrency();
+  if (threadCount == 0)
+    threadCount = 1;
+  // Aligned by hand: operator new only honors alignas from C++17 on. Without
+  // them, the jobs run serially on the calling thread.
+  ranges = (Range*) alignedMalloc(threadCount * sizeof(Range));
+  if (!ranges) {
+    threadCount = 1;
+    return;
+  }
+  for (unsigned i = 0 ; i < threadCount ; i++) {
+    new (ranges + i) Range();
+    ranges[i].begin = ranges[i].end = 0;
+  }
+  if (threadCount > 1) {
+    workers = new std::thread[threadCount - 1];
+    for (unsigned i = 1 ; i < threadCount ; i++)
+      workers[i - 1] = std::thread(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeUp.notify_all();
+  for (unsigned i = 1 ; i < threadCount ; i++)
+    workers[i - 1].join();
+  delete[] workers;
+  for (unsigned i = 0 ; ranges && i < threadCount ; i++)
+    ranges[i].~Range();
+  alignedFree(ranges);
+}
+
+ThreadPool& ThreadPool::global() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::run(size_t chunks, Task task, void* context) {
+  if (chunks == 0)
+    return;
+  bool idle = false;
+  if (threadCount == 1 || insideTask || !busy.compare_exchange_strong(idle, true)) {
+    for (size_t chunk = 0 ; chunk < chunks ; chunk++)
+      task(context, chunk);
+    return;
+  }
+  {
+    // Workers of the previous job have all left (see below): the ranges can
+    // be reset without any of them running a chunk with the previous task
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return active == 0; });
+    for (unsigned i = 0 ; i < threadCount ; i++) {
+      std::lock_guard<std::mutex> rangeLock(ranges[i].mutex);
+      ranges[i].begin = chunks * i / threadCount;
+      ranges[i].end = chunks * (i + 1) / threadCount;
+    }
+    this->task = task;
+    this->context = context;
+    remaining = chunks;
+    failed = false;
+    open = true;
+    generation++;
+  }
+  wakeUp.notify_all();
+  work(0);
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [this] { return remaining == 0; });
+  std::exception_ptr thrown = error;
+  error = nullptr;
+  busy = false;
+  lock.unlock();
+  if (thrown)
+    std::rethrow_exception(thrown);
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+  unsigned long seen = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wakeUp.wait(lock, [this, seen] { return stopping || (open && generation != seen); });
+    if (stopping)
+      return;
+    seen = generation;
+    active++;
+    lock.unlock();
+    work(index);
+    lock.lock();
+    active--;
+    if (active == 0)
+      finished.notify_all();
+  }
+}
+
+void ThreadPool::work(unsigned index) {
+  insideTask = true;
+  size_t chunk;
+  while (pop(index, chunk) || (steal(index) && pop(index, chunk))) {
+    // Chunks left after a task threw are only counted, so that the job ends
+    if (!failed) {
+      try {
+        task(context, chunk);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+          error = std::current_exception();
+        failed = true;
+      }
+    }
+    if (--remaining == 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      open = false;
+      finished.notify_all();
+    }
+  }
+  insideTask = false;
+}
+
+bool ThreadPool::pop(unsigned index, size_t& chunk) {
+  Range& range = ranges[index];
+  std::lock_guard<std::mutex> lock(range.mutex);
+  if (range.begin == range.end)
+    return false;
+  chunk = range.begin++;
+  return true;
+}
+
+// Move the second half of the largest range left to this thread's range
+bool ThreadPool::steal(unsigned index) {
+  while (true) {
+    unsigned victim = index;
+    size_t largest = 0;
+    for (unsigned i = 1 ; i < threadCount ; i++) {
+      unsigned other = (index + i) % threadCount;
+      size_t left = ranges[other].left();
+      if (left > largest) {
+        largest = left;
+        victim = other;
+      }
+    }
+    if (largest == 0)
+      return false;
+    size_t begin, end;
+    {
+      std::lock_guard<std::mutex> lock(ranges[victim].mutex);
+      Range& range = ranges[victim];
+      if (range.begin == range.end)
+        continue;
+      end = range.end;
+      begin = range.begin + (range.end - range.begin) / 2;
+      range.end = begin;
+    }
+    std::lock_guard<std::mutex> lock(ranges[index].mutex);
+    ranges[index].begin = begin;
+    ranges[index].end = end;
+    return true;
+  }
+}
+
+}
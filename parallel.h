@@ -0,0 +1,159 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <new>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "memory.h"
+
+namespace qm {
+
+// Default amount of data per chunk: large enough to amortize the scheduling,
+// small enough to balance the load.
+const size_t DEFAULT_CHUNK_BYTES = 16384;
+
+/**
+ * Work-stealing thread pool. run() splits the chunks of a job in one
+ * contiguous range per thread; a thread that runs out of chunks steals the
+ * second half of the range of another one. The calling thread takes part in
+ * the job, so a pool of size 1 has no worker thread. A pool whose ranges
+ * cannot be allocated has size 1.
+ */
+class ThreadPool {
+
+  public:
+    typedef void (*Task)(void* context, size_t chunk);
+
+    // Constructors: threads counts the calling thread (0: one per core)
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+    // Number of threads running the jobs, calling thread included
+    inline unsigned size() const {
+      return threadCount;
+    }
+    // Run task(context, chunk) for every chunk in [0, chunks) and return when
+    // all are done. Jobs started from inside a task, or while another thread
+    // runs a job on the same pool, run serially on the calling thread. Once a
+    // task throws, the chunks not started yet are skipped, and the first
+    // exception is rethrown here when the pool is idle again.
+    void run(size_t chunks, Task task, void* context);
+    // Pool used by parallel_for, with one thread per core
+    static ThreadPool& global();
+
+  private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    // Chunks [begin, end) left to a thread, alone on its cache lines
+    struct alignas(CACHE_LINE_SIZE) Range {
+      std::mutex mutex;
+      size_t begin;
+      size_t end;
+      inline size_t left() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return end - begin;
+      }
+    };
+
+    void workerLoop(unsigned index);
+    void work(unsigned index);
+    bool pop(unsigned index, size_t& chunk);
+    bool steal(unsigned index);
+
+    unsigned threadCount;
+    std::thread* workers;
+    Range* ranges;
+    // Current job, published under mutex
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    Task task;
+    void* context;
+    unsigned long generation;
+    bool open;
+    bool stopping;
+    unsigned active;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> busy;
+    // First exception thrown by a task of the current job, under mutex
+    std::exception_ptr error;
+    std::atomic<bool> failed;
+
+};
+
+namespace detail {
+
+template<typename F> struct ForContext {
+  const F& f;
+  size_t begin;
+  size_t end;
+  size_t grain;
+  static void run(void* context, size_t chunk) {
+    const ForContext& c = *static_cast<const ForContext*>(context);
+    size_t first = c.begin + chunk * c.grain;
+    size_t last = (c.end - first > c.grain) ? first + c.grain : c.end;
+    c.f(first, last);
+  }
+};
+
+inline size_t gcd(size_t a, size_t b) {
+  while (b != 0) {
+    size_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+}
+
+// Smallest number of T spanning whole cache lines: chunks of a multiple of it
+// that start at a 64-byte aligned element never share a cache line.
+template<typename T> inline size_t cacheLineElements() {
+  return CACHE_LINE_SIZE / detail::gcd(sizeof(T), CACHE_LINE_SIZE);
+}
+
+// Chunk size for arrays of T: at least minElements (DEFAULT_CHUNK_BYTES of T
+// if 0), rounded up to whole cache lines.
+template<typename T> inline size_t chunkSize(size_t minElements = 0) {
+  size_t line = cacheLineElements<T>();
+  if (minElements == 0)
+    minElements = DEFAULT_CHUNK_BYTES / sizeof(T);
+  return (minElements + line - 1) / line * line;
+}
+
+/**
+ * Call f(first, last) on the chunks [begin + k * grain, begin + (k+1) * grain)
+ * of [begin, end), in parallel on pool. Chunk boundaries only depend on begin,
+ * end and grain: as long as f only writes the elements of its chunk, results
+ * are the same for any number of threads. Batches of a single chunk, and
+ * pools of a single thread, run serially on the calling thread.
+ *
+ *   parallel_for(0, count, chunkSize<Vec3f>(), [&](size_t first, size_t last) {
+ *     transformPoints(M, in + first, out + first, last - first);
+ *   });
+ */
+template<typename F> void parallel_for(size_t begin, size_t end, size_t grain, const F& f,
+  ThreadPool& pool = ThreadPool::global()) {
+  if (end <= begin)
+    return;
+  if (grain == 0)
+    grain = 1;
+  size_t chunks = (end - begin - 1) / grain + 1;
+  detail::ForContext<F> context = {f, begin, end, grain};
+  if (chunks == 1 || pool.size() == 1) {
+    for (size_t chunk = 0 ; chunk < chunks ; chunk++)
+      detail::ForContext<F>::run(&context, chunk);
+    return;
+  }
+  pool.run(chunks, detail::ForContext<F>::run, &context);
+}
+
+}
+
+#endif // PARALLEL_H
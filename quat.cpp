@@ -1,35 +1,159 @@
 #include "quat.h"
+#include "fastmath.h"
+#include "simd.h"
 
 using namespace qm;
 
-const Quat slerp(Quat& A, Quat& B, float t) {
+namespace {
+
+#define QM_SIMD_KERNELS "quat_kernels.inl"
+#include "simd_foreach.h"
+
+typedef void (*QuatBinaryFn)(const float*, const float*, float*, size_t);
+typedef void (*QuatUnaryFn)(const float*, float*, size_t);
+typedef void (*SlerpFn)(const float*, const float*, const float*, float*, size_t);
+typedef void (*NlerpFn)(const float*, const float*, const float*, float*, size_t, bool);
+
+/**
+ * Quaternion kernels compiled for one instruction set.
+ */
+struct QuatKernels {
+  QuatBinaryFn multiply;
+  QuatUnaryFn conjugate;
+  QuatUnaryFn inverse;
+  QuatBinaryFn rotate;
+  QuatBinaryFn rotateShared;
+  SlerpFn slerp;
+  NlerpFn nlerp;
+};
+
+const QuatKernels& kernels() {
+  static const QuatKernels table[SIMD_ISA_COUNT] = {
+    {scalar::multiplyQuats, scalar::conjugateQuats, scalar::inverseQuats, scalar::rotateQuats, scalar::rotateShared,
+      scalar::slerpQuats, scalar::nlerpQuats},
+#if QM_SIMD_X86
+    {sse2::multiplyQuats, sse2::conjugateQuats, sse2::inverseQuats, sse2::rotateQuats, sse2::rotateShared,
+      sse2::slerpQuats, sse2::nlerpQuats},
+    {avx::multiplyQuats, avx::conjugateQuats, avx::inverseQuats, avx::rotateQuats, avx::rotateShared,
+      avx::slerpQuats, avx::nlerpQuats},
+    {avx2::multiplyQuats, avx2::conjugateQuats, avx2::inverseQuats, avx2::rotateQuats, avx2::rotateShared,
+      avx2::slerpQuats, avx2::nlerpQuats}
+#endif
+  };
+  return table[simdIsa()];
+}
+
+inline const float* floats(const Quat* Q) {
+  return reinterpret_cast<const float*>(Q);
+}
+
+inline float* floats(Quat* Q) {
+  return reinterpret_cast<float*>(Q);
+}
+
+inline const float* floats(const Vec3f* v) {
+  return reinterpret_cast<const float*>(v);
+}
+
+inline float* floats(Vec3f* v) {
+  return reinterpret_cast<float*>(v);
+}
+
+template<typename T> const Quaternion<T> slerpQuats(const Quaternion<T>& from, const Quaternion<T>& B, T t) {
+  Quaternion<T> A(from);
   // angle between A0-A1
-  float cosHalfTheta = Quat::dotProduct(A, B);
+  T cosHalfTheta = Quaternion<T>::dotProduct(A, B);
   // as found here http://stackoverflow.com/questions/2886606/flipping-issue-when-interpolating-rotations-using-quaternions
   // if dot product is negative then one quaternion should be negated, to make
   // it take the short way around, rather than the long way
-  if (cosHalfTheta < 0.0f) {
+  if (cosHalfTheta < T(0)) {
     for (int i = 0 ; i < 4 ; i++)
-      A[i] *= -1.0f;
-    cosHalfTheta = Quat::dotProduct(A, B);
+      A[i] *= T(-1);
+    cosHalfTheta = Quaternion<T>::dotProduct(A, B);
   }
   // if qa=qb or qa=-qb then theta = 0 and we can return qa
-  if (fabs(cosHalfTheta) >= 1.0f)
+  if (fabs(cosHalfTheta) >= T(1))
     return A;
   // Calculate temporary values
-  float sinHalfTheta = sqrt(1.0f - cosHalfTheta * cosHalfTheta);
+  T sinHalfTheta = sqrt(T(1) - cosHalfTheta * cosHalfTheta);
   // if theta = 180 degrees then result is not fully defined
   // we could rotate around any axis normal to qa or qb
-  Quat result;
-  if (fabs(sinHalfTheta) < 0.001f) {
+  Quaternion<T> result;
+  if (fabs(sinHalfTheta) < T(0.001)) {
     for (int i = 0 ; i < 4 ; i++)
-      result[i] = (1.0f - t) * A[i] + t * B[i];
+      result[i] = (T(1) - t) * A[i] + t * B[i];
     return result;
   }
-  float halfTheta = acos(cosHalfTheta);
-  float a = sin((1.0f - t) * halfTheta) / sinHalfTheta;
-  float b = sin(t * halfTheta) / sinHalfTheta;
+  T halfTheta = acos(cosHalfTheta);
+  T a = sin((T(1) - t) * halfTheta) / sinHalfTheta;
+  T b = sin(t * halfTheta) / sinHalfTheta;
   for (int i = 0 ; i < 4 ; i++)
     result[i] = A[i] * a + B[i] * b;
   return result;
 }
+
+}
+
+namespace qm {
+
+const Quat slerp(const Quat& A, const Quat& B, float t) {
+  return slerpQuats(A, B, t);
+}
+
+const Quatd slerp(const Quatd& A, const Quatd& B, double t) {
+  return slerpQuats(A, B, t);
+}
+
+void multiplyMany(const Quat* A, const Quat* B, Quat* out, size_t count) {
+  kernels().multiply(floats(A), floats(B), floats(out), count);
+}
+
+void conjugateMany(const Quat* in, Quat* out, size_t count) {
+  kernels().conjugate(floats(in), floats(out), count);
+}
+
+void inverseMany(const Quat* in, Quat* out, size_t count) {
+  kernels().inverse(floats(in), floats(out), count);
+}
+
+void rotateMany(const Quat* Q, const Vec3f* in, Vec3f* out, size_t count) {
+  kernels().rotate(floats(Q), floats(in), floats(out), count);
+}
+
+void rotateVectors(const Quat& Q, const Vec3f* in, Vec3f* out, size_t count) {
+  kernels().rotateShared(&Q[0], floats(in), floats(out), count);
+}
+
+void slerpMany(const Quat* A, const Quat* B, const float* t, Quat* out, size_t count, Precision precision) {
+  if (precision == PRECISION_FAST)
+    kernels().nlerp(floats(A), floats(B), t, floats(out), count, true);
+  else
+    kernels().slerp(floats(A), floats(B), t, floats(out), count);
+}
+
+void nlerpMany(const Quat* A, const Quat* B, const float* t, Quat* out, size_t count) {
+  kernels().nlerp(floats(A), floats(B), t, floats(out), count, false);
+}
+
+void axisAngleMany(const float* degAngles, const Vec3f* axes, Quat* out, size_t count, Precision precision) {
+  if (precision != PRECISION_FAST) {
+    for (size_t i = 0 ; i < count ; i++)
+      out[i].init(degAngles[i], axes[i][0], axes[i][1], axes[i][2], PRECISION_EXACT);
+    return;
+  }
+  // Half angles, sines and cosines of a chunk on the stack
+  const size_t CHUNK = 256;
+  float angles[CHUNK], s[CHUNK], c[CHUNK];
+  for (size_t first = 0 ; first < count ; first += CHUNK) {
+    size_t n = (count - first < CHUNK) ? count - first : CHUNK;
+    for (size_t k = 0 ; k < n ; k++)
+      angles[k] = degAngles[first + k] * (0.5f * fast::DEG_TO_RAD);
+    fast::sincosMany(angles, s, c, n);
+    for (size_t k = 0 ; k < n ; k++) {
+      const Vec3f& axis = axes[first + k];
+      out[first + k] = Quat::fromComponents(c[k], s[k] * axis[0], s[k] * axis[1], s[k] * axis[2]);
+    }
+  }
+}
+
+}
@@ -3,81 +3,261 @@
 
 #include <iostream>
 #include "mat4.h"
+#include "mat3x4.h"
 
 #define ONE_DEG_IN_RAD (2.0 * M_PI) / 360.0
 
 namespace qm {
 
-class Quat {
+/**
+ * Quaternion w + xi + yj + zk, stored (w, x, y, z). Quat is the float
+ * quaternion used across the library; Quatd keeps double precision.
+ */
+template<typename T>
+class Quaternion {
 
   public:
     // Constructors
-    inline Quat() { q[0] = q[1] = q[2] = q[3] = 0.f; }
-    inline Quat(float degAngle, float x, float y, float z) {
-      init(degAngle, x, y, z);
+    constexpr Quaternion() : q{T(), T(), T(), T()} { }
+    inline Quaternion(T degAngle, T x, T y, T z, Precision precision = QM_TRIG_PRECISION) {
+      init(degAngle, x, y, z, precision);
     }
     // Operators
-    inline float& operator[](int index) {
+    QM_CONSTEXPR14 T& operator[](int index) {
       return q[index];
     }
-    inline const float& operator[](int index) const {
+    constexpr const T& operator[](int index) const {
       return q[index];
     }
     // Others
-    inline void init(float degAngle, float x, float y, float z) {
-      float radAngle = degAngle * ONE_DEG_IN_RAD;
-      q[0] = cos(radAngle * 0.5f);
-      q[1] = sin(radAngle * 0.5f) * x;
-      q[2] = sin(radAngle * 0.5f) * y;
-      q[3] = sin(radAngle * 0.5f) * z;
-    }
-    inline Quat normalize() {
-      float sum = q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
-      // floats have mion 6 digits of precision
-      const float threshold = 0.0001f;
-      if (fabs(1.0f - sum) < threshold)
+    // PRECISION_FAST only applies to float quaternions
+    inline void init(T degAngle, T x, T y, T z, Precision precision = QM_TRIG_PRECISION) {
+      T s, c;
+      if (precision == PRECISION_FAST && sizeof(T) == sizeof(float)) {
+        float fs, fc;
+        fast::sincos(float(degAngle) * (0.5f * fast::DEG_TO_RAD), fs, fc);
+        s = fs;
+        c = fc;
+      } else {
+        T radAngle = degAngle * ONE_DEG_IN_RAD;
+        s = sin(radAngle * T(0.5));
+        c = cos(radAngle * T(0.5));
+      }
+      q[0] = c;
+      q[1] = s * x;
+      q[2] = s * y;
+      q[3] = s * z;
+    }
+    inline Quaternion normalize() {
+      T sum = q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+      // floats have min 6 digits of precision, doubles 15
+      const T threshold = (sizeof(T) == sizeof(float)) ? T(0.0001) : T(1e-12);
+      if (fabs(T(1) - sum) < threshold)
         return *this;
-      float norm = sqrt(sum);
+      T norm = sqrt(sum);
       q[0] /= norm;
       q[1] /= norm;
       q[2] /= norm;
       q[3] /= norm;
       return *this;
     }
-    const Quat operator*(const Quat& Q) {
-      Quat result;
-      result[0] = Q[0]*q[0] - Q[1]*q[1] - Q[2]*q[2] - Q[3]*q[3];
-      result[1] = Q[0]*q[1] + Q[1]*q[0] - Q[2]*q[3] + Q[3]*q[2];
-      result[2] = Q[0]*q[2] + Q[1]*q[3] + Q[2]*q[0] - Q[3]*q[1];
-      result[3] = Q[0]*q[3] - Q[1]*q[2] + Q[2]*q[1] + Q[3]*q[0];
+    // Product renormalized when its norm drifted (see normalize), for long
+    // chains see multiply and QuatChain
+    const Quaternion operator*(const Quaternion& Q) {
+      Quaternion result = multiply(*this, Q);
       result.normalize();
       return result;
     }
-    // Convert the quaternion to a 4x4 matrix. The quaternion has to be normalized first.
-    inline const qm::Mat4f toMatrix() const {
-      float w = q[0];
-      float x = q[1];
-      float y = q[2];
-      float z = q[3];
-      return qm::Mat4f(
-        1.0f - 2.0f*y*y - 2.0f*z*z, 2.0f*x*y + 2.0f*w*z, 2.0f*x*z - 2.0f*w*y, 0.0f,
-        2.0f*x*y - 2.0f*w*z, 1.0f - 2.0f*x*x - 2.0f*z*z, 2.0f*y*z + 2.0f*w*x, 0.0f,
-        2.0f*x*z + 2.0f*w*y, 2.0f*y*z - 2.0f*w*x, 1.0f - 2.0f*x*x - 2.0f*y*y, 0.0f,
-        0.0f, 0.0f, 0.0f, 1.0f
+    // Rotate v (same as toMatrix() * v for a unit quaternion): with u the
+    // vector part, t = 2 u x v and v' = v + w t + u x t
+    inline Vec3<T> rotate(const Vec3<T>& v) const {
+      T tx = T(2) * (q[2]*v[2] - q[3]*v[1]);
+      T ty = T(2) * (q[3]*v[0] - q[1]*v[2]);
+      T tz = T(2) * (q[1]*v[1] - q[2]*v[0]);
+      return Vec3<T>(
+        v[0] + q[0]*tx + (q[2]*tz - q[3]*ty),
+        v[1] + q[0]*ty + (q[3]*tx - q[1]*tz),
+        v[2] + q[0]*tz + (q[1]*ty - q[2]*tx)
       );
     }
+    // Convert the quaternion to a 4x4 matrix. The quaternion has to be normalized first.
+    constexpr const Mat4<T> toMatrix() const {
+      return rotationMatrix(q[0], q[1], q[2], q[3]);
+    }
+    // Same rotation as toMatrix, without the constant last row
+    constexpr const Mat3x4<T> toMat3x4() const {
+      return Mat3x4<T>(toMatrix());
+    }
+    // Inverse rotation of a unit quaternion
+    constexpr Quaternion conjugate() const {
+      return Quaternion(q[0], -q[1], -q[2], -q[3], Components());
+    }
+    // Inverse of any non-zero quaternion
+    constexpr Quaternion inverse() const {
+      return conjugate().scaled(T(1) / dotProduct(*this, *this));
+    }
 
     // Static methods
-    static inline float dotProduct(const Quat& A, const Quat& B) {
+    static constexpr T dotProduct(const Quaternion& A, const Quaternion& B) {
         return (A[0] * B[0] + A[1] * B[1] + A[2] * B[2] + A[3] * B[3]);
     }
+    // Quaternion w + xi + yj + zk (the 4-argument constructor takes an angle and an axis)
+    static constexpr Quaternion fromComponents(T w, T x, T y, T z) {
+      return Quaternion(w, x, y, z, Components());
+    }
+    static constexpr Quaternion identity() {
+      return Quaternion(T(1), T(0), T(0), T(0), Components());
+    }
+    // Hamilton product A * B (rotation B, then A), not renormalized
+    static constexpr Quaternion multiply(const Quaternion& A, const Quaternion& B) {
+      return Quaternion(
+        B[0]*A[0] - B[1]*A[1] - B[2]*A[2] - B[3]*A[3],
+        B[0]*A[1] + B[1]*A[0] - B[2]*A[3] + B[3]*A[2],
+        B[0]*A[2] + B[1]*A[3] + B[2]*A[0] - B[3]*A[1],
+        B[0]*A[3] - B[1]*A[2] + B[2]*A[1] + B[3]*A[0],
+        Components()
+      );
+    }
+
+  private:
+    static constexpr Mat4<T> rotationMatrix(T w, T x, T y, T z) {
+      return Mat4<T>(
+        T(1) - T(2)*y*y - T(2)*z*z, T(2)*x*y + T(2)*w*z, T(2)*x*z - T(2)*w*y, T(0),
+        T(2)*x*y - T(2)*w*z, T(1) - T(2)*x*x - T(2)*z*z, T(2)*y*z + T(2)*w*x, T(0),
+        T(2)*x*z + T(2)*w*y, T(2)*y*z - T(2)*w*x, T(1) - T(2)*x*x - T(2)*y*y, T(0),
+        T(0), T(0), T(0), T(1)
+      );
+    }
+
+    struct Components { };
+    constexpr Quaternion(T w, T x, T y, T z, Components) : q{w, x, y, z} { }
+    constexpr Quaternion scaled(T s) const {
+      return Quaternion(q[0] * s, q[1] * s, q[2] * s, q[3] * s, Components());
+    }
+
+    T q[4];
+
+};
+
+typedef Quaternion<float> Quat;
+typedef Quaternion<float> Quatf;
+typedef Quaternion<double> Quatd;
+
+/**
+ * When a chain of products renormalizes its result: never, every interval
+ * products, or when the squared norm drifts from 1 by more than threshold
+ * (operator* uses onDrift(0.0001f)).
+ */
+struct RenormalizePolicy {
+  enum Mode {
+    NEVER,
+    EVERY,
+    ON_DRIFT
+  };
+  Mode mode;
+  unsigned interval;
+  float threshold;
+
+  static constexpr RenormalizePolicy never() {
+    return RenormalizePolicy{NEVER, 0, 0.0f};
+  }
+  static constexpr RenormalizePolicy every(unsigned interval) {
+    return RenormalizePolicy{EVERY, interval, 0.0f};
+  }
+  static constexpr RenormalizePolicy onDrift(float threshold) {
+    return RenormalizePolicy{ON_DRIFT, 0, threshold};
+  }
+};
+
+/**
+ * Running product of rotations, multiplied without renormalization
+ * (Quat::multiply) and renormalized according to its policy.
+ */
+class QuatChain {
+
+  public:
+    // Constructors
+    explicit QuatChain(RenormalizePolicy policy = RenormalizePolicy::onDrift(0.0001f),
+      const Quat& start = Quat::identity()) : value(start), policy(policy), products(0) { }
+    // Operators
+    // value = value * Q
+    inline QuatChain& operator*=(const Quat& Q) {
+      value = Quat::multiply(value, Q);
+      products++;
+      bool renormalize = false;
+      switch (policy.mode) {
+        case RenormalizePolicy::EVERY:
+          renormalize = products >= policy.interval;
+          break;
+        case RenormalizePolicy::ON_DRIFT:
+          renormalize = fabs(1.0f - Quat::dotProduct(value, value)) > policy.threshold;
+          break;
+        default:
+          break;
+      }
+      if (renormalize)
+        normalize();
+      return *this;
+    }
+    // Others
+    inline const Quat& get() const {
+      return value;
+    }
+    inline void reset(const Quat& start = Quat::identity()) {
+      value = start;
+      products = 0;
+    }
+    // Divide by the norm, whatever the policy
+    inline void normalize() {
+      float norm = sqrt(Quat::dotProduct(value, value));
+      for (int i = 0 ; i < 4 ; i++)
+        value[i] /= norm;
+      products = 0;
+    }
 
   private:
-    float q[4];
+    Quat value;
+    RenormalizePolicy policy;
+    // Products since the last renormalization
+    unsigned products;
 
 };
 
-const Quat& slerp(Quat& A, Quat& B, float t);
+// Spherical interpolation from A (t = 0) to B (t = 1) along the shortest arc
+const Quat slerp(const Quat& A, const Quat& B, float t);
+const Quatd slerp(const Quatd& A, const Quatd& B, double t);
+
+// Batched quaternion operations over count contiguous elements, one element
+// per SIMD lane. Outputs may be the same array as an input, but must not
+// partially overlap. Results match the single-element methods, except for
+// the rounding of the multiply-adds fused on AVX2.
+// - multiplyMany: out[i] = Quat::multiply(A[i], B[i]) (not renormalized)
+// - conjugateMany: out[i] = in[i].conjugate()
+// - inverseMany: out[i] = in[i].inverse()
+// - rotateMany: out[i] = Q[i].rotate(in[i])
+// - rotateVectors: out[i] = Q.rotate(in[i])
+void multiplyMany(const Quat* A, const Quat* B, Quat* out, size_t count);
+void conjugateMany(const Quat* in, Quat* out, size_t count);
+void inverseMany(const Quat* in, Quat* out, size_t count);
+void rotateMany(const Quat* Q, const Vec3f* in, Vec3f* out, size_t count);
+void rotateVectors(const Quat& Q, const Vec3f* in, Vec3f* out, size_t count);
+
+// Batched interpolation of count pairs of unit quaternions with their own t in
+// [0, 1], as slerp (A and B are not modified, out may be either of them):
+// - slerpMany evaluates acos and sin with polynomials: every component is
+//   within 5e-7 of the exact slerp. With PRECISION_FAST it runs an nlerp with
+//   a corrected t instead, within 4e-4.
+// - nlerpMany: normalized linear interpolation, exact at t = 0, 1/2 and 1 but
+//   faster in the middle of the arc: up to 0.0711 from slerp for opposite
+//   rotations (dot product 0)
+void slerpMany(const Quat* A, const Quat* B, const float* t, Quat* out, size_t count,
+  Precision precision = QM_DEFAULT_PRECISION);
+void nlerpMany(const Quat* A, const Quat* B, const float* t, Quat* out, size_t count);
+
+// out[i] = Quat(degAngles[i], axes[i][0], axes[i][1], axes[i][2], precision):
+// with PRECISION_FAST, the sines and cosines go through fast::sincosMany.
+void axisAngleMany(const float* degAngles, const Vec3f* axes, Quat* out, size_t count,
+  Precision precision = QM_TRIG_PRECISION);
 
 }
 
@@ -0,0 +1,224 @@
+// Batched quaternion kernels of quat.cpp, expanded once per instruction set by
+// simd_foreach.h. Pack<float>::W quaternions (w, x, y, z) or vectors are
+// processed at once, one per lane, with the arithmetic of the Quat methods.
+
+typedef Pack<float> P;
+typedef P::V V;
+typedef P::M M;
+
+// acosPositive and sinHalfPi of slerpQuats
+#include "fastmath_poly.inl"
+
+inline void loadQuats(const float* p, V q[4]) {
+  P::loadTransposed4(p, 4, q[0], q[1], q[2], q[3]);
+}
+
+inline void storeQuats(float* p, const V q[4]) {
+  P::storeTransposed4(p, 4, q[0], q[1], q[2], q[3]);
+}
+
+// Runs Op on groups of W elements of a (sizeA floats each), b (sizeB) and out
+// (sizeOut). The last partial group goes through zeroed buffers, so out may be
+// the same array as a or b.
+template<typename Op> void forEachGroup(const float* a, int sizeA, const float* b, int sizeB, float* out,
+  int sizeOut, size_t count, const Op& op) {
+  const int W = P::W;
+  size_t n = 0;
+  for ( ; n + W <= count ; n += W)
+    op.run(a + sizeA*n, b + sizeB*n, out + sizeOut*n);
+  if (n == count)
+    return;
+  float bufferA[4 * W] = { 0.0f }, bufferB[4 * W] = { 0.0f }, bufferOut[4 * W];
+  for (size_t k = 0 ; k < sizeA * (count - n) ; k++)
+    bufferA[k] = a[sizeA*n + k];
+  for (size_t k = 0 ; k < sizeB * (count - n) ; k++)
+    bufferB[k] = b[sizeB*n + k];
+  op.run(bufferA, bufferB, bufferOut);
+  for (size_t k = 0 ; k < sizeOut * (count - n) ; k++)
+    out[sizeOut*n + k] = bufferOut[k];
+}
+
+// As Quat::multiply
+inline void multiply(const V a[4], const V b[4], V r[4]) {
+  r[0] = b[0]*a[0] - b[1]*a[1] - b[2]*a[2] - b[3]*a[3];
+  r[1] = b[0]*a[1] + b[1]*a[0] - b[2]*a[3] + b[3]*a[2];
+  r[2] = b[0]*a[2] + b[1]*a[3] + b[2]*a[0] - b[3]*a[1];
+  r[3] = b[0]*a[3] - b[1]*a[2] + b[2]*a[1] + b[3]*a[0];
+}
+
+// As Quat::rotate
+inline void rotate(const V q[4], const V v[3], V r[3]) {
+  V two = P::set1(2.0f);
+  V tx = two * (q[2]*v[2] - q[3]*v[1]);
+  V ty = two * (q[3]*v[0] - q[1]*v[2]);
+  V tz = two * (q[1]*v[1] - q[2]*v[0]);
+  r[0] = v[0] + q[0]*tx + (q[2]*tz - q[3]*ty);
+  r[1] = v[1] + q[0]*ty + (q[3]*tx - q[1]*tz);
+  r[2] = v[2] + q[0]*tz + (q[1]*ty - q[2]*tx);
+}
+
+struct MultiplyOp {
+  inline void run(const float* a, const float* b, float* out) const {
+    V qa[4], qb[4], r[4];
+    loadQuats(a, qa);
+    loadQuats(b, qb);
+    multiply(qa, qb, r);
+    storeQuats(out, r);
+  }
+};
+
+// Inverse: conjugate scaled by 1 / |q|^2
+struct ConjugateOp {
+  bool inverse;
+  inline void run(const float* a, const float*, float* out) const {
+    V q[4];
+    loadQuats(a, q);
+    // * -1 rather than 0 - q, to negate zeros as well
+    V minusOne = P::set1(-1.0f);
+    for (int k = 1 ; k < 4 ; k++)
+      q[k] = q[k] * minusOne;
+    if (inverse) {
+      V s = P::set1(1.0f) / (q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+      for (int k = 0 ; k < 4 ; k++)
+        q[k] = q[k] * s;
+    }
+    storeQuats(out, q);
+  }
+};
+
+// One quaternion per vector, or the same one (b is 0) for all of them
+struct RotateOp {
+  const V* shared;
+  inline void run(const float* a, const float* b, float* out) const {
+    V q[4], v[3], r[3];
+    if (shared) {
+      for (int k = 0 ; k < 4 ; k++)
+        q[k] = shared[k];
+    } else
+      loadQuats(b, q);
+    P::loadTransposed3(a, v[0], v[1], v[2]);
+    rotate(q, v, r);
+    P::storeTransposed3(out, r[0], r[1], r[2]);
+  }
+};
+
+void multiplyQuats(const float* a, const float* b, float* out, size_t count) {
+  forEachGroup(a, 4, b, 4, out, 4, count, MultiplyOp());
+}
+
+void conjugateQuats(const float* in, float* out, size_t count) {
+  ConjugateOp op = {false};
+  forEachGroup(in, 4, in, 0, out, 4, count, op);
+}
+
+void inverseQuats(const float* in, float* out, size_t count) {
+  ConjugateOp op = {true};
+  forEachGroup(in, 4, in, 0, out, 4, count, op);
+}
+
+void rotateQuats(const float* q, const float* in, float* out, size_t count) {
+  RotateOp op = {0};
+  forEachGroup(in, 3, q, 4, out, 3, count, op);
+}
+
+void rotateShared(const float* q, const float* in, float* out, size_t count) {
+  V shared[4];
+  for (int k = 0 ; k < 4 ; k++)
+    shared[k] = P::set1(q[k]);
+  RotateOp op = {shared};
+  forEachGroup(in, 3, in, 0, out, 3, count, op);
+}
+
+// Up to W quaternion pairs at a, b with their t, padded with zeros
+struct Blend {
+  V a[4], b[4], t;
+  float buffer[9 * P::W];
+  inline Blend(const float* pa, const float* pb, const float* pt, size_t lanes) {
+    if (lanes < (size_t) P::W) {
+      for (int k = 0 ; k < 9 * P::W ; k++)
+        buffer[k] = 0.0f;
+      for (size_t k = 0 ; k < 4 * lanes ; k++) {
+        buffer[k] = pa[k];
+        buffer[4 * P::W + k] = pb[k];
+      }
+      for (size_t k = 0 ; k < lanes ; k++)
+        buffer[8 * P::W + k] = pt[k];
+      pa = buffer;
+      pb = buffer + 4 * P::W;
+      pt = buffer + 8 * P::W;
+    }
+    loadQuats(pa, a);
+    loadQuats(pb, b);
+    t = P::load(pt);
+  }
+  // Cosine of the angle between a and b, after negating a if it was negative
+  inline V alignA() {
+    V d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+    M negative = P::lt(d, P::set1(0.0f));
+    V sign = P::select(negative, P::set1(-1.0f), P::set1(1.0f));
+    for (int k = 0 ; k < 4 ; k++)
+      a[k] = a[k] * sign;
+    return P::min(d * sign, P::set1(1.0f));
+  }
+  inline void store(float* out, V wa, V wb, size_t lanes) {
+    V r[4];
+    for (int k = 0 ; k < 4 ; k++)
+      r[k] = a[k] * wa + b[k] * wb;
+    if (lanes == (size_t) P::W) {
+      storeQuats(out, r);
+      return;
+    }
+    storeQuats(buffer, r);
+    for (size_t k = 0 ; k < 4 * lanes ; k++)
+      out[k] = buffer[k];
+  }
+};
+
+// sin((1 - t) theta) / sin(theta) and sin(t theta) / sin(theta), theta being
+// acos(d); linear weights when a and b are the same rotation
+void slerpQuats(const float* a, const float* b, const float* t, float* out, size_t count) {
+  for (size_t n = 0 ; n < count ; n += P::W) {
+    size_t lanes = (count - n < (size_t) P::W) ? count - n : P::W;
+    Blend blend(a + 4*n, b + 4*n, t + n, lanes);
+    V theta = acosPositive(blend.alignA());
+    V sinTheta = sinHalfPi(theta);
+    V tTheta = blend.t * theta;
+    V one = P::set1(1.0f);
+    M same = P::lt(sinTheta, P::set1(1e-6f));
+    V invSin = one / P::select(same, one, sinTheta);
+    V wa = P::select(same, one - blend.t, sinHalfPi(theta - tTheta) * invSin);
+    V wb = P::select(same, blend.t, sinHalfPi(tTheta) * invSin);
+    blend.store(out + 4*n, wa, wb, lanes);
+  }
+}
+
+// Normalized lerp. corrected remaps t to t + t (t - 1/2) (t - 1) k(t, d)
+// first, to follow the constant angular speed of slerp (fit by A. Kapoulkine,
+// "Approximating slerp"), and normalizes with rsqrt and one Newton step.
+void nlerpQuats(const float* a, const float* b, const float* t, float* out, size_t count, bool corrected) {
+  for (size_t n = 0 ; n < count ; n += P::W) {
+    size_t lanes = (count - n < (size_t) P::W) ? count - n : P::W;
+    Blend blend(a + 4*n, b + 4*n, t + n, lanes);
+    V d = blend.alignA();
+    V u = blend.t;
+    V half = P::set1(0.5f), one = P::set1(1.0f);
+    if (corrected) {
+      V ka = P::set1(1.0904f) + d * (P::set1(-3.2452f) + d * (P::set1(3.55645f) - d * P::set1(1.43519f)));
+      V kb = P::set1(0.848013f) + d * (P::set1(-1.06021f) + d * P::set1(0.215638f));
+      V c = u - half;
+      u = u + u * c * (u - one) * (ka * c * c + kb);
+    }
+    V wa = one - u, wb = u;
+    V r[4];
+    for (int k = 0 ; k < 4 ; k++)
+      r[k] = blend.a[k] * wa + blend.b[k] * wb;
+    V sum = r[0]*r[0] + r[1]*r[1] + r[2]*r[2] + r[3]*r[3];
+    V scale;
+    if (corrected) {
+      V y = P::rsqrt(sum);
+      scale = y * (P::set1(1.5f) - half * sum * y * y);
+    } else
+      scale = one / P::sqrt(sum);
+    blend.store(out + 4*n, wa * scale, wb * scale, lanes);
+  }
+}
@@ -0,0 +1,113 @@
+#include "ray.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+// Packet lanes, one array of rayCount floats per component
+struct RayData {
+  const float* origin[3];
+  const float* direction[3];
+  const float* tMax;
+};
+
+struct HitData {
+  float* t;
+  float* u;
+  float* v;
+  uint32_t* primitive;
+};
+
+#define QM_SIMD_KERNELS "ray_kernels.inl"
+#include "simd_foreach.h"
+
+typedef void (*PacketTrianglesFn)(const RayData&, int, const float*, size_t, size_t, const HitData&);
+typedef void (*PacketBoxesFn)(const RayData&, int, const float*, const float*, size_t, size_t, const HitData&);
+typedef void (*RayTrianglesFn)(const float*, const float*, float, const float*, size_t, size_t, RayHit&);
+typedef void (*RayBoxesFn)(const float*, const float*, float, const float*, const float*, size_t, size_t,
+  RayHit&);
+
+/**
+ * Ray intersection kernels compiled for one instruction set.
+ */
+struct RayKernels {
+  PacketTrianglesFn packetTriangles;
+  PacketBoxesFn packetBoxes;
+  RayTrianglesFn rayTriangles;
+  RayBoxesFn rayBoxes;
+};
+
+const RayKernels& kernels() {
+  static const RayKernels table[SIMD_ISA_COUNT] = {
+    {scalar::packetTriangles, scalar::packetBoxes, scalar::rayTriangles, scalar::rayBoxes},
+#if QM_SIMD_X86
+    {sse2::packetTriangles, sse2::packetBoxes, sse2::rayTriangles, sse2::rayBoxes},
+    {avx::packetTriangles, avx::packetBoxes, avx::rayTriangles, avx::rayBoxes},
+    {avx2::packetTriangles, avx2::packetBoxes, avx2::rayTriangles, avx2::rayBoxes}
+#endif
+  };
+  return table[simdIsa()];
+}
+
+template<int N> RayData rayData(const RayPacket<N>& rays) {
+  RayData data = {{rays.originX, rays.originY, rays.originZ},
+    {rays.directionX, rays.directionY, rays.directionZ}, rays.tMax};
+  return data;
+}
+
+template<int N> int hitMask(const HitPacket<N>& hits) {
+  int mask = 0;
+  for (int i = 0 ; i < N ; i++)
+    if (hits.primitive[i] != NO_HIT)
+      mask |= 1 << i;
+  return mask;
+}
+
+// Missed rays get t = INFINITY, as in packets
+bool finish(RayHit& hit) {
+  if (hit.primitive != NO_HIT)
+    return true;
+  hit.t = INFINITY;
+  hit.u = hit.v = 0.0f;
+  return false;
+}
+
+}
+
+namespace qm {
+
+bool intersect(const Vec3f& origin, const Vec3f& direction, const TriangleSoA& triangles, RayHit& hit,
+  float tMax) {
+  kernels().rayTriangles(&origin[0], &direction[0], tMax, triangles.getArray(), triangles.getStride(),
+    triangles.size(), hit);
+  return finish(hit);
+}
+
+bool intersect(const Vec3f& origin, const Vec3f& direction, const Vec3SoA<float>& min, const Vec3SoA<float>& max,
+  RayHit& hit, float tMax) {
+  kernels().rayBoxes(&origin[0], &direction[0], tMax, min.getArray(), max.getArray(), min.getStride(),
+    min.size(), hit);
+  return finish(hit);
+}
+
+template<int N> int intersect(const RayPacket<N>& rays, const TriangleSoA& triangles, HitPacket<N>& hits) {
+  HitData data = {hits.t, hits.u, hits.v, hits.primitive};
+  kernels().packetTriangles(rayData(rays), N, triangles.getArray(), triangles.getStride(), triangles.size(),
+    data);
+  return hitMask(hits);
+}
+
+template<int N> int intersect(const RayPacket<N>& rays, const Vec3SoA<float>& min, const Vec3SoA<float>& max,
+  HitPacket<N>& hits) {
+  HitData data = {hits.t, hits.u, hits.v, hits.primitive};
+  kernels().packetBoxes(rayData(rays), N, min.getArray(), max.getArray(), min.getStride(), min.size(), data);
+  return hitMask(hits);
+}
+
+template int intersect<4>(const RayPacket<4>&, const TriangleSoA&, HitPacket<4>&);
+template int intersect<8>(const RayPacket<8>&, const TriangleSoA&, HitPacket<8>&);
+template int intersect<4>(const RayPacket<4>&, const Vec3SoA<float>&, const Vec3SoA<float>&, HitPacket<4>&);
+template int intersect<8>(const RayPacket<8>&, const Vec3SoA<float>&, const Vec3SoA<float>&, HitPacket<8>&);
+
+}
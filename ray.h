@@ -0,0 +1,118 @@
+#ifndef RAY_H
+#define RAY_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vec3.h"
+#include "vecsoa.h"
+
+namespace qm {
+
+// Primitive index of a ray that hit nothing
+const uint32_t NO_HIT = 0xffffffffu;
+
+/**
+ * Triangles as structure-of-arrays, stored as their first vertex and the two
+ * edges from it (lanes v0 x, y, z, e1 x, y, z, e2 x, y, z), the form used by
+ * the Moller-Trumbore test. Padding triangles are degenerate and never hit.
+ */
+class TriangleSoA : public SoABase<float, 9> {
+
+  public:
+    // Constructors
+    inline TriangleSoA() : SoABase<float, 9>() { }
+    inline explicit TriangleSoA(size_t size) : SoABase<float, 9>(size) { }
+    // Triangle i has vertices[indices[3*i]], vertices[indices[3*i+1]] and
+    // vertices[indices[3*i+2]]
+    TriangleSoA(const Vec3f* vertices, const uint32_t* indices, size_t size) : SoABase<float, 9>(size) {
+      for (size_t i = 0 ; i < size ; i++)
+        set(i, vertices[indices[3*i]], vertices[indices[3*i + 1]], vertices[indices[3*i + 2]]);
+    }
+    // Elements
+    inline void set(size_t i, const Vec3f& a, const Vec3f& b, const Vec3f& c) {
+      for (int k = 0 ; k < 3 ; k++) {
+        lane(k)[i] = a[k];
+        lane(3 + k)[i] = b[k] - a[k];
+        lane(6 + k)[i] = c[k] - a[k];
+      }
+    }
+    inline Vec3f getVertex(size_t i, int vertex) const {
+      Vec3f v(lane(0)[i], lane(1)[i], lane(2)[i]);
+      if (vertex > 0)
+        v += Vec3f(lane(3*vertex)[i], lane(3*vertex + 1)[i], lane(3*vertex + 2)[i]);
+      return v;
+    }
+
+};
+
+/**
+ * Closest hit of a ray: distance t along the direction (in units of its
+ * length), barycentric coordinates u, v of the hit point on triangles
+ * (v0 + u * e1 + v * e2, 0 for boxes) and primitive index, NO_HIT if none.
+ */
+struct RayHit {
+  float t;
+  float u;
+  float v;
+  uint32_t primitive;
+};
+
+/**
+ * N rays as structure-of-arrays (N = 4 or 8), traced together: the SIMD
+ * lanes hold one ray each and every primitive is tested against all of them.
+ * Hits are searched for t in [0, tMax).
+ */
+template<int N> struct RayPacket {
+  float originX[N], originY[N], originZ[N];
+  float directionX[N], directionY[N], directionZ[N];
+  float tMax[N];
+
+  inline void set(int i, const Vec3f& origin, const Vec3f& direction, float t = INFINITY) {
+    originX[i] = origin[0];
+    originY[i] = origin[1];
+    originZ[i] = origin[2];
+    directionX[i] = direction[0];
+    directionY[i] = direction[1];
+    directionZ[i] = direction[2];
+    tMax[i] = t;
+  }
+};
+
+template<int N> struct HitPacket {
+  float t[N], u[N], v[N];
+  uint32_t primitive[N];
+
+  inline RayHit get(int i) const {
+    RayHit hit = {t[i], u[i], v[i], primitive[i]};
+    return hit;
+  }
+};
+
+typedef RayPacket<4> RayPacket4;
+typedef RayPacket<8> RayPacket8;
+typedef HitPacket<4> HitPacket4;
+typedef HitPacket<8> HitPacket8;
+
+/**
+ * Closest hit along a ray or a packet among SoA triangles (Moller-Trumbore)
+ * or boxes (slab test, t is where the ray enters the box, 0 from inside).
+ * Single rays are tested against W primitives at a time, packets W rays at a
+ * time against each primitive (see simd.h), with the same arithmetic: a ray
+ * gets the same hit either way on a given instruction set (AVX2 fuses
+ * multiply-adds). Ties go to the lowest primitive index. Rays lying in the
+ * plane of a box face may miss it.
+ * Single ray versions return true on a hit, packet versions the mask of the
+ * rays that hit something (bit i for ray i).
+ */
+bool intersect(const Vec3f& origin, const Vec3f& direction, const TriangleSoA& triangles, RayHit& hit,
+  float tMax = INFINITY);
+bool intersect(const Vec3f& origin, const Vec3f& direction, const Vec3SoA<float>& min, const Vec3SoA<float>& max,
+  RayHit& hit, float tMax = INFINITY);
+template<int N> int intersect(const RayPacket<N>& rays, const TriangleSoA& triangles, HitPacket<N>& hits);
+template<int N> int intersect(const RayPacket<N>& rays, const Vec3SoA<float>& min, const Vec3SoA<float>& max,
+  HitPacket<N>& hits);
+
+}
+
+#endif // RAY_H
@@ -0,0 +1,206 @@
+// Ray intersection kernels of ray.cpp, expanded once per instruction set by
+// simd_foreach.h. Triangles are SoA lanes (v0, e1, e2), boxes SoA min and max
+// lanes, all padded to 64 bytes (see vecsoa.h). Packet kernels hold W rays in
+// the lanes and broadcast each primitive, single ray kernels broadcast the ray
+// and load W primitives: both go through triangleHit and boxHit, and keep the
+// first closest primitive.
+
+typedef Pack<float> P;
+typedef P::V V;
+typedef P::M M;
+
+// Moller-Trumbore: hit at t in [0, tMax) with barycentric u, v
+inline M triangleHit(const V o[3], const V d[3], const V v0[3], const V e1[3], const V e2[3], V tMax,
+  V& t, V& u, V& v) {
+  V zero = P::set1(0.0f), one = P::set1(1.0f);
+  V px = d[1] * e2[2] - d[2] * e2[1], py = d[2] * e2[0] - d[0] * e2[2], pz = d[0] * e2[1] - d[1] * e2[0];
+  V det = e1[0] * px + e1[1] * py + e1[2] * pz;
+  V inv = one / det;
+  V sx = o[0] - v0[0], sy = o[1] - v0[1], sz = o[2] - v0[2];
+  u = (sx * px + sy * py + sz * pz) * inv;
+  V qx = sy * e1[2] - sz * e1[1], qy = sz * e1[0] - sx * e1[2], qz = sx * e1[1] - sy * e1[0];
+  v = (d[0] * qx + d[1] * qy + d[2] * qz) * inv;
+  t = (e2[0] * qx + e2[1] * qy + e2[2] * qz) * inv;
+  // NaNs (parallel rays, degenerate triangles) fail every comparison
+  M hit = P::both(P::lt(zero, det * det), P::both(P::le(zero, u), P::le(zero, v)));
+  return P::both(hit, P::both(P::le(u + v, one), P::both(P::le(zero, t), P::lt(t, tMax))));
+}
+
+// Slab test with the inverse direction: the ray enters the box at
+// t = max(tNear, 0) < tMax
+inline M boxHit(const V o[3], const V inv[3], const V min[3], const V max[3], V tMax, V& t) {
+  V zero = P::set1(0.0f);
+  V tNear = zero, tFar = tMax;
+  M crossed = P::eq(zero, zero);
+  for (int k = 0 ; k < 3 ; k++) {
+    V t0 = (min[k] - o[k]) * inv[k], t1 = (max[k] - o[k]) * inv[k];
+    // NaN (origin on a face plane, parallel direction) counts as a miss
+    crossed = P::both(crossed, P::both(P::eq(t0, t0), P::eq(t1, t1)));
+    tNear = P::max(tNear, P::min(t0, t1));
+    tFar = P::min(tFar, P::max(t0, t1));
+  }
+  t = tNear;
+  return P::both(crossed, P::both(P::le(tNear, tFar), P::lt(tNear, tMax)));
+}
+
+// W rays starting at r (count of them, the others are masked out), padded
+inline void loadRays(const RayData& rays, int r, int count, V o[3], V d[3], V& tMax) {
+  float lanes[7][P::W];
+  for (int j = 0 ; j < P::W ; j++) {
+    int i = r + ((j < count) ? j : 0);
+    for (int k = 0 ; k < 3 ; k++) {
+      lanes[k][j] = rays.origin[k][i];
+      lanes[3 + k][j] = rays.direction[k][i];
+    }
+    lanes[6][j] = (j < count) ? rays.tMax[i] : -1.0f;
+  }
+  for (int k = 0 ; k < 3 ; k++) {
+    o[k] = P::load(lanes[k]);
+    d[k] = P::load(lanes[3 + k]);
+  }
+  tMax = P::load(lanes[6]);
+}
+
+inline void storeHits(const HitData& hits, int r, int count, V t, V u, V v, const uint32_t* primitive) {
+  float lanes[3][P::W];
+  P::store(lanes[0], t);
+  P::store(lanes[1], u);
+  P::store(lanes[2], v);
+  for (int j = 0 ; j < count ; j++) {
+    bool hit = primitive[j] != NO_HIT;
+    hits.t[r + j] = hit ? lanes[0][j] : INFINITY;
+    hits.u[r + j] = hit ? lanes[1][j] : 0.0f;
+    hits.v[r + j] = hit ? lanes[2][j] : 0.0f;
+    hits.primitive[r + j] = primitive[j];
+  }
+}
+
+// Record primitive i for the lanes of hit
+inline void setPrimitive(M hit, uint32_t i, uint32_t* primitive) {
+  for (int mask = P::bits(hit), j = 0 ; mask != 0 ; mask >>= 1, j++)
+    if (mask & 1)
+      primitive[j] = i;
+}
+
+void packetTriangles(const RayData& rays, int rayCount, const float* triangles, size_t stride, size_t count,
+  const HitData& hits) {
+  for (int r = 0 ; r < rayCount ; r += P::W) {
+    int lanes = (rayCount - r < P::W) ? rayCount - r : P::W;
+    V o[3], d[3], best;
+    loadRays(rays, r, lanes, o, d, best);
+    V bestU = P::set1(0.0f), bestV = bestU;
+    uint32_t primitive[P::W];
+    for (int j = 0 ; j < P::W ; j++)
+      primitive[j] = NO_HIT;
+    for (size_t i = 0 ; i < count ; i++) {
+      V e[9];
+      for (int k = 0 ; k < 9 ; k++)
+        e[k] = P::set1(triangles[k * stride + i]);
+      V t, u, v;
+      M hit = triangleHit(o, d, e, e + 3, e + 6, best, t, u, v);
+      if (P::bits(hit) == 0)
+        continue;
+      best = P::select(hit, t, best);
+      bestU = P::select(hit, u, bestU);
+      bestV = P::select(hit, v, bestV);
+      setPrimitive(hit, (uint32_t) i, primitive);
+    }
+    storeHits(hits, r, lanes, best, bestU, bestV, primitive);
+  }
+}
+
+void packetBoxes(const RayData& rays, int rayCount, const float* boxMin, const float* boxMax, size_t stride,
+  size_t count, const HitData& hits) {
+  for (int r = 0 ; r < rayCount ; r += P::W) {
+    int lanes = (rayCount - r < P::W) ? rayCount - r : P::W;
+    V o[3], d[3], inv[3], best;
+    loadRays(rays, r, lanes, o, d, best);
+    for (int k = 0 ; k < 3 ; k++)
+      inv[k] = P::set1(1.0f) / d[k];
+    uint32_t primitive[P::W];
+    for (int j = 0 ; j < P::W ; j++)
+      primitive[j] = NO_HIT;
+    for (size_t i = 0 ; i < count ; i++) {
+      V min[3], max[3];
+      for (int k = 0 ; k < 3 ; k++) {
+        min[k] = P::set1(boxMin[k * stride + i]);
+        max[k] = P::set1(boxMax[k * stride + i]);
+      }
+      V t;
+      M hit = boxHit(o, inv, min, max, best, t);
+      if (P::bits(hit) == 0)
+        continue;
+      best = P::select(hit, t, best);
+      setPrimitive(hit, (uint32_t) i, primitive);
+    }
+    V zero = P::set1(0.0f);
+    storeHits(hits, r, lanes, best, zero, zero, primitive);
+  }
+}
+
+// Single ray: the closest hit among W primitives is picked lane by lane, the
+// first one winning ties as in the packet kernels
+void rayTriangles(const float* origin, const float* direction, float tMax, const float* triangles,
+  size_t stride, size_t count, RayHit& hit) {
+  V o[3], d[3];
+  for (int k = 0 ; k < 3 ; k++) {
+    o[k] = P::set1(origin[k]);
+    d[k] = P::set1(direction[k]);
+  }
+  hit.t = tMax;
+  hit.primitive = NO_HIT;
+  // Padding triangles are degenerate: no need to mask the last pack
+  for (size_t i = 0 ; i < count ; i += P::W) {
+    V e[9];
+    for (int k = 0 ; k < 9 ; k++)
+      e[k] = P::load(triangles + k * stride + i);
+    V t, u, v;
+    int mask = P::bits(triangleHit(o, d, e, e + 3, e + 6, P::set1(hit.t), t, u, v));
+    if (mask == 0)
+      continue;
+    float lanes[3][P::W];
+    P::store(lanes[0], t);
+    P::store(lanes[1], u);
+    P::store(lanes[2], v);
+    for (int j = 0 ; mask != 0 ; mask >>= 1, j++)
+      if ((mask & 1) && lanes[0][j] < hit.t) {
+        hit.t = lanes[0][j];
+        hit.u = lanes[1][j];
+        hit.v = lanes[2][j];
+        hit.primitive = (uint32_t) (i + j);
+      }
+  }
+}
+
+void rayBoxes(const float* origin, const float* direction, float tMax, const float* boxMin,
+  const float* boxMax, size_t stride, size_t count, RayHit& hit) {
+  V o[3], inv[3];
+  for (int k = 0 ; k < 3 ; k++) {
+    o[k] = P::set1(origin[k]);
+    inv[k] = P::set1(1.0f) / P::set1(direction[k]);
+  }
+  hit.t = tMax;
+  hit.u = hit.v = 0.0f;
+  hit.primitive = NO_HIT;
+  for (size_t i = 0 ; i < count ; i += P::W) {
+    V min[3], max[3];
+    for (int k = 0 ; k < 3 ; k++) {
+      min[k] = P::load(boxMin + k * stride + i);
+      max[k] = P::load(boxMax + k * stride + i);
+    }
+    V t;
+    int mask = P::bits(boxHit(o, inv, min, max, P::set1(hit.t), t));
+    // Padding boxes are empty at the origin, which a ray can hit
+    if (count - i < (size_t) P::W)
+      mask &= (1 << (count - i)) - 1;
+    if (mask == 0)
+      continue;
+    float lanes[P::W];
+    P::store(lanes, t);
+    for (int j = 0 ; mask != 0 ; mask >>= 1, j++)
+      if ((mask & 1) && lanes[j] < hit.t) {
+        hit.t = lanes[j];
+        hit.primitive = (uint32_t) (i + j);
+      }
+  }
+}
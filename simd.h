@@ -0,0 +1,84 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// x86 kernels are compiled with per-function target attributes, so they are
+// only available with GCC/Clang. Every other configuration uses scalar code.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define QM_SIMD_X86 1
+#define QM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define QM_SIMD_X86 0
+#define QM_TARGET(isa)
+#endif
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#if QM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace qm {
+
+/**
+ * Instruction sets the SIMD kernels can be dispatched to,
+ * ordered from the least to the most capable. SIMD_AVX2_FMA also requires
+ * F16C (half precision conversions), present on every AVX2 CPU.
+ */
+enum SimdIsa {
+  SIMD_SCALAR = 0,
+  SIMD_SSE2,
+  SIMD_AVX,
+  SIMD_AVX2_FMA,
+  SIMD_ISA_COUNT
+};
+
+// Best instruction set supported by the running CPU (CPUID + OS support).
+inline SimdIsa detectSimdIsa() {
+#if QM_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+    return SIMD_AVX2_FMA;
+  if (__builtin_cpu_supports("avx"))
+    return SIMD_AVX;
+  if (__builtin_cpu_supports("sse2"))
+    return SIMD_SSE2;
+#endif
+  return SIMD_SCALAR;
+}
+
+namespace detail {
+
+inline SimdIsa& activeSimdIsa() {
+  // Detected once, the first time a kernel is dispatched
+  static SimdIsa isa = detectSimdIsa();
+  return isa;
+}
+
+}
+
+// Instruction set currently used by the dispatched kernels.
+inline SimdIsa simdIsa() {
+  return detail::activeSimdIsa();
+}
+
+// Force a less capable instruction set (e.g. for benchmarks or to compare
+// against the scalar path). Requests above what the CPU supports are clamped.
+inline SimdIsa setSimdIsa(SimdIsa isa) {
+  SimdIsa best = detectSimdIsa();
+  detail::activeSimdIsa() = (isa > best) ? best : isa;
+  return detail::activeSimdIsa();
+}
+
+inline const char* simdIsaName(SimdIsa isa) {
+  switch (isa) {
+    case SIMD_SSE2: return "sse2";
+    case SIMD_AVX: return "avx";
+    case SIMD_AVX2_FMA: return "avx2+fma";
+    default: return "scalar";
+  }
+}
+
+}
+
+#endif // SIMD_H
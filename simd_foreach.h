@@ -0,0 +1,74 @@
+// No include guard: expands the kernel file named by QM_SIMD_KERNELS once per
+// instruction set, into namespaces scalar, sse2, avx and avx2 whose functions
+// are compiled for that target. Each namespace gets its own Pack<T> (see
+// simdpack.h), so kernels are written once as templates over Pack<T>:
+//
+//   namespace {
+//   #define QM_SIMD_KERNELS "vecsoa_kernels.inl"
+//   #include "simd_foreach.h"
+//   }
+//
+// simd.h must be included first.
+
+#ifndef SIMD_H
+#error "simd.h must be included before simd_foreach.h"
+#endif
+
+namespace scalar {
+#define QM_PACK_ISA 0
+#include "simdpack.h"
+#include QM_SIMD_KERNELS
+#undef QM_PACK_ISA
+}
+
+#if QM_SIMD_X86
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+namespace sse2 {
+#define QM_PACK_ISA 1
+#include "simdpack.h"
+#include QM_SIMD_KERNELS
+#undef QM_PACK_ISA
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push (__attribute__((target("avx"))), apply_to = function)
+#else
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx")
+#endif
+namespace avx {
+#define QM_PACK_ISA 2
+#include "simdpack.h"
+#include QM_SIMD_KERNELS
+#undef QM_PACK_ISA
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push (__attribute__((target("avx2,fma,f16c"))), apply_to = function)
+#else
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,f16c")
+#endif
+namespace avx2 {
+#define QM_PACK_ISA 3
+#include "simdpack.h"
+#include QM_SIMD_KERNELS
+#undef QM_PACK_ISA
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // QM_SIMD_X86
+
+#undef QM_SIMD_KERNELS
@@ -0,0 +1,513 @@
+// No include guard: this file is included once per instruction set by
+// simd_foreach.h, with QM_PACK_ISA set to the SimdIsa being compiled.
+//
+// A pack holds W lanes of T. Arithmetic uses the built-in vector operators
+// (+ - * / on __m128/__m256 with GCC and Clang), everything else goes
+// through the static functions below. Masks are all-ones/all-zeros lanes,
+// combined with both (and) and either (or). rsqrt is the hardware estimate
+// for float (relative error below 1.5 * 2^-12), exact for double.
+// loadTransposed4/storeTransposed4 move W vectors of 4 T, step T apart, and
+// loadGathered4 (float) W vectors of 4 T from W pointers, one per lane.
+// The float packs also convert W 16-bit integers (loadInt16, loadUint16, and
+// storeInt16, storeUint16 for lanes holding integers in range), deinterleave
+// 2 packs (a0 b0 a1 b1...) into even and odd elements and interleave them
+// back. The x86 float packs convert W halves (IEEE binary16 bits) with
+// loadHalf and storeHalf, rounding to nearest even: F16C on AVX2, SSE2
+// integer operations below. The scalar pack has no half conversion (see
+// packed.h).
+
+#ifndef QM_PACK_ISA
+#error "simdpack.h must be included through simd_foreach.h"
+#endif
+
+template<typename T> struct Pack;
+
+#if QM_PACK_ISA == 0 // SIMD_SCALAR
+
+template<typename T> struct Pack {
+  typedef T V;
+  typedef bool M;
+  static const int W = 1;
+  static inline V load(const T* p) { return *p; }
+  static inline void store(T* p, V v) { *p = v; }
+  static inline V set1(T s) { return s; }
+  static inline V sqrt(V a) { return std::sqrt(a); }
+  static inline V rsqrt(V a) { return T(1) / std::sqrt(a); }
+  static inline V fmadd(V a, V b, V c) { return a * b + c; }
+  static inline V min(V a, V b) { return (b < a) ? b : a; }
+  static inline V max(V a, V b) { return (a < b) ? b : a; }
+  static inline M eq(V a, V b) { return a == b; }
+  static inline M lt(V a, V b) { return a < b; }
+  static inline M le(V a, V b) { return a <= b; }
+  static inline V select(M m, V a, V b) { return m ? a : b; }
+  static inline M both(M a, M b) { return a && b; }
+  static inline M either(M a, M b) { return a || b; }
+  static inline int bits(M m) { return m ? 1 : 0; }
+  static inline void loadTransposed3(const T* p, V& x, V& y, V& z) {
+    x = p[0];
+    y = p[1];
+    z = p[2];
+  }
+  static inline void storeTransposed3(T* p, V x, V y, V z) {
+    p[0] = x;
+    p[1] = y;
+    p[2] = z;
+  }
+  static inline void loadTransposed4(const T* p, size_t, V& x, V& y, V& z, V& w) {
+    x = p[0];
+    y = p[1];
+    z = p[2];
+    w = p[3];
+  }
+  static inline void storeTransposed4(T* p, size_t, V x, V y, V z, V w) {
+    p[0] = x;
+    p[1] = y;
+    p[2] = z;
+    p[3] = w;
+  }
+  static inline void loadGathered4(const T* const* p, V& x, V& y, V& z, V& w) {
+    loadTransposed4(p[0], 0, x, y, z, w);
+  }
+  static inline V loadInt16(const int16_t* p) { return V(*p); }
+  static inline void storeInt16(int16_t* p, V v) { *p = (int16_t) v; }
+  static inline V loadUint16(const uint16_t* p) { return V(*p); }
+  static inline void storeUint16(uint16_t* p, V v) { *p = (uint16_t) v; }
+  static inline void deinterleave(V a, V b, V& even, V& odd) {
+    even = a;
+    odd = b;
+  }
+  static inline void interleave(V even, V odd, V& a, V& b) {
+    a = even;
+    b = odd;
+  }
+};
+
+#endif
+
+#if QM_PACK_ISA == 1 || QM_PACK_ISA == 2 || QM_PACK_ISA == 3
+
+// 4 halves in the low 16 bits of 32-bit lanes to floats (F. Giesen,
+// half_to_float_SSE2). Subnormal halves become subnormal floats scaled into
+// the normal range.
+inline __m128 halfToFloatSse2(__m128i h) {
+  __m128i expMant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+  __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMant), 16);
+  __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)),
+    _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+  __m128i infNan = _mm_cmpgt_epi32(expMant, _mm_set1_epi32(0x7bff));
+  __m128i infNanExp = _mm_and_si128(infNan, _mm_set1_epi32(255 << 23));
+  return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNanExp)));
+}
+
+// 4 floats to halves, rounded to nearest even, sign-extended to 32-bit lanes
+// so that _mm_packs_epi32 keeps their bits (F. Giesen, float_to_half_SSE2)
+inline __m128i floatToHalfSse2(__m128 f) {
+  __m128 sign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32(0x80000000u)));
+  __m128 absF = _mm_xor_ps(f, sign);
+  __m128i bits = _mm_castps_si128(absF);
+  // NaN (quiet), infinity and overflows (>= 65536, rounded up to infinity)
+  __m128i nanBit = _mm_and_si128(_mm_castps_si128(_mm_cmpunord_ps(absF, absF)), _mm_set1_epi32(0x200));
+  __m128i special = _mm_or_si128(nanBit, _mm_set1_epi32(0x7c00));
+  __m128i regular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), bits);
+  // Subnormal results: the float addition rounds the mantissa
+  __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+  __m128i subnormal = _mm_sub_epi32(
+    _mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+  __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), bits);
+  // Normal results: rebias the exponent, round half to even on bit 13
+  __m128i odd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+  __m128i normal = _mm_srli_epi32(
+    _mm_sub_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0xfff - ((127 - 15) << 23))), odd), 13);
+  __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+  __m128i joined = _mm_or_si128(_mm_and_si128(regular, finite), _mm_andnot_si128(regular, special));
+  return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+}
+
+// Integers in [0, 65535] minus 32768, in int32 lanes: _mm_packs_epi32 then
+// keeps them, and flipping bit 15 restores the unsigned values
+inline __m128i uint16Biased(__m128 v) {
+  return _mm_sub_epi32(_mm_cvtps_epi32(v), _mm_set1_epi32(0x8000));
+}
+
+#endif
+
+#if QM_PACK_ISA == 1 // SIMD_SSE2
+
+template<> struct Pack<float> {
+  typedef __m128 V;
+  typedef __m128 M;
+  static const int W = 4;
+  static inline V load(const float* p) { return _mm_loadu_ps(p); }
+  static inline void store(float* p, V v) { _mm_storeu_ps(p, v); }
+  static inline V set1(float s) { return _mm_set1_ps(s); }
+  static inline V sqrt(V a) { return _mm_sqrt_ps(a); }
+  static inline V rsqrt(V a) { return _mm_rsqrt_ps(a); }
+  static inline V fmadd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static inline V min(V a, V b) { return _mm_min_ps(a, b); }
+  static inline V max(V a, V b) { return _mm_max_ps(a, b); }
+  static inline M eq(V a, V b) { return _mm_cmpeq_ps(a, b); }
+  static inline M lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static inline M le(V a, V b) { return _mm_cmple_ps(a, b); }
+  static inline V select(M m, V a, V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+  static inline M both(M a, M b) { return _mm_and_ps(a, b); }
+  static inline M either(M a, M b) { return _mm_or_ps(a, b); }
+  static inline int bits(M m) { return _mm_movemask_ps(m); }
+  // 4 packed xyz (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) to x, y, z lanes
+  static inline void loadTransposed3(const float* p, V& x, V& y, V& z) {
+    __m128 a = _mm_loadu_ps(p);
+    __m128 b = _mm_loadu_ps(p + 4);
+    __m128 c = _mm_loadu_ps(p + 8);
+    __m128 t1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+    __m128 t2 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+    x = _mm_shuffle_ps(a, t1, _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(t2, t1, _MM_SHUFFLE(3, 1, 2, 0));
+    z = _mm_shuffle_ps(t2, c, _MM_SHUFFLE(3, 0, 3, 1));
+  }
+  static inline void storeTransposed3(float* p, V x, V y, V z) {
+    __m128 xyLo = _mm_unpacklo_ps(x, y);
+    __m128 xyHi = _mm_unpackhi_ps(x, y);
+    __m128 w0 = _mm_shuffle_ps(z, xyLo, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 w1 = _mm_shuffle_ps(xyLo, z, _MM_SHUFFLE(1, 1, 3, 3));
+    __m128 w2 = _mm_shuffle_ps(z, xyHi, _MM_SHUFFLE(3, 2, 3, 2));
+    _mm_storeu_ps(p, _mm_shuffle_ps(xyLo, w0, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(p + 4, _mm_shuffle_ps(w1, xyHi, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(p + 8, _mm_shuffle_ps(w2, w2, _MM_SHUFFLE(1, 3, 2, 0)));
+  }
+  static inline void loadTransposed4(const float* p, size_t step, V& x, V& y, V& z, V& w) {
+    x = _mm_loadu_ps(p);
+    y = _mm_loadu_ps(p + step);
+    z = _mm_loadu_ps(p + 2*step);
+    w = _mm_loadu_ps(p + 3*step);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+  }
+  static inline void storeTransposed4(float* p, size_t step, V x, V y, V z, V w) {
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(p, x);
+    _mm_storeu_ps(p + step, y);
+    _mm_storeu_ps(p + 2*step, z);
+    _mm_storeu_ps(p + 3*step, w);
+  }
+  static inline void loadGathered4(const float* const* p, V& x, V& y, V& z, V& w) {
+    x = _mm_loadu_ps(p[0]);
+    y = _mm_loadu_ps(p[1]);
+    z = _mm_loadu_ps(p[2]);
+    w = _mm_loadu_ps(p[3]);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+  }
+  static inline V loadHalf(const uint16_t* p) {
+    __m128i h = _mm_loadl_epi64((const __m128i*) p);
+    return halfToFloatSse2(_mm_unpacklo_epi16(h, _mm_setzero_si128()));
+  }
+  static inline void storeHalf(uint16_t* p, V v) {
+    __m128i h = floatToHalfSse2(v);
+    _mm_storel_epi64((__m128i*) p, _mm_packs_epi32(h, h));
+  }
+  static inline V loadInt16(const int16_t* p) {
+    __m128i h = _mm_loadl_epi64((const __m128i*) p);
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(h, h), 16));
+  }
+  static inline void storeInt16(int16_t* p, V v) {
+    __m128i i = _mm_cvtps_epi32(v);
+    _mm_storel_epi64((__m128i*) p, _mm_packs_epi32(i, i));
+  }
+  static inline V loadUint16(const uint16_t* p) {
+    __m128i h = _mm_loadl_epi64((const __m128i*) p);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(h, _mm_setzero_si128()));
+  }
+  static inline void storeUint16(uint16_t* p, V v) {
+    __m128i i = uint16Biased(v);
+    _mm_storel_epi64((__m128i*) p, _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16(-0x8000)));
+  }
+  static inline void deinterleave(V a, V b, V& even, V& odd) {
+    even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+  }
+  static inline void interleave(V even, V odd, V& a, V& b) {
+    a = _mm_unpacklo_ps(even, odd);
+    b = _mm_unpackhi_ps(even, odd);
+  }
+};
+
+template<> struct Pack<double> {
+  typedef __m128d V;
+  typedef __m128d M;
+  static const int W = 2;
+  static inline V load(const double* p) { return _mm_loadu_pd(p); }
+  static inline void store(double* p, V v) { _mm_storeu_pd(p, v); }
+  static inline V set1(double s) { return _mm_set1_pd(s); }
+  static inline V sqrt(V a) { return _mm_sqrt_pd(a); }
+  static inline V rsqrt(V a) { return _mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(a)); }
+  static inline V fmadd(V a, V b, V c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+  static inline V min(V a, V b) { return _mm_min_pd(a, b); }
+  static inline V max(V a, V b) { return _mm_max_pd(a, b); }
+  static inline M eq(V a, V b) { return _mm_cmpeq_pd(a, b); }
+  static inline M lt(V a, V b) { return _mm_cmplt_pd(a, b); }
+  static inline M le(V a, V b) { return _mm_cmple_pd(a, b); }
+  static inline V select(M m, V a, V b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+  static inline M both(M a, M b) { return _mm_and_pd(a, b); }
+  static inline M either(M a, M b) { return _mm_or_pd(a, b); }
+  static inline int bits(M m) { return _mm_movemask_pd(m); }
+  // 2 packed xyz (x0 y0 | z0 x1 | y1 z1) to x, y, z lanes
+  static inline void loadTransposed3(const double* p, V& x, V& y, V& z) {
+    __m128d a = _mm_loadu_pd(p);
+    __m128d b = _mm_loadu_pd(p + 2);
+    __m128d c = _mm_loadu_pd(p + 4);
+    x = _mm_shuffle_pd(a, b, 2);
+    y = _mm_shuffle_pd(a, c, 1);
+    z = _mm_shuffle_pd(b, c, 2);
+  }
+  static inline void storeTransposed3(double* p, V x, V y, V z) {
+    _mm_storeu_pd(p, _mm_unpacklo_pd(x, y));
+    _mm_storeu_pd(p + 2, _mm_shuffle_pd(z, x, 2));
+    _mm_storeu_pd(p + 4, _mm_unpackhi_pd(y, z));
+  }
+  static inline void loadTransposed4(const double* p, size_t step, V& x, V& y, V& z, V& w) {
+    __m128d a = _mm_loadu_pd(p);
+    __m128d b = _mm_loadu_pd(p + 2);
+    __m128d c = _mm_loadu_pd(p + step);
+    __m128d d = _mm_loadu_pd(p + step + 2);
+    x = _mm_unpacklo_pd(a, c);
+    y = _mm_unpackhi_pd(a, c);
+    z = _mm_unpacklo_pd(b, d);
+    w = _mm_unpackhi_pd(b, d);
+  }
+  static inline void storeTransposed4(double* p, size_t step, V x, V y, V z, V w) {
+    _mm_storeu_pd(p, _mm_unpacklo_pd(x, y));
+    _mm_storeu_pd(p + 2, _mm_unpacklo_pd(z, w));
+    _mm_storeu_pd(p + step, _mm_unpackhi_pd(x, y));
+    _mm_storeu_pd(p + step + 2, _mm_unpackhi_pd(z, w));
+  }
+};
+
+#elif QM_PACK_ISA == 2 || QM_PACK_ISA == 3 // SIMD_AVX, SIMD_AVX2_FMA
+
+template<> struct Pack<float> {
+  typedef __m256 V;
+  typedef __m256 M;
+  static const int W = 8;
+  static inline V load(const float* p) { return _mm256_loadu_ps(p); }
+  static inline void store(float* p, V v) { _mm256_storeu_ps(p, v); }
+  static inline V set1(float s) { return _mm256_set1_ps(s); }
+  static inline V sqrt(V a) { return _mm256_sqrt_ps(a); }
+  static inline V rsqrt(V a) { return _mm256_rsqrt_ps(a); }
+#if QM_PACK_ISA == 3
+  static inline V fmadd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+  static inline V fmadd(V a, V b, V c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+  static inline V min(V a, V b) { return _mm256_min_ps(a, b); }
+  static inline V max(V a, V b) { return _mm256_max_ps(a, b); }
+  static inline M eq(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+  static inline M lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static inline M le(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  static inline V select(M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+  static inline M both(M a, M b) { return _mm256_and_ps(a, b); }
+  static inline M either(M a, M b) { return _mm256_or_ps(a, b); }
+  static inline int bits(M m) { return _mm256_movemask_ps(m); }
+  static inline V combine(__m128 lo, __m128 hi) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+  }
+  // Two SSE transposes of 4 vectors each
+  static inline void loadTransposed3(const float* p, V& x, V& y, V& z) {
+    __m128 x0, y0, z0, x1, y1, z1;
+    transpose3(p, x0, y0, z0);
+    transpose3(p + 12, x1, y1, z1);
+    x = combine(x0, x1);
+    y = combine(y0, y1);
+    z = combine(z0, z1);
+  }
+  static inline void storeTransposed3(float* p, V x, V y, V z) {
+    untranspose3(p, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z));
+    untranspose3(p + 12, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+  }
+  static inline void loadTransposed4(const float* p, size_t step, V& x, V& y, V& z, V& w) {
+    __m128 x0 = _mm_loadu_ps(p), y0 = _mm_loadu_ps(p + step);
+    __m128 z0 = _mm_loadu_ps(p + 2*step), w0 = _mm_loadu_ps(p + 3*step);
+    __m128 x1 = _mm_loadu_ps(p + 4*step), y1 = _mm_loadu_ps(p + 5*step);
+    __m128 z1 = _mm_loadu_ps(p + 6*step), w1 = _mm_loadu_ps(p + 7*step);
+    _MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+    _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+    x = combine(x0, x1);
+    y = combine(y0, y1);
+    z = combine(z0, z1);
+    w = combine(w0, w1);
+  }
+  static inline void storeTransposed4(float* p, size_t step, V x, V y, V z, V w) {
+    __m128 x0 = _mm256_castps256_ps128(x), y0 = _mm256_castps256_ps128(y);
+    __m128 z0 = _mm256_castps256_ps128(z), w0 = _mm256_castps256_ps128(w);
+    __m128 x1 = _mm256_extractf128_ps(x, 1), y1 = _mm256_extractf128_ps(y, 1);
+    __m128 z1 = _mm256_extractf128_ps(z, 1), w1 = _mm256_extractf128_ps(w, 1);
+    _MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+    _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+    _mm_storeu_ps(p, x0);
+    _mm_storeu_ps(p + step, y0);
+    _mm_storeu_ps(p + 2*step, z0);
+    _mm_storeu_ps(p + 3*step, w0);
+    _mm_storeu_ps(p + 4*step, x1);
+    _mm_storeu_ps(p + 5*step, y1);
+    _mm_storeu_ps(p + 6*step, z1);
+    _mm_storeu_ps(p + 7*step, w1);
+  }
+  static inline void loadGathered4(const float* const* p, V& x, V& y, V& z, V& w) {
+    __m128 x0 = _mm_loadu_ps(p[0]), y0 = _mm_loadu_ps(p[1]), z0 = _mm_loadu_ps(p[2]), w0 = _mm_loadu_ps(p[3]);
+    __m128 x1 = _mm_loadu_ps(p[4]), y1 = _mm_loadu_ps(p[5]), z1 = _mm_loadu_ps(p[6]), w1 = _mm_loadu_ps(p[7]);
+    _MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+    _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+    x = combine(x0, x1);
+    y = combine(y0, y1);
+    z = combine(z0, z1);
+    w = combine(w0, w1);
+  }
+#if QM_PACK_ISA == 3
+  static inline V loadHalf(const uint16_t* p) {
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) p));
+  }
+  static inline void storeHalf(uint16_t* p, V v) {
+    _mm_storeu_si128((__m128i*) p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  static inline V loadInt16(const int16_t* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) p)));
+  }
+  static inline V loadUint16(const uint16_t* p) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) p)));
+  }
+#else
+  static inline V loadHalf(const uint16_t* p) {
+    __m128i h = _mm_loadu_si128((const __m128i*) p);
+    __m128i zero = _mm_setzero_si128();
+    return combine(halfToFloatSse2(_mm_unpacklo_epi16(h, zero)), halfToFloatSse2(_mm_unpackhi_epi16(h, zero)));
+  }
+  static inline void storeHalf(uint16_t* p, V v) {
+    __m128i lo = floatToHalfSse2(_mm256_castps256_ps128(v));
+    __m128i hi = floatToHalfSse2(_mm256_extractf128_ps(v, 1));
+    _mm_storeu_si128((__m128i*) p, _mm_packs_epi32(lo, hi));
+  }
+  static inline V loadInt16(const int16_t* p) {
+    __m128i h = _mm_loadu_si128((const __m128i*) p);
+    return combine(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(h, h), 16)),
+      _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(h, h), 16)));
+  }
+  static inline V loadUint16(const uint16_t* p) {
+    __m128i h = _mm_loadu_si128((const __m128i*) p);
+    __m128i zero = _mm_setzero_si128();
+    return combine(_mm_cvtepi32_ps(_mm_unpacklo_epi16(h, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(h, zero)));
+  }
+#endif
+  static inline void storeInt16(int16_t* p, V v) {
+    __m256i i = _mm256_cvtps_epi32(v);
+    _mm_storeu_si128((__m128i*) p, _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extractf128_si256(i, 1)));
+  }
+  static inline void storeUint16(uint16_t* p, V v) {
+    __m128i lo = uint16Biased(_mm256_castps256_ps128(v));
+    __m128i hi = uint16Biased(_mm256_extractf128_ps(v, 1));
+    _mm_storeu_si128((__m128i*) p, _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16(-0x8000)));
+  }
+  // Even and odd elements of each 128-bit half, then across halves
+  static inline void deinterleave(V a, V b, V& even, V& odd) {
+    V lo = _mm256_permute2f128_ps(a, b, 0x20), hi = _mm256_permute2f128_ps(a, b, 0x31);
+    even = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    odd = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+  }
+  static inline void interleave(V even, V odd, V& a, V& b) {
+    V lo = _mm256_unpacklo_ps(even, odd), hi = _mm256_unpackhi_ps(even, odd);
+    a = _mm256_permute2f128_ps(lo, hi, 0x20);
+    b = _mm256_permute2f128_ps(lo, hi, 0x31);
+  }
+
+  private:
+    static inline void transpose3(const float* p, __m128& x, __m128& y, __m128& z) {
+      __m128 a = _mm_loadu_ps(p);
+      __m128 b = _mm_loadu_ps(p + 4);
+      __m128 c = _mm_loadu_ps(p + 8);
+      __m128 t1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+      __m128 t2 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 2, 1));
+      x = _mm_shuffle_ps(a, t1, _MM_SHUFFLE(2, 0, 3, 0));
+      y = _mm_shuffle_ps(t2, t1, _MM_SHUFFLE(3, 1, 2, 0));
+      z = _mm_shuffle_ps(t2, c, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+    static inline void untranspose3(float* p, __m128 x, __m128 y, __m128 z) {
+      __m128 xyLo = _mm_unpacklo_ps(x, y);
+      __m128 xyHi = _mm_unpackhi_ps(x, y);
+      __m128 w0 = _mm_shuffle_ps(z, xyLo, _MM_SHUFFLE(2, 2, 0, 0));
+      __m128 w1 = _mm_shuffle_ps(xyLo, z, _MM_SHUFFLE(1, 1, 3, 3));
+      __m128 w2 = _mm_shuffle_ps(z, xyHi, _MM_SHUFFLE(3, 2, 3, 2));
+      _mm_storeu_ps(p, _mm_shuffle_ps(xyLo, w0, _MM_SHUFFLE(2, 0, 1, 0)));
+      _mm_storeu_ps(p + 4, _mm_shuffle_ps(w1, xyHi, _MM_SHUFFLE(1, 0, 2, 0)));
+      _mm_storeu_ps(p + 8, _mm_shuffle_ps(w2, w2, _MM_SHUFFLE(1, 3, 2, 0)));
+    }
+};
+
+template<> struct Pack<double> {
+  typedef __m256d V;
+  typedef __m256d M;
+  static const int W = 4;
+  static inline V load(const double* p) { return _mm256_loadu_pd(p); }
+  static inline void store(double* p, V v) { _mm256_storeu_pd(p, v); }
+  static inline V set1(double s) { return _mm256_set1_pd(s); }
+  static inline V sqrt(V a) { return _mm256_sqrt_pd(a); }
+  static inline V rsqrt(V a) { return _mm256_div_pd(_mm256_set1_pd(1.0), _mm256_sqrt_pd(a)); }
+#if QM_PACK_ISA == 3
+  static inline V fmadd(V a, V b, V c) { return _mm256_fmadd_pd(a, b, c); }
+#else
+  static inline V fmadd(V a, V b, V c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#endif
+  static inline V min(V a, V b) { return _mm256_min_pd(a, b); }
+  static inline V max(V a, V b) { return _mm256_max_pd(a, b); }
+  static inline M eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+  static inline M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+  static inline M le(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+  static inline V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+  static inline M both(M a, M b) { return _mm256_and_pd(a, b); }
+  static inline M either(M a, M b) { return _mm256_or_pd(a, b); }
+  static inline int bits(M m) { return _mm256_movemask_pd(m); }
+  static inline V combine(__m128d lo, __m128d hi) {
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(lo), hi, 1);
+  }
+  // 4 packed xyz (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) to x, y, z lanes
+  static inline void loadTransposed3(const double* p, V& x, V& y, V& z) {
+    V a = _mm256_loadu_pd(p);
+    V b = _mm256_loadu_pd(p + 4);
+    V c = _mm256_loadu_pd(p + 8);
+    // Regroup halves: ab = x0 y0 | x2 y2, bc = z0 x1 | z2 x3, cb = y1 z1 | y3 z3
+    V ab = _mm256_permute2f128_pd(a, b, 0x30);
+    V bc = _mm256_permute2f128_pd(a, c, 0x21);
+    V cb = _mm256_permute2f128_pd(b, c, 0x30);
+    x = _mm256_shuffle_pd(ab, bc, 0xA);
+    y = _mm256_shuffle_pd(ab, cb, 0x5);
+    z = _mm256_shuffle_pd(bc, cb, 0xA);
+  }
+  static inline void storeTransposed3(double* p, V x, V y, V z) {
+    V ab = _mm256_shuffle_pd(x, y, 0x0);
+    V bc = _mm256_shuffle_pd(z, x, 0xA);
+    V cb = _mm256_shuffle_pd(y, z, 0xF);
+    _mm256_storeu_pd(p, _mm256_permute2f128_pd(ab, bc, 0x20));
+    _mm256_storeu_pd(p + 4, _mm256_permute2f128_pd(cb, ab, 0x30));
+    _mm256_storeu_pd(p + 8, _mm256_permute2f128_pd(bc, cb, 0x31));
+  }
+  static inline void loadTransposed4(const double* p, size_t step, V& x, V& y, V& z, V& w) {
+    V a = _mm256_loadu_pd(p);
+    V b = _mm256_loadu_pd(p + step);
+    V c = _mm256_loadu_pd(p + 2*step);
+    V d = _mm256_loadu_pd(p + 3*step);
+    V ac0 = _mm256_permute2f128_pd(a, c, 0x20);
+    V ac1 = _mm256_permute2f128_pd(a, c, 0x31);
+    V bd0 = _mm256_permute2f128_pd(b, d, 0x20);
+    V bd1 = _mm256_permute2f128_pd(b, d, 0x31);
+    x = _mm256_unpacklo_pd(ac0, bd0);
+    y = _mm256_unpackhi_pd(ac0, bd0);
+    z = _mm256_unpacklo_pd(ac1, bd1);
+    w = _mm256_unpackhi_pd(ac1, bd1);
+  }
+  static inline void storeTransposed4(double* p, size_t step, V x, V y, V z, V w) {
+    V xy0 = _mm256_unpacklo_pd(x, y);
+    V xy1 = _mm256_unpackhi_pd(x, y);
+    V zw0 = _mm256_unpacklo_pd(z, w);
+    V zw1 = _mm256_unpackhi_pd(z, w);
+    _mm256_storeu_pd(p, _mm256_permute2f128_pd(xy0, zw0, 0x20));
+    _mm256_storeu_pd(p + step, _mm256_permute2f128_pd(xy1, zw1, 0x20));
+    _mm256_storeu_pd(p + 2*step, _mm256_permute2f128_pd(xy0, zw0, 0x31));
+    _mm256_storeu_pd(p + 3*step, _mm256_permute2f128_pd(xy1, zw1, 0x31));
+  }
+};
+
+#endif
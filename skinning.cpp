@@ -0,0 +1,124 @@
+#include <cassert>
+#include <cstring>
+
+#include "skinning.h"
+#include "memory.h"
+#include "parallel.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+// SoA lanes of a skinned mesh: influence k of vertex i is joints[k *
+// jointStride + i] with weights[k * weightStride + i]
+struct SkinData {
+  const uint16_t* joints;
+  size_t jointStride;
+  const float* weights;
+  size_t weightStride;
+  int influences;
+  const float* positions;
+  const float* normals;
+  size_t stride;
+  float* outPositions;
+  float* outNormals;
+  size_t outStride;
+};
+
+#define QM_SIMD_KERNELS "skinning_kernels.inl"
+#include "simd_foreach.h"
+
+typedef void (*SkinFn)(const float*, const SkinData&, size_t, size_t);
+
+/**
+ * Skinning kernels compiled for one instruction set.
+ */
+struct SkinKernels {
+  SkinFn linear;
+  SkinFn dualQuat;
+};
+
+const SkinKernels& kernels() {
+  static const SkinKernels table[SIMD_ISA_COUNT] = {
+    {scalar::skinLinear, scalar::skinDualQuat},
+#if QM_SIMD_X86
+    {sse2::skinLinear, sse2::skinDualQuat},
+    {avx::skinLinear, avx::skinDualQuat},
+    {avx2::skinLinear, avx2::skinDualQuat}
+#endif
+  };
+  return table[simdIsa()];
+}
+
+// Vertices per parallel chunk: whole cache lines of every lane
+const size_t VERTEX_CHUNK = 1024;
+
+#ifndef NDEBUG
+// Largest joint index of the first count vertices, padding excluded
+template<int K> uint16_t maxJoint(const SkinWeights<K>& weights, size_t count) {
+  uint16_t result = 0;
+  for (int k = 0 ; k < K ; k++)
+    for (size_t i = 0 ; i < count ; i++)
+      result = (weights.getJoint(i, k) > result) ? weights.getJoint(i, k) : result;
+  return result;
+}
+#endif
+
+template<int K> void skin(SkinFn kernel, const float* palette, size_t jointCount, const SkinWeights<K>& weights,
+  const Vec3SoA<float>& positions, const Vec3SoA<float>* normals, Vec3SoA<float>& outPositions,
+  Vec3SoA<float>* outNormals) {
+  size_t count = positions.size();
+  // The kernels read joint 0 for padding vertices, so there must be one
+  if (jointCount == 0)
+    return;
+  assert(weights.size() >= count);
+  assert(maxJoint(weights, count) < jointCount);
+  outPositions.resize(count);
+  if (normals && outNormals)
+    outNormals->resize(count);
+  else
+    normals = outNormals = 0;
+  SkinData data = {weights.getJoints().getArray(), weights.getJoints().getStride(),
+    weights.getWeights().getArray(), weights.getWeights().getStride(), K,
+    positions.getArray(), normals ? normals->getArray() : 0, positions.getStride(),
+    outPositions.getArray(), outNormals ? outNormals->getArray() : 0, outPositions.getStride()};
+  parallel_for(0, count, chunkSize<float>(VERTEX_CHUNK), [&](size_t first, size_t last) {
+    kernel(palette, data, first, last);
+  });
+}
+
+}
+
+namespace qm {
+
+template<int K> void skinLinear(const Mat3x4f* palette, size_t jointCount, const SkinWeights<K>& weights,
+  const Vec3SoA<float>& positions, const Vec3SoA<float>* normals, Vec3SoA<float>& outPositions,
+  Vec3SoA<float>* outNormals) {
+  // Entries padded to 16 floats, 2 AVX loads
+  float* padded = (float*) alignedMalloc(jointCount * 16 * sizeof(float));
+  if (!padded)
+    return;
+  memset(padded, 0, jointCount * 16 * sizeof(float));
+  for (size_t j = 0 ; j < jointCount ; j++)
+    memcpy(padded + 16 * j, palette[j].getArray(), 12 * sizeof(float));
+  skin(kernels().linear, padded, jointCount, weights, positions, normals, outPositions, outNormals);
+  alignedFree(padded);
+}
+
+template<int K> void skinDualQuat(const DualQuat* palette, size_t jointCount, const SkinWeights<K>& weights,
+  const Vec3SoA<float>& positions, const Vec3SoA<float>* normals, Vec3SoA<float>& outPositions,
+  Vec3SoA<float>* outNormals) {
+  skin(kernels().dualQuat, &palette[0].real[0], jointCount, weights, positions, normals, outPositions, outNormals);
+}
+
+template void skinLinear<4>(const Mat3x4f*, size_t, const SkinWeights<4>&, const Vec3SoA<float>&,
+  const Vec3SoA<float>*, Vec3SoA<float>&, Vec3SoA<float>*);
+template void skinLinear<8>(const Mat3x4f*, size_t, const SkinWeights<8>&, const Vec3SoA<float>&,
+  const Vec3SoA<float>*, Vec3SoA<float>&, Vec3SoA<float>*);
+template void skinDualQuat<4>(const DualQuat*, size_t, const SkinWeights<4>&, const Vec3SoA<float>&,
+  const Vec3SoA<float>*, Vec3SoA<float>&, Vec3SoA<float>*);
+template void skinDualQuat<8>(const DualQuat*, size_t, const SkinWeights<8>&, const Vec3SoA<float>&,
+  const Vec3SoA<float>*, Vec3SoA<float>&, Vec3SoA<float>*);
+
+}
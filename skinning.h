@@ -0,0 +1,116 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vec3.h"
+#include "mat3x4.h"
+#include "quat.h"
+#include "vecsoa.h"
+
+namespace qm {
+
+/**
+ * Rigid transform as a unit dual quaternion: rotation real, then translation
+ * t, with dual = 1/2 (0, t) real.
+ */
+struct DualQuat {
+  Quat real;
+  Quat dual;
+
+  inline DualQuat() : real(Quat::identity()), dual() { }
+  inline DualQuat(const Quat& rotation, const Vec3f& t) : real(rotation) {
+    float w = rotation[0], x = rotation[1], y = rotation[2], z = rotation[3];
+    dual = Quat::fromComponents(
+      -0.5f * (t[0]*x + t[1]*y + t[2]*z),
+      0.5f * (w*t[0] + t[1]*z - t[2]*y),
+      0.5f * (w*t[1] + t[2]*x - t[0]*z),
+      0.5f * (w*t[2] + t[0]*y - t[1]*x));
+  }
+  // 2 dual conjugate(real)
+  inline Vec3f getTranslation() const {
+    float w = real[0], x = real[1], y = real[2], z = real[3];
+    return Vec3f(
+      2.0f * (w*dual[1] - dual[0]*x + y*dual[3] - z*dual[2]),
+      2.0f * (w*dual[2] - dual[0]*y + z*dual[1] - x*dual[3]),
+      2.0f * (w*dual[3] - dual[0]*z + x*dual[2] - y*dual[1]));
+  }
+  inline Vec3f transformPoint(const Vec3f& p) const {
+    return real.rotate(p) + getTranslation();
+  }
+};
+
+/**
+ * Joint influences of vertices as structure-of-arrays: K = 4 or 8 lanes of
+ * joint indices and K lanes of weights, padded to 64 bytes (see vecsoa.h).
+ * Weights of a vertex should sum to 1; unused influences have weight 0.
+ */
+template<int K> class SkinWeights {
+
+  public:
+    static const int INFLUENCES = K;
+
+    // Constructors
+    inline SkinWeights() { }
+    inline explicit SkinWeights(size_t size) : joints(size), weights(size) { }
+    // Others
+    inline size_t size() const {
+      return weights.size();
+    }
+    inline void resize(size_t size) {
+      joints.resize(size);
+      weights.resize(size);
+    }
+    // Influence k of vertex i
+    inline void set(size_t i, int k, uint16_t joint, float weight) {
+      joints.lane(k)[i] = joint;
+      weights.lane(k)[i] = weight;
+    }
+    inline uint16_t getJoint(size_t i, int k) const {
+      return joints.lane(k)[i];
+    }
+    inline float getWeight(size_t i, int k) const {
+      return weights.lane(k)[i];
+    }
+    inline const SoABase<uint16_t, K>& getJoints() const {
+      return joints;
+    }
+    inline const SoABase<float, K>& getWeights() const {
+      return weights;
+    }
+
+  private:
+    SoABase<uint16_t, K> joints;
+    SoABase<float, K> weights;
+
+};
+
+typedef SkinWeights<4> SkinWeights4;
+typedef SkinWeights<8> SkinWeights8;
+
+/**
+ * Skin SoA positions (and normals, if not 0) with a palette of jointCount
+ * joint transforms, into outPositions (and outNormals), resized to
+ * positions.size(). Outputs may be the inputs. Vertices are split into chunks
+ * on the thread pool of parallel.h and skinned W at a time, one per SIMD lane
+ * (see simd.h). Joint indices must be below jointCount (asserted); with no
+ * joint (or if memory runs out), the outputs are left untouched.
+ * - skinLinear: linear blend skinning, each vertex goes through the weighted
+ *   sum of its Mat3x4 transforms. Normals go through its 3x3 block and are
+ *   renormalized: exact for rotations and uniform scales.
+ * - skinDualQuat: dual quaternion skinning, each vertex goes through the
+ *   normalized weighted sum of its rigid transforms, without the volume loss
+ *   of linear blending at twisted joints. Quaternions are flipped onto the
+ *   hemisphere of the first influence, which should be the heaviest.
+ */
+template<int K> void skinLinear(const Mat3x4f* palette, size_t jointCount, const SkinWeights<K>& weights,
+  const Vec3SoA<float>& positions, const Vec3SoA<float>* normals, Vec3SoA<float>& outPositions,
+  Vec3SoA<float>* outNormals);
+template<int K> void skinDualQuat(const DualQuat* palette, size_t jointCount, const SkinWeights<K>& weights,
+  const Vec3SoA<float>& positions, const Vec3SoA<float>* normals, Vec3SoA<float>& outPositions,
+  Vec3SoA<float>* outNormals);
+
+}
+
+#endif // SKINNING_H
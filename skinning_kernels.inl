@@ -0,0 +1,138 @@
+// Skinning kernels of skinning.cpp, expanded once per instruction set by
+// simd_foreach.h. Each SIMD lane holds one vertex, loaded straight from the SoA
+// position and normal lanes. Linear blending first sums the Mat3x4 entries of
+// each vertex, W floats at a time (entries padded to 16 floats), then
+// transposes the W sums: one transpose per vertex instead of one per
+// influence. Dual quaternions (8 floats) are gathered and transposed per
+// influence, so that the hemisphere test runs on whole lanes. Padding vertices
+// have zero weights and skin to zero.
+
+typedef Pack<float> P;
+typedef P::V V;
+
+// Weighted sum of the palette entries (16 floats) of the influences of vertex i
+inline void blend(const float* palette, const SkinData& skin, size_t i, float* out) {
+  V acc[16 / P::W];
+  for (int c = 0 ; c < 16 / P::W ; c++)
+    acc[c] = P::set1(0.0f);
+  for (int k = 0 ; k < skin.influences ; k++) {
+    const float* entry = palette + 16 * skin.joints[k * skin.jointStride + i];
+    V w = P::set1(skin.weights[k * skin.weightStride + i]);
+    for (int c = 0 ; c < 16 / P::W ; c++)
+      acc[c] = P::fmadd(w, P::load(entry + c * P::W), acc[c]);
+  }
+  for (int c = 0 ; c < 16 / P::W ; c++)
+    P::store(out + c * P::W, acc[c]);
+}
+
+// Lane j from the 4 floats at palette + 8 * joints[j] + offset
+inline void gather4(const float* palette, const uint16_t* joints, int offset, V e[4]) {
+  const float* p[P::W];
+  for (int j = 0 ; j < P::W ; j++)
+    p[j] = palette + 8 * joints[j] + offset;
+  P::loadGathered4(p, e[0], e[1], e[2], e[3]);
+}
+
+inline void loadVectors(const float* v, size_t stride, size_t i, V r[3]) {
+  for (int k = 0 ; k < 3 ; k++)
+    r[k] = P::load(v + k * stride + i);
+}
+
+inline void storeVectors(float* v, size_t stride, size_t i, const V r[3]) {
+  for (int k = 0 ; k < 3 ; k++)
+    P::store(v + k * stride + i, r[k]);
+}
+
+inline void cross(const V a[3], const V b[3], V r[3]) {
+  r[0] = a[1] * b[2] - a[2] * b[1];
+  r[1] = a[2] * b[0] - a[0] * b[2];
+  r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Vertices [begin, end), begin a multiple of W. Palette entries are Mat3x4
+// padded to 16 floats.
+void skinLinear(const float* palette, const SkinData& skin, size_t begin, size_t end) {
+  float blended[16 * P::W];
+  for (size_t i = begin ; i < end ; i += P::W) {
+    for (int j = 0 ; j < P::W ; j++)
+      blend(palette, skin, i + j, blended + 16 * j);
+    V m[12];
+    for (int r = 0 ; r < 3 ; r++)
+      P::loadTransposed4(blended + 4 * r, 16, m[4*r], m[4*r + 1], m[4*r + 2], m[4*r + 3]);
+    V p[3], r[3];
+    loadVectors(skin.positions, skin.stride, i, p);
+    for (int k = 0 ; k < 3 ; k++)
+      r[k] = m[k] * p[0] + m[3 + k] * p[1] + m[6 + k] * p[2] + m[9 + k];
+    storeVectors(skin.outPositions, skin.outStride, i, r);
+    if (!skin.normals)
+      continue;
+    loadVectors(skin.normals, skin.stride, i, p);
+    for (int k = 0 ; k < 3 ; k++)
+      r[k] = m[k] * p[0] + m[3 + k] * p[1] + m[6 + k] * p[2];
+    V sum = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+    V zero = P::set1(0.0f);
+    V scale = P::select(P::lt(zero, sum), P::set1(1.0f) / P::sqrt(sum), zero);
+    for (int k = 0 ; k < 3 ; k++)
+      r[k] = r[k] * scale;
+    storeVectors(skin.outNormals, skin.outStride, i, r);
+  }
+}
+
+// Blended dual quaternion (real q, dual d), normalized, then
+// p' = p + 2 u x (u x p + w p) + 2 (w d_u - d_w u + u x d_u)
+void skinDualQuat(const float* palette, const SkinData& skin, size_t begin, size_t end) {
+  for (size_t i = begin ; i < end ; i += P::W) {
+    V q[4], d[4], pivot[4];
+    for (int k = 0 ; k < skin.influences ; k++) {
+      V w = P::load(skin.weights + k * skin.weightStride + i);
+      const uint16_t* joints = skin.joints + k * skin.jointStride + i;
+      V eq[4], ed[4];
+      gather4(palette, joints, 0, eq);
+      gather4(palette, joints, 4, ed);
+      if (k == 0) {
+        for (int c = 0 ; c < 4 ; c++) {
+          pivot[c] = eq[c];
+          q[c] = w * eq[c];
+          d[c] = w * ed[c];
+        }
+        continue;
+      }
+      V dot = pivot[0] * eq[0] + pivot[1] * eq[1] + pivot[2] * eq[2] + pivot[3] * eq[3];
+      w = P::select(P::lt(dot, P::set1(0.0f)), P::set1(0.0f) - w, w);
+      for (int c = 0 ; c < 4 ; c++) {
+        q[c] = P::fmadd(w, eq[c], q[c]);
+        d[c] = P::fmadd(w, ed[c], d[c]);
+      }
+    }
+    V sum = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+    V zero = P::set1(0.0f);
+    V scale = P::select(P::lt(zero, sum), P::set1(1.0f) / P::sqrt(sum), zero);
+    for (int c = 0 ; c < 4 ; c++) {
+      q[c] = q[c] * scale;
+      d[c] = d[c] * scale;
+    }
+    V u[3] = {q[1], q[2], q[3]}, du[3] = {d[1], d[2], d[3]};
+    V t[3], p[3], a[3], b[3];
+    cross(u, du, t);
+    for (int k = 0 ; k < 3 ; k++)
+      t[k] = P::set1(2.0f) * (q[0] * du[k] - d[0] * u[k] + t[k]);
+    loadVectors(skin.positions, skin.stride, i, p);
+    cross(u, p, a);
+    for (int k = 0 ; k < 3 ; k++)
+      a[k] = a[k] + q[0] * p[k];
+    cross(u, a, b);
+    for (int k = 0 ; k < 3 ; k++)
+      a[k] = p[k] + P::set1(2.0f) * b[k] + t[k];
+    storeVectors(skin.outPositions, skin.outStride, i, a);
+    if (!skin.normals)
+      continue;
+    loadVectors(skin.normals, skin.stride, i, p);
+    cross(u, p, a);
+    for (int k = 0 ; k < 3 ; k++)
+      a[k] = a[k] + q[0] * p[k];
+    cross(u, a, b);
+    for (int k = 0 ; k < 3 ; k++)
+      a[k] = p[k] + P::set1(2.0f) * b[k];
+    storeVectors(skin.outNormals, skin.outStride, i, a);
+  }
+}
@@ -0,0 +1,185 @@
+#include <cstring>
+
+#include "transform.h"
+#include "memory.h"
+#include "simd.h"
+
+#if QM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace qm;
+
+namespace {
+
+// Columns of R * S, the 3x3 block of the local matrix (as Quat::toMatrix)
+inline void rotationScale(const Quat& q, const Vec3f& s, float* rs) {
+  float w = q[0], x = q[1], y = q[2], z = q[3];
+  rs[0] = (1.0f - 2.0f*y*y - 2.0f*z*z) * s[0];
+  rs[1] = (2.0f*x*y + 2.0f*w*z) * s[0];
+  rs[2] = (2.0f*x*z - 2.0f*w*y) * s[0];
+  rs[3] = (2.0f*x*y - 2.0f*w*z) * s[1];
+  rs[4] = (1.0f - 2.0f*x*x - 2.0f*z*z) * s[1];
+  rs[5] = (2.0f*y*z + 2.0f*w*x) * s[1];
+  rs[6] = (2.0f*x*z + 2.0f*w*y) * s[2];
+  rs[7] = (2.0f*y*z - 2.0f*w*x) * s[2];
+  rs[8] = (1.0f - 2.0f*x*x - 2.0f*y*y) * s[2];
+}
+
+const float IDENTITY[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+/**
+ * world = parent * local, where local has rs as 3x3 block, t as translation
+ * and 0 0 0 1 as last row: 3 multiply-adds per element instead of 4.
+ * Same operation order in every kernel, so results do not depend on the ISA.
+ */
+typedef void (*ComposeTrsFn)(const float* parent, const float* rs, const float* t, float* world);
+
+void composeTrsScalar(const float* p, const float* rs, const float* t, float* world) {
+  for (int r = 0 ; r < 4 ; r++) {
+    for (int j = 0 ; j < 3 ; j++)
+      world[4*j + r] = p[r] * rs[3*j] + p[4 + r] * rs[3*j + 1] + p[8 + r] * rs[3*j + 2];
+    world[12 + r] = p[r] * t[0] + p[4 + r] * t[1] + p[8 + r] * t[2] + p[12 + r];
+  }
+}
+
+#if QM_SIMD_X86
+
+// One column per register
+QM_TARGET("sse2") void composeTrsSse2(const float* p, const float* rs, const float* t, float* world) {
+  __m128 p0 = _mm_loadu_ps(p);
+  __m128 p1 = _mm_loadu_ps(p + 4);
+  __m128 p2 = _mm_loadu_ps(p + 8);
+  __m128 p3 = _mm_loadu_ps(p + 12);
+  for (int j = 0 ; j < 3 ; j++) {
+    _mm_storeu_ps(world + 4*j, _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(p0, _mm_set1_ps(rs[3*j])),
+      _mm_mul_ps(p1, _mm_set1_ps(rs[3*j + 1]))),
+      _mm_mul_ps(p2, _mm_set1_ps(rs[3*j + 2]))));
+  }
+  _mm_storeu_ps(world + 12, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+    _mm_mul_ps(p0, _mm_set1_ps(t[0])),
+    _mm_mul_ps(p1, _mm_set1_ps(t[1]))),
+    _mm_mul_ps(p2, _mm_set1_ps(t[2]))), p3));
+}
+
+#endif // QM_SIMD_X86
+
+ComposeTrsFn composeTrs() {
+  static const ComposeTrsFn table[SIMD_ISA_COUNT] = {
+    composeTrsScalar,
+#if QM_SIMD_X86
+    composeTrsSse2,
+    composeTrsSse2,
+    composeTrsSse2
+#endif
+  };
+  return table[simdIsa()];
+}
+
+}
+
+namespace qm {
+
+TransformHierarchy::TransformHierarchy() :
+  parents(0), translations(0), rotations(0), scales(0), worlds(0), flags(0),
+  count(0), capacity(0), firstDirty(0) {
+  grow(16);
+}
+
+TransformHierarchy::TransformHierarchy(const TransformHierarchy& H) :
+  parents(0), translations(0), rotations(0), scales(0), worlds(0), flags(0),
+  count(0), capacity(0), firstDirty(0) {
+  grow(H.capacity);
+  *this = H;
+}
+
+TransformHierarchy::~TransformHierarchy() {
+  alignedFree(parents);
+  alignedFree(translations);
+  alignedFree(rotations);
+  alignedFree(scales);
+  alignedFree(worlds);
+  alignedFree(flags);
+}
+
+TransformHierarchy& TransformHierarchy::operator=(const TransformHierarchy& H) {
+  if (this == &H)
+    return *this;
+  count = 0;
+  firstDirty = 0;
+  if (!reserve(H.count))
+    return *this;
+  count = H.count;
+  firstDirty = H.firstDirty;
+  memcpy(parents, H.parents, count * sizeof(int));
+  memcpy((void*) translations, H.translations, count * sizeof(Vec3f));
+  memcpy((void*) rotations, H.rotations, count * sizeof(Quat));
+  memcpy((void*) scales, H.scales, count * sizeof(Vec3f));
+  memcpy((void*) worlds, H.worlds, count * sizeof(Mat4f));
+  if (count > 0)
+    memcpy(flags, H.flags, count + 1);
+  return *this;
+}
+
+bool TransformHierarchy::reserve(size_t size) {
+  // No flags until a grow() succeeded
+  return (size <= capacity && flags) || grow(size);
+}
+
+// Arrays grown before a failed allocation keep their new block: capacity is
+// only raised once all of them hold size nodes
+bool TransformHierarchy::grow(size_t size) {
+  bool first = (flags == 0);
+  if (!alignedReallocate(parents, count, size) || !alignedReallocate(translations, count, size)
+      || !alignedReallocate(rotations, count, size) || !alignedReallocate(scales, count, size)
+      || !alignedReallocate(worlds, count, size) || !alignedReallocate(flags, first ? 0 : count + 1, size + 1))
+    return false;
+  if (first)
+    flags[0] = 0;
+  capacity = size;
+  return true;
+}
+
+int TransformHierarchy::addNode(int parent, const Vec3f& translation, const Quat& rotation, const Vec3f& scale) {
+  if (parent < NO_PARENT || parent >= (int) count)
+    return -1;
+  if (count == capacity && !grow((capacity > 0) ? 2 * capacity : 16))
+    return -1;
+  int node = (int) count;
+  count++;
+  parents[node] = parent;
+  translations[node] = translation;
+  rotations[node] = rotation;
+  scales[node] = scale;
+  worlds[node] = Mat4f::identityMatrix();
+  setDirty(node);
+  return node;
+}
+
+Mat4f TransformHierarchy::getLocalMatrix(int node) const {
+  return trsMatrix(translations[node], rotations[node], scales[node]);
+}
+
+size_t TransformHierarchy::update() {
+  ComposeTrsFn compose = composeTrs();
+  size_t updated = 0;
+  for (size_t i = firstDirty ; i < count ; i++) {
+    // Parents come first: their flag is final when their children are reached
+    int parent = parents[i];
+    if (!(flags[i + 1] | flags[parent + 1]))
+      continue;
+    flags[i + 1] = 1;
+    float rs[9];
+    rotationScale(rotations[i], scales[i], rs);
+    const float* parentWorld = (parent == NO_PARENT) ? IDENTITY : worlds[parent].getArray();
+    compose(parentWorld, rs, &translations[i][0], &worlds[i][0]);
+    updated++;
+  }
+  if (firstDirty < count)
+    memset(flags + 1 + firstDirty, 0, count - firstDirty);
+  firstDirty = count;
+  return updated;
+}
+
+}
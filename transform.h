@@ -0,0 +1,138 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <cstddef>
+
+#include "vec3.h"
+#include "mat4.h"
+#include "quat.h"
+
+namespace qm {
+
+// Local matrix T * R * S of a translation, unit quaternion and scale
+inline Mat4f trsMatrix(const Vec3f& t, const Quat& r, const Vec3f& s) {
+  Mat4f M = r.toMatrix();
+  for (int j = 0 ; j < 3 ; j++) {
+    M[4*j] *= s[j];
+    M[4*j + 1] *= s[j];
+    M[4*j + 2] *= s[j];
+  }
+  M[12] = t[0];
+  M[13] = t[1];
+  M[14] = t[2];
+  return M;
+}
+
+/**
+ * Hierarchy of transforms stored in flat arrays, parents before their
+ * children. Each node has a local translation, rotation (unit quaternion) and
+ * scale, and a cached world matrix: parent world * T * R * S.
+ *
+ * Setters only flag the node. update() then recomputes the world matrices of
+ * the flagged nodes and of their descendants in one linear sweep, starting at
+ * the first flagged node, so a frame where few nodes move costs little more
+ * than one byte per node.
+ *
+ * If an allocation fails, assignments leave the hierarchy empty and addNode()
+ * returns -1.
+ */
+class TransformHierarchy {
+
+  public:
+    static const int NO_PARENT = -1;
+
+    // Constructors
+    TransformHierarchy();
+    TransformHierarchy(const TransformHierarchy& H);
+    ~TransformHierarchy();
+    // Operators
+    TransformHierarchy& operator=(const TransformHierarchy& H);
+    // Nodes
+    inline size_t size() const {
+      return count;
+    }
+    // Make room for size nodes. Returns false if the allocation failed.
+    bool reserve(size_t size);
+    // Append a node under parent (an existing node or NO_PARENT) and return
+    // its index, or -1 if parent is invalid or the allocation failed. Its
+    // world matrix is computed by the next update().
+    int addNode(int parent = NO_PARENT, const Vec3f& translation = Vec3f(),
+      const Quat& rotation = Quat::identity(), const Vec3f& scale = Vec3f(1.0f, 1.0f, 1.0f));
+    inline int getParent(int node) const {
+      return parents[node];
+    }
+    // Local transform
+    inline const Vec3f& getTranslation(int node) const {
+      return translations[node];
+    }
+    inline const Quat& getRotation(int node) const {
+      return rotations[node];
+    }
+    inline const Vec3f& getScale(int node) const {
+      return scales[node];
+    }
+    inline void setTranslation(int node, const Vec3f& translation) {
+      translations[node] = translation;
+      setDirty(node);
+    }
+    inline void setRotation(int node, const Quat& rotation) {
+      rotations[node] = rotation;
+      setDirty(node);
+    }
+    inline void setScale(int node, const Vec3f& scale) {
+      scales[node] = scale;
+      setDirty(node);
+    }
+    inline void setLocal(int node, const Vec3f& translation, const Quat& rotation, const Vec3f& scale) {
+      translations[node] = translation;
+      rotations[node] = rotation;
+      scales[node] = scale;
+      setDirty(node);
+    }
+    inline void translate(int node, const Vec3f& v) {
+      translations[node] += v;
+      setDirty(node);
+    }
+    // True if the node changed since the last update() (not its ancestors)
+    inline bool isDirty(int node) const {
+      return flags[node + 1] != 0;
+    }
+    // World matrices, as of the last update()
+    inline const Mat4f& getWorldMatrix(int node) const {
+      return worlds[node];
+    }
+    inline const Mat4f* getWorldMatrices() const {
+      return worlds;
+    }
+    // Local matrix T * R * S
+    Mat4f getLocalMatrix(int node) const;
+    // Recompute the world matrices of the changed nodes and their
+    // descendants. Returns the number of recomputed nodes.
+    size_t update();
+
+  private:
+    inline void setDirty(int node) {
+      flags[node + 1] = 1;
+      if ((size_t) node < firstDirty)
+        firstDirty = node;
+    }
+    bool grow(size_t size);
+
+    int* parents;
+    Vec3f* translations;
+    Quat* rotations;
+    Vec3f* scales;
+    Mat4f* worlds;
+    // flags[node + 1]: node changed, or one of its ancestors during update().
+    // flags[0] stands for NO_PARENT and stays 0.
+    unsigned char* flags;
+    size_t count;
+    size_t capacity;
+    // No flagged node before this index
+    size_t firstDirty;
+
+};
+
+}
+
+#endif // TRANSFORM_H
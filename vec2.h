@@ -4,6 +4,8 @@
 #include <cmath>
 #include <ostream>
 
+#include "config.h"
+
 namespace qm {
 
 template<typename T> class Vec2;
@@ -16,41 +18,36 @@ class Vec2 {
 
   public:
     // Constructors
-    inline Vec2() {
-      v[0] = v[1] = T();
-    }
-    inline Vec2(T v0, T v1) {
-      v[0] = v0;
-      v[1] = v1;
-    }
+    constexpr Vec2() : v{T(), T()} { }
+    constexpr Vec2(T v0, T v1) : v{v0, v1} { }
     // Operators
-    inline T& operator[] (int index) {
+    QM_CONSTEXPR14 T& operator[] (int index) {
         return v[index];
     }
-    inline const T& operator[] (int index) const {
+    constexpr const T& operator[] (int index) const {
         return v[index];
     }
-    inline Vec2& operator= (const Vec2& V) {
+    QM_CONSTEXPR14 Vec2& operator= (const Vec2& V) {
       v[0] = V[0];
       v[1] = V[1];
       return *this;
     }
-    inline Vec2& operator+= (const Vec2& V) {
+    QM_CONSTEXPR14 Vec2& operator+= (const Vec2& V) {
         v[0] += V[0];
         v[1] += V[1];
         return *this;
     }
-    inline Vec2& operator-= (const Vec2& V) {
+    QM_CONSTEXPR14 Vec2& operator-= (const Vec2& V) {
         v[0] -= V[0];
         v[1] -= V[1];
         return *this;
     }
-    inline Vec2& operator*= (T s) {
+    QM_CONSTEXPR14 Vec2& operator*= (T s) {
         v[0] *= s;
         v[1] *= s;
         return *this;
     }
-    inline Vec2& operator/= (T s) {
+    QM_CONSTEXPR14 Vec2& operator/= (T s) {
         v[0] /= s;
         v[1] /= s;
         return *this;
@@ -59,7 +56,7 @@ class Vec2 {
     inline T* getArray() const {
       return v;
     }
-    inline double squaredLength() const {
+    constexpr double squaredLength() const {
       return dotProduct(*this, *this);
     }
     inline double getLength() const {
@@ -76,7 +73,7 @@ class Vec2 {
       return length;
     }
     // Static methods
-    static inline T dotProduct(const Vec2& a, const Vec2& b) {
+    static constexpr T dotProduct(const Vec2& a, const Vec2& b) {
         return (a[0] * b[0] + a[1] * b[1]);
     }
     static inline T distance(const Vec2& a, const Vec2& b) {
@@ -88,39 +85,39 @@ class Vec2 {
 
 
   protected:
-    T v[3];
+    T v[2];
 
 };
 
-template<typename T> const Vec2<T> operator+(const Vec2<T>& a, const Vec2<T>& b) {
+template<typename T> constexpr const Vec2<T> operator+(const Vec2<T>& a, const Vec2<T>& b) {
     return Vec2<T>(a[0] + b[0], a[1] + b[1]);
 }
 
-template<typename T> const Vec2<T> operator-(const Vec2<T>& a, const Vec2<T>& b) {
+template<typename T> constexpr const Vec2<T> operator-(const Vec2<T>& a, const Vec2<T>& b) {
     return Vec2<T>(a[0] - b[0], a[1] - b[1]);
 }
 
-template<typename T> const Vec2<T> operator-(const Vec2<T>& v) {
+template<typename T> constexpr const Vec2<T> operator-(const Vec2<T>& v) {
     return Vec2<T>(-v[0], -v[1]);
 }
 
-template<typename T> const Vec2<T> operator*(const Vec2<T>& v, float scalar) {
+template<typename T> constexpr const Vec2<T> operator*(const Vec2<T>& v, float scalar) {
     return Vec2<T>(v[0] * scalar, v[1] * scalar);
 }
 
-template<typename T> const Vec2<T> operator*(float scalar, const Vec2<T>& v) {
+template<typename T> constexpr const Vec2<T> operator*(float scalar, const Vec2<T>& v) {
     return Vec2<T> (v[0] * scalar, v[1] * scalar);
 }
 
-template<typename T> const Vec2<T> operator/(const Vec2<T>& v, float scalar) {
+template<typename T> constexpr const Vec2<T> operator/(const Vec2<T>& v, float scalar) {
     return Vec2<T>(v[0] / scalar, v[1] / scalar);
 }
 
-template<typename T> bool operator!=(const Vec2<T>& a, const Vec2<T>& b) {
+template<typename T> constexpr bool operator!=(const Vec2<T>& a, const Vec2<T>& b) {
     return (a[0] != b[0] || a[1] != b[1]);
 }
 
-template<typename T> bool operator==(const Vec2<T>& a, const Vec2<T>& b) {
+template<typename T> constexpr bool operator==(const Vec2<T>& a, const Vec2<T>& b) {
     return (a[0] == b[0] && a[1] == b[1]);
 }
 
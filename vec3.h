@@ -4,6 +4,8 @@
 #include <cmath>
 #include <ostream>
 
+#include "config.h"
+
 namespace qm {
 
 template<typename T> class Vec3;
@@ -16,65 +18,53 @@ class Vec3 {
 
   public:
     // Constructors
-    inline Vec3() {
-      v[0] = v[1] = v[2] = T();
-    }
-    inline Vec3(T v0, T v1, T v2) {
-      init(v0, v1, v2);
-    }
-    inline void init(T v0, T v1, T v2) {
+    constexpr Vec3() : v{T(), T(), T()} { }
+    constexpr Vec3(T v0, T v1, T v2) : v{v0, v1, v2} { }
+    QM_CONSTEXPR14 void init(T v0, T v1, T v2) {
       v[0] = v0;
       v[1] = v1;
       v[2] = v2;
     }
-    inline Vec3(const Vec3& V) {
-      v[0] = V[0];
-      v[1] = V[1];
-      v[2] = V[2];
-    }
-    inline Vec3(Vec3& V) {
-      v[0] = V[0];
-      v[1] = V[1];
-      v[2] = V[2];
-    }
+    constexpr Vec3(const Vec3& V) : v{V[0], V[1], V[2]} { }
+    constexpr Vec3(Vec3& V) : v{V[0], V[1], V[2]} { }
     // Operators
-    inline T& operator[] (int index) {
+    QM_CONSTEXPR14 T& operator[] (int index) {
         return v[index];
     }
-    inline const T& operator[] (int index) const {
+    constexpr const T& operator[] (int index) const {
         return v[index];
     }
-    inline Vec3& operator= (const Vec3& V) {
+    QM_CONSTEXPR14 Vec3& operator= (const Vec3& V) {
       v[0] = V[0];
       v[1] = V[1];
       v[2] = V[2];
       return *this;
     }
-    inline Vec3& operator+= (const Vec3& V) {
+    QM_CONSTEXPR14 Vec3& operator+= (const Vec3& V) {
         v[0] += V[0];
         v[1] += V[1];
         v[2] += V[2];
         return *this;
     }
-    inline Vec3& operator-= (const Vec3& V) {
+    QM_CONSTEXPR14 Vec3& operator-= (const Vec3& V) {
         v[0] -= V[0];
         v[1] -= V[1];
         v[2] -= V[2];
         return *this;
     }
-    inline Vec3& operator*= (T s) {
+    QM_CONSTEXPR14 Vec3& operator*= (T s) {
         v[0] *= s;
         v[1] *= s;
         v[2] *= s;
         return *this;
     }
-    inline Vec3& operator*= (Vec3& V) {
+    QM_CONSTEXPR14 Vec3& operator*= (Vec3& V) {
         v[0] *= V[0];
         v[1] *= V[1];
         v[2] *= V[2];
         return *this;
     }
-    inline Vec3& operator/= (T s) {
+    QM_CONSTEXPR14 Vec3& operator/= (T s) {
         v[0] /= s;
         v[1] /= s;
         v[2] /= s;
@@ -84,7 +74,7 @@ class Vec3 {
     inline T* getArray() const {
       return v;
     }
-    inline T squaredLength() const {
+    constexpr T squaredLength() const {
       return dotProduct(*this, *this);
     }
     inline T getLength() const {
@@ -102,10 +92,10 @@ class Vec3 {
       return length;
     }
     // Static methods
-    static inline T dotProduct(const Vec3& a, const Vec3& b) {
+    static constexpr T dotProduct(const Vec3& a, const Vec3& b) {
         return (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
     }
-    static inline Vec3 crossProduct(const Vec3& a, const Vec3& b) {
+    static constexpr Vec3 crossProduct(const Vec3& a, const Vec3& b) {
         return Vec3(
           a[1] * b[2] - a[2] * b[1],
           a[2] * b[0] - a[0] * b[2],
@@ -125,51 +115,51 @@ class Vec3 {
 
 };
 
-template<typename T> const Vec3<T> operator+(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr const Vec3<T> operator+(const Vec3<T>& a, const Vec3<T>& b) {
     return Vec3<T>(a[0] + b[0], a[1] + b[1], a[2] + b[2]);
 }
 
-template<typename T> const Vec3<T> operator-(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr const Vec3<T> operator-(const Vec3<T>& a, const Vec3<T>& b) {
     return Vec3<T>(a[0] - b[0], a[1] - b[1], a[2] - b[2]);
 }
 
-template<typename T> const Vec3<T> operator-(const Vec3<T>& v) {
+template<typename T> constexpr const Vec3<T> operator-(const Vec3<T>& v) {
     return Vec3<T>(-v[0], -v[1], -v[2]);
 }
 
-template<typename T> const Vec3<T> operator*(const Vec3<T>& v, float scalar) {
+template<typename T> constexpr const Vec3<T> operator*(const Vec3<T>& v, float scalar) {
     return Vec3<T>(v[0] * scalar, v[1] * scalar, v[2] * scalar);
 }
 
-template<typename T> const Vec3<T> operator*(float scalar, const Vec3<T>& v) {
+template<typename T> constexpr const Vec3<T> operator*(float scalar, const Vec3<T>& v) {
     return Vec3<T> (v[0] * scalar, v[1] * scalar, v[2] * scalar);
 }
 
-template<typename T> const Vec3<T> operator/(const Vec3<T>& v, float scalar) {
+template<typename T> constexpr const Vec3<T> operator/(const Vec3<T>& v, float scalar) {
     return Vec3<T>(v[0] / scalar, v[1] / scalar, v[2] / scalar);
 }
 
-template<typename T> bool operator!=(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr bool operator!=(const Vec3<T>& a, const Vec3<T>& b) {
     return (a[0] != b[0] || a[1] != b[1] || a[2] != b[2]);
 }
 
-template<typename T> bool operator==(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr bool operator==(const Vec3<T>& a, const Vec3<T>& b) {
     return (a[0] == b[0] && a[1] == b[1] && a[2] == b[2]);
 }
 
-template<typename T> bool operator<(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr bool operator<(const Vec3<T>& a, const Vec3<T>& b) {
     return (a[0] < b[0] && a[1] < b[1] && a[2] < b[2]);
 }
 
-template<typename T> bool operator<=(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr bool operator<=(const Vec3<T>& a, const Vec3<T>& b) {
     return (a[0] <= b[0] && a[1] <= b[1] && a[2] <= b[2]);
 }
 
-template<typename T> bool operator>(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr bool operator>(const Vec3<T>& a, const Vec3<T>& b) {
     return (a[0] > b[0] && a[1] > b[1] && a[2] > b[2]);
 }
 
-template<typename T> bool operator>=(const Vec3<T>& a, const Vec3<T>& b) {
+template<typename T> constexpr bool operator>=(const Vec3<T>& a, const Vec3<T>& b) {
     return (a[0] >= b[0] && a[1] >= b[1] && a[2] >= b[2]);
 }
 
@@ -178,8 +168,29 @@ template<typename T> std::ostream& operator<<(std::ostream& output, const Vec3<T
     return output;
 }
 
+/**
+ * Vec3 padded to 4 elements and aligned on their size (16 bytes for float):
+ * arrays of them never split a vector across cache lines, and load one
+ * vector per SIMD register. The padding element is not part of the vector.
+ */
+template<typename T>
+class alignas(4 * sizeof(T)) Vec3A : public Vec3<T> {
+
+  public:
+    // Constructors
+    constexpr Vec3A() : Vec3<T>(), pad() { }
+    constexpr Vec3A(T v0, T v1, T v2) : Vec3<T>(v0, v1, v2), pad() { }
+    constexpr Vec3A(const Vec3<T>& V) : Vec3<T>(V), pad() { }
+
+  private:
+    T pad;
+
+};
 
 typedef Vec3<float> Vec3f;
+typedef Vec3<double> Vec3d;
+typedef Vec3A<float> Vec3fA;
+typedef Vec3A<double> Vec3dA;
 
 }
 
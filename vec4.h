@@ -3,6 +3,8 @@
 
 #include <ostream>
 
+#include "config.h"
+
 namespace qm {
 
 template<typename T> class Vec4;
@@ -15,54 +17,50 @@ class Vec4 {
 
   public:
     // Constructors
-    inline Vec4() {
-      v[0] = v[1] = v[2] = v[3] = T();
-    }
-    inline Vec4(T v0, T v1, T v2, T v3) {
-      init(v0, v1, v2, v3);
-    }
-    inline void init(T v0, T v1, T v2, T v3) {
+    constexpr Vec4() : v{T(), T(), T(), T()} { }
+    constexpr Vec4(T v0, T v1, T v2, T v3) : v{v0, v1, v2, v3} { }
+    QM_CONSTEXPR14 void init(T v0, T v1, T v2, T v3) {
       v[0] = v0;
       v[1] = v1;
       v[2] = v2;
       v[3] = v3;
     }
     // Operators
-    inline T& operator[](int index) {
+    QM_CONSTEXPR14 T& operator[](int index) {
         return v[index];
     }
-    inline const T& operator[](int index) const {
+    constexpr const T& operator[](int index) const {
         return v[index];
     }
-    inline Vec4& operator=(const Vec4& V) {
+    QM_CONSTEXPR14 Vec4& operator=(const Vec4& V) {
       v[0] = V[0];
       v[1] = V[1];
       v[2] = V[2];
       v[3] = V[3];
       return *this;
     }
-    inline Vec4& operator+=(const Vec4& V) {
+    QM_CONSTEXPR14 Vec4& operator+=(const Vec4& V) {
         v[0] += V[0];
         v[1] += V[1];
         v[2] += V[2];
         v[3] += V[3];
         return *this;
     }
-    inline Vec4& operator-=(const Vec4& V) {
+    QM_CONSTEXPR14 Vec4& operator-=(const Vec4& V) {
         v[0] -= V[0];
         v[1] -= V[1];
         v[2] -= V[2];
         v[3] -= V[3];
         return *this;
     }
-    inline Vec4& operator*=(T s) {
+    QM_CONSTEXPR14 Vec4& operator*=(T s) {
         v[0] *= s;
         v[1] *= s;
         v[2] *= s;
         v[3] *= s;
         return *this;
     }
-    inline Vec4& operator/=(T s) {
+    QM_CONSTEXPR14 Vec4& operator/=(T s) {
         v[0] /= s;
         v[1] /= s;
         v[2] /= s;
@@ -79,7 +77,31 @@ class Vec4 {
 
 };
 
-template<typename T> const Vec4<T> operator-(const Vec4<T>& v) {
+template<typename T> constexpr const Vec4<T> operator+(const Vec4<T>& a, const Vec4<T>& b) {
+    return Vec4<T>(a[0] + b[0], a[1] + b[1], a[2] + b[2], a[3] + b[3]);
+}
+
+template<typename T> constexpr const Vec4<T> operator-(const Vec4<T>& a, const Vec4<T>& b) {
+    return Vec4<T>(a[0] - b[0], a[1] - b[1], a[2] - b[2], a[3] - b[3]);
+}
+
+template<typename T> constexpr const Vec4<T> operator*(const Vec4<T>& v, float scalar) {
+    return Vec4<T>(v[0] * scalar, v[1] * scalar, v[2] * scalar, v[3] * scalar);
+}
+
+template<typename T> constexpr const Vec4<T> operator*(float scalar, const Vec4<T>& v) {
+    return Vec4<T>(v[0] * scalar, v[1] * scalar, v[2] * scalar, v[3] * scalar);
+}
+
+template<typename T> constexpr bool operator!=(const Vec4<T>& a, const Vec4<T>& b) {
+    return (a[0] != b[0] || a[1] != b[1] || a[2] != b[2] || a[3] != b[3]);
+}
+
+template<typename T> constexpr bool operator==(const Vec4<T>& a, const Vec4<T>& b) {
+    return (a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3]);
+}
+
+template<typename T> constexpr const Vec4<T> operator-(const Vec4<T>& v) {
     return Vec4<T>(-v[0], -v[1], -v[2], -v[3]);
 }
 
@@ -88,11 +110,12 @@ template<typename T> std::ostream& operator<<(std::ostream& output, const Vec4<T
     return output;
 }
 
-template<typename T> const Vec4<T> operator/(const Vec4<T>& v, float scalar) {
+template<typename T> constexpr const Vec4<T> operator/(const Vec4<T>& v, float scalar) {
     return Vec4<T>(v[0] / scalar, v[1] / scalar, v[2] / scalar, v[3] / scalar);
 }
 
 typedef Vec4<float> Vec4f;
+typedef Vec4<double> Vec4d;
 
 }
 
@@ -0,0 +1,150 @@
+#include <limits>
+
+#include "vecsoa.h"
+#include "simd.h"
+
+using namespace qm;
+
+namespace {
+
+#define QM_SIMD_KERNELS "vecsoa_kernels.inl"
+#include "simd_foreach.h"
+
+/**
+ * Lane kernels compiled for one instruction set.
+ */
+template<typename T> struct SoAKernels {
+  void (*add)(const T*, const T*, T*, size_t);
+  void (*sub)(const T*, const T*, T*, size_t);
+  void (*mul)(const T*, T, T*, size_t);
+  void (*div)(const T*, T, T*, size_t);
+  void (*dot3)(const T*, const T*, T*, size_t, size_t);
+  void (*dot4)(const T*, const T*, T*, size_t, size_t);
+  void (*cross3)(const T*, const T*, T*, size_t, size_t);
+  void (*squaredDistance3)(const T*, const T*, T*, size_t, size_t);
+  void (*normalize3)(T*, T*, size_t, size_t, bool);
+  void (*normalize4)(T*, T*, size_t, size_t, bool);
+  void (*normalizePacked3)(T*, T*, size_t, bool);
+  void (*normalizePacked4)(T*, T*, size_t, bool);
+  void (*aosToSoa3)(const T*, T*, size_t, size_t);
+  void (*soaToAos3)(const T*, T*, size_t, size_t);
+  void (*aosToSoa4)(const T*, T*, size_t, size_t);
+  void (*soaToAos4)(const T*, T*, size_t, size_t);
+};
+
+#define QM_SOA_KERNELS(ns, T) { \
+    ns::addLanes<T>, ns::subLanes<T>, ns::mulLanes<T>, ns::divLanes<T>, \
+    ns::dot3<T>, ns::dot4<T>, ns::cross3<T>, ns::squaredDistance3<T>, \
+    ns::normalize3<T>, ns::normalize4<T>, ns::normalizePacked3<T>, ns::normalizePacked4<T>, \
+    ns::aosToSoa3<T>, ns::soaToAos3<T>, ns::aosToSoa4<T>, ns::soaToAos4<T> }
+
+template<typename T> const SoAKernels<T>& kernels() {
+  static const SoAKernels<T> table[SIMD_ISA_COUNT] = {
+    QM_SOA_KERNELS(scalar, T),
+#if QM_SIMD_X86
+    QM_SOA_KERNELS(sse2, T),
+    QM_SOA_KERNELS(avx, T),
+    QM_SOA_KERNELS(avx2, T)
+#endif
+  };
+  return table[simdIsa()];
+}
+
+#undef QM_SOA_KERNELS
+
+}
+
+namespace qm {
+
+namespace detail {
+
+template<typename T> void soaAdd(const T* a, const T* b, T* r, size_t n) {
+  kernels<T>().add(a, b, r, n);
+}
+
+template<typename T> void soaSub(const T* a, const T* b, T* r, size_t n) {
+  kernels<T>().sub(a, b, r, n);
+}
+
+template<typename T> void soaMul(const T* a, T s, T* r, size_t n) {
+  kernels<T>().mul(a, s, r, n);
+}
+
+template<typename T> void soaDiv(const T* a, T s, T* r, size_t n) {
+  kernels<T>().div(a, s, r, n);
+}
+
+template<typename T> void soaDot3(const T* a, const T* b, T* r, size_t stride, size_t count) {
+  kernels<T>().dot3(a, b, r, stride, count);
+}
+
+template<typename T> void soaDot4(const T* a, const T* b, T* r, size_t stride, size_t count) {
+  kernels<T>().dot4(a, b, r, stride, count);
+}
+
+template<typename T> void soaCross3(const T* a, const T* b, T* r, size_t stride, size_t n) {
+  kernels<T>().cross3(a, b, r, stride, n);
+}
+
+template<typename T> void soaSquaredDistance3(const T* a, const T* b, T* r, size_t stride, size_t count) {
+  kernels<T>().squaredDistance3(a, b, r, stride, count);
+}
+
+template<typename T> void soaNormalize3(T* v, T* lengths, size_t stride, size_t count, Precision precision) {
+  kernels<T>().normalize3(v, lengths, stride, count, precision == PRECISION_FAST);
+}
+
+template<typename T> void soaNormalize4(T* v, T* lengths, size_t stride, size_t count, Precision precision) {
+  kernels<T>().normalize4(v, lengths, stride, count, precision == PRECISION_FAST);
+}
+
+template<typename T> void normalizePacked3(T* v, T* lengths, size_t count, Precision precision) {
+  kernels<T>().normalizePacked3(v, lengths, count, precision == PRECISION_FAST);
+}
+
+template<typename T> void normalizePacked4(T* v, T* lengths, size_t count, Precision precision) {
+  kernels<T>().normalizePacked4(v, lengths, count, precision == PRECISION_FAST);
+}
+
+template<typename T> void aosToSoa3(const T* aos, T* soa, size_t stride, size_t count) {
+  kernels<T>().aosToSoa3(aos, soa, stride, count);
+}
+
+template<typename T> void soaToAos3(const T* soa, T* aos, size_t stride, size_t count) {
+  kernels<T>().soaToAos3(soa, aos, stride, count);
+}
+
+template<typename T> void aosToSoa4(const T* aos, T* soa, size_t stride, size_t count) {
+  kernels<T>().aosToSoa4(aos, soa, stride, count);
+}
+
+template<typename T> void soaToAos4(const T* soa, T* aos, size_t stride, size_t count) {
+  kernels<T>().soaToAos4(soa, aos, stride, count);
+}
+
+#define QM_SOA_INSTANTIATE(T) \
+  template void soaAdd<T>(const T*, const T*, T*, size_t); \
+  template void soaSub<T>(const T*, const T*, T*, size_t); \
+  template void soaMul<T>(const T*, T, T*, size_t); \
+  template void soaDiv<T>(const T*, T, T*, size_t); \
+  template void soaDot3<T>(const T*, const T*, T*, size_t, size_t); \
+  template void soaDot4<T>(const T*, const T*, T*, size_t, size_t); \
+  template void soaCross3<T>(const T*, const T*, T*, size_t, size_t); \
+  template void soaSquaredDistance3<T>(const T*, const T*, T*, size_t, size_t); \
+  template void soaNormalize3<T>(T*, T*, size_t, size_t, Precision); \
+  template void soaNormalize4<T>(T*, T*, size_t, size_t, Precision); \
+  template void normalizePacked3<T>(T*, T*, size_t, Precision); \
+  template void normalizePacked4<T>(T*, T*, size_t, Precision); \
+  template void aosToSoa3<T>(const T*, T*, size_t, size_t); \
+  template void soaToAos3<T>(const T*, T*, size_t, size_t); \
+  template void aosToSoa4<T>(const T*, T*, size_t, size_t); \
+  template void soaToAos4<T>(const T*, T*, size_t, size_t);
+
+QM_SOA_INSTANTIATE(float)
+QM_SOA_INSTANTIATE(double)
+
+#undef QM_SOA_INSTANTIATE
+
+}
+
+}
@@ -0,0 +1,401 @@
+#ifndef VECSOA_H
+#define VECSOA_H
+
+#include <cassert>
+#include <cstring>
+
+#include "memory.h"
+#include "vec3.h"
+#include "vec4.h"
+#include "quat.h"
+
+namespace qm {
+
+namespace detail {
+
+// Lane kernels of vecsoa.cpp (float and double), dispatched on simdIsa().
+// n counts padded lane elements, count the vectors actually stored.
+template<typename T> void soaAdd(const T* a, const T* b, T* r, size_t n);
+template<typename T> void soaSub(const T* a, const T* b, T* r, size_t n);
+template<typename T> void soaMul(const T* a, T s, T* r, size_t n);
+template<typename T> void soaDiv(const T* a, T s, T* r, size_t n);
+template<typename T> void soaDot3(const T* a, const T* b, T* r, size_t stride, size_t count);
+template<typename T> void soaDot4(const T* a, const T* b, T* r, size_t stride, size_t count);
+template<typename T> void soaCross3(const T* a, const T* b, T* r, size_t stride, size_t n);
+template<typename T> void soaSquaredDistance3(const T* a, const T* b, T* r, size_t stride, size_t count);
+template<typename T> void soaNormalize3(T* v, T* lengths, size_t stride, size_t count, Precision precision);
+template<typename T> void soaNormalize4(T* v, T* lengths, size_t stride, size_t count, Precision precision);
+template<typename T> void normalizePacked3(T* v, T* lengths, size_t count, Precision precision);
+template<typename T> void normalizePacked4(T* v, T* lengths, size_t count, Precision precision);
+template<typename T> void aosToSoa3(const T* aos, T* soa, size_t stride, size_t count);
+template<typename T> void soaToAos3(const T* soa, T* aos, size_t stride, size_t count);
+template<typename T> void aosToSoa4(const T* aos, T* soa, size_t stride, size_t count);
+template<typename T> void soaToAos4(const T* soa, T* aos, size_t stride, size_t count);
+
+}
+
+/**
+ * Base class for structure-of-arrays storage: N lanes of T in one block.
+ * Each lane is 64-byte aligned and padded to a multiple of 64 bytes, so the
+ * SIMD kernels never need a scalar tail. Padding elements start at zero.
+ * If an allocation fails, assignments leave the array empty and resize()
+ * keeps the previous block.
+ */
+template<typename T, int N> class SoABase {
+
+  public:
+    // Constructors
+    inline SoABase() : data(0), count(0), stride(0) { }
+    inline explicit SoABase(size_t size) : data(0), count(0), stride(0) {
+      resize(size);
+    }
+    inline SoABase(const SoABase& S) : data(0), count(0), stride(0) {
+      *this = S;
+    }
+    inline ~SoABase() {
+      alignedFree(data);
+    }
+    // Operators
+    inline SoABase& operator=(const SoABase& S) {
+      if (this == &S)
+        return *this;
+      if (stride != S.stride) {
+        alignedFree(data);
+        data = (T*) alignedMalloc(N * S.stride * sizeof(T));
+        stride = data ? S.stride : 0;
+      }
+      count = data ? S.count : 0;
+      if (data)
+        memcpy(data, S.data, N * stride * sizeof(T));
+      return *this;
+    }
+    // Others
+    inline size_t size() const {
+      return count;
+    }
+    // Distance between two lanes, in elements
+    inline size_t getStride() const {
+      return stride;
+    }
+    inline T* lane(int index) {
+      return data + index * stride;
+    }
+    inline const T* lane(int index) const {
+      return data + index * stride;
+    }
+    inline T* getArray() {
+      return data;
+    }
+    inline const T* getArray() const {
+      return data;
+    }
+    // Resize, keeping the first min(size, size()) elements. Returns false
+    // (and keeps the array as it was) if the allocation failed.
+    bool resize(size_t size) {
+      size_t newStride = paddedCount<T>(size);
+      if (newStride != stride) {
+        T* newData = (newStride > 0) ? (T*) alignedMalloc(N * newStride * sizeof(T)) : 0;
+        if (newStride > 0 && !newData)
+          return false;
+        if (newData) {
+          memset(newData, 0, N * newStride * sizeof(T));
+          size_t kept = (size < count) ? size : count;
+          for (int k = 0 ; k < N && kept > 0 ; k++)
+            memcpy(newData + k * newStride, data + k * stride, kept * sizeof(T));
+        }
+        alignedFree(data);
+        data = newData;
+        stride = newStride;
+      } else {
+        // Same block: clear the dropped elements so that padding stays zero
+        for (int k = 0 ; k < N && size < count ; k++)
+          memset(lane(k) + size, 0, (count - size) * sizeof(T));
+      }
+      count = size;
+      return true;
+    }
+
+  protected:
+    T* data;
+    size_t count;
+    size_t stride;
+
+};
+
+/**
+ * Structure-of-arrays of Vec3, with the same operations as the static Vec3
+ * API applied to every element. Binary operations require equal sizes
+ * (asserted).
+ * Results match Vec3, except that AVX2 targets may contract a*b+c into FMAs.
+ */
+template<typename T> class Vec3SoA : public SoABase<T, 3> {
+
+  public:
+    // Constructors
+    inline Vec3SoA() : SoABase<T, 3>() { }
+    inline explicit Vec3SoA(size_t size) : SoABase<T, 3>(size) { }
+    inline Vec3SoA(const Vec3<T>* V, size_t size) : SoABase<T, 3>(size) {
+      detail::aosToSoa3(reinterpret_cast<const T*>(V), this->data, this->stride, this->count);
+    }
+    // Lanes
+    inline T* x() { return this->lane(0); }
+    inline T* y() { return this->lane(1); }
+    inline T* z() { return this->lane(2); }
+    inline const T* x() const { return this->lane(0); }
+    inline const T* y() const { return this->lane(1); }
+    inline const T* z() const { return this->lane(2); }
+    // Elements
+    inline Vec3<T> get(size_t i) const {
+      return Vec3<T>(x()[i], y()[i], z()[i]);
+    }
+    inline void set(size_t i, const Vec3<T>& V) {
+      x()[i] = V[0];
+      y()[i] = V[1];
+      z()[i] = V[2];
+    }
+    // AoS <-> SoA
+    inline void toAoS(Vec3<T>* V) const {
+      detail::soaToAos3(this->data, reinterpret_cast<T*>(V), this->stride, this->count);
+    }
+    // Operators
+    inline Vec3SoA& operator+=(const Vec3SoA& V) {
+      assert(V.count == this->count);
+      detail::soaAdd(this->data, V.data, this->data, 3 * this->stride);
+      return *this;
+    }
+    inline Vec3SoA& operator-=(const Vec3SoA& V) {
+      assert(V.count == this->count);
+      detail::soaSub(this->data, V.data, this->data, 3 * this->stride);
+      return *this;
+    }
+    inline Vec3SoA& operator*=(T s) {
+      detail::soaMul(this->data, s, this->data, 3 * this->stride);
+      return *this;
+    }
+    inline Vec3SoA& operator/=(T s) {
+      detail::soaDiv(this->data, s, this->data, 3 * this->stride);
+      return *this;
+    }
+    // Normalize every vector, storing the previous lengths if lengths is not 0
+    // (see Precision in config.h)
+    inline void normalize(T* lengths = 0, Precision precision = QM_DEFAULT_PRECISION) {
+      detail::soaNormalize3(this->data, lengths, this->stride, this->count, precision);
+    }
+    // Static methods (r receives a.size() elements)
+    static inline void dotProduct(const Vec3SoA& a, const Vec3SoA& b, T* r) {
+      assert(a.count == b.count);
+      detail::soaDot3(a.data, b.data, r, a.stride, a.count);
+    }
+    static inline Vec3SoA crossProduct(const Vec3SoA& a, const Vec3SoA& b) {
+      assert(a.count == b.count);
+      Vec3SoA result(a.count);
+      if (result.count == a.count)
+        detail::soaCross3(a.data, b.data, result.data, a.stride, a.stride);
+      return result;
+    }
+    static inline void squaredDistance(const Vec3SoA& a, const Vec3SoA& b, T* r) {
+      assert(a.count == b.count);
+      detail::soaSquaredDistance3(a.data, b.data, r, a.stride, a.count);
+    }
+
+};
+
+template<typename T> const Vec3SoA<T> operator+(const Vec3SoA<T>& a, const Vec3SoA<T>& b) {
+  Vec3SoA<T> result(a);
+  result += b;
+  return result;
+}
+
+template<typename T> const Vec3SoA<T> operator-(const Vec3SoA<T>& a, const Vec3SoA<T>& b) {
+  Vec3SoA<T> result(a);
+  result -= b;
+  return result;
+}
+
+template<typename T> const Vec3SoA<T> operator*(const Vec3SoA<T>& v, T scalar) {
+  Vec3SoA<T> result(v);
+  result *= scalar;
+  return result;
+}
+
+template<typename T> const Vec3SoA<T> operator*(T scalar, const Vec3SoA<T>& v) {
+  return v * scalar;
+}
+
+template<typename T> const Vec3SoA<T> operator/(const Vec3SoA<T>& v, T scalar) {
+  Vec3SoA<T> result(v);
+  result /= scalar;
+  return result;
+}
+
+/**
+ * Structure-of-arrays of Vec4.
+ */
+template<typename T> class Vec4SoA : public SoABase<T, 4> {
+
+  public:
+    // Constructors
+    inline Vec4SoA() : SoABase<T, 4>() { }
+    inline explicit Vec4SoA(size_t size) : SoABase<T, 4>(size) { }
+    inline Vec4SoA(const Vec4<T>* V, size_t size) : SoABase<T, 4>(size) {
+      detail::aosToSoa4(reinterpret_cast<const T*>(V), this->data, this->stride, this->count);
+    }
+    // Lanes
+    inline T* x() { return this->lane(0); }
+    inline T* y() { return this->lane(1); }
+    inline T* z() { return this->lane(2); }
+    inline T* w() { return this->lane(3); }
+    inline const T* x() const { return this->lane(0); }
+    inline const T* y() const { return this->lane(1); }
+    inline const T* z() const { return this->lane(2); }
+    inline const T* w() const { return this->lane(3); }
+    // Elements
+    inline Vec4<T> get(size_t i) const {
+      return Vec4<T>(x()[i], y()[i], z()[i], w()[i]);
+    }
+    inline void set(size_t i, const Vec4<T>& V) {
+      x()[i] = V[0];
+      y()[i] = V[1];
+      z()[i] = V[2];
+      w()[i] = V[3];
+    }
+    // AoS <-> SoA
+    inline void toAoS(Vec4<T>* V) const {
+      detail::soaToAos4(this->data, reinterpret_cast<T*>(V), this->stride, this->count);
+    }
+    // Operators
+    inline Vec4SoA& operator+=(const Vec4SoA& V) {
+      assert(V.count == this->count);
+      detail::soaAdd(this->data, V.data, this->data, 4 * this->stride);
+      return *this;
+    }
+    inline Vec4SoA& operator-=(const Vec4SoA& V) {
+      assert(V.count == this->count);
+      detail::soaSub(this->data, V.data, this->data, 4 * this->stride);
+      return *this;
+    }
+    inline Vec4SoA& operator*=(T s) {
+      detail::soaMul(this->data, s, this->data, 4 * this->stride);
+      return *this;
+    }
+    inline Vec4SoA& operator/=(T s) {
+      detail::soaDiv(this->data, s, this->data, 4 * this->stride);
+      return *this;
+    }
+    inline void normalize(T* lengths = 0, Precision precision = QM_DEFAULT_PRECISION) {
+      detail::soaNormalize4(this->data, lengths, this->stride, this->count, precision);
+    }
+    // Static methods
+    static inline void dotProduct(const Vec4SoA& a, const Vec4SoA& b, T* r) {
+      assert(a.count == b.count);
+      detail::soaDot4(a.data, b.data, r, a.stride, a.count);
+    }
+
+};
+
+template<typename T> const Vec4SoA<T> operator+(const Vec4SoA<T>& a, const Vec4SoA<T>& b) {
+  Vec4SoA<T> result(a);
+  result += b;
+  return result;
+}
+
+template<typename T> const Vec4SoA<T> operator-(const Vec4SoA<T>& a, const Vec4SoA<T>& b) {
+  Vec4SoA<T> result(a);
+  result -= b;
+  return result;
+}
+
+template<typename T> const Vec4SoA<T> operator*(const Vec4SoA<T>& v, T scalar) {
+  Vec4SoA<T> result(v);
+  result *= scalar;
+  return result;
+}
+
+template<typename T> const Vec4SoA<T> operator*(T scalar, const Vec4SoA<T>& v) {
+  return v * scalar;
+}
+
+template<typename T> const Vec4SoA<T> operator/(const Vec4SoA<T>& v, T scalar) {
+  Vec4SoA<T> result(v);
+  result /= scalar;
+  return result;
+}
+
+/**
+ * Structure-of-arrays of quaternions, lanes in Quat order (w, x, y, z).
+ */
+class QuatSoA : public SoABase<float, 4> {
+
+  public:
+    // Constructors
+    inline QuatSoA() : SoABase<float, 4>() { }
+    inline explicit QuatSoA(size_t size) : SoABase<float, 4>(size) { }
+    inline QuatSoA(const Quat* Q, size_t size) : SoABase<float, 4>(size) {
+      detail::aosToSoa4(reinterpret_cast<const float*>(Q), data, stride, count);
+    }
+    // Lanes
+    inline float* w() { return lane(0); }
+    inline float* x() { return lane(1); }
+    inline float* y() { return lane(2); }
+    inline float* z() { return lane(3); }
+    inline const float* w() const { return lane(0); }
+    inline const float* x() const { return lane(1); }
+    inline const float* y() const { return lane(2); }
+    inline const float* z() const { return lane(3); }
+    // Elements
+    inline Quat get(size_t i) const {
+      Quat result;
+      result[0] = w()[i];
+      result[1] = x()[i];
+      result[2] = y()[i];
+      result[3] = z()[i];
+      return result;
+    }
+    inline void set(size_t i, const Quat& Q) {
+      w()[i] = Q[0];
+      x()[i] = Q[1];
+      y()[i] = Q[2];
+      z()[i] = Q[3];
+    }
+    // AoS <-> SoA
+    inline void toAoS(Quat* Q) const {
+      detail::soaToAos4(data, reinterpret_cast<float*>(Q), stride, count);
+    }
+    // Unlike Quat::normalize, always divides by the norm
+    inline void normalize(Precision precision = QM_DEFAULT_PRECISION) {
+      detail::soaNormalize4(data, (float*) 0, stride, count, precision);
+    }
+    // Static methods
+    static inline void dotProduct(const QuatSoA& a, const QuatSoA& b, float* r) {
+      assert(a.count == b.count);
+      detail::soaDot4(a.data, b.data, r, a.stride, a.count);
+    }
+
+};
+
+/**
+ * Normalize count packed vectors or quaternions in place, W at a time (see
+ * simd.h), storing the previous lengths if lengths is not 0. Zero-length
+ * vectors are left untouched; quaternions are always divided by their norm,
+ * unlike Quat::normalize. See Precision in config.h for the fast path.
+ */
+template<typename T> inline void normalizeMany(Vec3<T>* v, size_t count, T* lengths = 0,
+  Precision precision = QM_DEFAULT_PRECISION) {
+  detail::normalizePacked3(reinterpret_cast<T*>(v), lengths, count, precision);
+}
+
+template<typename T> inline void normalizeMany(Vec4<T>* v, size_t count, T* lengths = 0,
+  Precision precision = QM_DEFAULT_PRECISION) {
+  detail::normalizePacked4(reinterpret_cast<T*>(v), lengths, count, precision);
+}
+
+inline void normalizeMany(Quat* Q, size_t count, float* lengths = 0, Precision precision = QM_DEFAULT_PRECISION) {
+  detail::normalizePacked4(reinterpret_cast<float*>(Q), lengths, count, precision);
+}
+
+typedef Vec3SoA<float> Vec3fSoA;
+typedef Vec4SoA<float> Vec4fSoA;
+
+}
+
+#endif // VECSOA_H
@@ -0,0 +1,230 @@
+// Lane kernels of vecsoa.cpp, expanded once per instruction set by
+// simd_foreach.h. SoA lanes are padded to a multiple of 64 bytes, so every n
+// below is a multiple of Pack<T>::W and lanes can be read and written a whole
+// pack at a time. Outputs to caller arrays (count elements) store the last
+// partial pack through storePartial. Vector components live stride elements
+// apart.
+
+template<typename T> inline void storePartial(T* p, typename Pack<T>::V v, size_t count) {
+  if (count >= (size_t) Pack<T>::W) {
+    Pack<T>::store(p, v);
+    return;
+  }
+  T buffer[Pack<T>::W];
+  Pack<T>::store(buffer, v);
+  for (size_t k = 0 ; k < count ; k++)
+    p[k] = buffer[k];
+}
+
+template<typename T> void addLanes(const T* a, const T* b, T* r, size_t n) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < n ; i += P::W)
+    P::store(r + i, P::load(a + i) + P::load(b + i));
+}
+
+template<typename T> void subLanes(const T* a, const T* b, T* r, size_t n) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < n ; i += P::W)
+    P::store(r + i, P::load(a + i) - P::load(b + i));
+}
+
+template<typename T> void mulLanes(const T* a, T s, T* r, size_t n) {
+  typedef Pack<T> P;
+  typename P::V scalar = P::set1(s);
+  for (size_t i = 0 ; i < n ; i += P::W)
+    P::store(r + i, P::load(a + i) * scalar);
+}
+
+template<typename T> void divLanes(const T* a, T s, T* r, size_t n) {
+  typedef Pack<T> P;
+  typename P::V scalar = P::set1(s);
+  for (size_t i = 0 ; i < n ; i += P::W)
+    P::store(r + i, P::load(a + i) / scalar);
+}
+
+template<typename T> void dot3(const T* a, const T* b, T* r, size_t stride, size_t count) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < count ; i += P::W) {
+    typename P::V x = P::load(a + i) * P::load(b + i);
+    typename P::V y = P::load(a + stride + i) * P::load(b + stride + i);
+    typename P::V z = P::load(a + 2*stride + i) * P::load(b + 2*stride + i);
+    storePartial(r + i, x + y + z, count - i);
+  }
+}
+
+template<typename T> void dot4(const T* a, const T* b, T* r, size_t stride, size_t count) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < count ; i += P::W) {
+    typename P::V x = P::load(a + i) * P::load(b + i);
+    typename P::V y = P::load(a + stride + i) * P::load(b + stride + i);
+    typename P::V z = P::load(a + 2*stride + i) * P::load(b + 2*stride + i);
+    typename P::V w = P::load(a + 3*stride + i) * P::load(b + 3*stride + i);
+    storePartial(r + i, x + y + z + w, count - i);
+  }
+}
+
+template<typename T> void cross3(const T* a, const T* b, T* r, size_t stride, size_t n) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < n ; i += P::W) {
+    typename P::V ax = P::load(a + i), ay = P::load(a + stride + i), az = P::load(a + 2*stride + i);
+    typename P::V bx = P::load(b + i), by = P::load(b + stride + i), bz = P::load(b + 2*stride + i);
+    P::store(r + i, ay * bz - az * by);
+    P::store(r + stride + i, az * bx - ax * bz);
+    P::store(r + 2*stride + i, ax * by - ay * bx);
+  }
+}
+
+template<typename T> void squaredDistance3(const T* a, const T* b, T* r, size_t stride, size_t count) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < count ; i += P::W) {
+    typename P::V x = P::load(a + i) - P::load(b + i);
+    typename P::V y = P::load(a + stride + i) - P::load(b + stride + i);
+    typename P::V z = P::load(a + 2*stride + i) - P::load(b + 2*stride + i);
+    storePartial(r + i, x*x + y*y + z*z, count - i);
+  }
+}
+
+// Normalize the dim components c of a pack and set their lengths.
+// Zero-length vectors are left untouched, as in Vec3::normalize. The fast path
+// (float SIMD only) refines the rsqrt estimate y of s = |c|^2 with one Newton
+// step, y * (1.5 - 0.5 * s * y^2), and leaves vectors with s below the
+// smallest normal float (|c| < 1.1e-19) untouched, with length 0.
+template<typename T> inline void normalizePack(typename Pack<T>::V* c, int dim, bool fast,
+  typename Pack<T>::V& length) {
+  typedef Pack<T> P;
+  const typename P::V zero = P::set1(T(0));
+  const typename P::V one = P::set1(T(1));
+  typename P::V sum = c[0] * c[0];
+  for (int k = 1 ; k < dim ; k++)
+    sum = sum + c[k] * c[k];
+  typename P::M isZero;
+  typename P::V lengthInv;
+  if (fast && P::W > 1 && sizeof(T) == sizeof(float)) {
+    isZero = P::lt(sum, P::set1(std::numeric_limits<T>::min()));
+    typename P::V y = P::rsqrt(sum);
+    lengthInv = y * (P::set1(T(1.5)) - P::set1(T(0.5)) * sum * y * y);
+    length = P::select(isZero, zero, sum * lengthInv);
+  } else {
+    length = P::sqrt(sum);
+    isZero = P::eq(length, zero);
+    lengthInv = one / length;
+  }
+  for (int k = 0 ; k < dim ; k++)
+    c[k] = P::select(isZero, c[k], c[k] * lengthInv);
+}
+
+template<typename T> void normalizeN(T* v, T* lengths, size_t stride, size_t count, int dim, bool fast) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < count ; i += P::W) {
+    typename P::V c[4], length;
+    for (int k = 0 ; k < dim ; k++)
+      c[k] = P::load(v + k*stride + i);
+    normalizePack<T>(c, dim, fast, length);
+    for (int k = 0 ; k < dim ; k++)
+      P::store(v + k*stride + i, c[k]);
+    if (lengths)
+      storePartial(lengths + i, length, count - i);
+  }
+}
+
+template<typename T> void normalize3(T* v, T* lengths, size_t stride, size_t count, bool fast) {
+  normalizeN(v, lengths, stride, count, 3, fast);
+}
+
+template<typename T> void normalize4(T* v, T* lengths, size_t stride, size_t count, bool fast) {
+  normalizeN(v, lengths, stride, count, 4, fast);
+}
+
+// count packed vectors of dim 3 or 4, transposed a pack at a time. The last
+// partial pack goes through a zeroed buffer.
+template<typename T> void normalizePacked(T* v, T* lengths, size_t count, int dim, bool fast) {
+  typedef Pack<T> P;
+  for (size_t i = 0 ; i < count ; i += P::W) {
+    size_t n = (count - i < (size_t) P::W) ? count - i : P::W;
+    T buffer[4 * P::W] = {};
+    T* p = v + dim*i;
+    if (n < (size_t) P::W) {
+      memcpy(buffer, p, dim * n * sizeof(T));
+      p = buffer;
+    }
+    typename P::V c[4], length;
+    if (dim == 3)
+      P::loadTransposed3(p, c[0], c[1], c[2]);
+    else
+      P::loadTransposed4(p, 4, c[0], c[1], c[2], c[3]);
+    normalizePack<T>(c, dim, fast, length);
+    if (dim == 3)
+      P::storeTransposed3(p, c[0], c[1], c[2]);
+    else
+      P::storeTransposed4(p, 4, c[0], c[1], c[2], c[3]);
+    if (p == buffer)
+      memcpy(v + dim*i, buffer, dim * n * sizeof(T));
+    if (lengths)
+      storePartial(lengths + i, length, n);
+  }
+}
+
+template<typename T> void normalizePacked3(T* v, T* lengths, size_t count, bool fast) {
+  normalizePacked(v, lengths, count, 3, fast);
+}
+
+template<typename T> void normalizePacked4(T* v, T* lengths, size_t count, bool fast) {
+  normalizePacked(v, lengths, count, 4, fast);
+}
+
+// count packed vectors: the last partial pack is done per element
+template<typename T> void aosToSoa3(const T* aos, T* soa, size_t stride, size_t count) {
+  typedef Pack<T> P;
+  size_t i = 0;
+  for ( ; i + P::W <= count ; i += P::W) {
+    typename P::V x, y, z;
+    P::loadTransposed3(aos + 3*i, x, y, z);
+    P::store(soa + i, x);
+    P::store(soa + stride + i, y);
+    P::store(soa + 2*stride + i, z);
+  }
+  for ( ; i < count ; i++) {
+    soa[i] = aos[3*i];
+    soa[stride + i] = aos[3*i + 1];
+    soa[2*stride + i] = aos[3*i + 2];
+  }
+}
+
+template<typename T> void soaToAos3(const T* soa, T* aos, size_t stride, size_t count) {
+  typedef Pack<T> P;
+  size_t i = 0;
+  for ( ; i + P::W <= count ; i += P::W)
+    P::storeTransposed3(aos + 3*i, P::load(soa + i), P::load(soa + stride + i), P::load(soa + 2*stride + i));
+  for ( ; i < count ; i++) {
+    aos[3*i] = soa[i];
+    aos[3*i + 1] = soa[stride + i];
+    aos[3*i + 2] = soa[2*stride + i];
+  }
+}
+
+template<typename T> void aosToSoa4(const T* aos, T* soa, size_t stride, size_t count) {
+  typedef Pack<T> P;
+  size_t i = 0;
+  for ( ; i + P::W <= count ; i += P::W) {
+    typename P::V x, y, z, w;
+    P::loadTransposed4(aos + 4*i, 4, x, y, z, w);
+    P::store(soa + i, x);
+    P::store(soa + stride + i, y);
+    P::store(soa + 2*stride + i, z);
+    P::store(soa + 3*stride + i, w);
+  }
+  for ( ; i < count ; i++)
+    for (int k = 0 ; k < 4 ; k++)
+      soa[k*stride + i] = aos[4*i + k];
+}
+
+template<typename T> void soaToAos4(const T* soa, T* aos, size_t stride, size_t count) {
+  typedef Pack<T> P;
+  size_t i = 0;
+  for ( ; i + P::W <= count ; i += P::W)
+    P::storeTransposed4(aos + 4*i, 4, P::load(soa + i), P::load(soa + stride + i),
+      P::load(soa + 2*stride + i), P::load(soa + 3*stride + i));
+  for ( ; i < count ; i++)
+    for (int k = 0 ; k < 4 ; k++)
+      aos[4*i + k] = soa[k*stride + i];
+}